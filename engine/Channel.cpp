@@ -388,10 +388,21 @@ static Mutex s_paramMutex(true,"ChannelParams");
 // Mutex used to protect channel data
 Mutex Channel::s_chanDataMutex(false,"ChannelData");
 
+// Mutex used to protect the timer wheels of all drivers, nothing is locked while holding it
+static Mutex s_timerMutex(false,"ChannelTimers");
+
+// Seconds covered by a driver timer wheel, later times wait in an extra list
+#define TIMER_SLOTS 64
+// Initial size of the channel index, it grows 4 times when it holds 4 channels per list
+#define INDEX_SIZE 61
+// A HashList never holds more lists, the channel index stops growing there
+#define INDEX_MAX 1024
+
 Channel::Channel(Driver* driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_chanParams(0), m_driver(driver), m_outgoing(outgoing),
-      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
+      m_timeout(0), m_maxcall(0), m_maxPDD(0),
+      m_timerWhen(0), m_timerSlot(-1), m_dtmfTime(0),
       m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
@@ -400,7 +411,8 @@ Channel::Channel(Driver* driver, const char* id, bool outgoing)
 Channel::Channel(Driver& driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_chanParams(0), m_driver(&driver), m_outgoing(outgoing),
-      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
+      m_timeout(0), m_maxcall(0), m_maxPDD(0),
+      m_timerWhen(0), m_timerSlot(-1), m_dtmfTime(0),
       m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
@@ -478,7 +490,7 @@ void Channel::initChan()
 	return;
     Lock mylock(m_driver);
 #ifndef NDEBUG
-    if (m_driver->channels().find(this)) {
+    if (m_driver->m_chanIndex && m_driver->m_chanIndex->find(this,id().hash())) {
 	Debug(DebugCrit,"Channel '%s' already in list of '%s' driver [%p]",
 	    id().c_str(),m_driver->name().c_str(),this);
 	return;
@@ -487,6 +499,7 @@ void Channel::initChan()
     m_driver->m_total++;
     m_driver->m_chanCount++;
     m_driver->channels().append(this);
+    m_driver->indexChan(this);
     m_driver->changed();
 }
 
@@ -502,6 +515,10 @@ void Channel::dropChan()
 	    m_driver->m_chanCount--;
 	m_driver->changed();
     }
+    // the channel may have been removed from list by the driver itself
+    if (m_driver->m_chanIndex)
+	m_driver->m_chanIndex->remove(this,false,true);
+    timerReset();
     m_driver->unlock();
 }
 
@@ -563,9 +580,15 @@ void Channel::dispatched(const Message& msg, bool handled)
 
 void Channel::setId(const char* newId)
 {
+    Lock lck(m_driver);
+    // the index is hashed by id, take the channel out while changing it
+    bool indexed = m_driver && m_driver->m_chanIndex &&
+	m_driver->m_chanIndex->remove(this,false,true);
     debugName(0);
     CallEndpoint::setId(newId);
     debugName(id());
+    if (indexed)
+	m_driver->m_chanIndex->append(this)->setDelete(false);
 }
 
 Message* Channel::getDisconnect(const char* reason)
@@ -870,6 +893,43 @@ void Channel::statusParams(String& str)
     }
 }
 
+// Request the driver to check the timers, keep the earliest request
+void Channel::timerCheck(u_int64_t when)
+{
+    if (!(when && m_driver))
+	return;
+    Lock lck(s_timerMutex);
+    Driver* drv = m_driver;
+    if (!drv || ((m_timerSlot >= 0) && (m_timerWhen <= when)))
+	return;
+    if (!drv->m_timerSlots) {
+	drv->m_timerSlots = new ObjList[TIMER_SLOTS + 1];
+	drv->m_timerSec = Time::now() / 1000000 - 1;
+    }
+    if (m_timerSlot >= 0)
+	drv->m_timerSlots[m_timerSlot].remove(this,false);
+    // check in the second after the time so it has surely passed
+    u_int64_t sec = when / 1000000 + 1;
+    if (sec <= drv->m_timerSec)
+	sec = drv->m_timerSec + 1;
+    m_timerWhen = when;
+    if (sec - drv->m_timerSec > TIMER_SLOTS)
+	m_timerSlot = TIMER_SLOTS;
+    else
+	m_timerSlot = (int)(sec % TIMER_SLOTS);
+    drv->m_timerSlots[m_timerSlot].append(this)->setDelete(false);
+}
+
+// Take the channel out of the driver's timer wheel
+void Channel::timerReset()
+{
+    Lock lck(s_timerMutex);
+    if (m_driver && (m_timerSlot >= 0))
+	m_driver->m_timerSlots[m_timerSlot].remove(this,false);
+    m_timerSlot = -1;
+    m_timerWhen = 0;
+}
+
 void Channel::checkTimers(Message& msg, const Time& tmr)
 {
     if (timeout() && (timeout() < tmr))
@@ -1379,6 +1439,7 @@ bool Module::filterDebug(const String& item) const
 Driver::Driver(const char* name, const char* type)
     : Module(name,type),
       m_init(false), m_varchan(true),
+      m_chanIndex(0), m_timerSlots(0), m_timerSec(0),
       m_routing(0), m_routed(0), m_total(0),
       m_nextid(0), m_timeout(0),
       m_maxroute(0), m_maxchans(0), m_chanCount(0),
@@ -1387,6 +1448,15 @@ Driver::Driver(const char* name, const char* type)
     m_prefix << name << "/";
 }
 
+Driver::~Driver()
+{
+    delete m_chanIndex;
+    s_timerMutex.lock();
+    delete[] m_timerSlots;
+    m_timerSlots = 0;
+    s_timerMutex.unlock();
+}
+
 void* Driver::getObject(const String& name) const
 {
     if (name == YATOM("Driver"))
@@ -1431,8 +1501,88 @@ bool Driver::isBusy() const
 
 Channel* Driver::find(const String& id) const
 {
-    const ObjList* pos = m_chans.find(id);
-    return pos ? static_cast<Channel*>(pos->get()) : 0;
+    return m_chanIndex ? static_cast<Channel*>((*m_chanIndex)[id]) : 0;
+}
+
+// Add a channel to the index, grow the index as needed
+// Must be called with the driver locked
+void Driver::indexChan(Channel* chan)
+{
+    if (!m_chanIndex)
+	m_chanIndex = new HashList(INDEX_SIZE);
+    else if ((m_chanIndex->length() < INDEX_MAX) &&
+	((unsigned int)m_chanCount > 4 * m_chanIndex->length())) {
+	HashList* idx = new HashList(4 * m_chanIndex->length() + 1);
+	for (unsigned int i = 0; i < m_chanIndex->length(); i++) {
+	    for (ObjList* l = m_chanIndex->getList(i); l; l = l->next())
+		if (l->get())
+		    idx->append(l->get())->setDelete(false);
+	}
+	delete m_chanIndex;
+	m_chanIndex = idx;
+	DDebug(this,DebugInfo,"Channel index grown to %u lists [%p]",idx->length(),this);
+    }
+    m_chanIndex->append(chan)->setDelete(false);
+}
+
+// Check the timers of channels having some due in the elapsed seconds
+void Driver::expireTimers(Message& msg)
+{
+    Time t;
+    u_int64_t sec = t.sec();
+    ObjList due;
+    ObjList* add = &due;
+    s_timerMutex.lock();
+    if (m_timerSlots && (sec / TIMER_SLOTS != m_timerSec / TIMER_SLOTS)) {
+	// once for each turn of the wheel move the times getting close into it
+	ObjList* l = &m_timerSlots[TIMER_SLOTS];
+	while (l) {
+	    Channel* c = static_cast<Channel*>(l->get());
+	    u_int64_t s = c ? c->m_timerWhen / 1000000 + 1 : 0;
+	    if (!c || (s > sec + TIMER_SLOTS)) {
+		l = l->next();
+		continue;
+	    }
+	    l->remove(false);
+	    // times already passed are checked below
+	    c->m_timerSlot = (int)(((s > sec) ? s : sec) % TIMER_SLOTS);
+	    m_timerSlots[c->m_timerSlot].append(c)->setDelete(false);
+	}
+    }
+    if (m_timerSlots) {
+	// seconds missed by a late timer are checked too, each slot only once
+	unsigned int n = (sec - m_timerSec > TIMER_SLOTS) ? TIMER_SLOTS : (unsigned int)(sec - m_timerSec);
+	for (u_int64_t s = sec - n + 1; s <= sec; s++) {
+	    ObjList* l = &m_timerSlots[s % TIMER_SLOTS];
+	    while (l) {
+		Channel* c = static_cast<Channel*>(l->get());
+		// later times in the same slot wait for the wheel to come around
+		if (!c || (c->m_timerWhen / 1000000 >= sec)) {
+		    l = l->next();
+		    continue;
+		}
+		l->remove(false);
+		c->m_timerSlot = -1;
+		c->m_timerWhen = 0;
+		// skip channels being destroyed
+		if (c->ref())
+		    add = add->append(c);
+	    }
+	}
+	m_timerSec = sec;
+    }
+    s_timerMutex.unlock();
+    for (ObjList* l = due.skipNull(); l; l = l->skipNext()) {
+	Channel* c = static_cast<Channel*>(l->get());
+	c->checkTimers(msg,t);
+	// keep waiting for the timers not expired yet
+	u_int64_t when = c->timeout();
+	if (c->maxcall() && (!when || (c->maxcall() < when)))
+	    when = c->maxcall();
+	if (c->maxPDD() && (!when || (c->maxPDD() < when)))
+	    when = c->maxPDD();
+	c->timerCheck(when);
+    }
 }
 
 bool Driver::received(Message &msg, int id)
@@ -1446,18 +1596,9 @@ bool Driver::received(Message &msg, int id)
 	    if (m_doExpire && lock(950000)) {
 		if (m_doExpire) {
 		    m_doExpire = false;
-		    // check each channel for timeouts
-		    ListIterator iter(m_chans);
-		    Time t;
-		    for (;;) {
-			RefPointer<Channel> c = static_cast<Channel*>(iter.get());
-			unlock();
-			if (!c)
-			    break;
-			c->checkTimers(msg,t);
-			c = 0;
-			lock();
-		    }
+		    unlock();
+		    // check the channels having timers due
+		    expireTimers(msg);
 		    m_doExpire = true;
 		}
 		else
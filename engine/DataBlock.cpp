@@ -22,6 +22,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef _WINDOWS
+#include <pthread.h>
+#endif
+
 using namespace TelEngine;
 
 namespace { // anonymous
@@ -77,32 +81,275 @@ static InitG711 s_initG711;
 
 static const DataBlock s_empty;
 
+// Smallest pooled buffer is 1 << POOL_SHIFT bytes
+#define POOL_SHIFT 6
+// Number of power of two size classes, 64 to 8192 bytes
+#define POOL_CLASSES 8
+// Buffers moved at once between a thread cache and the shared lists
+#define POOL_BATCH 16
+// Maximum number of free buffers kept in a shared list
+#define POOL_SHARED 1024
+
+namespace { // anonymous
+
+// Free list of same size buffers linked through their first bytes
+class PoolList
+{
+public:
+    inline PoolList()
+	: m_head(0), m_count(0)
+	{ }
+    inline unsigned int count() const
+	{ return m_count; }
+    inline void push(void* buf)
+	{ *(void**)buf = m_head; m_head = buf; m_count++; }
+    inline void* pop()
+    {
+	void* buf = m_head;
+	if (buf) {
+	    m_head = *(void**)buf;
+	    m_count--;
+	}
+	return buf;
+    }
+    // Move up to count buffers to another list
+    inline void move(PoolList& dest, unsigned int count)
+    {
+	while (count-- && m_head)
+	    dest.push(pop());
+    }
+    // Give all buffers back to the system
+    inline void flush()
+    {
+	while (void* buf = pop())
+	    ::free(buf);
+    }
+private:
+    void* m_head;
+    unsigned int m_count;
+};
+
+}; // anonymous namespace
+
+static PoolList s_poolShared[POOL_CLASSES];
+static Mutex s_poolMutex(false,"DataPool");
+static ObjList s_pools;
+static Mutex s_poolsMutex(false,"DataPools");
+
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+static inline void poolInc(u_int64_t& val)
+    { InterlockedIncrement64((LONGLONG*)&val); }
+#else
+static inline void poolInc(u_int64_t& val)
+    { __sync_add_and_fetch(&val,1); }
+#endif
+#else
+static Mutex s_poolAtomic(false,"DataPoolAtomic");
+static inline void poolInc(u_int64_t& val)
+    { Lock lock(s_poolAtomic); ++val; }
+#endif
+
+// Size class able to hold len bytes, -1 if too large to pool
+static inline int poolClass(unsigned int len)
+{
+    if (len <= (1U << POOL_SHIFT))
+	return 0;
+    if (len > (1U << (POOL_SHIFT + POOL_CLASSES - 1)))
+	return -1;
+    int c = 1;
+    for (len = (len - 1) >> (POOL_SHIFT + 1); len; len >>= 1)
+	c++;
+    return c;
+}
+
+// Take a buffer from the shared lists, refill a thread cache if provided
+static void* poolShared(int c, PoolList* cache)
+{
+    Lock lock(s_poolMutex);
+    if (cache)
+	s_poolShared[c].move(*cache,POOL_BATCH);
+    return cache ? cache->pop() : s_poolShared[c].pop();
+}
+
+// Return buffers to the shared lists, free them if the list is full
+static void poolShared(int c, PoolList& list, unsigned int count)
+{
+    Lock lock(s_poolMutex);
+    unsigned int room = POOL_SHARED - s_poolShared[c].count();
+    if (count > room) {
+	list.move(s_poolShared[c],room);
+	lock.drop();
+	PoolList extra;
+	list.move(extra,count - room);
+	extra.flush();
+    }
+    else
+	list.move(s_poolShared[c],count);
+}
+
+#ifdef _WINDOWS
+
+// No thread exit hook to flush a cache, all buffers go through shared lists
+static inline PoolList* poolCache()
+    { return 0; }
+
+#else
+
+static void poolCacheDestroy(void* arg)
+{
+    PoolList* cache = static_cast<PoolList*>(arg);
+    for (int c = 0; c < POOL_CLASSES; c++)
+	poolShared(c,cache[c],cache[c].count());
+    delete[] cache;
+}
+
+static pthread_key_t s_poolKey;
+static bool s_poolKeyValid = !::pthread_key_create(&s_poolKey,poolCacheDestroy);
+
+// Per thread array of free lists, one for each size class
+static PoolList* poolCache()
+{
+    if (!s_poolKeyValid)
+	return 0;
+    PoolList* cache = static_cast<PoolList*>(::pthread_getspecific(s_poolKey));
+    if (!cache) {
+	cache = new PoolList[POOL_CLASSES];
+	if (::pthread_setspecific(s_poolKey,cache)) {
+	    delete[] cache;
+	    cache = 0;
+	}
+    }
+    return cache;
+}
+
+#endif // _WINDOWS
+
+
+DataPool::DataPool(const String& name)
+    : String(name),
+      m_allocs(0), m_released(0), m_missed(0), m_oversized(0)
+{
+}
+
+DataPool* DataPool::get(const String& name)
+{
+    if (name.null())
+	return 0;
+    Lock lock(s_poolsMutex);
+    ObjList* l = s_pools.find(name);
+    if (l)
+	return static_cast<DataPool*>(l->get());
+    DataPool* pool = new DataPool(name);
+    // accounts outlive any data block, never delete them
+    s_pools.append(pool)->setDelete(false);
+    return pool;
+}
+
+unsigned int DataPool::maxSize()
+{
+    return 1 << (POOL_SHIFT + POOL_CLASSES - 1);
+}
+
+unsigned int DataPool::cached()
+{
+    unsigned int count = 0;
+    Lock lock(s_poolMutex);
+    for (int c = 0; c < POOL_CLASSES; c++)
+	count += s_poolShared[c].count();
+    return count;
+}
+
+unsigned int DataPool::status(String& str)
+{
+    unsigned int count = 0;
+    Lock lock(s_poolsMutex);
+    for (ObjList* l = s_pools.skipNull(); l; l = l->skipNext()) {
+	const DataPool* p = static_cast<const DataPool*>(l->get());
+	str.append(*p,",") << "=" << p->allocs() << "|" << p->reused() <<
+	    "|" << p->oversized() << "|" << p->inUse();
+	count++;
+    }
+    return count;
+}
+
+// Get a buffer of at least len bytes, len is updated to the real size
+void* DataPool::alloc(unsigned int& len)
+{
+    poolInc(m_allocs);
+    int c = poolClass(len);
+    if (c < 0) {
+	poolInc(m_oversized);
+	return ::malloc(len);
+    }
+    len = 1 << (POOL_SHIFT + c);
+    PoolList* cache = poolCache();
+    void* buf = cache ? cache[c].pop() : 0;
+    if (!buf)
+	buf = poolShared(c,cache);
+    if (buf)
+	return buf;
+    poolInc(m_missed);
+    return ::malloc(len);
+}
+
+// Recycle a buffer obtained from alloc()
+void DataPool::release(void* data, unsigned int len)
+{
+    poolInc(m_released);
+    int c = poolClass(len);
+    if ((c < 0) || (len != (1U << (POOL_SHIFT + c)))) {
+	::free(data);
+	return;
+    }
+    PoolList* cache = poolCache();
+    if (!cache) {
+	PoolList list;
+	list.push(data);
+	poolShared(c,list,1);
+	return;
+    }
+    cache[c].push(data);
+    if (cache[c].count() >= 2 * POOL_BATCH)
+	poolShared(c,cache[c],POOL_BATCH);
+}
+
+// A buffer was handed over to code that will free it
+void DataPool::detach()
+{
+    poolInc(m_released);
+}
+
 const DataBlock& DataBlock::empty()
 {
     return s_empty;
 }
 
 DataBlock::DataBlock(unsigned int overAlloc)
-    : m_data(0), m_length(0), m_allocated(0), m_overAlloc(overAlloc)
+    : m_data(0), m_length(0), m_allocated(0), m_overAlloc(overAlloc),
+      m_pool(0), m_dataPool(0)
 {
 }
 
 DataBlock::DataBlock(const DataBlock& value)
     : GenObject(),
-      m_data(0), m_length(0), m_allocated(0), m_overAlloc(value.overAlloc())
+      m_data(0), m_length(0), m_allocated(0), m_overAlloc(value.overAlloc()),
+      m_pool(0), m_dataPool(0)
 {
     assign(value.data(),value.length());
 }
 
 DataBlock::DataBlock(const DataBlock& value, unsigned int overAlloc)
     : GenObject(),
-      m_data(0), m_length(0), m_allocated(0), m_overAlloc(overAlloc)
+      m_data(0), m_length(0), m_allocated(0), m_overAlloc(overAlloc),
+      m_pool(0), m_dataPool(0)
 {
     assign(value.data(),value.length());
 }
 
 DataBlock::DataBlock(void* value, unsigned int len, bool copyData, unsigned int overAlloc)
-    : m_data(0), m_length(0), m_allocated(0), m_overAlloc(overAlloc)
+    : m_data(0), m_length(0), m_allocated(0), m_overAlloc(overAlloc),
+      m_pool(0), m_dataPool(0)
 {
     assign(value,len,copyData);
 }
@@ -126,7 +373,10 @@ void DataBlock::clear(bool deleteData)
 	void *data = m_data;
 	m_data = 0;
 	if (deleteData)
-	    ::free(data);
+	    freeData(data,m_allocated,m_dataPool);
+	else if (m_dataPool)
+	    m_dataPool->detach();
+	m_dataPool = 0;
     }
 }
 
@@ -134,25 +384,34 @@ DataBlock& DataBlock::assign(void* value, unsigned int len, bool copyData, unsig
 {
     if ((value != m_data) || (len != m_length)) {
 	void *odata = m_data;
+	unsigned int oalloc = m_allocated;
+	DataPool* opool = m_dataPool;
 	m_length = 0;
 	m_allocated = 0;
 	m_data = 0;
+	m_dataPool = 0;
 	if (len) {
 	    if (copyData) {
 		allocated = allocLen(len);
-		void *data = ::malloc(allocated);
+		void *data = allocData(allocated);
 		if (data) {
 		    if (value)
 			::memcpy(data,value,len);
 		    else
 			::memset(data,0,len);
 		    m_data = data;
+		    m_dataPool = m_pool;
 		}
 		else
 		    Debug("DataBlock",DebugFail,"malloc(%d) returned NULL!",allocated);
 	    }
 	    else {
-		if (allocated < len)
+		if (value == odata) {
+		    // keeping our own buffer, just shorter
+		    allocated = oalloc;
+		    m_dataPool = opool;
+		}
+		else if (allocated < len)
 		    allocated = len;
 		m_data = value;
 	    }
@@ -162,7 +421,7 @@ DataBlock& DataBlock::assign(void* value, unsigned int len, bool copyData, unsig
 	    }
 	}
 	if (odata && (odata != m_data))
-	    ::free(odata);
+	    freeData(odata,oalloc,opool);
     }
     return *this;
 }
@@ -209,11 +468,15 @@ void DataBlock::append(const DataBlock& value)
 		return;
 	    }
 	    unsigned int aLen = allocLen(len);
-	    void *data = ::malloc(aLen);
+	    void *data = allocData(aLen);
 	    if (data) {
 		::memcpy(data,m_data,m_length);
 		::memcpy(m_length+(char*)data,value.data(),value.length());
-		assign(data,len,false,aLen);
+		freeData(m_data,m_allocated,m_dataPool);
+		m_data = data;
+		m_length = len;
+		m_allocated = aLen;
+		m_dataPool = m_pool;
 	    }
 	    else
 		Debug("DataBlock",DebugFail,"malloc(%d) returned NULL!",aLen);
@@ -234,11 +497,15 @@ void DataBlock::append(const String& value)
 		return;
 	    }
 	    unsigned int aLen = allocLen(len);
-	    void *data = ::malloc(aLen);
+	    void *data = allocData(aLen);
 	    if (data) {
 		::memcpy(data,m_data,m_length);
 		::memcpy(m_length+(char*)data,value.safe(),value.length());
-		assign(data,len,false,aLen);
+		freeData(m_data,m_allocated,m_dataPool);
+		m_data = data;
+		m_length = len;
+		m_allocated = aLen;
+		m_dataPool = m_pool;
 	    }
 	    else
 		Debug("DataBlock",DebugFail,"malloc(%d) returned NULL!",aLen);
@@ -254,11 +521,16 @@ void DataBlock::insert(const DataBlock& value)
     if (m_length) {
 	if (vl) {
 	    unsigned int len = m_length+vl;
-	    void *data = ::malloc(len);
+	    unsigned int aLen = len;
+	    void *data = allocData(aLen);
 	    if (data) {
 		::memcpy(data,value.data(),vl);
 		::memcpy(vl+(char*)data,m_data,m_length);
-		assign(data,len,false);
+		freeData(m_data,m_allocated,m_dataPool);
+		m_data = data;
+		m_length = len;
+		m_allocated = aLen;
+		m_dataPool = m_pool;
 	    }
 	    else
 		Debug("DataBlock",DebugFail,"malloc(%d) returned NULL!",len);
@@ -268,6 +540,22 @@ void DataBlock::insert(const DataBlock& value)
 	assign(value.data(),vl);
 }
 
+// Allocate memory from the pool if one is set, len is updated to the real size
+void* DataBlock::allocData(unsigned int& len) const
+{
+    if (m_pool)
+	return m_pool->alloc(len);
+    return ::malloc(len);
+}
+
+void DataBlock::freeData(void* data, unsigned int len, DataPool* pool)
+{
+    if (pool)
+	pool->release(data,len);
+    else
+	::free(data);
+}
+
 unsigned int DataBlock::allocLen(unsigned int len) const
 {
     // allocate a multiple of 8 bytes
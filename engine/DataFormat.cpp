@@ -21,6 +21,11 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace TelEngine {
 
@@ -46,6 +51,8 @@ static const FormatInfo s_formats[] = {
     FormatInfo("g729", 10, 10000),
     FormatInfo("plain", 0, 0, "text", 0),
     FormatInfo("raw", 0, 0, "data", 0),
+    FormatInfo("slin/44100", 882, 10000, "audio", 44100, 1, true),
+    FormatInfo("slin/48000", 960, 10000, "audio", 48000, 1, true),
 };
 
 // FIXME: put proper conversion costs everywhere below
@@ -87,15 +94,44 @@ static TranslatorCaps s_simpleCaps32k[] = {
 };
 
 static TranslatorCaps s_resampCaps[] = {
+    { s_formats+0, s_formats+3, 3 },
+    { s_formats+0, s_formats+6, 3 },
+    { s_formats+3, s_formats+0, 3 },
+    { s_formats+3, s_formats+6, 3 },
+    { s_formats+6, s_formats+0, 3 },
+    { s_formats+6, s_formats+3, 3 },
+    { 0, 0, 0 }
+};
+
+static TranslatorCaps s_polyphaseCaps[] = {
     { s_formats+0, s_formats+3, 2 },
     { s_formats+0, s_formats+6, 2 },
+    { s_formats+0, s_formats+20, 2 },
+    { s_formats+0, s_formats+21, 2 },
     { s_formats+3, s_formats+0, 2 },
     { s_formats+3, s_formats+6, 2 },
+    { s_formats+3, s_formats+20, 2 },
+    { s_formats+3, s_formats+21, 2 },
     { s_formats+6, s_formats+0, 2 },
     { s_formats+6, s_formats+3, 2 },
+    { s_formats+6, s_formats+20, 2 },
+    { s_formats+6, s_formats+21, 2 },
+    { s_formats+20, s_formats+0, 2 },
+    { s_formats+20, s_formats+3, 2 },
+    { s_formats+20, s_formats+6, 2 },
+    { s_formats+20, s_formats+21, 2 },
+    { s_formats+21, s_formats+0, 2 },
+    { s_formats+21, s_formats+3, 2 },
+    { s_formats+21, s_formats+6, 2 },
+    { s_formats+21, s_formats+20, 2 },
     { 0, 0, 0 }
 };
 
+// Zero crossings of the windowed sinc on each side of the polyphase filter
+#define POLY_ZEROS 8
+// Fixed point precision of the polyphase filter coefficients
+#define POLY_SHIFT 14
+
 static TranslatorCaps s_stereoCaps[] = {
     { s_formats+0, s_formats+9, 1 },
     { s_formats+9, s_formats+0, 2 },
@@ -136,12 +172,20 @@ private:
     RefPointer<ThreadedSource> m_source;
 };
 
+// Pool of the buffers produced by the builtin translators
+static DataPool* transPool()
+{
+    static DataPool* s_pool = DataPool::get("translate");
+    return s_pool;
+}
+
 // slin/alaw/mulaw converter
 class SimpleTranslator : public DataTranslator
 {
 public:
     SimpleTranslator(const DataFormat& sFormat, const DataFormat& dFormat)
 	: DataTranslator(sFormat,dFormat), m_valid(false) {
+	    m_buffer.pool(transPool());
 	    if (!getTransSource())
 		return;
 	    int nchan = m_format.numChannels();
@@ -204,6 +248,7 @@ public:
 		long delta = tStamp - m_timestamp;
 		short* s = (short*) data.data();
 		DataBlock oblock;
+		oblock.pool(transPool());
 		if (m_dRate > m_sRate) {
 		    int mul = m_dRate / m_sRate;
 		    // linear interpolation between existing samples
@@ -246,6 +291,205 @@ public:
 	}
 };
 
+// Polyphase filter bank for a rational resampling ratio
+class PolyphaseBank : public GenObject
+{
+public:
+    ~PolyphaseBank()
+	{ delete[] m_coefs; }
+    virtual const String& toString() const
+	{ return m_name; }
+    inline unsigned int up() const
+	{ return m_up; }
+    inline unsigned int down() const
+	{ return m_down; }
+    inline unsigned int taps() const
+	{ return m_taps; }
+    inline const int16_t* phase(unsigned int p) const
+	{ return m_coefs + p * m_taps; }
+    static const PolyphaseBank* get(int sRate, int dRate);
+private:
+    PolyphaseBank(const String& name, unsigned int up, unsigned int down);
+    String m_name;
+    unsigned int m_up;
+    unsigned int m_down;
+    unsigned int m_taps;
+    int16_t* m_coefs;
+};
+
+// Banks are built once per ratio and kept until the engine exits
+static ObjList s_polyBanks;
+static Mutex s_polyMutex(false,"PolyphaseBanks");
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while (b) {
+	unsigned int t = a % b;
+	a = b;
+	b = t;
+    }
+    return a;
+}
+
+const PolyphaseBank* PolyphaseBank::get(int sRate, int dRate)
+{
+    if ((sRate <= 0) || (dRate <= 0) || (sRate == dRate))
+	return 0;
+    unsigned int g = gcd(sRate,dRate);
+    String name;
+    name << (dRate / g) << "/" << (sRate / g);
+    Lock lock(s_polyMutex);
+    ObjList* o = s_polyBanks.find(name);
+    if (o)
+	return static_cast<const PolyphaseBank*>(o->get());
+    PolyphaseBank* bank = new PolyphaseBank(name,dRate / g,sRate / g);
+    s_polyBanks.append(bank);
+    return bank;
+}
+
+// Build a Blackman windowed sinc low pass cut below the lower Nyquist frequency
+//  and split it in phases, each phase holds the taps for one output position
+PolyphaseBank::PolyphaseBank(const String& name, unsigned int up, unsigned int down)
+    : m_name(name), m_up(up), m_down(down), m_taps(0), m_coefs(0)
+{
+    // when decimating the filter spans proportionally more input samples
+    double ratio = (down > up) ? (double)down / up : 1.0;
+    m_taps = ((unsigned int)(2 * POLY_ZEROS * ratio) + 7) & ~7;
+    unsigned int len = m_taps * m_up;
+    // cutoff relative to the upsampled rate, slightly below Nyquist
+    double fc = 0.45 / ((up > down) ? up : down);
+    double center = (len - 1) / 2.0;
+    double* proto = new double[len];
+    for (unsigned int i = 0; i < len; i++) {
+	double x = i - center;
+	double v = (x == 0) ? 2 * fc : ::sin(2 * M_PI * fc * x) / (M_PI * x);
+	double w = 2 * M_PI * i / (len - 1);
+	proto[i] = v * (0.42 - 0.5 * ::cos(w) + 0.08 * ::cos(2 * w));
+    }
+    m_coefs = new int16_t[len];
+    for (unsigned int p = 0; p < m_up; p++) {
+	int16_t* c = m_coefs + p * m_taps;
+	// each phase is scaled to unity gain so DC passes unchanged
+	double sum = 0;
+	for (unsigned int t = 0; t < m_taps; t++)
+	    sum += proto[p + t * m_up];
+	int isum = 0;
+	unsigned int peak = 0;
+	for (unsigned int t = 0; t < m_taps; t++) {
+	    // stored reversed so they multiply the input in ascending order
+	    int v = (int)::floor(proto[p + (m_taps - 1 - t) * m_up] / sum * (1 << POLY_SHIFT) + 0.5);
+	    c[t] = v;
+	    isum += v;
+	    if (v > c[peak])
+		peak = t;
+	}
+	c[peak] += (1 << POLY_SHIFT) - isum;
+    }
+    delete[] proto;
+    DDebug(DebugAll,"Built polyphase bank %s with %u taps per phase",m_name.c_str(),m_taps);
+}
+
+// Filter a window of samples, the number of taps is a multiple of 8
+static inline int polyDot(const int16_t* x, const int16_t* h, unsigned int taps)
+{
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+    for (unsigned int i = 0; i < taps; i += 8)
+	acc = _mm_add_epi32(acc,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(x + i)),
+	    _mm_loadu_si128((const __m128i*)(h + i))));
+    acc = _mm_add_epi32(acc,_mm_shuffle_epi32(acc,0x4e));
+    acc = _mm_add_epi32(acc,_mm_shuffle_epi32(acc,0xb1));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int acc = 0;
+    for (unsigned int i = 0; i < taps; i++)
+	acc += x[i] * h[i];
+    return acc;
+#endif
+}
+
+// slin mono resampler for any rational ratio using a polyphase filter bank
+class PolyphaseTranslator : public DataTranslator
+{
+public:
+    PolyphaseTranslator(const DataFormat& sFormat, const DataFormat& dFormat)
+	: DataTranslator(sFormat,dFormat),
+	  m_bank(PolyphaseBank::get(sFormat.sampleRate(),dFormat.sampleRate())),
+	  m_buf(0), m_size(0), m_pos(0), m_phase(0), m_stampRem(0)
+	{ m_out.pool(transPool()); }
+    ~PolyphaseTranslator()
+	{ delete[] m_buf; }
+    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+	{
+	    unsigned int n = data.length();
+	    if (!n || (n & 1) || !m_bank || !ref())
+		return 0;
+	    unsigned long len = 0;
+	    n /= 2;
+	    DataSource* src = getTransSource();
+	    if (src) {
+		unsigned int up = m_bank->up();
+		unsigned int down = m_bank->down();
+		unsigned int taps = m_bank->taps();
+		unsigned int hist = taps - 1;
+		// new samples go after the ones kept from the previous block
+		if (m_size < hist + n) {
+		    int16_t* buf = new int16_t[hist + n];
+		    if (m_buf)
+			::memcpy(buf,m_buf,hist * sizeof(int16_t));
+		    else
+			::memset(buf,0,hist * sizeof(int16_t));
+		    delete[] m_buf;
+		    m_buf = buf;
+		    m_size = hist + n;
+		}
+		::memcpy(m_buf + hist,data.data(),n * sizeof(int16_t));
+		// output samples whose last input sample falls in this block
+		unsigned int count = 0;
+		if (m_pos < n)
+		    count = ((n - m_pos) * up - m_phase + down - 1) / down;
+		// same size blocks reuse the buffer
+		m_out.resize(count * sizeof(int16_t));
+		int16_t* d = (int16_t*)m_out.data();
+		unsigned int step = down / up;
+		unsigned int frac = down % up;
+		unsigned int pos = m_pos;
+		unsigned int phase = m_phase;
+		for (unsigned int i = 0; i < count; i++) {
+		    int v = (polyDot(m_buf + pos,m_bank->phase(phase),taps) + (1 << (POLY_SHIFT - 1))) >> POLY_SHIFT;
+		    d[i] = (v < -32767) ? -32767 : ((v > 32767) ? 32767 : v);
+		    pos += step;
+		    phase += frac;
+		    if (phase >= up) {
+			phase -= up;
+			pos++;
+		    }
+		}
+		m_pos = pos - n;
+		m_phase = phase;
+		::memmove(m_buf,m_buf + n,hist * sizeof(int16_t));
+		// scale the timestamp delta keeping the remainder for the next block
+		int64_t delta = (int64_t)(long)(tStamp - m_timestamp) * up + m_stampRem;
+		long odelta = (long)(delta / down);
+		m_stampRem = delta - (int64_t)odelta * down;
+		if (src->timeStamp() != invalidStamp())
+		    odelta += src->timeStamp();
+		if (count)
+		    len = src->Forward(m_out,odelta,flags);
+	    }
+	    deref();
+	    return len;
+	}
+private:
+    const PolyphaseBank* m_bank;
+    int16_t* m_buf;
+    unsigned int m_size;
+    unsigned int m_pos;
+    unsigned int m_phase;
+    int64_t m_stampRem;
+    DataBlock m_out;
+};
+
 // slin simple mono-stereo converter
 class StereoTranslator : public DataTranslator
 {
@@ -266,6 +510,7 @@ public:
 	    if (getTransSource()) {
 		short* s = (short*) data.data();
 		DataBlock oblock;
+		oblock.pool(transPool());
 		if ((m_sChans == 1) && (m_dChans == 2)) {
 		    oblock.assign(0,n*4);
 		    short* d = (short*) oblock.data();
@@ -324,6 +569,17 @@ public:
 	{ return s_resampCaps; }
 };
 
+class PolyphaseFactory : public TranslatorFactory
+{
+public:
+    PolyphaseFactory() : TranslatorFactory("polyphase")
+	{ }
+    virtual DataTranslator* create(const DataFormat& sFormat, const DataFormat& dFormat)
+	{ return converts(sFormat,dFormat) ? new PolyphaseTranslator(sFormat,dFormat) : 0; }
+    virtual const TranslatorCaps* getCapabilities() const
+	{ return s_polyphaseCaps; }
+};
+
 class StereoFactory : public TranslatorFactory
 {
 public:
@@ -1207,6 +1463,7 @@ static SimpleFactory s_sFactory16k(s_simpleCaps16k,"g711wb");
 static SimpleFactory s_sFactory32k(s_simpleCaps32k,"g711uwb");
 // FIXME
 static ResampFactory s_rFactory;
+static PolyphaseFactory s_pFactory;
 static StereoFactory s_stereoFactory;
 
 void DataTranslator::setMaxChain(unsigned int maxChain)
@@ -1529,6 +1786,18 @@ int DataTranslator::cost(const DataFormat& sFormat, const DataFormat& dFormat)
     return c;
 }
 
+// Create a translator using a specific factory
+static DataTranslator* createBy(TranslatorFactory* f, const DataFormat& sFormat, const DataFormat& dFormat, bool counting)
+{
+    if (counting)
+	Thread::setCurrentObjCounter(f->objectsCounter());
+    DataTranslator* trans = f->create(sFormat,dFormat);
+    if (trans)
+	Debug(DebugAll,"Created DataTranslator %p for '%s' -> '%s' by factory %p (len=%u)",
+	    trans,sFormat.c_str(),dFormat.c_str(),f,f->length());
+    return trans;
+}
+
 DataTranslator* DataTranslator::create(const DataFormat& sFormat, const DataFormat& dFormat)
 {
     if (sFormat == dFormat) {
@@ -1542,18 +1811,31 @@ DataTranslator* DataTranslator::create(const DataFormat& sFormat, const DataForm
 
     s_mutex.lock();
     compose();
-    ObjList *l = s_factories.skipNull();
-    for (; l; l=l->skipNext()) {
-	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
-	if (counting)
-	    Thread::setCurrentObjCounter(f->objectsCounter());
-	trans = f->create(sFormat,dFormat);
-	if (trans) {
-	    Debug(DebugAll,"Created DataTranslator %p for '%s' -> '%s' by factory %p (len=%u)",
-		trans,sFormat.c_str(),dFormat.c_str(),f,f->length());
-	    break;
+    // try first the factory advertising the lowest cost for this conversion
+    TranslatorFactory* best = 0;
+    const FormatInfo* src = sFormat.getInfo();
+    const FormatInfo* dest = dFormat.getInfo();
+    if (src && dest) {
+	int c = -1;
+	for (ObjList* l = s_factories.skipNull(); l; l=l->skipNext()) {
+	    TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
+	    const TranslatorCaps* caps = f->getCapabilities();
+	    for (; caps && caps->src && caps->dest; caps++) {
+		if ((caps->src == src) && (caps->dest == dest) && ((c == -1) || (c > caps->cost))) {
+		    c = caps->cost;
+		    best = f;
+		}
+	    }
 	}
     }
+    if (best)
+	trans = createBy(best,sFormat,dFormat,counting);
+    // then all the others in the order they were installed
+    for (ObjList* l = s_factories.skipNull(); l && !trans; l=l->skipNext()) {
+	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
+	if (f != best)
+	    trans = createBy(f,sFormat,dFormat,counting);
+    }
     s_mutex.unlock();
     if (counting)
 	Thread::setCurrentObjCounter(saved);
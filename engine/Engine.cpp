@@ -91,12 +91,14 @@ class EnginePrivate : public Thread
 {
 public:
     EnginePrivate()
-	: Thread("Engine Worker")
-	{ count++; }
+	: Thread("Engine Worker"), m_queue(count++)
+	{ }
     ~EnginePrivate()
 	{ count--; }
     virtual void run();
     static int count;
+private:
+    unsigned int m_queue;
 };
 
 class EngineCommand : public MessageHandler
@@ -375,6 +377,7 @@ public:
     virtual bool received(Message &msg);
     static void objects(String& retVal, bool details);
     static int objects(String& str);
+    static bool pools(String& retVal, bool details, bool always = true);
 };
 
 class EngineHelp : public MessageHandler
@@ -507,6 +510,22 @@ void EngineStatusHandler::objects(String& retVal, bool details)
     retVal << "\r\n";
 }
 
+// Data buffer pools: allocations, recycled buffers, too large to pool and in use
+bool EngineStatusHandler::pools(String& retVal, bool details, bool always)
+{
+    String str;
+    unsigned int count = DataPool::status(str);
+    if (!(count || always))
+	return false;
+    retVal << "name=datapool,type=system,format=Allocs|Reused|Oversized|InUse";
+    retVal << ";pools=" << count << ",cached=" << DataPool::cached();
+    retVal << ",maxsize=" << DataPool::maxSize();
+    if (details)
+	retVal.append(str,";");
+    retVal << "\r\n";
+    return true;
+}
+
 bool EngineStatusHandler::received(Message &msg)
 {
     bool details = msg.getBoolValue("details",true);
@@ -528,6 +547,8 @@ bool EngineStatusHandler::received(Message &msg)
 		objects(msg.retValue(),details);
 	    return true;
 	}
+	if (sel == YSTRING("datapool"))
+	    return pools(msg.retValue(),details);
 	return false;
     }
     msg.retValue() << "name=engine,type=system";
@@ -542,6 +563,7 @@ bool EngineStatusHandler::received(Message &msg)
     Engine::self()->getStats(enq,deq,disp,qmax);
     msg.retValue() << ",messages=" << (enq - deq) << ",maxqueue=" << qmax;
     msg.retValue() << ",messageage=" << Engine::self()->messageAge();
+    msg.retValue() << ",queues=" << Engine::self()->messageQueues();
     msg.retValue() << ",messagerate=" << Engine::self()->messageRate();
     msg.retValue() << ",maxmsgrate=" << Engine::self()->messageMaxRate();
     msg.retValue() << ",enqueued=" << enq << ",dequeued=" << deq << ",dispatched=" << disp ;
@@ -571,10 +593,22 @@ bool EngineStatusHandler::received(Message &msg)
 	    msg.retValue() << sep << p->name() << "=" << *p;
 	    sep = ',';
 	}
+	// depth and average message age (msec) of each message queue
+	sep = ';';
+	unsigned int depth = 0;
+	u_int64_t age = 0;
+	for (unsigned int i = 0; i < Engine::self()->messageQueues(); i++) {
+	    if (!Engine::self()->getQueueStats(i,depth,age))
+		break;
+	    msg.retValue() << sep << "queue" << i << "=" << depth << ",queueage" << i << "=" << ((age + 500) / 1000);
+	    sep = ',';
+	}
     }
     msg.retValue() << "\r\n";
     if (getObjCounting() && sel.null())
 	objects(msg.retValue(),details);
+    if (sel.null())
+	pools(msg.retValue(),details,false);
     return !sel.null();
 }
 
@@ -740,6 +774,7 @@ void EngineCommand::doCompletion(Message &msg, const String& partLine, const Str
     else if (partLine == YSTRING("status")) {
 	completeOne(msg.retValue(),"engine",partWord);
 	completeOne(msg.retValue(),"objects",partWord);
+	completeOne(msg.retValue(),"datapool",partWord);
     }
     else if (partLine == YSTRING("status objects")) {
 	for (ObjList* l = getObjCounters().skipNull();l;l = l->skipNext())
@@ -943,7 +978,7 @@ void EnginePrivate::run()
 	Semaphore* s = s_semWorkers;
 	if (s && Engine::self()->m_dispatcher.hasMessages())
 	    s->unlock();
-	Engine::self()->m_dispatcher.dequeue();
+	Engine::self()->m_dispatcher.dequeue(m_queue);
 	s = s_semWorkers;
 	if (s) {
 	    s->lock(WORKER_SLEEP);
@@ -1551,6 +1586,8 @@ int Engine::engineInit()
 	s_timejump = MIN_TIME_JUMP;
     s_timejump *= 1000;
     m_dispatcher.warnTime(1000*(u_int64_t)s_cfg.getIntValue("general","warntime"));
+    m_dispatcher.queues(s_cfg.getIntValue("general","queues",4,1,MessageDispatcher::maxQueues()));
+    NamedList::indexThreshold(s_cfg.getIntValue("general","paramsindex",NamedList::indexThreshold(),0,10000));
     extraPath(clientMode() ? "client" : "server");
     extraPath(s_cfg.getValue("general","extrapath"));
 
@@ -20,6 +20,11 @@
 #include "yatemath.h"
 #include <stdio.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATH_X86
+#include <immintrin.h>
+#endif
+
 using namespace TelEngine;
 
 #ifdef DEBUG
@@ -309,6 +314,349 @@ String& BitVector::appendTo(String& buf, unsigned int offs, int len) const
 }
 
 
+//
+// Vector kernels
+//
+namespace { // anonymous
+
+// Set of vector kernels for an instruction set
+struct MathKernels
+{
+    const char* name;
+    float (*sumF)(const float* src, unsigned int len);
+    void (*sumC)(float* res, const float* src, unsigned int len);
+    float (*sumMulF)(const float* a, const float* b, unsigned int len);
+    void (*sumMulC)(float* res, const float* a, const float* b, unsigned int len);
+    float (*sumNorm2)(const float* src, unsigned int len);
+    void (*toInt16)(int16_t* dest, const float* src, unsigned int len,
+	float scaleI, float scaleQ, unsigned int shift);
+    void (*toFloat)(float* dest, const int16_t* src, unsigned int len, float scale);
+};
+
+}; // anonymous namespace
+
+// Complex numbers are handled as arrays of real, imaginary float pairs
+
+static float sumFScalar(const float* src, unsigned int len)
+{
+    float res = 0;
+    for (const float* last = src + len; src != last; ++src)
+	res += *src;
+    return res;
+}
+
+static void sumCScalar(float* res, const float* src, unsigned int len)
+{
+    float re = 0;
+    float im = 0;
+    for (unsigned int i = 0; i < len; i++, src += 2) {
+	re += src[0];
+	im += src[1];
+    }
+    res[0] = re;
+    res[1] = im;
+}
+
+static float sumMulFScalar(const float* a, const float* b, unsigned int len)
+{
+    float res = 0;
+    for (const float* last = a + len; a != last; ++a, ++b)
+	res += *a * *b;
+    return res;
+}
+
+static void sumMulCScalar(float* res, const float* a, const float* b, unsigned int len)
+{
+    float re = 0;
+    float im = 0;
+    for (unsigned int i = 0; i < len; i++, a += 2, b += 2) {
+	re += a[0] * b[0] - a[1] * b[1];
+	im += a[0] * b[1] + a[1] * b[0];
+    }
+    res[0] = re;
+    res[1] = im;
+}
+
+static float sumNorm2Scalar(const float* src, unsigned int len)
+{
+    return sumMulFScalar(src,src,2 * len);
+}
+
+// Round to nearest even like the SIMD conversions do, saturate to 16 bit
+static inline int16_t saturate16(float val)
+{
+    if (val >= 32767.0F)
+	return 32767;
+    if (val <= -32768.0F)
+	return -32768;
+    return (int16_t)::lrintf(val);
+}
+
+static void toInt16Scalar(int16_t* dest, const float* src, unsigned int len,
+    float scaleI, float scaleQ, unsigned int shift)
+{
+    unsigned int i = 0;
+    for (; i + 1 < len; i += 2) {
+	dest[i] = saturate16(src[i] * scaleI) >> shift;
+	dest[i + 1] = saturate16(src[i + 1] * scaleQ) >> shift;
+    }
+    if (i < len)
+	dest[i] = saturate16(src[i] * scaleI) >> shift;
+}
+
+static void toFloatScalar(float* dest, const int16_t* src, unsigned int len, float scale)
+{
+    for (const int16_t* last = src + len; src != last; ++src, ++dest)
+	*dest = *src * scale;
+}
+
+static const MathKernels s_mathScalar = { "scalar",
+    sumFScalar, sumCScalar, sumMulFScalar, sumMulCScalar, sumNorm2Scalar,
+    toInt16Scalar, toFloatScalar };
+
+#ifdef MATH_X86
+// Vector kernels are built for their instruction set and picked at runtime
+//  so they do not depend on the compiler flags of the whole build
+
+__attribute__((target("sse2")))
+static inline float hsumSSE2(__m128 v)
+{
+    v = _mm_add_ps(v,_mm_movehl_ps(v,v));
+    v = _mm_add_ss(v,_mm_shuffle_ps(v,v,0x55));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2")))
+static float sumFSSE2(const float* src, unsigned int len)
+{
+    __m128 acc = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= len; i += 4)
+	acc = _mm_add_ps(acc,_mm_loadu_ps(src + i));
+    return hsumSSE2(acc) + sumFScalar(src + i,len - i);
+}
+
+__attribute__((target("sse2")))
+static void sumCSSE2(float* res, const float* src, unsigned int len)
+{
+    __m128 acc = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 2 <= len; i += 2)
+	acc = _mm_add_ps(acc,_mm_loadu_ps(src + 2 * i));
+    sumCScalar(res,src + 2 * i,len - i);
+    // even lanes hold real parts, odd lanes imaginary parts
+    acc = _mm_add_ps(acc,_mm_movehl_ps(acc,acc));
+    res[0] += _mm_cvtss_f32(acc);
+    res[1] += _mm_cvtss_f32(_mm_shuffle_ps(acc,acc,0x55));
+}
+
+__attribute__((target("sse2")))
+static float sumMulFSSE2(const float* a, const float* b, unsigned int len)
+{
+    __m128 acc = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= len; i += 4)
+	acc = _mm_add_ps(acc,_mm_mul_ps(_mm_loadu_ps(a + i),_mm_loadu_ps(b + i)));
+    return hsumSSE2(acc) + sumMulFScalar(a + i,b + i,len - i);
+}
+
+__attribute__((target("sse2")))
+static void sumMulCSSE2(float* res, const float* a, const float* b, unsigned int len)
+{
+    // accumulate ar*br, ai*bi in one register and ar*bi, ai*br in another
+    __m128 accRe = _mm_setzero_ps();
+    __m128 accIm = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 2 <= len; i += 2) {
+	__m128 va = _mm_loadu_ps(a + 2 * i);
+	__m128 vb = _mm_loadu_ps(b + 2 * i);
+	accRe = _mm_add_ps(accRe,_mm_mul_ps(va,vb));
+	accIm = _mm_add_ps(accIm,_mm_mul_ps(va,_mm_shuffle_ps(vb,vb,0xb1)));
+    }
+    sumMulCScalar(res,a + 2 * i,b + 2 * i,len - i);
+    accRe = _mm_add_ps(accRe,_mm_movehl_ps(accRe,accRe));
+    res[0] += _mm_cvtss_f32(accRe) - _mm_cvtss_f32(_mm_shuffle_ps(accRe,accRe,0x55));
+    res[1] += hsumSSE2(accIm);
+}
+
+__attribute__((target("sse2")))
+static float sumNorm2SSE2(const float* src, unsigned int len)
+{
+    return sumMulFSSE2(src,src,2 * len);
+}
+
+__attribute__((target("sse2")))
+static void toInt16SSE2(int16_t* dest, const float* src, unsigned int len,
+    float scaleI, float scaleQ, unsigned int shift)
+{
+    const __m128 scale = _mm_setr_ps(scaleI,scaleQ,scaleI,scaleQ);
+    // clamp before converting, out of range conversions yield INT_MIN
+    const __m128 vMax = _mm_set1_ps(32767.0F);
+    const __m128 vMin = _mm_set1_ps(-32768.0F);
+    const __m128i vShift = _mm_cvtsi32_si128(shift);
+    unsigned int i = 0;
+    for (; i + 8 <= len; i += 8) {
+	__m128 f1 = _mm_mul_ps(_mm_loadu_ps(src + i),scale);
+	__m128 f2 = _mm_mul_ps(_mm_loadu_ps(src + i + 4),scale);
+	f1 = _mm_max_ps(_mm_min_ps(f1,vMax),vMin);
+	f2 = _mm_max_ps(_mm_min_ps(f2,vMax),vMin);
+	__m128i v = _mm_packs_epi32(_mm_cvtps_epi32(f1),_mm_cvtps_epi32(f2));
+	_mm_storeu_si128((__m128i*)(dest + i),_mm_sra_epi16(v,vShift));
+    }
+    toInt16Scalar(dest + i,src + i,len - i,scaleI,scaleQ,shift);
+}
+
+__attribute__((target("sse2")))
+static void toFloatSSE2(float* dest, const int16_t* src, unsigned int len, float scale)
+{
+    const __m128 vScale = _mm_set1_ps(scale);
+    unsigned int i = 0;
+    for (; i + 8 <= len; i += 8) {
+	__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+	// sign extend to 32 bit by placing the value in the upper half
+	__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v,v),16);
+	__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v,v),16);
+	_mm_storeu_ps(dest + i,_mm_mul_ps(_mm_cvtepi32_ps(lo),vScale));
+	_mm_storeu_ps(dest + i + 4,_mm_mul_ps(_mm_cvtepi32_ps(hi),vScale));
+    }
+    toFloatScalar(dest + i,src + i,len - i,scale);
+}
+
+__attribute__((target("avx2")))
+static inline __m128 foldAVX2(__m256 v)
+{
+    return _mm_add_ps(_mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1));
+}
+
+__attribute__((target("avx2")))
+static float sumFAVX2(const float* src, unsigned int len)
+{
+    __m256 acc = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 8 <= len; i += 8)
+	acc = _mm256_add_ps(acc,_mm256_loadu_ps(src + i));
+    return hsumSSE2(foldAVX2(acc)) + sumFScalar(src + i,len - i);
+}
+
+__attribute__((target("avx2")))
+static void sumCAVX2(float* res, const float* src, unsigned int len)
+{
+    __m256 acc = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= len; i += 4)
+	acc = _mm256_add_ps(acc,_mm256_loadu_ps(src + 2 * i));
+    sumCScalar(res,src + 2 * i,len - i);
+    __m128 v = foldAVX2(acc);
+    v = _mm_add_ps(v,_mm_movehl_ps(v,v));
+    res[0] += _mm_cvtss_f32(v);
+    res[1] += _mm_cvtss_f32(_mm_shuffle_ps(v,v,0x55));
+}
+
+__attribute__((target("avx2")))
+static float sumMulFAVX2(const float* a, const float* b, unsigned int len)
+{
+    __m256 acc = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 8 <= len; i += 8)
+	acc = _mm256_add_ps(acc,_mm256_mul_ps(_mm256_loadu_ps(a + i),_mm256_loadu_ps(b + i)));
+    return hsumSSE2(foldAVX2(acc)) + sumMulFScalar(a + i,b + i,len - i);
+}
+
+__attribute__((target("avx2")))
+static void sumMulCAVX2(float* res, const float* a, const float* b, unsigned int len)
+{
+    __m256 accRe = _mm256_setzero_ps();
+    __m256 accIm = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= len; i += 4) {
+	__m256 va = _mm256_loadu_ps(a + 2 * i);
+	__m256 vb = _mm256_loadu_ps(b + 2 * i);
+	accRe = _mm256_add_ps(accRe,_mm256_mul_ps(va,vb));
+	accIm = _mm256_add_ps(accIm,_mm256_mul_ps(va,_mm256_permute_ps(vb,0xb1)));
+    }
+    sumMulCScalar(res,a + 2 * i,b + 2 * i,len - i);
+    __m128 re = foldAVX2(accRe);
+    re = _mm_add_ps(re,_mm_movehl_ps(re,re));
+    res[0] += _mm_cvtss_f32(re) - _mm_cvtss_f32(_mm_shuffle_ps(re,re,0x55));
+    res[1] += hsumSSE2(foldAVX2(accIm));
+}
+
+__attribute__((target("avx2")))
+static float sumNorm2AVX2(const float* src, unsigned int len)
+{
+    return sumMulFAVX2(src,src,2 * len);
+}
+
+__attribute__((target("avx2")))
+static void toInt16AVX2(int16_t* dest, const float* src, unsigned int len,
+    float scaleI, float scaleQ, unsigned int shift)
+{
+    const __m256 scale = _mm256_setr_ps(scaleI,scaleQ,scaleI,scaleQ,scaleI,scaleQ,scaleI,scaleQ);
+    const __m256 vMax = _mm256_set1_ps(32767.0F);
+    const __m256 vMin = _mm256_set1_ps(-32768.0F);
+    const __m128i vShift = _mm_cvtsi32_si128(shift);
+    unsigned int i = 0;
+    for (; i + 16 <= len; i += 16) {
+	__m256 f1 = _mm256_mul_ps(_mm256_loadu_ps(src + i),scale);
+	__m256 f2 = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8),scale);
+	f1 = _mm256_max_ps(_mm256_min_ps(f1,vMax),vMin);
+	f2 = _mm256_max_ps(_mm256_min_ps(f2,vMax),vMin);
+	__m256i v = _mm256_packs_epi32(_mm256_cvtps_epi32(f1),_mm256_cvtps_epi32(f2));
+	// packing works on 128 bit lanes, restore the order of the values
+	v = _mm256_permute4x64_epi64(v,0xd8);
+	_mm256_storeu_si256((__m256i*)(dest + i),_mm256_sra_epi16(v,vShift));
+    }
+    toInt16SSE2(dest + i,src + i,len - i,scaleI,scaleQ,shift);
+}
+
+__attribute__((target("avx2")))
+static void toFloatAVX2(float* dest, const int16_t* src, unsigned int len, float scale)
+{
+    const __m256 vScale = _mm256_set1_ps(scale);
+    unsigned int i = 0;
+    for (; i + 8 <= len; i += 8) {
+	__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+	_mm256_storeu_ps(dest + i,_mm256_mul_ps(_mm256_cvtepi32_ps(v),vScale));
+    }
+    toFloatScalar(dest + i,src + i,len - i,scale);
+}
+
+static const MathKernels s_mathSSE2 = { "sse2",
+    sumFSSE2, sumCSSE2, sumMulFSSE2, sumMulCSSE2, sumNorm2SSE2,
+    toInt16SSE2, toFloatSSE2 };
+static const MathKernels s_mathAVX2 = { "avx2",
+    sumFAVX2, sumCAVX2, sumMulFAVX2, sumMulCAVX2, sumNorm2AVX2,
+    toInt16AVX2, toFloatAVX2 };
+#endif
+
+// Best kernels supported by the CPU
+static const MathKernels* mathKernels(bool simd)
+{
+#ifdef MATH_X86
+    if (simd) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	    return &s_mathAVX2;
+	if (__builtin_cpu_supports("sse2"))
+	    return &s_mathSSE2;
+    }
+#endif
+    return &s_mathScalar;
+}
+
+// Scalar kernels are usable even before the best ones are selected
+static const MathKernels* s_math = &s_mathScalar;
+
+class InitMathKernels
+{
+public:
+    InitMathKernels()
+	{ s_math = mathKernels(true); }
+};
+
+static InitMathKernels s_initMathKernels;
+
+
 //
 // Math
 //
@@ -342,4 +690,55 @@ String& Math::dumpFloat(String& dest, const float& val, const char* sep,
     return dest.append(s,sep);
 }
 
+float Math::sum(const float* src, unsigned int len)
+{
+    return s_math->sumF(src,len);
+}
+
+Complex Math::sum(const Complex* src, unsigned int len)
+{
+    float res[2];
+    s_math->sumC(res,(const float*)src,len);
+    return Complex(res[0],res[1]);
+}
+
+float Math::sumMul(const float* a, const float* b, unsigned int len)
+{
+    return s_math->sumMulF(a,b,len);
+}
+
+Complex Math::sumMul(const Complex* a, const Complex* b, unsigned int len)
+{
+    float res[2];
+    s_math->sumMulC(res,(const float*)a,(const float*)b,len);
+    return Complex(res[0],res[1]);
+}
+
+float Math::sumNorm2(const Complex* src, unsigned int len)
+{
+    return s_math->sumNorm2((const float*)src,len);
+}
+
+void Math::floatToInt16(int16_t* dest, const float* src, unsigned int len,
+    float scaleI, float scaleQ, unsigned int shift)
+{
+    s_math->toInt16(dest,src,len,scaleI,scaleQ,shift);
+}
+
+void Math::int16ToFloat(float* dest, const int16_t* src, unsigned int len, float scale)
+{
+    s_math->toFloat(dest,src,len,scale);
+}
+
+const char* Math::simd(bool enable)
+{
+    s_math = mathKernels(enable);
+    return s_math->name;
+}
+
+const char* Math::simd()
+{
+    return s_math->name;
+}
+
 /* vi: set ts=8 sw=4 sts=4 noet: */
@@ -20,6 +20,9 @@
 #include "yatengine.h"
 #include <string.h>
 
+// Number of queues allocated by each dispatcher
+#define MAX_QUEUES 32
+
 using namespace TelEngine;
 
 class QueueWorker : public GenObject, public Thread
@@ -35,9 +38,143 @@ private:
     RefPointer<MessageQueue> m_queue;
 };
 
+// Handlers that can match a message name, sorted in dispatch order
+class MessageHandlerList : public String
+{
+public:
+    inline MessageHandlerList(const String& name)
+	: String(name), m_named(0)
+	{ }
+    ObjList m_list;
+    unsigned int m_named;
+};
+
+// Handler and its priority as seen when a snapshot was built
+struct MessageHandlerEntry
+{
+    MessageHandler* handler;
+    unsigned int priority;
+};
+
+// Immutable array of handlers that can match a message name
+class MessageHandlerVector
+{
+public:
+    MessageHandlerVector(const String& name, const ObjList& list);
+    inline ~MessageHandlerVector()
+	{ delete[] m_entries; }
+    unsigned int locate(const MessageHandler* handler, unsigned int priority) const;
+    String m_name;
+    MessageHandlerEntry* m_entries;
+    unsigned int m_count;
+    MessageHandlerVector* m_next;
+};
+
+namespace TelEngine {
+
+// Immutable, reference counted copy of the handler index read by dispatch()
+class MessageHandlerSnapshot : public RefObject
+{
+public:
+    MessageHandlerSnapshot(const HashList& index, const ObjList& broadcast);
+    ~MessageHandlerSnapshot();
+    const MessageHandlerVector& find(const String& name) const;
+private:
+    unsigned int m_size;
+    MessageHandlerVector** m_buckets;
+    MessageHandlerVector m_broadcast;
+};
+
+// One of the queues holding messages waiting to be dispatched
+class MessageDispatchQueue : public Mutex
+{
+public:
+    inline MessageDispatchQueue()
+	: Mutex(false,"DispatchQueue"),
+	  m_append(&m_messages), m_count(0), m_avgAge(0)
+	{ }
+    ObjList m_messages;
+    ObjList* m_append;
+    int m_count;
+    u_int64_t m_avgAge;
+};
+
+};
+
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+static inline int atomicAdd(int& val, int add)
+    { return InterlockedExchangeAdd((LONG*)&val,add) + add; }
+static inline void atomicInc(u_int64_t& val)
+    { InterlockedIncrement64((LONGLONG*)&val); }
+static inline bool atomicSet(u_int64_t& val, u_int64_t old, u_int64_t set)
+    { return (u_int64_t)InterlockedCompareExchange64((LONGLONG*)&val,(LONGLONG)set,(LONGLONG)old) == old; }
+#else
+static inline int atomicAdd(int& val, int add)
+    { return __sync_add_and_fetch(&val,add); }
+static inline void atomicInc(u_int64_t& val)
+    { __sync_add_and_fetch(&val,1); }
+static inline bool atomicSet(u_int64_t& val, u_int64_t old, u_int64_t set)
+    { return __sync_bool_compare_and_swap(&val,old,set); }
+#endif
+#else
+static Mutex s_atomicMutex(false,"MessageAtomic");
+static inline int atomicAdd(int& val, int add)
+    { Lock lock(s_atomicMutex); return (val += add); }
+static inline void atomicInc(u_int64_t& val)
+    { Lock lock(s_atomicMutex); ++val; }
+static inline bool atomicSet(u_int64_t& val, u_int64_t old, u_int64_t set)
+{
+    Lock lock(s_atomicMutex);
+    if (val != old)
+	return false;
+    val = set;
+    return true;
+}
+#endif
+
+// Raise a value shared between threads to a new maximum
+static inline void atomicMax(u_int64_t& val, u_int64_t max)
+{
+    for (u_int64_t old = val; old < max; old = val)
+	if (atomicSet(val,old,max))
+	    break;
+}
+
+// Update an average shared between threads
+static inline void atomicAvg(u_int64_t& val, u_int64_t sample)
+{
+    for (u_int64_t old = val; ; old = val)
+	if (atomicSet(val,old,(3 * old + sample) >> 2))
+	    break;
+}
+
+// Insert a handler in ascending priority order, equal priorities sorted by address
+static void insertHandler(ObjList& list, MessageHandler* handler, bool owned)
+{
+    unsigned p = handler->priority();
+    ObjList* l = &list;
+    for (; l; l = l->next()) {
+	MessageHandler* h = static_cast<MessageHandler*>(l->get());
+	if (!h)
+	    continue;
+	if (h->priority() < p)
+	    continue;
+	if (h->priority() > p)
+	    break;
+	// at the same priority we sort them in pointer address order
+	if (h > handler)
+	    break;
+    }
+    if (l)
+	l->insert(handler)->setDelete(owned);
+    else
+	list.append(handler)->setDelete(owned);
+}
+
 Message::Message(const char* name, const char* retval, bool broadcast)
     : NamedList(name),
-      m_return(retval), m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_return(retval), m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(\"%s\",\"%s\",%s) [%p]",
 	name,retval,String::boolText(broadcast),this);
@@ -46,7 +183,7 @@ Message::Message(const char* name, const char* retval, bool broadcast)
 Message::Message(const Message& original)
     : NamedList(original),
       m_return(original.retValue()), m_time(original.msgTime()),
-      m_data(0), m_notify(false), m_broadcast(original.broadcast())
+      m_data(0), m_notify(false), m_broadcast(original.broadcast()), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(&%p) [%p]",&original,this);
 }
@@ -54,7 +191,7 @@ Message::Message(const Message& original)
 Message::Message(const Message& original, bool broadcast)
     : NamedList(original),
       m_return(original.retValue()), m_time(original.msgTime()),
-      m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0)
 {
     XDebug(DebugAll,"Message::Message(&%p,%s) [%p]",
 	&original,String::boolText(broadcast),this);
@@ -258,9 +395,8 @@ void MessageHandler::destruct()
 
 void MessageHandler::safeNowInternal()
 {
-    Lock lock(m_dispatcher);
     // when the unsafe counter reaches zero we're again safe to destroy
-    m_unsafe--;
+    atomicAdd(m_unsafe,-1);
 }
 
 bool MessageHandler::receivedInternal(Message& msg)
@@ -297,16 +433,93 @@ bool MessageRelay::receivedInternal(Message& msg)
 }
 
 
+MessageHandlerVector::MessageHandlerVector(const String& name, const ObjList& list)
+    : m_name(name), m_entries(0), m_count(list.count()), m_next(0)
+{
+    if (!m_count)
+	return;
+    m_entries = new MessageHandlerEntry[m_count];
+    unsigned int n = 0;
+    for (ObjList* l = list.skipNull(); l && n < m_count; l = l->skipNext(), n++) {
+	MessageHandler* h = static_cast<MessageHandler*>(l->get());
+	m_entries[n].handler = h;
+	m_entries[n].priority = h->priority();
+    }
+}
+
+// Find the position of a handler or of the first one that follows it in order
+unsigned int MessageHandlerVector::locate(const MessageHandler* handler, unsigned int priority) const
+{
+    unsigned int lo = 0;
+    unsigned int hi = m_count;
+    while (lo < hi) {
+	unsigned int mid = (lo + hi) / 2;
+	const MessageHandlerEntry& e = m_entries[mid];
+	if ((e.priority < priority) || ((e.priority == priority) && (e.handler < handler)))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+
+MessageHandlerSnapshot::MessageHandlerSnapshot(const HashList& index, const ObjList& broadcast)
+    : m_size(index.length()), m_buckets(0), m_broadcast(String::empty(),broadcast)
+{
+    m_buckets = new MessageHandlerVector*[m_size];
+    for (unsigned int i = 0; i < m_size; i++) {
+	m_buckets[i] = 0;
+	for (ObjList* l = index.getList(i); l; l = l->next()) {
+	    MessageHandlerList* hl = static_cast<MessageHandlerList*>(l->get());
+	    if (!hl)
+		continue;
+	    MessageHandlerVector* v = new MessageHandlerVector(*hl,hl->m_list);
+	    v->m_next = m_buckets[i];
+	    m_buckets[i] = v;
+	}
+    }
+}
+
+MessageHandlerSnapshot::~MessageHandlerSnapshot()
+{
+    for (unsigned int i = 0; i < m_size; i++) {
+	while (m_buckets[i]) {
+	    MessageHandlerVector* v = m_buckets[i];
+	    m_buckets[i] = v->m_next;
+	    delete v;
+	}
+    }
+    delete[] m_buckets;
+}
+
+// Buckets match the ones of the HashList the snapshot was built from
+const MessageHandlerVector& MessageHandlerSnapshot::find(const String& name) const
+{
+    unsigned int hash = name.hash();
+    for (const MessageHandlerVector* v = m_buckets[hash % m_size]; v; v = v->m_next) {
+	if ((v->m_name.hash() == hash) && (v->m_name == name))
+	    return *v;
+    }
+    return m_broadcast;
+}
+
+
 MessageDispatcher::MessageDispatcher(const char* trackParam)
     : Mutex(false,"MessageDispatcher"),
+      m_index(101),
+      m_queues(0), m_queueCount(1), m_queueNext(0), m_queued(0),
       m_hookMutex(false,"PostHooks"),
-      m_msgAppend(&m_messages), m_hookAppend(&m_hooks),
-      m_trackParam(trackParam), m_changes(0), m_warnTime(0),
+      m_hookAppend(&m_hooks),
+      m_trackParam(trackParam), m_snapshot(0), m_epoch(0), m_warnTime(0),
       m_enqueueCount(0), m_dequeueCount(0), m_dispatchCount(0),
       m_queuedMax(0), m_msgAvgAge(0),
       m_hookCount(0), m_hookHole(false)
 {
     XDebug(DebugInfo,"MessageDispatcher::MessageDispatcher('%s') [%p]",trackParam,this);
+    m_readers[0] = m_readers[1] = 0;
+    m_snapshot = new MessageHandlerSnapshot(m_index,m_broadcast);
+    m_queues = new MessageDispatchQueue[MAX_QUEUES];
 }
 
 MessageDispatcher::~MessageDispatcher()
@@ -314,7 +527,68 @@ MessageDispatcher::~MessageDispatcher()
     XDebug(DebugInfo,"MessageDispatcher::~MessageDispatcher() [%p]",this);
     lock();
     clear();
+    TelEngine::destruct(m_snapshot);
     unlock();
+    for (unsigned int i = 0; i < MAX_QUEUES; i++)
+	m_queues[i].m_messages.clear();
+    delete[] m_queues;
+}
+
+void MessageDispatcher::clear()
+{
+    m_index.clear();
+    m_broadcast.clear();
+    publish();
+    m_handlers.clear();
+    m_hookAppend = &m_hooks;
+    m_hooks.clear();
+}
+
+// Enter the short read section that protects taking a snapshot reference
+//  or marking a handler unsafe, returns the reader slot to leave
+int MessageDispatcher::readEnter()
+{
+    for (;;) {
+	int slot = atomicAdd(m_epoch,0) & 1;
+	atomicAdd(m_readers[slot],1);
+	if ((atomicAdd(m_epoch,0) & 1) == slot)
+	    return slot;
+	// a writer switched epochs meanwhile, retry in the new one
+	atomicAdd(m_readers[slot],-1);
+    }
+}
+
+void MessageDispatcher::readLeave(int slot)
+{
+    atomicAdd(m_readers[slot],-1);
+}
+
+// Wait until all readers that may have seen the previous snapshot left, must be called locked
+void MessageDispatcher::readSync()
+{
+    int slot = (atomicAdd(m_epoch,1) - 1) & 1;
+    while (atomicAdd(m_readers[slot],0) > 0)
+	Thread::yield();
+}
+
+// Retrieve a referenced copy of the current snapshot
+MessageHandlerSnapshot* MessageDispatcher::getSnapshot()
+{
+    int slot = readEnter();
+    MessageHandlerSnapshot* snap = m_snapshot;
+    snap->ref();
+    readLeave(slot);
+    return snap;
+}
+
+// Replace the current snapshot with one built from the index, must be called locked
+void MessageDispatcher::publish()
+{
+    MessageHandlerSnapshot* old = m_snapshot;
+    m_snapshot = new MessageHandlerSnapshot(m_index,m_broadcast);
+    readSync();
+    // dispatchers still holding the old snapshot keep it alive
+    TelEngine::destruct(old);
 }
 
 bool MessageDispatcher::install(MessageHandler* handler)
@@ -323,35 +597,35 @@ bool MessageDispatcher::install(MessageHandler* handler)
     if (!handler)
 	return false;
     Lock lock(this);
-    ObjList *l = m_handlers.find(handler);
-    if (l)
+    if (m_handlers.find(handler))
 	return false;
-    unsigned p = handler->priority();
-    int pos = 0;
-    for (l=&m_handlers; l; l=l->next(),pos++) {
-	MessageHandler *h = static_cast<MessageHandler *>(l->get());
-	if (!h)
-	    continue;
-	if (h->priority() < p)
-	    continue;
-	if (h->priority() > p)
-	    break;
-	// at the same priority we sort them in pointer address order
-	if (h > handler)
-	    break;
-    }
-    m_changes++;
-    if (l) {
-	XDebug(DebugAll,"Inserting handler [%p] on place #%d",handler,pos);
-	l->insert(handler);
+    insertHandler(m_handlers,handler,true);
+    if (handler->null()) {
+	// broadcast handlers are merged in the list of every message name
+	insertHandler(m_broadcast,handler,false);
+	for (unsigned int i = 0; i < m_index.length(); i++) {
+	    for (ObjList* l = m_index.getList(i); l; l = l->next()) {
+		MessageHandlerList* hl = static_cast<MessageHandlerList*>(l->get());
+		if (hl)
+		    insertHandler(hl->m_list,handler,false);
+	    }
+	}
+	Debug(DebugInfo,"Registered broadcast message handler %p",handler);
     }
     else {
-	XDebug(DebugAll,"Appending handler [%p] on place #%d",handler,pos);
-	m_handlers.append(handler);
+	MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_index[*handler]);
+	if (!hl) {
+	    XDebug(DebugAll,"Creating handler list for '%s'",handler->c_str());
+	    hl = new MessageHandlerList(*handler);
+	    for (ObjList* l = m_broadcast.skipNull(); l; l = l->skipNext())
+		hl->m_list.append(l->get())->setDelete(false);
+	    m_index.append(hl);
+	}
+	hl->m_named++;
+	insertHandler(hl->m_list,handler,false);
     }
     handler->m_dispatcher = this;
-    if (handler->null())
-	Debug(DebugInfo,"Registered broadcast message handler %p",handler);
+    publish();
     return true;
 }
 
@@ -361,8 +635,27 @@ bool MessageDispatcher::uninstall(MessageHandler* handler)
     lock();
     handler = static_cast<MessageHandler *>(m_handlers.remove(handler,false));
     if (handler) {
-	m_changes++;
-	if (handler->m_unsafe > 0) {
+	if (handler->null()) {
+	    m_broadcast.remove(handler,false);
+	    for (unsigned int i = 0; i < m_index.length(); i++) {
+		for (ObjList* l = m_index.getList(i); l; l = l->next()) {
+		    MessageHandlerList* hl = static_cast<MessageHandlerList*>(l->get());
+		    if (hl)
+			hl->m_list.remove(handler,false);
+		}
+	    }
+	}
+	else {
+	    MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_index[*handler]);
+	    if (hl) {
+		hl->m_list.remove(handler,false);
+		if (!--hl->m_named)
+		    m_index.remove(hl,true,true);
+	    }
+	}
+	// after publishing no dispatcher can mark the handler unsafe anymore
+	publish();
+	if (atomicAdd(handler->m_unsafe,0) > 0) {
 	    DDebug(DebugNote,"Waiting for unsafe MessageHandler %p '%s'",
 		handler,handler->c_str());
 	    // wait until handler is again safe to destroy
@@ -370,7 +663,7 @@ bool MessageDispatcher::uninstall(MessageHandler* handler)
 		unlock();
 		Thread::yield();
 		lock();
-	    } while (handler->m_unsafe > 0);
+	    } while (atomicAdd(handler->m_unsafe,0) > 0);
 	}
 	if (handler->m_unsafe != 0)
 	    Debug(DebugFail,"MessageHandler %p has unsafe=%d",handler,handler->m_unsafe);
@@ -391,83 +684,78 @@ bool MessageDispatcher::dispatch(Message& msg)
     bool retv = false;
     bool counting = getObjCounting();
     NamedCounter* saved = Thread::getCurrentObjCounter(counting);
-    ObjList *l = &m_handlers;
-    Lock mylock(this);
-    m_dispatchCount++;
-    for (; l; l=l->next()) {
-	MessageHandler *h = static_cast<MessageHandler*>(l->get());
-	if (h && (h->null() || *h == msg)) {
-	    if (h->filter()) {
-		if (h->filterRegexp()) {
-		    if (!h->filterRegexp()->matches(msg.getValue(h->filter()->name())))
-			continue;
-		}
-		else if (*(h->filter()) != msg[h->filter()->name()])
-		    continue;
-	    }
-	    if (counting)
-		Thread::setCurrentObjCounter(h->objectsCounter());
-
-	    unsigned int c = m_changes;
-	    unsigned int p = h->priority();
-	    if (trackParam() && h->trackName()) {
-		NamedString* tracked = msg.getParam(trackParam());
-		if (tracked)
-		    tracked->append(h->trackName(),",");
-		else
-		    msg.addParam(trackParam(),h->trackName());
-	    }
-	    // mark handler as unsafe to destroy / uninstall
-	    h->m_unsafe++;
-	    mylock.drop();
-
-	    u_int64_t tm = m_warnTime ? Time::now() : 0;
-
-	    retv = h->receivedInternal(msg) || retv;
-
-	    if (tm) {
-		tm = Time::now() - tm;
-		if (tm > m_warnTime) {
-		    mylock.acquire(this);
-		    const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
-		    Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
-			msg.c_str(),&msg,h,
-			(name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
-		}
-	    }
-
-	    if (retv && !msg.broadcast())
-		break;
-	    mylock.acquire(this);
-	    if (c == m_changes)
-		continue;
+    atomicInc(m_dispatchCount);
+    MessageHandlerSnapshot* snap = getSnapshot();
+    // only handlers with a matching or null name are in the vector
+    const MessageHandlerVector* hv = &snap->find(msg);
+    for (unsigned int i = 0; i < hv->m_count; ) {
+	MessageHandler* h = hv->m_entries[i].handler;
+	unsigned int p = hv->m_entries[i].priority;
+	int slot = readEnter();
+	if (snap != m_snapshot) {
 	    // the handler list has changed - find again
+	    MessageHandlerSnapshot* tmp = m_snapshot;
+	    tmp->ref();
+	    readLeave(slot);
+	    snap->deref();
+	    snap = tmp;
 	    NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
 		msg.c_str(),&msg,p);
-	    ObjList* l2 = &m_handlers;
-	    for (l = l2; l; l=l->next()) {
-		MessageHandler *mh = static_cast<MessageHandler*>(l->get());
-		if (!mh)
-		    continue;
-		if (mh == h)
-		    // exact match - silently continue where we left
-		    break;
-
-		// gone past last handler priority - exit with last handler
-		if ((mh->priority() > p) || ((mh->priority() == p) && (mh > h))) {
-		    Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
-			msg.c_str(),&msg,h,p,mh,mh->priority());
-		    // l will advance in the outer for loop so use previous
-		    l = l2;
-		    break;
-		}
-		l2 = l;
+	    hv = &snap->find(msg);
+	    i = hv->locate(h,p);
+	    if ((i < hv->m_count) && (hv->m_entries[i].handler != h))
+		Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
+		    msg.c_str(),&msg,h,p,hv->m_entries[i].handler,hv->m_entries[i].priority);
+	    continue;
+	}
+	// mark handler as unsafe to destroy / uninstall
+	atomicAdd(h->m_unsafe,1);
+	readLeave(slot);
+	i++;
+	if (h->filter()) {
+	    bool skip = false;
+	    if (h->filterRegexp())
+		skip = !h->filterRegexp()->matches(msg.getValue(h->filter()->name()));
+	    else
+		skip = (*(h->filter()) != msg[h->filter()->name()]);
+	    if (skip) {
+		h->safeNowInternal();
+		continue;
 	    }
-	    if (!l)
-		break;
 	}
+	if (counting)
+	    Thread::setCurrentObjCounter(h->objectsCounter());
+
+	if (trackParam() && h->trackName()) {
+	    NamedString* tracked = msg.getParam(trackParam());
+	    if (tracked)
+		tracked->append(h->trackName(),",");
+	    else
+		msg.addParam(trackParam(),h->trackName());
+	}
+
+	u_int64_t tm = 0;
+	String name;
+	if (m_warnTime) {
+	    // handler may be gone after receivedInternal() returns
+	    name = h->trackName();
+	    tm = Time::now();
+	}
+
+	retv = h->receivedInternal(msg) || retv;
+
+	if (tm) {
+	    tm = Time::now() - tm;
+	    if (tm > m_warnTime)
+		Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
+		    msg.c_str(),&msg,h,
+		    (name ? " '" : ""),name.safe(),(name ? "'" : ""),tm);
+	}
+
+	if (retv && !msg.broadcast())
+	    break;
     }
-    mylock.drop();
+    snap->deref();
     if (counting)
 	Thread::setCurrentObjCounter(msg.getObjCounter());
     msg.dispatched(retv);
@@ -493,7 +781,7 @@ bool MessageDispatcher::dispatch(Message& msg)
     m_hookMutex.lock();
     if (m_hookHole && !m_hookCount) {
 	// compact the list, remove the holes
-	for (l = &m_hooks; l; l = l->next()) {
+	for (ObjList* l = &m_hooks; l; l = l->next()) {
 	    while (!l->get()) {
 		if (!l->next())
 		    break;
@@ -505,7 +793,7 @@ bool MessageDispatcher::dispatch(Message& msg)
 	m_hookHole = false;
     }
     m_hookCount++;
-    for (l = m_hooks.skipNull(); l; l = l->skipNext()) {
+    for (ObjList* l = m_hooks.skipNull(); l; l = l->skipNext()) {
 	RefPointer<MessagePostHook> ph = static_cast<MessagePostHook*>(l->get());
 	if (ph) {
 	    m_hookMutex.unlock();
@@ -526,46 +814,111 @@ bool MessageDispatcher::dispatch(Message& msg)
 
 bool MessageDispatcher::enqueue(Message* msg)
 {
-    Lock lock(this);
-    if (!msg || m_messages.find(msg))
+    if (!msg)
+	return false;
+    // refuse messages that are already waiting in a queue
+    if (atomicAdd(msg->m_queued,1) != 1) {
+	atomicAdd(msg->m_queued,-1);
 	return false;
-    m_msgAppend = m_msgAppend->append(msg);
-    u_int64_t count = (++m_enqueueCount) - m_dequeueCount;
-    if (m_queuedMax < count)
-	m_queuedMax = count;
+    }
+    atomicInc(m_enqueueCount);
+    atomicMax(m_queuedMax,(u_int64_t)atomicAdd(m_queued,1));
+    // distribute messages to queues in round robin order
+    MessageDispatchQueue& q = m_queues[(unsigned int)atomicAdd(m_queueNext,1) % m_queueCount];
+    q.lock();
+    q.m_append = q.m_append->append(msg);
+    q.m_count++;
+    q.unlock();
     return true;
 }
 
-bool MessageDispatcher::dequeueOne()
+bool MessageDispatcher::dequeueOne(unsigned int queue)
 {
-    lock();
-    if (m_messages.next() == m_msgAppend)
-	m_msgAppend = &m_messages;
-    Message* msg = static_cast<Message *>(m_messages.remove(false));
-    if (msg) {
-	m_dequeueCount++;
-	uint64_t age = Time::now() - msg->msgTime();
-	if (age < 60000000)
-	    m_msgAvgAge = (3 * m_msgAvgAge + age) >> 2;
+    Message* msg = 0;
+    unsigned int count = m_queueCount;
+    queue %= count;
+    // messages are FIFO in each queue, not across queues
+    // start with the preferred queue and steal from the longest other one if
+    //  it's empty or falls behind so no queue starves without its own worker
+    // lengths are read unlocked as hints, only the chosen queue is locked
+    while (!msg) {
+	MessageDispatchQueue* q = &m_queues[queue];
+	unsigned int own = q->m_count;
+	unsigned int len = own;
+	for (unsigned int i = 1; i < count; i++) {
+	    MessageDispatchQueue& o = m_queues[(queue + i) % count];
+	    if ((o.m_count > 2 * own) && (o.m_count > len)) {
+		q = &o;
+		len = o.m_count;
+	    }
+	}
+	// queues past the current count hold only leftovers after a reduction
+	for (unsigned int i = count; !len && (i < MAX_QUEUES); i++) {
+	    if (m_queues[i].m_count) {
+		q = &m_queues[i];
+		len = q->m_count;
+	    }
+	}
+	if (!len)
+	    return false;
+	// another worker may have emptied the queue meanwhile, look again
+	q->lock();
+	if (q->m_messages.next() == q->m_append)
+	    q->m_append = &q->m_messages;
+	msg = static_cast<Message *>(q->m_messages.remove(false));
+	if (msg) {
+	    q->m_count--;
+	    uint64_t age = Time::now() - msg->msgTime();
+	    if (age < 60000000) {
+		q->m_avgAge = (3 * q->m_avgAge + age) >> 2;
+		atomicAvg(m_msgAvgAge,age);
+	    }
+	}
+	q->unlock();
     }
-    unlock();
-    if (!msg)
-	return false;
+    atomicAdd(msg->m_queued,-1);
+    atomicAdd(m_queued,-1);
+    atomicInc(m_dequeueCount);
     dispatch(*msg);
     msg->destruct();
     return true;
 }
 
-void MessageDispatcher::dequeue()
+void MessageDispatcher::dequeue(unsigned int queue)
 {
-    while (dequeueOne())
+    while (dequeueOne(queue))
 	;
 }
 
+void MessageDispatcher::queues(unsigned int count)
+{
+    if (count < 1)
+	count = 1;
+    else if (count > MAX_QUEUES)
+	count = MAX_QUEUES;
+    m_queueCount = count;
+}
+
+unsigned int MessageDispatcher::maxQueues()
+{
+    return MAX_QUEUES;
+}
+
+bool MessageDispatcher::getQueueStats(unsigned int queue, unsigned int& depth, u_int64_t& age)
+{
+    if (queue >= MAX_QUEUES)
+	return false;
+    MessageDispatchQueue& q = m_queues[queue];
+    Lock lock(q);
+    depth = q.m_count;
+    age = q.m_avgAge;
+    return true;
+}
+
 unsigned int MessageDispatcher::messageCount()
 {
-    Lock lock(this);
-    return (unsigned int)(m_enqueueCount - m_dequeueCount);
+    int count = atomicAdd(m_queued,0);
+    return (count > 0) ? count : 0;
 }
 
 unsigned int MessageDispatcher::handlerCount()
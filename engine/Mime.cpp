@@ -50,8 +50,8 @@ MimeHeaderLine::MimeHeaderLine(const char* name, const String& value, char sep)
 	    ep = value.length();
 	int eq = value.find('=',sp+1);
 	if ((eq > 0) && (eq < ep)) {
-	    String pname(value.substr(sp+1,eq-sp-1));
-	    String pvalue(value.substr(eq+1,ep-eq-1));
+	    String pname(value.c_str()+sp+1,eq-sp-1);
+	    String pvalue(value.c_str()+eq+1,ep-eq-1);
 	    pname.trimBlanks();
 	    pvalue.trimBlanks();
 	    if (!pname.null()) {
@@ -60,7 +60,7 @@ MimeHeaderLine::MimeHeaderLine(const char* name, const String& value, char sep)
 	    }
 	}
 	else {
-	    String pname(value.substr(sp+1,ep-sp-1));
+	    String pname(value.c_str()+sp+1,ep-sp-1);
 	    pname.trimBlanks();
 	    if (!pname.null()) {
 		XDebug(DebugAll,"hdr param name='%s' (no value)",pname.c_str());
@@ -287,8 +287,8 @@ MimeAuthLine::MimeAuthLine(const char* name, const String& value)
 	    ep = value.length();
 	int eq = value.find('=',sp+1);
 	if ((eq > 0) && (eq < ep)) {
-	    String pname(value.substr(sp+1,eq-sp-1));
-	    String pvalue(value.substr(eq+1,ep-eq-1));
+	    String pname(value.c_str()+sp+1,eq-sp-1);
+	    String pvalue(value.c_str()+eq+1,ep-eq-1);
 	    pname.trimBlanks();
 	    pvalue.trimBlanks();
 	    if (!pname.null()) {
@@ -297,7 +297,7 @@ MimeAuthLine::MimeAuthLine(const char* name, const String& value)
 	    }
 	}
 	else {
-	    String pname(value.substr(sp+1,ep-sp-1));
+	    String pname(value.c_str()+sp+1,ep-sp-1);
 	    pname.trimBlanks();
 	    if (!pname.null()) {
 		XDebug(DebugAll,"auth param name='%s' (no value)",pname.c_str());
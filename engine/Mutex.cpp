@@ -79,7 +79,7 @@ private:
     HMUTEX m_mutex;
     int m_refcount;
     volatile unsigned int m_locked;
-    volatile unsigned int m_waiting;
+    volatile int m_waiting;
     bool m_recursive;
     const char* m_name;
     const char* m_owner;
@@ -104,7 +104,7 @@ public:
 private:
     HSEMAPHORE m_semaphore;
     int m_refcount;
-    volatile unsigned int m_waiting;
+    volatile int m_waiting;
     unsigned int m_maxcount;
     const char* m_name;
 };
@@ -184,13 +184,32 @@ void GlobalMutex::unlock()
 #endif
 }
 
+// Mutex and semaphore statistics are kept in atomic counters when possible
+//  so that creating, destroying and locking don't serialize on GlobalMutex
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+static inline int atomicAdd(volatile int& val, int add)
+    { return InterlockedExchangeAdd((LONG*)&val,add) + add; }
+#else
+static inline int atomicAdd(volatile int& val, int add)
+    { return __sync_add_and_fetch(&val,add); }
+#endif
+#else
+static inline int atomicAdd(volatile int& val, int add)
+{
+    GlobalMutex::lock();
+    int ret = (val += add);
+    GlobalMutex::unlock();
+    return ret;
+}
+#endif
+
 
 MutexPrivate::MutexPrivate(bool recursive, const char* name)
     : m_refcount(1), m_locked(0), m_waiting(0), m_recursive(recursive),
       m_name(name), m_owner(0)
 {
-    GlobalMutex::lock();
-    s_count++;
+    atomicAdd(s_count,1);
 #ifdef _WINDOWS
     // All mutexes are recursive in Windows
     m_mutex = ::CreateMutex(NULL,FALSE,NULL);
@@ -205,34 +224,31 @@ MutexPrivate::MutexPrivate(bool recursive, const char* name)
     else
 	::pthread_mutex_init(&m_mutex,0);
 #endif
-    GlobalMutex::unlock();
 }
 
 MutexPrivate::~MutexPrivate()
 {
     bool warn = false;
-    GlobalMutex::lock();
     if (m_locked) {
 	warn = true;
 	m_locked--;
 	if (s_safety)
-	    s_locks--;
+	    atomicAdd(s_locks,-1);
 #ifdef _WINDOWS
 	::ReleaseMutex(m_mutex);
 #else
 	::pthread_mutex_unlock(&m_mutex);
 #endif
     }
-    s_count--;
+    atomicAdd(s_count,-1);
 #ifdef _WINDOWS
     ::CloseHandle(m_mutex);
     m_mutex = 0;
 #else
     ::pthread_mutex_destroy(&m_mutex);
 #endif
-    GlobalMutex::unlock();
     if (m_locked || m_waiting)
-	Debug(DebugFail,"MutexPrivate '%s' owned by '%s' destroyed with %u locks, %u waiting [%p]",
+	Debug(DebugFail,"MutexPrivate '%s' owned by '%s' destroyed with %u locks, %d waiting [%p]",
 	    m_name,m_owner,m_locked,m_waiting,this);
     else if (warn)
 	Debug(DebugCrit,"MutexPrivate '%s' owned by '%s' unlocked in destructor [%p]",
@@ -248,15 +264,11 @@ bool MutexPrivate::lock(long maxwait)
 	warn = true;
     }
     bool safety = s_safety;
-    if (safety)
-	GlobalMutex::lock();
     Thread* thr = Thread::current();
     if (thr)
 	thr->m_locking = true;
-    if (safety) {
-	m_waiting++;
-	GlobalMutex::unlock();
-    }
+    if (safety)
+	atomicAdd(m_waiting,1);
 #ifdef _WINDOWS
     DWORD ms = 0;
     if (maxwait < 0)
@@ -297,15 +309,14 @@ bool MutexPrivate::lock(long maxwait)
 #endif // HAVE_TIMEDLOCK
     }
 #endif // _WINDOWS
-    if (safety) {
-	GlobalMutex::lock();
-	m_waiting--;
-    }
+    if (safety)
+	atomicAdd(m_waiting,-1);
     if (thr)
 	thr->m_locking = false;
     if (rval) {
+	// the mutex is held so its own members need no protection
 	if (safety)
-	    s_locks++;
+	    atomicAdd(s_locks,1);
 	m_locked++;
 	if (thr) {
 	    thr->m_locks++;
@@ -314,10 +325,8 @@ bool MutexPrivate::lock(long maxwait)
 	else
 	    m_owner = 0;
     }
-    if (safety)
-	GlobalMutex::unlock();
     if (warn && !rval)
-	Debug(DebugFail,"Thread '%s' could not lock mutex '%s' owned by '%s' waited by %u others for %lu usec!",
+	Debug(DebugFail,"Thread '%s' could not lock mutex '%s' owned by '%s' waited by %d others for %lu usec!",
 	    Thread::currentName(),m_name,m_owner,m_waiting,maxwait);
     return rval;
 }
@@ -327,8 +336,6 @@ bool MutexPrivate::unlock()
     bool ok = false;
     // Hope we don't hit a bug related to the debug mutex!
     bool safety = s_safety;
-    if (safety)
-	GlobalMutex::lock();
     if (m_locked) {
 	Thread* thr = Thread::current();
 	if (thr)
@@ -341,11 +348,11 @@ bool MutexPrivate::unlock()
 	    m_owner = 0;
 	}
 	if (safety) {
-	    int locks = --s_locks;
+	    int locks = atomicAdd(s_locks,-1);
 	    if (locks < 0) {
 		// this is very very bad - abort right now
 		abortOnBug(true);
-		s_locks = 0;
+		atomicAdd(s_locks,-locks);
 		Debug(DebugFail,"MutexPrivate::locks() is %d [%p]",locks,this);
 	    }
 	}
@@ -359,8 +366,6 @@ bool MutexPrivate::unlock()
     }
     else
 	Debug(DebugFail,"MutexPrivate::unlock called on unlocked '%s' [%p]",m_name,this);
-    if (safety)
-	GlobalMutex::unlock();
     return ok;
 }
 
@@ -372,29 +377,25 @@ SemaphorePrivate::SemaphorePrivate(unsigned int maxcount, const char* name,
 {
     if (initialCount > m_maxcount)
 	initialCount = m_maxcount;
-    GlobalMutex::lock();
-    s_count++;
+    atomicAdd(s_count,1);
 #ifdef _WINDOWS
     m_semaphore = ::CreateSemaphore(NULL,initialCount,maxcount,NULL);
 #else
     ::sem_init(&m_semaphore,0,initialCount);
 #endif
-    GlobalMutex::unlock();
 }
 
 SemaphorePrivate::~SemaphorePrivate()
 {
-    GlobalMutex::lock();
-    s_count--;
+    atomicAdd(s_count,-1);
 #ifdef _WINDOWS
     ::CloseHandle(m_semaphore);
     m_semaphore = 0;
 #else
     ::sem_destroy(&m_semaphore);
 #endif
-    GlobalMutex::unlock();
     if (m_waiting)
-	Debug(DebugFail,"SemaphorePrivate '%s' destroyed with %u locks [%p]",
+	Debug(DebugFail,"SemaphorePrivate '%s' destroyed with %d locks [%p]",
 	    m_name,m_waiting,this);
 }
 
@@ -407,15 +408,12 @@ bool SemaphorePrivate::lock(long maxwait)
 	warn = true;
     }
     bool safety = s_safety;
-    if (safety)
-	GlobalMutex::lock();
     Thread* thr = Thread::current();
     if (thr)
 	thr->m_locking = true;
     if (safety) {
-	s_locks++;
-	m_waiting++;
-	GlobalMutex::unlock();
+	atomicAdd(s_locks,1);
+	atomicAdd(m_waiting,1);
     }
 #ifdef _WINDOWS
     DWORD ms = 0;
@@ -458,22 +456,19 @@ bool SemaphorePrivate::lock(long maxwait)
     }
 #endif // _WINDOWS
     if (safety) {
-	GlobalMutex::lock();
-	int locks = --s_locks;
+	int locks = atomicAdd(s_locks,-1);
 	if (locks < 0) {
 	    // this is very very bad - abort right now
 	    abortOnBug(true);
-	    s_locks = 0;
+	    atomicAdd(s_locks,-locks);
 	    Debug(DebugFail,"SemaphorePrivate::locks() is %d [%p]",locks,this);
 	}
-	m_waiting--;
+	atomicAdd(m_waiting,-1);
     }
     if (thr)
 	thr->m_locking = false;
-    if (safety)
-	GlobalMutex::unlock();
     if (warn && !rval)
-	Debug(DebugFail,"Thread '%s' could not lock semaphore '%s' waited by %u others for %lu usec!",
+	Debug(DebugFail,"Thread '%s' could not lock semaphore '%s' waited by %d others for %lu usec!",
 	    Thread::currentName(),m_name,m_waiting,maxwait);
     return rval;
 }
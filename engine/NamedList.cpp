@@ -19,9 +19,155 @@
 
 #include "yateclass.h"
 
+namespace TelEngine {
+
+// Open addressing hash table of parameter names, holds the list node of the
+//  first parameter of each name so it can be replaced without a list walk
+class NamedListIndex
+{
+public:
+    NamedListIndex(unsigned int count);
+    inline ~NamedListIndex()
+	{ delete[] m_entries; }
+    inline NamedString* find(const String& name) const
+	{ ObjList* n = findNode(name); return n ? static_cast<NamedString*>(n->get()) : 0; }
+    ObjList* findNode(const String& name) const;
+    bool add(ObjList* node);
+    bool remove(const ObjList* node);
+    void moved(const ObjList* from, ObjList* to);
+    ObjList* m_tail;
+    bool m_stale;
+    bool m_dups;
+private:
+    struct Entry {
+	unsigned int hash;
+	ObjList* node;
+    };
+    static inline const String& nodeName(const ObjList* node)
+	{ return static_cast<const NamedString*>(node->get())->name(); }
+    void insert(unsigned int hash, ObjList* node);
+    Entry* m_entries;
+    unsigned int m_mask;
+    unsigned int m_used;
+};
+
+};
+
 using namespace TelEngine;
 
 static const NamedList s_empty("");
+static unsigned int s_indexThreshold = 16;
+// 64 bit so layout versions never wrap around in practice
+static u_int64_t s_version = 0;
+
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+static inline u_int64_t nextVersion()
+    { return (u_int64_t)InterlockedIncrement64((LONGLONG*)&s_version); }
+#else
+static inline u_int64_t nextVersion()
+    { return __sync_add_and_fetch(&s_version,1); }
+#endif
+#else
+static Mutex s_versionMutex(false,"NamedListVersion");
+static inline u_int64_t nextVersion()
+    { Lock lock(s_versionMutex); return ++s_version; }
+#endif
+
+NamedListIndex::NamedListIndex(unsigned int count)
+    : m_tail(0), m_stale(false), m_dups(false),
+      m_entries(0), m_mask(31), m_used(0)
+{
+    // keep the table at most half full
+    while (m_mask < 2 * count)
+	m_mask = (m_mask << 1) | 1;
+    m_entries = new Entry[m_mask + 1];
+    for (unsigned int i = 0; i <= m_mask; i++)
+	m_entries[i].node = 0;
+}
+
+ObjList* NamedListIndex::findNode(const String& name) const
+{
+    unsigned int hash = name.hash();
+    for (unsigned int i = hash & m_mask; m_entries[i].node; i = (i + 1) & m_mask) {
+	if ((m_entries[i].hash == hash) && (nodeName(m_entries[i].node) == name))
+	    return m_entries[i].node;
+    }
+    return 0;
+}
+
+void NamedListIndex::insert(unsigned int hash, ObjList* node)
+{
+    unsigned int i = hash & m_mask;
+    while (m_entries[i].node)
+	i = (i + 1) & m_mask;
+    m_entries[i].hash = hash;
+    m_entries[i].node = node;
+    m_used++;
+}
+
+// Add the parameter held by a node unless one with the same name is already indexed
+bool NamedListIndex::add(ObjList* node)
+{
+    const String& name = nodeName(node);
+    if (findNode(name)) {
+	m_dups = true;
+	return false;
+    }
+    if (2 * (m_used + 1) > m_mask) {
+	Entry* old = m_entries;
+	unsigned int size = m_mask + 1;
+	m_mask = (m_mask << 1) | 1;
+	m_entries = new Entry[m_mask + 1];
+	for (unsigned int i = 0; i <= m_mask; i++)
+	    m_entries[i].node = 0;
+	m_used = 0;
+	for (unsigned int i = 0; i < size; i++) {
+	    if (old[i].node)
+		insert(old[i].hash,old[i].node);
+	}
+	delete[] old;
+    }
+    insert(name.hash(),node);
+    return true;
+}
+
+// Remove the entry of a node, must be called while the node still holds its parameter
+bool NamedListIndex::remove(const ObjList* node)
+{
+    unsigned int i = nodeName(node).hash() & m_mask;
+    for (; m_entries[i].node != node; i = (i + 1) & m_mask) {
+	if (!m_entries[i].node)
+	    return false;
+    }
+    // shift back following entries so probe sequences stay unbroken
+    unsigned int j = i;
+    for (;;) {
+	j = (j + 1) & m_mask;
+	if (!m_entries[j].node)
+	    break;
+	unsigned int k = m_entries[j].hash & m_mask;
+	if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+	    continue;
+	m_entries[i] = m_entries[j];
+	i = j;
+    }
+    m_entries[i].node = 0;
+    m_used--;
+    return true;
+}
+
+// A parameter is about to move to another node by removing the one before it
+void NamedListIndex::moved(const ObjList* from, ObjList* to)
+{
+    for (unsigned int i = nodeName(from).hash() & m_mask; m_entries[i].node; i = (i + 1) & m_mask) {
+	if (m_entries[i].node == from) {
+	    m_entries[i].node = to;
+	    return;
+	}
+    }
+}
+
 
 const NamedList& NamedList::empty()
 {
@@ -29,26 +175,34 @@ const NamedList& NamedList::empty()
 }
 
 NamedList::NamedList(const char* name)
-    : String(name)
+    : String(name),
+      m_index(0), m_added(0), m_version(0), m_noIndex(false)
 {
 }
 
 NamedList::NamedList(const NamedList& original)
-    : String(original)
+    : String(original),
+      m_index(0), m_added(0), m_version(0), m_noIndex(false)
 {
     ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* p = static_cast<const NamedString*>(l->get());
-	dest = dest->append(new NamedString(p->name(),*p));
+	dest = appendParam(new NamedString(p->name(),*p),dest);
     }
 }
 
 NamedList::NamedList(const char* name, const NamedList& original, const String& prefix)
-    : String(name)
+    : String(name),
+      m_index(0), m_added(0), m_version(0), m_noIndex(false)
 {
     copySubParams(original,prefix);
 }
 
+NamedList::~NamedList()
+{
+    delete m_index;
+}
+
 NamedList& NamedList::operator=(const NamedList& value)
 {
     String::operator=(value);
@@ -63,26 +217,193 @@ void* NamedList::getObject(const String& name) const
     return String::getObject(name);
 }
 
+void NamedList::clearParams()
+{
+    delete m_index;
+    m_index = 0;
+    m_added = 0;
+    m_version = 0;
+    m_params.clear();
+}
+
+void NamedList::indexParams(bool enable)
+{
+    m_noIndex = !enable;
+    if (enable)
+	indexBuild();
+    else {
+	delete m_index;
+	m_index = 0;
+	m_added = m_params.count();
+    }
+}
+
+bool NamedList::indexed() const
+{
+    return m_index && !m_index->m_stale;
+}
+
+void NamedList::indexThreshold(unsigned int count)
+{
+    s_indexThreshold = count;
+}
+
+unsigned int NamedList::indexThreshold()
+{
+    return s_indexThreshold;
+}
+
+ObjList* NamedList::paramList()
+{
+    // the caller may change the list behind our back
+    if (m_index)
+	m_index->m_stale = true;
+    m_version = 0;
+    return &m_params;
+}
+
+u_int64_t NamedList::version() const
+{
+    // assigned lazily so only lists someone watches consume numbers
+    while (!m_version)
+	m_version = nextVersion();
+    return m_version;
+}
+
+// (Re)build the parameter index from the list
+void NamedList::indexBuild()
+{
+    delete m_index;
+    m_index = new NamedListIndex(m_params.count());
+    for (ObjList* l = m_params.skipNull(); l; l = l->skipNext())
+	m_index->add(l);
+    m_index->m_tail = m_params.last();
+}
+
+// Rebuild an index invalidated by direct list changes, call before any change
+void NamedList::indexCheck()
+{
+    if (m_index && m_index->m_stale)
+	indexBuild();
+}
+
+// Account for a parameter added to a list without index
+void NamedList::indexAdd()
+{
+    if (m_index || m_noIndex || !s_indexThreshold)
+	return;
+    if (++m_added >= s_indexThreshold)
+	indexBuild();
+}
+
+// Append a parameter at the end of the list, searching for end from a known node
+ObjList* NamedList::appendParam(NamedString* param, ObjList* from)
+{
+    m_version = 0;
+    if (m_index) {
+	m_index->m_tail = m_index->m_tail->append(param);
+	m_index->add(m_index->m_tail);
+	return m_index->m_tail;
+    }
+    ObjList* node = (from ? from : &m_params)->append(param);
+    indexAdd();
+    return node;
+}
+
+// Remove the parameter held by a list node, keeps the index consistent
+void NamedList::removeParam(ObjList* node, bool delParam)
+{
+    NamedString* param = static_cast<NamedString*>(node->get());
+    // honor lists holding parameters they don't own
+    if (!node->autoDelete())
+	delParam = false;
+    m_version = 0;
+    if (!m_index) {
+	node->remove(false);
+	if (param && m_added)
+	    m_added--;
+	if (param && delParam)
+	    param->destruct();
+	return;
+    }
+    bool indexed = param && m_index->remove(node);
+    // removing a node moves the parameter of the next node into it
+    ObjList* next = node->next();
+    if (next) {
+	if (next == m_index->m_tail)
+	    m_index->m_tail = node;
+	if (next->get())
+	    m_index->moved(next,node);
+    }
+    node->remove(false);
+    if (!param)
+	return;
+    if (indexed && m_index->m_dups) {
+	// a parameter with the same name may follow, it becomes the indexed one
+	for (ObjList* l = node->skipNull(); l; l = l->skipNext()) {
+	    if (static_cast<NamedString*>(l->get())->name() == param->name()) {
+		m_index->add(l);
+		break;
+	    }
+	}
+    }
+    if (delParam)
+	param->destruct();
+}
+
 NamedList& NamedList::addParam(NamedString* param)
 {
     XDebug(DebugInfo,"NamedList::addParam(%p) [\"%s\",\"%s\"]",
         param,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
-    if (param)
-	m_params.append(param);
+    if (param) {
+	indexCheck();
+	appendParam(param);
+    }
     return *this;
 }
 
 NamedList& NamedList::addParam(const char* name, const char* value, bool emptyOK)
 {
     XDebug(DebugInfo,"NamedList::addParam(\"%s\",\"%s\",%s)",name,value,String::boolText(emptyOK));
-    if (emptyOK || !TelEngine::null(value))
-	m_params.append(new NamedString(name, value));
+    if (emptyOK || !TelEngine::null(value)) {
+	indexCheck();
+	appendParam(new NamedString(name, value));
+    }
+    return *this;
+}
+
+NamedList& NamedList::setParam(NamedString* param)
+{
+    if (!param)
+	return *this;
+    indexCheck();
+    m_version = 0;
+    if (m_index) {
+	ObjList* o = m_index->findNode(param->name());
+	if (o)
+	    o->set(param);
+	else
+	    appendParam(param);
+    }
+    else {
+	m_params.setUnique(param);
+	indexAdd();
+    }
     return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, const char* value)
 {
     XDebug(DebugInfo,"NamedList::setParam(\"%s\",\"%s\")",name.c_str(),value);
+    indexCheck();
+    if (m_index) {
+	NamedString* s = m_index->find(name);
+	if (s)
+	    *s = value;
+	else
+	    appendParam(new NamedString(name,value));
+	return *this;
+    }
     ObjList *p = m_params.skipNull();
     while (p) {
         NamedString *s = static_cast<NamedString*>(p->get());
@@ -96,10 +417,7 @@ NamedList& NamedList::setParam(const String& name, const char* value)
 	else
 	    break;
     }
-    if (p)
-	p->append(new NamedString(name,value));
-    else
-	m_params.append(new NamedString(name,value));
+    appendParam(new NamedString(name,value),p);
     return *this;
 }
 
@@ -107,6 +425,17 @@ NamedList& NamedList::clearParam(const String& name, char childSep)
 {
     XDebug(DebugInfo,"NamedList::clearParam(\"%s\",'%.1s')",
 	name.c_str(),&childSep);
+    indexCheck();
+    if (m_index && !childSep) {
+	ObjList* o = m_index->findNode(name);
+	if (!o)
+	    return *this;
+	if (!m_index->m_dups) {
+	    // a single parameter with this name, no need to check the others
+	    removeParam(o,true);
+	    return *this;
+	}
+    }
     String tmp;
     if (childSep)
 	tmp << name << childSep;
@@ -114,7 +443,7 @@ NamedList& NamedList::clearParam(const String& name, char childSep)
     while (p) {
         NamedString *s = static_cast<NamedString *>(p->get());
         if (s && ((s->name() == name) || s->name().startsWith(tmp)))
-            p->remove();
+            removeParam(p,true);
 	else
 	    p = p->next();
     }
@@ -126,9 +455,10 @@ NamedList& NamedList::clearParam(NamedString* param, bool delParam)
 {
     if (!param)
 	return *this;
+    indexCheck();
     ObjList* o = m_params.find(param);
     if (o)
-	o->remove(delParam);
+	removeParam(o,delParam);
     XDebug(DebugInfo,"NamedList::clearParam(%p) found=%p",param,o);
     return *this;
 }
@@ -149,7 +479,7 @@ NamedList& NamedList::copyParam(const NamedList& original, const String& name, c
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* s = static_cast<const NamedString*>(l->get());
         if ((s->name() == name) || s->name().startsWith(tmp))
-	    dest = dest->append(new NamedString(s->name(),*s));
+	    dest = appendParam(new NamedString(s->name(),*s),dest);
     }
     return *this;
 }
@@ -199,6 +529,7 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 	&original,prefix.c_str(),String::boolText(skipPrefix),
 	String::boolText(replace),this);
     if (prefix) {
+	indexCheck();
 	unsigned int offs = skipPrefix ? prefix.length() : 0;
 	ObjList* dest = &m_params;
 	for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
@@ -208,7 +539,7 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 		if (!*name)
 		    continue;
 		if (!replace)
-		    dest = dest->append(new NamedString(name,*s));
+		    dest = appendParam(new NamedString(name,*s),dest);
 		else if (offs)
 		    setParam(name,*s);
 		else
@@ -272,6 +603,8 @@ int NamedList::getIndex(const String& name) const
 NamedString* NamedList::getParam(const String& name) const
 {
     XDebug(DebugInfo,"NamedList::getParam(\"%s\")",name.c_str());
+    if (m_index && !m_index->m_stale)
+	return m_index->find(name);
     const ObjList *p = m_params.skipNull();
     for (; p; p=p->skipNext()) {
         NamedString *s = static_cast<NamedString *>(p->get());
@@ -39,6 +39,12 @@
 #endif
 #endif
 
+#ifdef HAVE_MMSG
+#include <sys/socket.h>
+// Maximum number of datagrams in one recvmmsg() or sendmmsg() call
+#define MAX_MMSG 64
+#endif
+
 #undef HAS_AF_UNIX
 
 #ifndef _WINDOWS
@@ -1941,6 +1947,96 @@ int Socket::recvFrom(void* buffer, int length, SocketAddr& addr, int flags)
     return res;
 }
 
+int Socket::recvFromMulti(void* buffer, int size, int count, int* lengths, SocketAddr* addrs, int flags)
+{
+    if (!(buffer && lengths && addrs) || (size <= 0) || (count <= 0)) {
+	m_error = EINVAL;
+	return socketError();
+    }
+#ifdef HAVE_MMSG
+    if (count > 1) {
+	if (count > MAX_MMSG)
+	    count = MAX_MMSG;
+	struct mmsghdr msgs[MAX_MMSG];
+	struct iovec iovs[MAX_MMSG];
+	struct sockaddr_storage names[MAX_MMSG];
+	::memset(msgs,0,count * sizeof(struct mmsghdr));
+	for (int i = 0; i < count; i++) {
+	    iovs[i].iov_base = (char*)buffer + i * size;
+	    iovs[i].iov_len = size;
+	    msgs[i].msg_hdr.msg_name = &names[i];
+	    msgs[i].msg_hdr.msg_namelen = sizeof(names[i]);
+	    msgs[i].msg_hdr.msg_iov = &iovs[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int res = ::recvmmsg(m_handle,msgs,count,flags,0);
+	if (!checkError(res,true))
+	    return socketError();
+	int n = 0;
+	for (int i = 0; i < res; i++) {
+	    char* buf = (char*)iovs[i].iov_base;
+	    int len = msgs[i].msg_len;
+	    struct sockaddr* addr = (struct sockaddr*)&names[i];
+	    socklen_t adrlen = msgs[i].msg_hdr.msg_namelen;
+	    if (applyFilters(buf,len,flags,addr,adrlen))
+		continue;
+	    // keep the datagrams not claimed by filters in the first slots
+	    if (n != i)
+		::memmove((char*)buffer + n * size,buf,len);
+	    lengths[n] = len;
+	    addrs[n].assign(addr,adrlen);
+	    n++;
+	}
+	return n;
+    }
+#endif
+    int res = recvFrom(buffer,size,addrs[0],flags);
+    if (res == socketError())
+	return res;
+    lengths[0] = res;
+    return 1;
+}
+
+int Socket::sendToMulti(const void* const* buffers, const int* lengths, const SocketAddr* const* addrs,
+    int count, int flags)
+{
+    if (!(buffers && lengths && addrs) || (count <= 0)) {
+	m_error = EINVAL;
+	return socketError();
+    }
+    int sent = 0;
+#ifdef HAVE_MMSG
+    while (count - sent > 1) {
+	int n = count - sent;
+	if (n > MAX_MMSG)
+	    n = MAX_MMSG;
+	struct mmsghdr msgs[MAX_MMSG];
+	struct iovec iovs[MAX_MMSG];
+	::memset(msgs,0,n * sizeof(struct mmsghdr));
+	for (int i = 0; i < n; i++) {
+	    iovs[i].iov_base = const_cast<void*>(buffers[sent + i]);
+	    iovs[i].iov_len = lengths[sent + i];
+	    msgs[i].msg_hdr.msg_name = addrs[sent + i]->address();
+	    msgs[i].msg_hdr.msg_namelen = addrs[sent + i]->length();
+	    msgs[i].msg_hdr.msg_iov = &iovs[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int res = ::sendmmsg(m_handle,msgs,n,flags);
+	if (!checkError(res,true))
+	    return sent ? sent : socketError();
+	sent += res;
+	// a short count means the next datagram would fail or block
+	if (res < n)
+	    return sent;
+    }
+#endif
+    for (; sent < count; sent++) {
+	if (sendTo(buffers[sent],lengths[sent],*addrs[sent],flags) == socketError())
+	    return sent ? sent : socketError();
+    }
+    return sent;
+}
+
 int Socket::recv(void* buffer, int length, int flags)
 {
     if (!buffer)
@@ -107,7 +107,7 @@ const XmlEscape XmlSaxParser::s_escape[] = {
 
 XmlSaxParser::XmlSaxParser(const char* name)
     : m_offset(0), m_row(1), m_column(1), m_error(NoError),
-    m_parsed(""), m_unparsed(None)
+    m_bufPos(0), m_checked(0), m_parsed(""), m_unparsed(None)
 {
     debugName(name);
 }
@@ -129,15 +129,52 @@ bool XmlSaxParser::parse(const char* text)
     XDebug(this,DebugAll,"XmlSaxParser::parse(%s) unparsed=%u%s buf=%s [%p]",
 	text,unparsed(),tmp.safe(),m_buf.safe(),this);
 #endif
-    char car;
     setError(NoError);
-    String auxData;
     m_buf << text;
-    if (m_buf.lenUtf8() == -1) {
+    if (!checkUtf8()) {
 	//FIXME this should not be here in case we have a different encoding
 	DDebug(this,DebugNote,"Request to parse invalid utf-8 data [%p]",this);
 	return setError(Incomplete);
     }
+    bool ok = parseBuffer();
+    // Drop consumed data once, the tokens only advanced the buffer position
+    if (m_bufPos) {
+	if (m_bufPos < m_buf.length())
+	    m_buf = m_buf.substr(m_bufPos);
+	else
+	    m_buf.clear();
+	m_bufPos = 0;
+    }
+    m_checked = m_buf.length();
+    return ok;
+}
+
+// Check if data appended to the buffer since last parse is valid UTF-8
+bool XmlSaxParser::checkUtf8()
+{
+    unsigned int end = m_buf.length();
+    if (m_checked >= end)
+	return true;
+    // A character split between chunks can't be checked until completed
+    for (unsigned int i = 1; (i <= 3) && (i <= end - m_checked); i++) {
+	unsigned char c = (unsigned char)m_buf.at(end - i);
+	if ((c & 0xc0) == 0x80)
+	    continue;
+	if ((c >= 0xc0) && (i < ((c >= 0xf0) ? 4u : ((c >= 0xe0) ? 3u : 2u))))
+	    return false;
+	break;
+    }
+    if (String::lenUtf8(m_buf.c_str() + m_checked) < 0)
+	return false;
+    m_checked = end;
+    return true;
+}
+
+// Parse the unconsumed part of the buffer
+bool XmlSaxParser::parseBuffer()
+{
+    char car;
+    String auxData;
     if (unparsed()) {
 	if (unparsed() != Text) {
 	    if (!auxParse())
@@ -149,8 +186,8 @@ bool XmlSaxParser::parse(const char* text)
 	setUnparsed(None);
     }
     unsigned int len = 0;
-    while (m_buf.at(len) && !error()) {
-	car = m_buf.at(len);
+    while (bufAt(len) && !error()) {
+	car = bufAt(len);
 	if (car != '<' ) { // We have a new child check what it is
 	    if (car == '>' || !checkDataChar(car)) {
 		Debug(this,DebugNote,"XML text contains unescaped '%c' character [%p]",
@@ -161,51 +198,51 @@ bool XmlSaxParser::parse(const char* text)
 	    continue;
 	}
 	if (len > 0) {
-	    auxData << m_buf.substr(0,len);
+	    auxData.append(bufPtr(),len);
 	}
 	if (auxData.c_str()) {  // We have an end of tag or another child is riseing
 	    if (!processText(auxData))
 		return false;
-	    m_buf = m_buf.substr(len);
+	    consume(len);
 	    len = 0;
 	    auxData = "";
 	}
-	char auxCar = m_buf.at(1);
+	char auxCar = bufAt(1);
 	if (!auxCar)
 	    return setError(Incomplete);
 	if (auxCar == '?') {
-	    m_buf = m_buf.substr(2);
+	    consume(2);
 	    if (!parseInstruction())
 		return false;
 	    continue;
 	}
 	if (auxCar == '!') {
-	    m_buf = m_buf.substr(2);
+	    consume(2);
 	    if (!parseSpecial())
 		return false;
 	    continue;
 	}
 	if (auxCar == '/') {
-	    m_buf = m_buf.substr(2);
+	    consume(2);
 	    if (!parseEndTag())
 		return false;
 	    continue;
 	}
 	// If we are here mens that we have a element
 	// process an xml element
-	m_buf = m_buf.substr(1);
+	consume(1);
 	if (!parseElement())
 	    return false;
     }
     // Incomplete text
-    if ((unparsed() == None || unparsed() == Text) && (auxData || m_buf)) {
+    if ((unparsed() == None || unparsed() == Text) && (auxData || bufLength())) {
 	if (!auxData)
-	    m_parsed.assign(m_buf);
+	    m_parsed.assign(bufPtr());
 	else {
-	    auxData << m_buf;
+	    auxData << bufPtr();
 	    m_parsed.assign(auxData);
 	}
-	m_buf = "";
+	setBuffer(String::empty());
 	setUnparsed(Text);
 	return setError(Incomplete);
     }
@@ -213,7 +250,7 @@ bool XmlSaxParser::parse(const char* text)
 	DDebug(this,DebugNote,"Got error while parsing %s [%p]",getError(),this);
 	return false;
     }
-    m_buf = "";
+    setBuffer(String::empty());
     resetParsed();
     setUnparsed(None);
     return true;
@@ -271,22 +308,22 @@ bool XmlSaxParser::parseEndTag()
 	    setUnparsed(EndTag);
 	return false;
     }
-    if (!aux || m_buf.at(0) == '/') { // The end tag has attributes or contains / char at the end of name
+    if (!aux || bufAt(0) == '/') { // The end tag has attributes or contains / char at the end of name
 	setError(ReadingEndTag);
 	Debug(this,DebugNote,"Got bad end tag </%s/> [%p]",name->c_str(),this);
 	setUnparsed(EndTag);
-	m_buf = *name + m_buf;
+	setBuffer(*name + bufPtr());
 	return false;
     }
     resetError();
     endElement(*name);
     if (error()) {
 	setUnparsed(EndTag);
-	m_buf = *name + ">";
+	setBuffer(*name + ">");
 	TelEngine::destruct(name);
 	return false;
     }
-    m_buf = m_buf.substr(1);
+    consume(1);
     TelEngine::destruct(name);
     return true;
 }
@@ -294,9 +331,9 @@ bool XmlSaxParser::parseEndTag()
 // Parse an instruction form the main buffer
 bool XmlSaxParser::parseInstruction()
 {
-    XDebug(this,DebugAll,"XmlSaxParser::parseInstruction() buf len=%u [%p]",m_buf.length(),this);
+    XDebug(this,DebugAll,"XmlSaxParser::parseInstruction() buf len=%u [%p]",bufLength(),this);
     setUnparsed(Instruction);
-    if (!m_buf.c_str())
+    if (!bufLength())
 	return setError(Incomplete);
     // extract the name
     String name;
@@ -305,12 +342,12 @@ bool XmlSaxParser::parseInstruction()
     if (!m_parsed) {
 	bool nameComplete = false;
 	bool endDecl = false;
-	while (0 != (c = m_buf.at(len))) {
+	while (0 != (c = bufAt(len))) {
 	    nameComplete = blank(c);
 	    if (!nameComplete) {
 		// Check for instruction end: '?>'
 		if (c == '?') {
-		    char next = m_buf.at(len + 1);
+		    char next = bufAt(len + 1);
 		    if (!next)
 			return setError(Incomplete);
 		    if (next == '>') {
@@ -335,14 +372,14 @@ bool XmlSaxParser::parseInstruction()
 	    if (!endDecl)
 		return setError(Incomplete);
 	    // Remove instruction end from buffer
-	    m_buf = m_buf.substr(2);
+	    consume(2);
 	    Debug(this,DebugNote,"Instruction with empty name [%p]",this);
 	    return setError(InvalidElementName);
 	}
 	if (!nameComplete)
 	    return setError(Incomplete);
-	name = m_buf.substr(0,len);
-	m_buf = m_buf.substr(!endDecl ? len : len + 2);
+	name.assign(bufPtr(),len);
+	consume(!endDecl ? len : len + 2);
 	if (name == YSTRING("xml")) {
 	    if (!endDecl)
 		return parseDeclaration();
@@ -365,7 +402,7 @@ bool XmlSaxParser::parseInstruction()
     // Retrieve instruction content
     skipBlanks();
     len = 0;
-    while (0 != (c = m_buf.at(len))) {
+    while (0 != (c = bufAt(len))) {
 	if (c != '?') {
 	    if (c == 0x0c) {
 		setError(Unknown);
@@ -376,13 +413,13 @@ bool XmlSaxParser::parseInstruction()
 	    len++;
 	    continue;
 	}
-	char ch = m_buf.at(len + 1);
+	char ch = bufAt(len + 1);
 	if (!ch)
 	    break;
 	if (ch == '>') { // end of instruction
-	    NamedString inst(name,m_buf.substr(0,len));
+	    NamedString inst(name,String(bufPtr(),len));
 	    // Parsed instruction: remove instruction end from buffer and reset parsed
-	    m_buf = m_buf.substr(len + 2);
+	    consume(len + 2);
 	    resetParsed();
 	    resetError();
 	    setUnparsed(None);
@@ -399,9 +436,9 @@ bool XmlSaxParser::parseInstruction()
 // Parse a declaration form the main buffer
 bool XmlSaxParser::parseDeclaration()
 {
-    XDebug(this,DebugAll,"XmlSaxParser::parseDeclaration() buf len=%u [%p]",m_buf.length(),this);
+    XDebug(this,DebugAll,"XmlSaxParser::parseDeclaration() buf len=%u [%p]",bufLength(),this);
     setUnparsed(Declaration);
-    if (!m_buf.c_str())
+    if (!bufLength())
 	return setError(Incomplete);
     NamedList dc("xml");
     if (m_parsed.count()) {
@@ -411,8 +448,8 @@ bool XmlSaxParser::parseDeclaration()
     char c;
     skipBlanks();
     int len = 0;
-    while (m_buf.at(len)) {
-	c = m_buf.at(len);
+    while (bufAt(len)) {
+	c = bufAt(len);
 	if (c != '?') {
 	    skipBlanks();
 	    NamedString* s = getAttribute();
@@ -429,7 +466,7 @@ bool XmlSaxParser::parseDeclaration()
 		return setError(DeclarationParse);
 	    }
 	    dc.addParam(s);
-	    char ch = m_buf.at(len);
+	    char ch = bufAt(len);
 	    if (ch && !blank(ch) && ch != '?') {
 		Debug(this,DebugNote,"No blanks between attributes in declaration [%p]",this);
 		return setError(DeclarationParse);
@@ -437,15 +474,15 @@ bool XmlSaxParser::parseDeclaration()
 	    skipBlanks();
 	    continue;
 	}
-	if (!m_buf.at(++len))
+	if (!bufAt(++len))
 	    break;
-	char ch = m_buf.at(len);
+	char ch = bufAt(len);
 	if (ch == '>') { // end of declaration
 	    // Parsed declaration: remove declaration end from buffer and reset parsed
 	    resetError();
 	    resetParsed();
 	    setUnparsed(None);
-	    m_buf = m_buf.substr(len + 1);
+	    consume(len + 1);
 	    gotDeclaration(dc);
 	    return error() == NoError;
 	}
@@ -460,7 +497,7 @@ bool XmlSaxParser::parseDeclaration()
 // Parse a CData section form the main buffer
 bool XmlSaxParser::parseCData()
 {
-    if (!m_buf.c_str()) {
+    if (!bufLength()) {
 	setUnparsed(CData);
 	setError(Incomplete);
 	return false;
@@ -472,28 +509,27 @@ bool XmlSaxParser::parseCData()
     }
     char c;
     int len = 0;
-    while (m_buf.at(len)) {
-	c = m_buf.at(len);
+    while (bufAt(len)) {
+	c = bufAt(len);
 	if (c != ']') {
 	    len ++;
 	    continue;
 	}
-	if (m_buf.substr(++len,2) == "]>") { // End of CData section
-	    cdata += m_buf.substr(0,len - 1);
+	if ((bufAt(++len) == ']') && (bufAt(len + 1) == '>')) { // End of CData section
+	    cdata.append(bufPtr(),len - 1);
 	    resetError();
 	    gotCdata(cdata);
 	    resetParsed();
 	    if (error())
 		return false;
-	    m_buf = m_buf.substr(len + 2);
+	    consume(len + 2);
 	    return true;
 	}
     }
-    cdata += m_buf;
-    m_buf = "";
+    cdata += bufPtr();
     setUnparsed(CData);
     int length = cdata.length();
-    m_buf << cdata.substr(length - 2);
+    setBuffer(cdata.substr(length - 2));
     if (length > 1)
 	m_parsed.assign(cdata.substr(0,length - 2));
     setError(Incomplete);
@@ -503,34 +539,34 @@ bool XmlSaxParser::parseCData()
 // Helper method to classify the Xml objects starting with "<!" sequence
 bool XmlSaxParser::parseSpecial()
 {
-    if (m_buf.length() < 2) {
+    if (bufLength() < 2) {
 	setUnparsed(Special);
 	return setError(Incomplete);
     }
-    if (m_buf.startsWith("--")) {
-	m_buf = m_buf.substr(2);
+    if ((bufAt(0) == '-') && (bufAt(1) == '-')) {
+	consume(2);
 	if (!parseComment())
 	    return false;
 	return true;
     }
-    if (m_buf.length() < 7) {
+    if (bufLength() < 7) {
 	setUnparsed(Special);
 	return setError(Incomplete);
     }
-    if (m_buf.startsWith("[CDATA[")) {
-	m_buf = m_buf.substr(7);
+    if (!::strncmp(bufPtr(),"[CDATA[",7)) {
+	consume(7);
 	if (!parseCData())
 	    return false;
 	return true;
     }
-    if (m_buf.startsWith("DOCTYPE")) {
-	m_buf = m_buf.substr(7);
+    if (!::strncmp(bufPtr(),"DOCTYPE",7)) {
+	consume(7);
 	if (!parseDoctype())
 	    return false;
 	return true;
     }
     Debug(this,DebugNote,"Can't parse unknown special starting with '%s' [%p]",
-	m_buf.c_str(),this);
+	bufPtr(),this);
     setError(Unknown);
     return false;
 }
@@ -546,8 +582,8 @@ bool XmlSaxParser::parseComment()
     }
     char c;
     int len = 0;
-    while (m_buf.at(len)) {
-	c = m_buf.at(len);
+    while (bufAt(len)) {
+	c = bufAt(len);
 	if (c != '-') {
 	    if (c == 0x0c) {
 		Debug(this,DebugNote,"Xml comment with unaccepted character '%c' [%p]",c,this);
@@ -556,9 +592,9 @@ bool XmlSaxParser::parseComment()
 	    len++;
 	    continue;
 	}
-	if (m_buf.at(len + 1) == '-' && m_buf.at(len + 2) == '>') { // End of comment
-	    comment << m_buf.substr(0,len);
-	    m_buf = m_buf.substr(len + 3);
+	if (bufAt(len + 1) == '-' && bufAt(len + 2) == '>') { // End of comment
+	    comment.append(bufPtr(),len);
+	    consume(len + 3);
 #ifdef DEBUG
 	    if (comment.at(0) == '-' || comment.at(comment.length() - 1) == '-')
 		DDebug(this,DebugInfo,"Comment starts or ends with '-' character [%p]",this);
@@ -574,11 +610,11 @@ bool XmlSaxParser::parseComment()
 	len++;
     }
     // If we are here we haven't detect the end of comment
-    comment << m_buf;
+    comment << bufPtr();
     int length = comment.length();
     // Keep the last 2 charaters in buffer because if the input buffer ends
     // between "--" and ">"
-    m_buf = comment.substr(length - 2);
+    setBuffer(comment.substr(length - 2));
     setUnparsed(Comment);
     if (length > 1)
 	m_parsed.assign(comment.substr(0,length - 2));
@@ -588,8 +624,8 @@ bool XmlSaxParser::parseComment()
 // Parse an element form the main buffer
 bool XmlSaxParser::parseElement()
 {
-    XDebug(this,DebugAll,"XmlSaxParser::parseElement() buf len=%u [%p]",m_buf.length(),this);
-    if (!m_buf.c_str()) {
+    XDebug(this,DebugAll,"XmlSaxParser::parseElement() buf len=%u [%p]",bufLength(),this);
+    if (!bufLength()) {
 	setUnparsed(Element);
 	return setError(Incomplete);
     }
@@ -615,37 +651,37 @@ bool XmlSaxParser::parseElement()
     }
     if (empty) { // empty flag means that the element does not have attributes
 	// check if the element is empty
-	bool aux = m_buf.at(0) == '/';
+	bool aux = bufAt(0) == '/';
 	if (!processElement(m_parsed,aux))
 	    return false;
 	if (aux)
-	    m_buf = m_buf.substr(2); // go back where we were
+	    consume(2); // go back where we were
 	else
-	    m_buf = m_buf.substr(1); // go back where we were
+	    consume(1); // go back where we were
 	return true;
     }
     char c;
     skipBlanks();
     int len = 0;
-    while (m_buf.at(len)) {
-	c = m_buf.at(len);
+    while (bufAt(len)) {
+	c = bufAt(len);
 	if (c == '/' || c == '>') { // end of element declaration
 	    if (c == '>') {
 		if (!processElement(m_parsed,false))
 		    return false;
-		m_buf = m_buf.substr(1);
+		consume(1);
 		return true;
 	    }
-	    if (!m_buf.at(++len))
+	    if (!bufAt(++len))
 		break;
-	    char ch = m_buf.at(len);
+	    char ch = bufAt(len);
 	    if (ch != '>') {
 		Debug(this,DebugNote,"Element attribute name contains '/' character [%p]",this);
 		return setError(ReadingAttributes);
 	    }
 	    if (!processElement(m_parsed,true))
 		return false;
-	    m_buf = m_buf.substr(len + 1);
+	    consume(len + 1);
 	    return true;
 	}
 	NamedString* ns = getAttribute();
@@ -662,7 +698,7 @@ bool XmlSaxParser::parseElement()
 	XDebug(this,DebugAll,"Parser adding attribute %s='%s' to '%s' [%p]",
 	    ns->name().c_str(),ns->c_str(),m_parsed.c_str(),this);
 	m_parsed.setParam(ns);
-	char ch = m_buf.at(len);
+	char ch = bufAt(len);
 	if (ch && !blank(ch) && (ch != '/' && ch != '>')) {
 	    Debug(this,DebugNote,"Element without blanks between attributes [%p]",this);
 	    return setError(NotWellFormed);
@@ -676,44 +712,44 @@ bool XmlSaxParser::parseElement()
 // Parse a doctype form the main buffer
 bool XmlSaxParser::parseDoctype()
 {
-    if (!m_buf.c_str()) {
+    if (!bufLength()) {
 	setUnparsed(Doctype);
 	setError(Incomplete);
 	return false;
     }
     unsigned int len = 0;
     skipBlanks();
-    while (m_buf.at(len) && !blank(m_buf.at(len)))
+    while (bufAt(len) && !blank(bufAt(len)))
 	len++;
     // Use a while() to break to the end
-    while (m_buf.at(len)) {
-	while (m_buf.at(len) && blank(m_buf.at(len)))
+    while (bufAt(len)) {
+	while (bufAt(len) && blank(bufAt(len)))
 	    len++;
-	if (len >= m_buf.length())
+	if (len >= bufLength())
 	   break;
-	if (m_buf[len++] == '[') {
-	    while (len < m_buf.length()) {
-		if (m_buf[len] != ']') {
+	if (bufAt(len++) == '[') {
+	    while (len < bufLength()) {
+		if (bufAt(len) != ']') {
 		    len ++;
 		    continue;
 		}
-		if (m_buf.at(++len) != '>')
+		if (bufAt(++len) != '>')
 		    continue;
-		gotDoctype(m_buf.substr(0,len));
+		gotDoctype(String(bufPtr(),len));
 		resetParsed();
-		m_buf = m_buf.substr(len + 1);
+		consume(len + 1);
 		return true;
 	    }
 	    break;
 	}
-	while (len < m_buf.length()) {
-	    if (m_buf[len] != '>') {
+	while (len < bufLength()) {
+	    if (bufAt(len) != '>') {
 		len++;
 		continue;
 	    }
-	    gotDoctype(m_buf.substr(0,len));
+	    gotDoctype(String(bufPtr(),len));
 	    resetParsed();
-	    m_buf = m_buf.substr(len + 1);
+	    consume(len + 1);
 	    return true;
 	}
 	break;
@@ -729,31 +765,31 @@ String* XmlSaxParser::extractName(bool& empty)
     unsigned int len = 0;
     bool ok = false;
     empty = false;
-    while (len < m_buf.length()) {
-	char c = m_buf[len];
+    while (len < bufLength()) {
+	char c = bufAt(len);
 	if (blank(c)) {
-	    if (checkFirstNameCharacter(m_buf[0])) {
+	    if (checkFirstNameCharacter(bufAt(0))) {
 		ok = true;
 		break;
 	    }
 	    Debug(this,DebugNote,"Element tag starting with invalid char %c [%p]",
-		m_buf[0],this);
+		bufAt(0),this);
 	    setError(ReadElementName);
 	    return 0;
 	}
 	if (c == '/' || c == '>') { // end of element declaration
 	    if (c == '>') {
-		if (checkFirstNameCharacter(m_buf[0])) {
+		if (checkFirstNameCharacter(bufAt(0))) {
 		    empty = true;
 		    ok = true;
 		    break;
 		}
 		Debug(this,DebugNote,"Element tag starting with invalid char %c [%p]",
-		    m_buf[0],this);
+		    bufAt(0),this);
 		setError(ReadElementName);
 		return 0;
 	    }
-	    char ch = m_buf.at(len + 1);
+	    char ch = bufAt(len + 1);
 	    if (!ch)
 		break;
 	    if (ch != '>') {
@@ -761,13 +797,13 @@ String* XmlSaxParser::extractName(bool& empty)
 		setError(ReadElementName);
 		return 0;
 	    }
-	    if (checkFirstNameCharacter(m_buf[0])) {
+	    if (checkFirstNameCharacter(bufAt(0))) {
 		empty = true;
 		ok = true;
 		break;
 	    }
 	    Debug(this,DebugNote,"Element tag starting with invalid char %c [%p]",
-		m_buf[0],this);
+		bufAt(0),this);
 	    setError(ReadElementName);
 	    return 0;
 	}
@@ -780,12 +816,11 @@ String* XmlSaxParser::extractName(bool& empty)
 	}
     }
     if (ok) {
-	String* name = new String(m_buf.substr(0,len));
-	m_buf = m_buf.substr(len);
+	String* name = new String(bufPtr(),len);
+	consume(len);
 	if (!empty) {
 	    skipBlanks();
-	    empty = (m_buf && m_buf[0] == '>') ||
-		(m_buf.length() > 1 && m_buf[0] == '/' && m_buf[1] == '>');
+	    empty = (bufAt(0) == '>') || (bufAt(0) == '/' && bufAt(1) == '>');
 	}
 	return name;
     }
@@ -801,11 +836,11 @@ NamedString* XmlSaxParser::getAttribute()
     char c,sep = 0;
     unsigned int len = 0;
 
-    while (len < m_buf.length()) { // Circle until we find attribute value startup character (["]|['])
-	c = m_buf[len];
+    while (len < bufLength()) { // Circle until we find attribute value startup character (["]|['])
+	c = bufAt(len);
 	if (blank(c) || c == '=') {
 	    if (!name.c_str())
-		name = m_buf.substr(0,len);
+		name.assign(bufPtr(),len);
 	    len++;
 	    continue;
 	}
@@ -839,8 +874,8 @@ NamedString* XmlSaxParser::getAttribute()
     }
     int pos = ++len;
 
-    while (len < m_buf.length()) {
-	c = m_buf[len];
+    while (len < bufLength()) {
+	c = bufAt(len);
 	if (c != sep && !badCharacter(c)) {
 	    len ++;
 	    continue;
@@ -851,8 +886,8 @@ NamedString* XmlSaxParser::getAttribute()
 	    setError(ReadingAttributes);
 	    return 0;
 	}
-	NamedString* ns = new NamedString(name,m_buf.substr(pos,len - pos));
-	m_buf = m_buf.substr(len + 1);
+	NamedString* ns = new NamedString(name,String(bufPtr() + pos,len - pos));
+	consume(len + 1);
 	// End of attribute value
 	unEscape(*ns);
 	if (error()) {
@@ -874,6 +909,8 @@ void XmlSaxParser::reset()
     m_column = 1;
     m_error = NoError;
     m_buf.clear();
+    m_bufPos = 0;
+    m_checked = 0;
     resetParsed();
     m_unparsed = None;
 }
@@ -898,14 +935,21 @@ bool XmlSaxParser::checkNameCharacter(unsigned char ch)
 	|| ch == 0xB7;
 }
 
+// Replace the unconsumed part of the buffer
+void XmlSaxParser::setBuffer(const String& buf)
+{
+    m_buf = buf;
+    m_bufPos = 0;
+}
+
 // Remove blank characters from the beginning of the buffer
 void XmlSaxParser::skipBlanks()
 {
     unsigned int len = 0;
-    while (len < m_buf.length() && blank(m_buf[len]))
+    while (len < bufLength() && blank(bufAt(len)))
 	len++;
     if (len != 0)
-	m_buf = m_buf.substr(len);
+	consume(len);
 }
 
 // Obtain a char from an ascii decimal char declaration
@@ -19,19 +19,19 @@
  */
 
 #include <yatertp.h>
+#include <string.h>
+#include <stdlib.h>
 
 using namespace TelEngine;
 
 namespace { // anonymous
 
-class RTPDelayedData : public DataBlock
+class RTPDelayedData : public GenObject
 {
 public:
-    inline RTPDelayedData(u_int64_t when, bool mark, int payload,
-	unsigned int tstamp, const void* data, int len)
-	: DataBlock(const_cast<void*>(data),len), m_scheduled(when),
-	  m_marker(mark), m_payload(payload), m_timestamp(tstamp)
-	{ }
+    RTPDelayedData(RTPGroup* grp, u_int64_t when, bool mark, int payload,
+	unsigned int tstamp, const void* data, int len);
+    virtual ~RTPDelayedData();
     inline u_int64_t scheduled() const
 	{ return m_scheduled; }
     inline bool marker() const
@@ -40,7 +40,14 @@ public:
 	{ return m_payload; }
     inline unsigned int timestamp() const
 	{ return m_timestamp; }
+    inline const void* data() const
+	{ return m_data; }
+    inline int length() const
+	{ return m_length; }
 private:
+    RTPGroup* m_group;
+    void* m_data;
+    int m_length;
     u_int64_t m_scheduled;
     bool m_marker;
     int m_payload;
@@ -50,6 +57,33 @@ private:
 }; // anonymous namespace
 
 
+// Packet data is held in a buffer recycled by the group if it has one
+RTPDelayedData::RTPDelayedData(RTPGroup* grp, u_int64_t when, bool mark, int payload,
+    unsigned int tstamp, const void* data, int len)
+    : m_group(grp), m_data(0), m_length(len), m_scheduled(when),
+      m_marker(mark), m_payload(payload), m_timestamp(tstamp)
+{
+    if (m_length < 0)
+	m_length = 0;
+    if (m_group)
+	m_data = m_group->getBuffer(m_length);
+    if (!m_data) {
+	m_group = 0;
+	m_data = ::malloc(m_length ? m_length : 1);
+    }
+    if (m_length)
+	::memcpy(m_data,data,m_length);
+}
+
+RTPDelayedData::~RTPDelayedData()
+{
+    if (m_group)
+	m_group->releaseBuffer(m_data);
+    else
+	::free(m_data);
+}
+
+
 RTPDejitter::RTPDejitter(RTPReceiver* receiver, unsigned int mindelay, unsigned int maxdelay,
     DebugEnabler* dbg, const char* traceId)
     : RTPProcessor(dbg,traceId),
@@ -69,6 +103,14 @@ RTPDejitter::RTPDejitter(RTPReceiver* receiver, unsigned int mindelay, unsigned
 RTPDejitter::~RTPDejitter()
 {
     DDebug(dbg(),DebugInfo,"Dejitter destroyed with %u packets [%p]",m_packets.count(),this);
+    // release packet buffers while still in the group
+    m_packets.clear();
+}
+
+void RTPDejitter::groupChanged(RTPGroup* grp, bool joined)
+{
+    if (!joined)
+	m_packets.clear();
 }
 
 void RTPDejitter::clear()
@@ -143,13 +185,13 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 	    if (pkt->timestamp() == timestamp)
 		return true;
 	    if (pkt->timestamp() > timestamp && pkt->scheduled() > when) {
-		l->insert(new RTPDelayedData(when,marker,payload,timestamp,data,len));
+		l->insert(new RTPDelayedData(group(),when,marker,payload,timestamp,data,len));
 		return true;
 	    }
 	}
     }
     m_tailStamp = timestamp;
-    m_packets.append(new RTPDelayedData(when,marker,payload,timestamp,data,len));
+    m_packets.append(new RTPDelayedData(group(),when,marker,payload,timestamp,data,len));
     return true;
 }
 
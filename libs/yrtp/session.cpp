@@ -735,8 +735,12 @@ bool UDPSession::initGroup(int msec, Thread::Priority prio, const String& affini
     // try to pick the group from the transport if it has one
     if (m_transport)
 	group(m_transport->group());
-    if (!m_group)
-	group(new RTPGroup(msec,prio,affinity));
+    if (!m_group) {
+	if (RTPGroup::sharedSessions() > 1)
+	    RTPGroup::joinShared(this,msec,prio,affinity);
+	else
+	    group(new RTPGroup(msec,prio,affinity));
+    }
     if (!m_group)
 	return false;
     if (m_transport)
@@ -20,12 +20,67 @@
 
 #include <yatertp.h>
 #include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 #define BUF_SIZE 1500
+// Maximum number of socket events handled in one loop
+#define EVENTS_MAX 64
+// Maximum number of datagrams received or sent in one operation
+#define RTP_BATCH 16
+// Maximum number of spare packet buffers kept by a group
+#define POOL_MAX 256
 
 using namespace TelEngine;
 
+namespace TelEngine {
+
+// Batched socket I/O and recycled packet buffers of an event driven group
+// Buffers and queue are used from the group's thread with the group locked
+class RTPGroupIO
+{
+public:
+    inline RTPGroupIO()
+	: m_txCount(0), m_pool(0), m_poolCount(0)
+	{ }
+    ~RTPGroupIO();
+    char m_rxBuffer[RTP_BATCH * BUF_SIZE];
+    int m_rxLengths[RTP_BATCH];
+    SocketAddr m_rxAddrs[RTP_BATCH];
+    char m_txBuffer[RTP_BATCH * BUF_SIZE];
+    const void* m_txData[RTP_BATCH];
+    int m_txLengths[RTP_BATCH];
+    const SocketAddr* m_txAddrs[RTP_BATCH];
+    Socket* m_txSocks[RTP_BATCH];
+    RTPTransport* m_txTrans[RTP_BATCH];
+    bool m_txRtcp[RTP_BATCH];
+    int m_txCount;
+    void* m_pool;
+    unsigned int m_poolCount;
+};
+
+}; // namespace TelEngine
+
 static unsigned long s_sleep = 5;
+static bool s_events = false;
+static unsigned int s_sessions = 1;
+// Event driven groups shared by several sessions
+static ObjList s_groups;
+static Mutex s_groupsMutex(false,"RTPGroups");
+
+RTPGroupIO::~RTPGroupIO()
+{
+    while (m_pool) {
+	void* buf = m_pool;
+	m_pool = *static_cast<void**>(buf);
+	::free(buf);
+    }
+}
 
 // Set IPv6 sin6_scope_id for remote addresses from local address
 // recvFrom() will set the sin6_scope_id of the remote socket address
@@ -45,7 +100,10 @@ static inline void setScopeId(const SocketAddr& local, SocketAddr& sa1,
 
 RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
     : Mutex(true,"RTPGroup"),
-      Thread("RTP Group",prio), m_listChanged(false)
+      Thread("RTP Group",prio), m_listChanged(false),
+      m_prio(prio), m_affinity(affinity),
+      m_epoll(-1), m_events(0), m_eventCount(0),
+      m_heap(0), m_heapLen(0), m_heapSize(0), m_io(0)
 {
     DDebug(DebugInfo,"RTPGroup::RTPGroup() [%p]",this);
     if (msec < 1)
@@ -59,16 +117,42 @@ RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
 	    Debug(DebugWarn,"Failed to set affinity to '%s', error=%s(%d) [%p]",
 		    affinity.c_str(),::strerror(err),err,this);
     }
+#ifdef HAVE_EPOLL
+    if (s_events) {
+	m_epoll = ::epoll_create(EVENTS_MAX);
+	if (m_epoll >= 0) {
+	    m_events = new struct epoll_event[EVENTS_MAX];
+	    // batch buffers are worth their memory only if sessions are shared
+	    if (s_sessions > 1)
+		m_io = new RTPGroupIO;
+	}
+	else {
+	    int err = errno;
+	    Debug(DebugWarn,"Failed to create epoll, polling sockets instead. Error: %s(%d) [%p]",
+		::strerror(err),err,this);
+	}
+    }
+#endif
 }
 
 RTPGroup::~RTPGroup()
 {
     DDebug(DebugInfo,"RTPGroup::~RTPGroup() [%p]",this);
+#ifdef HAVE_EPOLL
+    if (m_epoll >= 0)
+	::close(m_epoll);
+    delete[] static_cast<struct epoll_event*>(m_events);
+#endif
+    delete[] m_heap;
+    delete m_io;
 }
 
 void RTPGroup::cleanup()
 {
     DDebug(DebugInfo,"RTPGroup::cleanup() [%p]",this);
+    s_groupsMutex.lock();
+    s_groups.remove(this,false);
+    s_groupsMutex.unlock();
     lock();
     m_listChanged = true;
     ObjList* l = &m_processors;
@@ -88,6 +172,11 @@ void RTPGroup::cleanup()
 void RTPGroup::run()
 {
     DDebug(DebugInfo,"RTPGroup::run() [%p]",this);
+    if (eventDriven()) {
+	runEvents();
+	DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
+	return;
+    }
     bool ok = true;
     while (ok) {
 	unsigned long msec = m_sleep;
@@ -115,12 +204,80 @@ void RTPGroup::run()
     DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
 }
 
+// Event driven loop: wait for data on the sockets until the earliest
+//  processor in the timer heap is due, then deliver data and tick processors
+void RTPGroup::runEvents()
+{
+#ifdef HAVE_EPOLL
+    struct epoll_event* events = static_cast<struct epoll_event*>(m_events);
+    for (;;) {
+	lock();
+	if (!m_heapLen) {
+	    unlock();
+	    if (idleShared())
+		break;
+	    continue;
+	}
+	u_int64_t next = m_heap[0]->m_tickTime;
+	unlock();
+	u_int64_t now = Time::now();
+	int msec = (next > now) ? (int)((next - now + 999) / 1000) : 0;
+	int n = ::epoll_wait(m_epoll,events,EVENTS_MAX,msec);
+	Thread::check();
+	u_int64_t interval = 1000 * (u_int64_t)((m_sleep < s_sleep) ? s_sleep : m_sleep);
+	lock();
+	m_eventCount = (n > 0) ? n : 0;
+	for (int i = 0; i < m_eventCount; i++) {
+	    u_int64_t data = events[i].data.u64;
+	    // cleared if the transport was removed while handling the events
+	    if (!data)
+		continue;
+	    RTPTransport* trans = reinterpret_cast<RTPTransport*>((uintptr_t)(data & ~(u_int64_t)1));
+	    if (data & 1)
+		trans->readRTCP();
+	    else
+		trans->readRTP();
+	}
+	m_eventCount = 0;
+	Time t;
+	while (m_heapLen && (m_heap[0]->m_tickTime <= t)) {
+	    RTPProcessor* p = m_heap[0];
+	    // reschedule first as the processor may leave the group while ticking
+	    p->m_tickTime += interval;
+	    if (p->m_tickTime <= t)
+		p->m_tickTime = t + interval;
+	    heapMove(0);
+	    p->timerTick(t);
+	}
+	if (m_io && m_io->m_txCount)
+	    flush();
+	unlock();
+    }
+#endif
+}
+
+// Check if the group ran out of processors, unlist it from shared groups if so
+bool RTPGroup::idleShared()
+{
+    Lock mylock(s_groupsMutex);
+    Lock lock(this);
+    if (m_processors.skipNull())
+	return false;
+    s_groups.remove(this,false);
+    return true;
+}
+
 void RTPGroup::join(RTPProcessor* proc)
 {
     DDebug(DebugAll,"RTPGroup::join(%p) [%p]",proc,this);
     lock();
     m_listChanged = true;
     m_processors.append(proc)->setDelete(false);
+    if (eventDriven()) {
+	proc->m_tickTime = Time::now();
+	heapPush(proc);
+    }
+    proc->groupChanged(this,true);
     startup();
     unlock();
 }
@@ -130,7 +287,14 @@ void RTPGroup::part(RTPProcessor* proc)
     DDebug(DebugAll,"RTPGroup::part(%p) [%p]",proc,this);
     lock();
     m_listChanged = true;
+    // packets queued by a transport must be sent while it still exists
+    if (m_io && m_io->m_txCount)
+	flush();
+    proc->groupChanged(this,false);
     m_processors.remove(proc,false);
+    m_shared.remove(proc,false);
+    if (eventDriven())
+	heapRemove(proc);
     unlock();
 }
 
@@ -143,10 +307,231 @@ void RTPGroup::setMinSleep(int msec)
     s_sleep = msec;
 }
 
+void RTPGroup::setEventDriven(bool enable, unsigned int sessions)
+{
+#ifdef HAVE_EPOLL
+    s_events = enable;
+#else
+    if (enable)
+	Debug(DebugNote,"Event driven RTP groups are not supported on this platform");
+#endif
+    if (sessions < 1)
+	sessions = 1;
+    if (sessions > 1000)
+	sessions = 1000;
+    s_sessions = sessions;
+}
+
+unsigned int RTPGroup::sharedSessions()
+{
+    return s_events ? s_sessions : 0;
+}
+
+bool RTPGroup::joinShared(RTPProcessor* proc, int msec, Priority prio, const String& affinity)
+{
+    if (!proc)
+	return false;
+    Lock lock(s_groupsMutex);
+    RTPGroup* grp = 0;
+    if (msec < 1)
+	msec = 1;
+    if (msec > 50)
+	msec = 50;
+    for (ObjList* l = s_groups.skipNull(); l; l = l->skipNext()) {
+	RTPGroup* g = static_cast<RTPGroup*>(l->get());
+	if ((g->m_sleep != (unsigned long)msec) || (g->m_prio != prio) || (g->m_affinity != affinity))
+	    continue;
+	Lock glock(g);
+	if (g->m_shared.count() < s_sessions) {
+	    grp = g;
+	    break;
+	}
+    }
+    if (!grp) {
+	grp = new RTPGroup(msec,prio,affinity);
+	// a group that could not set up events is not shared
+	if (grp->eventDriven())
+	    s_groups.append(grp)->setDelete(false);
+    }
+    Lock glock(grp);
+    proc->group(grp);
+    if (proc->group() != grp)
+	return false;
+    grp->m_shared.append(proc)->setDelete(false);
+    return true;
+}
+
+// Start waiting for data on a transport socket
+bool RTPGroup::watch(RTPTransport* trans, Socket& sock, bool rtcp)
+{
+#ifdef HAVE_EPOLL
+    if ((m_epoll < 0) || !sock.valid())
+	return false;
+    struct epoll_event ev;
+    ::memset(&ev,0,sizeof(ev));
+    ev.events = EPOLLIN;
+    // transports are aligned so the lowest bit tells RTCP from RTP
+    ev.data.u64 = (u_int64_t)(uintptr_t)trans | (rtcp ? 1 : 0);
+    if (!::epoll_ctl(m_epoll,EPOLL_CTL_ADD,sock.handle(),&ev))
+	return true;
+    if ((errno == EEXIST) && !::epoll_ctl(m_epoll,EPOLL_CTL_MOD,sock.handle(),&ev))
+	return true;
+    int err = errno;
+    Debug(DebugMild,"Failed to watch socket %d, polling instead. Error: %s(%d) [%p]",
+	sock.handle(),::strerror(err),err,this);
+#endif
+    return false;
+}
+
+// Stop waiting for data on a transport socket, forget its pending events
+void RTPGroup::unwatch(RTPTransport* trans, Socket& sock)
+{
+#ifdef HAVE_EPOLL
+    if (m_epoll < 0)
+	return;
+    if (sock.valid()) {
+	struct epoll_event ev;
+	::memset(&ev,0,sizeof(ev));
+	::epoll_ctl(m_epoll,EPOLL_CTL_DEL,sock.handle(),&ev);
+    }
+    struct epoll_event* events = static_cast<struct epoll_event*>(m_events);
+    for (int i = 0; i < m_eventCount; i++) {
+	if ((events[i].data.u64 & ~(u_int64_t)1) == (u_int64_t)(uintptr_t)trans)
+	    events[i].data.u64 = 0;
+    }
+#endif
+}
+
+// Queue a packet to be sent at the end of the loop of the group's thread
+bool RTPGroup::queue(RTPTransport* trans, Socket& sock, const SocketAddr& to,
+    const void* data, int len, bool rtcp)
+{
+    if (!m_io || (len <= 0) || (len > BUF_SIZE) || (Thread::current() != this))
+	return false;
+    if (m_io->m_txCount >= RTP_BATCH)
+	flush();
+    int i = m_io->m_txCount++;
+    char* buf = m_io->m_txBuffer + i * BUF_SIZE;
+    ::memcpy(buf,data,len);
+    m_io->m_txData[i] = buf;
+    m_io->m_txLengths[i] = len;
+    m_io->m_txAddrs[i] = &to;
+    m_io->m_txSocks[i] = &sock;
+    m_io->m_txTrans[i] = trans;
+    m_io->m_txRtcp[i] = rtcp;
+    return true;
+}
+
+// Send queued packets, consecutive packets on the same socket in one operation
+void RTPGroup::flush()
+{
+    int count = m_io->m_txCount;
+    m_io->m_txCount = 0;
+    for (int i = 0; i < count; ) {
+	Socket* sock = m_io->m_txSocks[i];
+	int n = 1;
+	while ((i + n < count) && (m_io->m_txSocks[i + n] == sock))
+	    n++;
+	int sent = sock->sendToMulti(m_io->m_txData + i,m_io->m_txLengths + i,m_io->m_txAddrs + i,n);
+	if (sent < 0)
+	    sent = 0;
+	// send the rest one by one so the transport can report errors
+	for (int j = i + sent; j < i + n; j++)
+	    m_io->m_txTrans[j]->resend(m_io->m_txRtcp[j],m_io->m_txData[j],m_io->m_txLengths[j]);
+	i += n;
+    }
+}
+
+void* RTPGroup::getBuffer(unsigned int len)
+{
+    if (!m_io || (len > BUF_SIZE))
+	return 0;
+    Lock lock(this);
+    void* buf = m_io->m_pool;
+    if (!buf)
+	return ::malloc(BUF_SIZE);
+    m_io->m_pool = *static_cast<void**>(buf);
+    m_io->m_poolCount--;
+    return buf;
+}
+
+void RTPGroup::releaseBuffer(void* buf)
+{
+    if (!buf)
+	return;
+    Lock lock(this);
+    if (m_io && (m_io->m_poolCount < POOL_MAX)) {
+	*static_cast<void**>(buf) = m_io->m_pool;
+	m_io->m_pool = buf;
+	m_io->m_poolCount++;
+	return;
+    }
+    lock.drop();
+    ::free(buf);
+}
+
+// Add a processor to the timer heap
+void RTPGroup::heapPush(RTPProcessor* proc)
+{
+    if (m_heapLen >= m_heapSize) {
+	unsigned int size = m_heapSize ? 2 * m_heapSize : 16;
+	RTPProcessor** heap = new RTPProcessor*[size];
+	for (unsigned int i = 0; i < m_heapLen; i++)
+	    heap[i] = m_heap[i];
+	delete[] m_heap;
+	m_heap = heap;
+	m_heapSize = size;
+    }
+    m_heap[m_heapLen] = proc;
+    proc->m_tickIndex = m_heapLen++;
+    heapMove(proc->m_tickIndex);
+}
+
+// Remove a processor from the timer heap
+void RTPGroup::heapRemove(RTPProcessor* proc)
+{
+    unsigned int i = proc->m_tickIndex;
+    if ((i >= m_heapLen) || (m_heap[i] != proc))
+	return;
+    m_heapLen--;
+    if (i < m_heapLen) {
+	m_heap[i] = m_heap[m_heapLen];
+	heapMove(i);
+    }
+}
+
+// Restore heap order after the tick time of an entry changed
+void RTPGroup::heapMove(unsigned int index)
+{
+    RTPProcessor* p = m_heap[index];
+    while (index) {
+	unsigned int parent = (index - 1) / 2;
+	if (m_heap[parent]->m_tickTime <= p->m_tickTime)
+	    break;
+	m_heap[index] = m_heap[parent];
+	m_heap[index]->m_tickIndex = index;
+	index = parent;
+    }
+    for (;;) {
+	unsigned int child = 2 * index + 1;
+	if (child >= m_heapLen)
+	    break;
+	if ((child + 1 < m_heapLen) && (m_heap[child + 1]->m_tickTime < m_heap[child]->m_tickTime))
+	    child++;
+	if (p->m_tickTime <= m_heap[child]->m_tickTime)
+	    break;
+	m_heap[index] = m_heap[child];
+	m_heap[index]->m_tickIndex = index;
+	index = child;
+    }
+    m_heap[index] = p;
+    p->m_tickIndex = index;
+}
+
 
 RTPProcessor::RTPProcessor(DebugEnabler* dbg, const char* traceId)
     : RTPDebug(dbg,traceId),
-    m_wrongSrc(0), m_group(0)
+    m_wrongSrc(0), m_group(0), m_tickTime(0), m_tickIndex(0)
 {
     DDebug(this->dbg(),DebugAll,"RTPProcessor::RTPProcessor() [%p]",this);
 }
@@ -181,11 +566,15 @@ void RTPProcessor::getStats(String& stats) const
 {
 }
 
+void RTPProcessor::groupChanged(RTPGroup* grp, bool joined)
+{
+}
+
 
 RTPTransport::RTPTransport(RTPTransport::Type type, DebugEnabler* dbg, const char* traceId)
     : RTPProcessor(dbg,traceId),
       m_type(type), m_processor(0), m_monitor(0), m_autoRemote(false),
-      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true)
+      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true), m_watched(false)
 {
     DDebug(this->dbg(),DebugAll,"RTPTransport::RTPTransport(%d) [%p]",type,this);
 }
@@ -212,72 +601,148 @@ void RTPTransport::destruct()
 void RTPTransport::timerTick(const Time& when)
 {
     XDebug(dbg(),DebugAll,"RTPTransport::timerTick() group=%p [%p]",group(),this);
+    // sockets watched by an event driven group are read when data arrives
     if (m_rtpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while ((len = m_rtpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTP)) > 0) {
-	    XDebug(dbg(),DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
-		m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port(),len,this);
-	    switch (m_type) {
-		case RTP:
-		    if (len < 12)
-			continue;
-		    if (((unsigned char)buf[0] & 0xc0) != 0x80)
-			continue;
-		    break;
-		case UDPTL:
-		    if (len < 6)
-			continue;
-		    break;
-		default:
-		    break;
-	    }
-	    if (!m_remoteAddr.valid())
-		continue;
-	    // looks like it's RTP or UDPTL, at least by length and version
-	    bool preferred = false;
-	    if ((m_autoRemote || (preferred = (m_rxAddrRTP == m_remotePref))) && (m_rxAddrRTP != m_remoteAddr)) {
-		TraceDebug(m_traceId,dbg(),DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
-		    m_remoteAddr.host().c_str(),m_remoteAddr.port(),
-		    (preferred ? " preferred" : ""),
-		    m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port());
-		// if we received from the preferred address don't auto change any more
-		if (preferred)
-		    m_remotePref.clear();
-		remoteAddr(m_rxAddrRTP);
-	    }
-	    m_autoRemote = false;
-	    if (m_rxAddrRTP == m_remoteAddr) {
-		if (m_processor)
-		    m_processor->rtpData(buf,len);
-		if (m_monitor)
-		    m_monitor->rtpData(buf,len);
-	    }
-	    else if (m_processor)
-		m_processor->incWrongSrc();
-	}
+	if (!m_watched)
+	    readRTP();
 	m_rtpSock.timerTick(when);
     }
     if (m_rtcpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while (((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP)) {
-	    XDebug(dbg(),DebugAll,"RTCP from '%s:%d' length %d [%p]",
-		m_rxAddrRTCP.host().c_str(),m_rxAddrRTCP.port(),len,this);
-	    if (m_processor)
-		m_processor->rtcpData(buf,len);
-	    if (m_monitor)
-		m_monitor->rtcpData(buf,len);
-	}
+	if (!m_watched)
+	    readRTCP();
 	m_rtcpSock.timerTick(when);
     }
 }
 
+// Read and process all RTP packets waiting in socket
+void RTPTransport::readRTP()
+{
+    RTPGroupIO* io = group() ? group()->m_io : 0;
+    if (io) {
+	// event driven groups receive several packets in one operation
+	int n;
+	while ((n = m_rtpSock.recvFromMulti(io->m_rxBuffer,BUF_SIZE,RTP_BATCH,
+		io->m_rxLengths,io->m_rxAddrs)) != Socket::socketError()) {
+	    for (int i = 0; i < n; i++)
+		rxRTP(io->m_rxBuffer + i * BUF_SIZE,io->m_rxLengths[i],io->m_rxAddrs[i]);
+	}
+	return;
+    }
+    char buf[BUF_SIZE];
+    int len;
+    while ((len = m_rtpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTP)) > 0)
+	rxRTP(buf,len,m_rxAddrRTP);
+}
+
+// Read and process all RTCP packets waiting in socket
+void RTPTransport::readRTCP()
+{
+    RTPGroupIO* io = group() ? group()->m_io : 0;
+    if (io) {
+	int n;
+	while ((n = m_rtcpSock.recvFromMulti(io->m_rxBuffer,BUF_SIZE,RTP_BATCH,
+		io->m_rxLengths,io->m_rxAddrs)) != Socket::socketError()) {
+	    for (int i = 0; i < n; i++)
+		rxRTCP(io->m_rxBuffer + i * BUF_SIZE,io->m_rxLengths[i],io->m_rxAddrs[i]);
+	}
+	return;
+    }
+    char buf[BUF_SIZE];
+    int len;
+    while (((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP))
+	rxRTCP(buf,len,m_rxAddrRTCP);
+}
+
+// Process one received RTP or UDPTL packet
+void RTPTransport::rxRTP(const char* buf, int len, const SocketAddr& from)
+{
+    XDebug(dbg(),DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
+	from.host().c_str(),from.port(),len,this);
+    switch (m_type) {
+	case RTP:
+	    if (len < 12)
+		return;
+	    if (((unsigned char)buf[0] & 0xc0) != 0x80)
+		return;
+	    break;
+	case UDPTL:
+	    if (len < 6)
+		return;
+	    break;
+	default:
+	    break;
+    }
+    if (!m_remoteAddr.valid())
+	return;
+    // looks like it's RTP or UDPTL, at least by length and version
+    bool preferred = false;
+    if ((m_autoRemote || (preferred = (from == m_remotePref))) && (from != m_remoteAddr)) {
+	TraceDebug(m_traceId,dbg(),DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
+	    m_remoteAddr.host().c_str(),m_remoteAddr.port(),
+	    (preferred ? " preferred" : ""),
+	    from.host().c_str(),from.port());
+	// if we received from the preferred address don't auto change any more
+	if (preferred)
+	    m_remotePref.clear();
+	if (&from != &m_rxAddrRTP)
+	    m_rxAddrRTP = from;
+	remoteAddr(m_rxAddrRTP);
+    }
+    m_autoRemote = false;
+    if (from == m_remoteAddr) {
+	if (m_processor)
+	    m_processor->rtpData(buf,len);
+	if (m_monitor)
+	    m_monitor->rtpData(buf,len);
+    }
+    else if (m_processor)
+	m_processor->incWrongSrc();
+}
+
+// Process one received RTCP packet
+void RTPTransport::rxRTCP(const char* buf, int len, const SocketAddr& from)
+{
+    if ((len < 8) || (from != m_remoteRTCP))
+	return;
+    XDebug(dbg(),DebugAll,"RTCP from '%s:%d' length %d [%p]",
+	from.host().c_str(),from.port(),len,this);
+    if (m_processor)
+	m_processor->rtcpData(buf,len);
+    if (m_monitor)
+	m_monitor->rtcpData(buf,len);
+}
+
+void RTPTransport::groupChanged(RTPGroup* grp, bool joined)
+{
+    watchSockets(grp,joined);
+}
+
+// Register or unregister the sockets with an event driven group
+void RTPTransport::watchSockets(RTPGroup* grp, bool watch)
+{
+    if (!(grp && grp->eventDriven()))
+	return;
+    Lock lock(grp);
+    if (watch) {
+	// fall back to polling from timerTick if any of the sockets can't be watched
+	m_watched = grp->watch(this,m_rtpSock,false);
+	if (m_watched && m_rtcpSock.valid() && !grp->watch(this,m_rtcpSock,true)) {
+	    grp->unwatch(this,m_rtpSock);
+	    m_watched = false;
+	}
+    }
+    else if (m_watched) {
+	grp->unwatch(this,m_rtpSock);
+	grp->unwatch(this,m_rtcpSock);
+	m_watched = false;
+    }
+}
+
 // Send data to remote party
 // Put a debug message on failure
 // Return true if all bytes were sent
 bool RTPTransport::sendData(Socket& sock, const SocketAddr& to, const void* data, int len,
-    const char* what, bool& flag)
+    const char* what, bool& flag, bool queue)
 {
     if (!sock.valid())
 	return false;
@@ -291,6 +756,9 @@ bool RTPTransport::sendData(Socket& sock, const SocketAddr& to, const void* data
 	}
 	return false;
     }
+    // in an event driven group's thread packets are sent in batches
+    if (queue && group() && group()->queue(this,sock,to,data,len,(&sock == &m_rtcpSock)))
+	return true;
     int wr = sock.sendTo(data,len,to);
     if (wr == Socket::socketError() && flag && !sock.canRetry()) {
 	flag = false;
@@ -306,6 +774,15 @@ bool RTPTransport::sendData(Socket& sock, const SocketAddr& to, const void* data
     return wr == len;
 }
 
+// Send a packet the group failed to send in a batch
+void RTPTransport::resend(bool rtcp, const void* data, int len)
+{
+    if (rtcp)
+	sendData(m_rtcpSock,m_remoteRTCP,data,len,"RTCP",m_warnSendErrorRtcp,false);
+    else
+	sendData(m_rtpSock,m_remoteAddr,data,len,"RTP",m_warnSendErrorRtp,false);
+}
+
 void RTPTransport::rtpData(const void* data, int len)
 {
     if (!data)
@@ -351,6 +828,8 @@ void RTPTransport::setMonitor(RTPProcessor* monitor)
 
 bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 {
+    // don't let the group read the sockets before they are set non blocking
+    Lock lock(group());
     // check if sockets are already created and bound
     if (m_rtpSock.valid())
 	return false;
@@ -367,6 +846,7 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 	    m_rtpSock.getSockName(addr);
 	    m_localAddr = addr;
 	    setScopeId(m_localAddr,m_remoteAddr,m_remotePref);
+	    watchSockets(group(),true);
 	    return true;
 	}
 	if (!p) {
@@ -380,6 +860,7 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 		    m_rtpSock.setBlocking(false);
 		    m_localAddr = addr;
 		    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+		    watchSockets(group(),true);
 		    return true;
 		}
 		DDebug(dbg(),DebugMild,"RTP Socket failed with code %d",m_rtpSock.error());
@@ -394,6 +875,7 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 	    addr.port(p);
 	    m_localAddr = addr;
 	    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+	    watchSockets(group(),true);
 	    return true;
 	}
 #ifdef DEBUG
@@ -45,6 +45,7 @@
 namespace TelEngine {
 
 class RTPGroup;
+class RTPGroupIO;
 class RTPTransport;
 class RTPSession;
 class RTPSender;
@@ -182,20 +183,32 @@ protected:
      */
     virtual void timerTick(const Time& when) = 0;
 
+    /**
+     * Method called by the group after this processor joined or before it left
+     * @param grp The group that was joined or left
+     * @param joined True if the group was joined, false if it is being left
+     */
+    virtual void groupChanged(RTPGroup* grp, bool joined);
+
     unsigned int m_wrongSrc;
 
 private:
     RTPGroup* m_group;
+    u_int64_t m_tickTime;
+    unsigned int m_tickIndex;
 };
 
 /**
  * Several possibly related RTP processors share the same RTP group which
  *  holds the thread that keeps them running.
+ * An event driven group waits for data on the sockets of its transports and
+ *  keeps the processors ticking from a timer heap instead of polling them all.
  * @short A group of RTP processors handled by the same thread
  */
 class YRTP_API RTPGroup : public GenObject, public Mutex, public Thread
 {
     friend class RTPProcessor;
+    friend class RTPTransport;
 
 public:
     /**
@@ -239,10 +252,74 @@ public:
      */
     void part(RTPProcessor* proc);
 
+    /**
+     * Check if this group waits for socket events instead of polling
+     * @return True if the group is event driven
+     */
+    inline bool eventDriven() const
+	{ return m_epoll >= 0; }
+
+    /**
+     * Set the system global mode of newly created groups
+     * @param enable True to create event driven groups if supported by the system
+     * @param sessions Maximum number of sessions sharing an event driven group
+     */
+    static void setEventDriven(bool enable, unsigned int sessions = 1);
+
+    /**
+     * Get the maximum number of sessions sharing an event driven group
+     * @return Sessions per group thread, zero if groups are not event driven
+     */
+    static unsigned int sharedSessions();
+
+    /**
+     * Join a RTP processor to a group shared with other sessions.
+     * A new group is created if none has room for another session
+     * @param proc Pointer to the RTP processor to add
+     * @param msec Minimum time to sleep in loop in milliseconds
+     * @param prio Thread priority to run the group
+     * @param affinity Comma-separated list of CPUs and/or CPU range on which the thread should run on
+     * @return True if the processor joined a group
+     */
+    static bool joinShared(RTPProcessor* proc, int msec, Priority prio, const String& affinity);
+
+    /**
+     * Get a packet buffer recycled by this group.
+     * Only event driven groups keep a pool of buffers
+     * @param len Length of the data to be stored in the buffer
+     * @return Pointer to the buffer, NULL if the group can't provide one
+     */
+    void* getBuffer(unsigned int len);
+
+    /**
+     * Return to the pool a buffer obtained from @ref getBuffer()
+     * @param buf Pointer to the buffer to release
+     */
+    void releaseBuffer(void* buf);
+
 private:
+    void runEvents();
+    bool idleShared();
+    bool watch(RTPTransport* trans, Socket& sock, bool rtcp);
+    void unwatch(RTPTransport* trans, Socket& sock);
+    void heapPush(RTPProcessor* proc);
+    void heapRemove(RTPProcessor* proc);
+    void heapMove(unsigned int index);
+    bool queue(RTPTransport* trans, Socket& sock, const SocketAddr& to, const void* data, int len, bool rtcp);
+    void flush();
     ObjList m_processors;
+    ObjList m_shared;
     bool m_listChanged;
     unsigned long m_sleep;
+    Priority m_prio;
+    String m_affinity;
+    int m_epoll;
+    void* m_events;
+    int m_eventCount;
+    RTPProcessor** m_heap;
+    unsigned int m_heapLen;
+    unsigned int m_heapSize;
+    RTPGroupIO* m_io;
 };
 
 /**
@@ -251,6 +328,8 @@ private:
  */
 class YRTP_API RTPTransport : public RTPProcessor
 {
+    friend class RTPGroup;
+
 public:
     /**
      * Activation status of the transport
@@ -386,9 +465,22 @@ protected:
      */
     virtual void rtcpData(const void* data, int len);
 
+    /**
+     * Start or stop waiting for data in an event driven group
+     * @param grp The group that was joined or left
+     * @param joined True if the group was joined, false if it is being left
+     */
+    virtual void groupChanged(RTPGroup* grp, bool joined);
+
 private:
+    void readRTP();
+    void readRTCP();
+    void rxRTP(const char* buf, int len, const SocketAddr& from);
+    void rxRTCP(const char* buf, int len, const SocketAddr& from);
+    void resend(bool rtcp, const void* data, int len);
+    void watchSockets(RTPGroup* grp, bool watch);
     bool sendData(Socket& sock, const SocketAddr& to, const void* data, int len,
-	const char* what, bool& flag);
+	const char* what, bool& flag, bool queue = true);
     Type m_type;
     RTPProcessor* m_processor;
     RTPProcessor* m_monitor;
@@ -403,6 +495,7 @@ private:
     bool m_autoRemote;
     bool m_warnSendErrorRtp;
     bool m_warnSendErrorRtcp;
+    bool m_watched;
 };
 
 /**
@@ -454,6 +547,13 @@ protected:
      */
     virtual void timerTick(const Time& when);
 
+    /**
+     * Drop buffered packets before leaving a group as their buffers belong to it
+     * @param grp The group that was joined or left
+     * @param joined True if the group was joined, false if it is being left
+     */
+    virtual void groupChanged(RTPGroup* grp, bool joined);
+
 private:
     ObjList m_packets;
     RTPReceiver* m_receiver;
@@ -972,7 +972,8 @@ ExpOperation* ExpEvaluator::popOne(ObjList& stack)
 	XDebug(DebugInfo,"Not popping barrier %u: '%s'='%s'",o->opcode(),o->name().c_str(),o->c_str());
 	return 0;
     }
-    stack.remove(o,false);
+    // keep the emptied entry, it is reused by the next push
+    stack.set(0,false);
 #ifdef DEBUG
     Debug(DebugAll,"popOne: %p%s%s",o,(o ? " " : ""),(o ? o->typeOf() : ""));
 #endif
@@ -989,7 +990,7 @@ ExpOperation* ExpEvaluator::popAny(ObjList& stack)
 	// non-terminal NULL - remove the list entry
 	stack.remove();
     }
-    stack.remove(o,false);
+    stack.set(0,false);
 #ifdef DEBUG
     Debug(DebugAll,"popAny: %p%s%s '%s'",o,(o ? " " : ""),
 	(o ? o->typeOf() : ""),(o ? o->name().safe() : (const char*)0));
@@ -1009,6 +1010,64 @@ ExpOperation* ExpEvaluator::popValue(ObjList& stack, GenObject* context) const
     return ok ? popOne(stack) : 0;
 }
 
+// Check if a popped operand is a plain value that can hold an operation result
+static inline bool reusable(const ExpOperation* oper)
+{
+    return oper && (oper->opcode() == ExpEvaluator::OpcPush) && !YOBJECT(ExpWrapper,oper);
+}
+
+ExpOperation* ExpEvaluator::numberResult(ExpOperation* oper, int64_t value)
+{
+    if (!reusable(oper)) {
+	TelEngine::destruct(oper);
+	return new ExpOperation(value);
+    }
+    const_cast<String&>(oper->name()).clear();
+    if (value != ExpOperation::nonInteger())
+	oper->String::operator=(value);
+    else
+	oper->String::operator=("NaN");
+    oper->m_number = value;
+    oper->m_bool = false;
+    oper->m_isNumber = true;
+    oper->m_lineNo = 0;
+    oper->m_barrier = false;
+    return oper;
+}
+
+ExpOperation* ExpEvaluator::boolResult(ExpOperation* oper, bool value)
+{
+    if (!reusable(oper)) {
+	TelEngine::destruct(oper);
+	return new ExpOperation(value);
+    }
+    const_cast<String&>(oper->name()).clear();
+    oper->String::operator=(String::boolText(value));
+    oper->m_number = value ? 1 : 0;
+    oper->m_bool = true;
+    oper->m_isNumber = true;
+    oper->m_lineNo = 0;
+    oper->m_barrier = false;
+    return oper;
+}
+
+ExpOperation* ExpEvaluator::concatResult(ExpOperation* oper, const String& value)
+{
+    if (!reusable(oper)) {
+	ExpOperation* res = new ExpOperation(oper ? (*oper + value) : value);
+	TelEngine::destruct(oper);
+	return res;
+    }
+    const_cast<String&>(oper->name()).clear();
+    oper->append(value);
+    oper->m_number = ExpOperation::nonInteger();
+    oper->m_bool = false;
+    oper->m_isNumber = false;
+    oper->m_lineNo = 0;
+    oper->m_barrier = false;
+    return oper;
+}
+
 bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObject* context) const
 {
     DDebug(this,DebugAll,"runOperation(%p,%u,%p) %s",&stack,oper.opcode(),context,getOperator(oper.opcode()));
@@ -1085,14 +1144,11 @@ bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObj
 			if (op1->isNumber() && op2->isNumber())
 			    break;
 			// turn addition into concatenation
-			{
-			    String val = *op1 + *op2;
-			    TelEngine::destruct(op1);
-			    TelEngine::destruct(op2);
-			    DDebug(this,DebugAll,"String result: '%s'",val.c_str());
-			    pushOne(stack,new ExpOperation(val));
-			    return true;
-			}
+			op1 = concatResult(op1,*op2);
+			TelEngine::destruct(op2);
+			DDebug(this,DebugAll,"String result: '%s'",op1->c_str());
+			pushOne(stack,op1);
+			return true;
 		    default:
 			break;
 		}
@@ -1169,15 +1225,14 @@ bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObj
 			}
 		    }
 		}
-		TelEngine::destruct(op1);
 		TelEngine::destruct(op2);
 		if (boolRes) {
 		    DDebug(this,DebugAll,"Bool result: '%s'",String::boolText(val != 0));
-		    pushOne(stack,new ExpOperation(val != 0));
+		    pushOne(stack,boolResult(op1,val != 0));
 		}
 		else {
 		    DDebug(this,DebugAll,"Numeric result: " FMT64,val);
-		    pushOne(stack,new ExpOperation(val));
+		    pushOne(stack,numberResult(op1,val));
 		}
 	    }
 	    break;
@@ -1202,10 +1257,9 @@ bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObj
 		    default:
 			break;
 		}
-		TelEngine::destruct(op1);
 		TelEngine::destruct(op2);
 		DDebug(this,DebugAll,"Bool result: '%s'",String::boolText(val));
-		pushOne(stack,new ExpOperation(val));
+		pushOne(stack,boolResult(op1,val));
 	    }
 	    break;
 	case OpcCat:
@@ -1217,11 +1271,10 @@ bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObj
 		    TelEngine::destruct(op2);
 		    return gotError("ExpEvaluator stack underflow",oper.lineNumber());
 		}
-		String val = *op1 + *op2;
-		TelEngine::destruct(op1);
+		op1 = concatResult(op1,*op2);
 		TelEngine::destruct(op2);
-		DDebug(this,DebugAll,"String result: '%s'",val.c_str());
-		pushOne(stack,new ExpOperation(val));
+		DDebug(this,DebugAll,"String result: '%s'",op1->c_str());
+		pushOne(stack,op1);
 	    }
 	    break;
 	case OpcAs:
@@ -1247,19 +1300,19 @@ bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObj
 		    return gotError("ExpEvaluator stack underflow",oper.lineNumber());
 		switch (oper.opcode()) {
 		    case OpcNeg:
-			pushOne(stack,new ExpOperation(-op->toNumber()));
+			op = numberResult(op,-op->toNumber());
 			break;
 		    case OpcNot:
-			pushOne(stack,new ExpOperation(~op->valInteger()));
+			op = numberResult(op,~op->valInteger());
 			break;
 		    case OpcLNot:
-			pushOne(stack,new ExpOperation(!op->valBoolean()));
+			op = boolResult(op,!op->valBoolean());
 			break;
 		    default:
-			pushOne(stack,new ExpOperation(op->valInteger()));
+			op = numberResult(op,op->valInteger());
 			break;
 		}
-		TelEngine::destruct(op);
+		pushOne(stack,op);
 	    }
 	    break;
 	case OpcFunc:
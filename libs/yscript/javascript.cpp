@@ -129,12 +129,6 @@ private:
     String m_shortName;
 };
 
-struct JsEntry
-{
-    long int number;
-    unsigned int index;
-};
-
 class JsCode : public ScriptCode, public ExpEvaluator
 {
     friend class TelEngine::JsFunction;
@@ -189,7 +183,7 @@ public:
     };
     inline JsCode()
 	: ExpEvaluator(C),
-	  m_pragmas(""), m_label(0), m_depth(0), m_entries(0), m_traceable(false)
+	  m_pragmas(""), m_label(0), m_depth(0), m_jumps(0), m_jumpsLen(0), m_traceable(false)
 	{ debugName("JsCode"); }
     ~JsCode();
     virtual void* getObject(const String& name) const
@@ -284,7 +278,9 @@ private:
 	{ return YOBJECT(JsFunction,m_globals[name]); }
     long int m_label;
     int m_depth;
-    JsEntry* m_entries;
+    // Linked index of each label, indexed by label number
+    unsigned int* m_jumps;
+    unsigned int m_jumpsLen;
     bool m_traceable;
 };
 
@@ -589,6 +585,7 @@ static const TokenDict s_internals[] =
 
 static const ExpNull s_null;
 static const String s_noFile = "[no file]";
+static const unsigned int s_noJump = (unsigned int)-1;
 static const NativeFields s_nativeFields;
 
 void JsContext::destroyed()
@@ -603,6 +600,10 @@ GenObject* JsContext::resolveTop(ObjList& stack, const String& name, GenObject*
 {
     XDebug(DebugAll,"JsContext::resolveTop '%s'",name.c_str());
     for (ObjList* l = stack.skipNull(); l; l = l->skipNext()) {
+	// call contexts are wrapped with their "()" name as value, skip other operands cheaply
+	const String& val = *static_cast<const ExpOperation*>(l->get());
+	if (val.length() != 2 || val != YSTRING("()"))
+	    continue;
 	JsObject* jso = YOBJECT(JsObject,l->get());
 	if (jso && jso->toString() == YSTRING("()") && jso->hasField(stack,name,context))
 	    return jso;
@@ -616,43 +617,43 @@ GenObject* JsContext::resolve(ObjList& stack, String& name, GenObject* context)
     if (name.find('.') < 0)
 	obj = resolveTop(stack,name,context);
     else {
-	ObjList* list = name.split('.',true);
+	// walk the dotted components in place, this runs for every field access
+	const String full(name);
 	name.clear();
-	for (ObjList* l = list->skipNull(); l; ) {
-	    const String* s = static_cast<const String*>(l->get());
-	    ObjList* l2 = l->skipNext();
-	    if (TelEngine::null(s)) {
+	for (int pos = 0; ; ) {
+	    int dot = full.find('.',pos);
+	    const String s = (dot < 0) ? full.substr(pos) : full.substr(pos,dot - pos);
+	    if (s.null()) {
 		// consecutive dots - not good
 		obj = 0;
 		break;
 	    }
 	    if (!obj)
-		obj = resolveTop(stack,*s,context);
-	    name.append(*s,".");
-	    if (!l2)
+		obj = resolveTop(stack,s,context);
+	    name.append(s,".");
+	    if (dot < 0)
 		break;
+	    pos = dot + 1;
 	    ExpExtender* ext = YOBJECT(ExpExtender,obj);
 	    if (ext) {
 		GenObject* adv = ext->getField(stack,name,context);
 		XDebug(DebugAll,"JsContext::resolve advanced to '%s' of %p for '%s'",
-		    (adv ? adv->toString().c_str() : 0),ext,s->c_str());
+		    (adv ? adv->toString().c_str() : 0),ext,s.c_str());
 		if (adv) {
 		    if (YOBJECT(ExpExtender,adv)) {
 			obj = adv;
 			name.clear();
 		    }
-		    else if (l->count() == 2) { // there is only one other field after this one
-			s = static_cast<const String*>(l2->get());
-			if (!TelEngine::null(s) && s_nativeFields.find(*s)) {
+		    else if ((full.find('.',pos) < 0) && (pos < (int)full.length())) {
+			// there is only one other field after this one
+			if (s_nativeFields.find(full.substr(pos))) {
 			    obj = adv;
 			    name.clear();
 			}
 		    }
 		}
 	    }
-	    l = l2;
 	}
-	TelEngine::destruct(list);
     }
     DDebug(DebugAll,"JsContext::resolve got '%s' %p for '%s'",
 	(obj ? obj->toString().c_str() : 0),obj,name.c_str());
@@ -1053,7 +1054,7 @@ ObjList* JsContext::countAllocations()
 
 JsCode::~JsCode()
 {
-    delete[] m_entries;
+    delete[] m_jumps;
 }
 
 // Initialize standard globals in the execution context
@@ -1091,61 +1092,55 @@ bool JsCode::evaluate(ScriptRun& runner, ObjList& results) const
     return true;
 }
 
-// Convert list to vector and fix label relocations
+// Convert list to vector, build the label table and fix label relocations
 bool JsCode::link()
 {
     if (!m_opcodes.skipNull())
 	return false;
     m_linked.assign(m_opcodes);
-    delete[] m_entries;
-    m_entries = 0;
+    delete[] m_jumps;
+    m_jumps = 0;
+    m_jumpsLen = 0;
     unsigned int n = m_linked.count();
     if (!n)
 	return false;
-    unsigned int entries = 0;
+    m_jumpsLen = m_label + 1;
+    m_jumps = new unsigned int[m_jumpsLen];
+    for (unsigned int i = 0; i < m_jumpsLen; i++)
+	m_jumps[i] = s_noJump;
     for (unsigned int i = 0; i < n; i++) {
 	const ExpOperation* l = static_cast<const ExpOperation*>(m_linked[i]);
 	if (!l || l->opcode() != OpcLabel)
 	    continue;
-	long int lbl = (long int)l->number();
-	if (lbl >= 0 && l->barrier())
-	    entries++;
-	for (unsigned int j = 0; j < n; j++) {
-	    const ExpOperation* jmp = static_cast<const ExpOperation*>(m_linked[j]);
-	    if (!jmp || jmp->number() != lbl)
+	int64_t lbl = l->number();
+	if (lbl >= 0 && lbl < m_jumpsLen && m_jumps[lbl] == s_noJump)
+	    m_jumps[lbl] = i;
+    }
+    for (unsigned int j = 0; j < n; j++) {
+	const ExpOperation* jmp = static_cast<const ExpOperation*>(m_linked[j]);
+	if (!jmp)
+	    continue;
+	Opcode op = OpcNone;
+	switch ((int)jmp->opcode()) {
+	    case OpcJump:
+		op = (Opcode)OpcJRel;
+		break;
+	    case OpcJumpTrue:
+		op = (Opcode)OpcJRelTrue;
+		break;
+	    case OpcJumpFalse:
+		op = (Opcode)OpcJRelFalse;
+		break;
+	    default:
 		continue;
-	    Opcode op = OpcNone;
-	    switch ((int)jmp->opcode()) {
-		case OpcJump:
-		    op = (Opcode)OpcJRel;
-		    break;
-		case OpcJumpTrue:
-		    op = (Opcode)OpcJRelTrue;
-		    break;
-		case OpcJumpFalse:
-		    op = (Opcode)OpcJRelFalse;
-		    break;
-		default:
-		    continue;
-	    }
-	    long int offs = (long int)i - j;
-	    ExpOperation* newJump = new ExpOperation(op,0,offs,jmp->barrier());
-	    newJump->lineNumber(jmp->lineNumber());
-	    m_linked.set(newJump,j);
-	}
-    }
-    if (entries) {
-	m_entries = new JsEntry[entries+1];
-	unsigned int e = 0;
-	for (unsigned int j = 0; j < n; j++) {
-	    const ExpOperation* l = static_cast<const ExpOperation*>(m_linked[j]);
-	    if (l && l->barrier() && l->opcode() == OpcLabel && l->number() >= 0) {
-		m_entries[e].number = (long int)l->number();
-		m_entries[e++].index = j;
-	    }
 	}
-	m_entries[entries].number = -1;
-	m_entries[entries].index = 0;
+	int64_t lbl = jmp->number();
+	if (lbl < 0 || lbl >= m_jumpsLen || m_jumps[lbl] == s_noJump)
+	    continue;
+	long int offs = (long int)m_jumps[lbl] - j;
+	ExpOperation* newJump = new ExpOperation(op,0,offs,jmp->barrier());
+	newJump->lineNumber(jmp->lineNumber());
+	m_linked.set(newJump,j);
     }
     return true;
 }
@@ -2283,11 +2278,10 @@ bool JsCode::runOperation(ObjList& stack, const ExpOperation& oper, GenObject* c
 		    else
 			eq = (op1->number() == op2->number()) && (*op1 == *op2);
 		}
-		TelEngine::destruct(op1);
 		TelEngine::destruct(op2);
 		if ((JsOpcode)oper.opcode() == OpcNeIdentity)
 		    eq = !eq;
-		pushOne(stack,new ExpOperation(eq));
+		pushOne(stack,boolResult(op1,eq));
 	    }
 	    break;
 	case OpcBegin:
@@ -2306,7 +2300,7 @@ bool JsCode::runOperation(ObjList& stack, const ExpOperation& oper, GenObject* c
 		}
 		bool done = false;
 		ExpOperation* o;
-		while ((o = static_cast<ExpOperation*>(stack.remove(false)))) {
+		while ((o = popAny(stack))) {
 		    done = (o->opcode() == (Opcode)OpcBegin);
 		    TelEngine::destruct(o);
 		    if (done)
@@ -2867,27 +2861,10 @@ bool JsCode::jumpToLabel(long int label, GenObject* context) const
 	    }
 	}
     }
-    else {
-	if (m_entries) {
-	    for (const JsEntry* e = m_entries; e->number >= 0; e++) {
-		if (e->number == label) {
-		    runner->m_index = e->index;
-		    XDebug(this,DebugInfo,"Fast jumped to index %u",e->index);
-		    return true;
-		}
-	    }
-	}
-	unsigned int n = m_linked.length();
-	if (!n)
-	    return false;
-	for (unsigned int i = 0; i < n; i++) {
-	    const ExpOperation* o = static_cast<const ExpOperation*>(m_linked[i]);
-	    if (o && o->opcode() == OpcLabel && o->number() == label) {
-		runner->m_index = i;
-		XDebug(this,DebugInfo,"Jumped to index %u",i);
-		return true;
-	    }
-	}
+    else if (label >= 0 && (unsigned long int)label < m_jumpsLen && m_jumps[label] != s_noJump) {
+	runner->m_index = m_jumps[label];
+	XDebug(this,DebugInfo,"Jumped to index %u",runner->m_index);
+	return true;
     }
     return false;
 }
@@ -21,6 +21,31 @@
 #include "yatescript.h"
 #include <string.h>
 
+namespace TelEngine {
+
+// Direct mapped cache of fields an object resolves through its prototype or
+//  native parameters, validated by the layout versions of the lists involved
+class JsFieldCache
+{
+public:
+    JsFieldCache();
+    bool find(const JsObject* obj, const String& name, NamedString*& field) const;
+    void store(const JsObject* obj, const String& name, const ScriptContext* proto, NamedString* field);
+private:
+    struct Entry {
+	String name;
+	u_int64_t version;
+	const ScriptContext* proto;
+	u_int64_t protoVersion;
+	const NamedList* native;
+	u_int64_t nativeVersion;
+	NamedString* field;
+    };
+    Entry m_entries[16];
+};
+
+};
+
 using namespace TelEngine;
 
 namespace { // anonymous
@@ -270,9 +295,47 @@ static void dumpRecursiveObj(const GenObject* obj, String& buf, unsigned int dep
 
 const String JsObject::s_protoName("__proto__");
 
+// Lookups an object must resolve past its own fields before it gets a cache
+static const unsigned int s_fieldCacheAfter = 4;
+
+JsFieldCache::JsFieldCache()
+{
+    for (unsigned int i = 0; i < 16; i++)
+	m_entries[i].version = 0;
+}
+
+bool JsFieldCache::find(const JsObject* obj, const String& name, NamedString*& field) const
+{
+    const Entry& e = m_entries[name.hash() & 15];
+    if (!e.version || (e.version != obj->params().version()) || (e.name != name))
+	return false;
+    // unchanged own fields still hold a reference to the same prototype
+    if (e.proto && ((e.proto->params().version() != e.protoVersion) || e.proto->nativeParams()))
+	return false;
+    const NamedList* np = obj->nativeParams();
+    if ((np != e.native) || (np && (np->version() != e.nativeVersion)))
+	return false;
+    field = e.field;
+    return true;
+}
+
+void JsFieldCache::store(const JsObject* obj, const String& name, const ScriptContext* proto, NamedString* field)
+{
+    Entry& e = m_entries[name.hash() & 15];
+    e.name = name;
+    e.version = obj->params().version();
+    e.proto = proto;
+    e.protoVersion = proto ? proto->params().version() : 0;
+    e.native = obj->nativeParams();
+    e.nativeVersion = e.native ? e.native->version() : 0;
+    e.field = field;
+}
+
+
 JsObject::JsObject(const char* name, ScriptMutex* mtx, bool frozen)
     : ScriptContext(String("[object ") + name + "]"),
-      m_frozen(frozen), m_mutex(mtx), m_lineNo(0)
+      m_frozen(frozen), m_mutex(mtx), m_lineNo(0),
+      m_fieldCache(0), m_fieldMisses(0)
 {
     XDebug(DebugAll,"JsObject::JsObject('%s',%p,%s) [%p]",
 	name,mtx,String::boolText(frozen),this);
@@ -284,7 +347,8 @@ JsObject::JsObject(const char* name, ScriptMutex* mtx, bool frozen)
 
 JsObject::JsObject(ScriptMutex* mtx, const char* name, unsigned int line, bool frozen)
     : ScriptContext(name),
-      m_frozen(frozen), m_mutex(mtx), m_lineNo(line)
+      m_frozen(frozen), m_mutex(mtx), m_lineNo(line),
+      m_fieldCache(0), m_fieldMisses(0)
 {
     XDebug(DebugAll,"JsObject::JsObject(%p,'%s',0x%08x,%s) [%p]",
 	mtx,name,m_lineNo,String::boolText(frozen),this);
@@ -294,7 +358,8 @@ JsObject::JsObject(ScriptMutex* mtx, const char* name, unsigned int line, bool f
 
 JsObject::JsObject(GenObject* context, unsigned int line, ScriptMutex* mtx, bool frozen)
     : ScriptContext("[object Object]"),
-      m_frozen(frozen), m_mutex(mtx), m_lineNo(line)
+      m_frozen(frozen), m_mutex(mtx), m_lineNo(line),
+      m_fieldCache(0), m_fieldMisses(0)
 {
     XDebug(DebugAll,"JsObject::JsObject(ctxt=%p,l=0x%08x,mtx=%p,f=%s) [%p]",
 	context,m_lineNo,mtx,String::boolText(frozen),this);
@@ -308,6 +373,7 @@ JsObject::~JsObject()
     if (m_mutex && m_mutex->objTrack())
 	m_mutex->objDeleted(this);
     XDebug(DebugAll,"JsObject::~JsObject '%s' [%p]",toString().c_str(),this);
+    delete m_fieldCache;
 }
 
 JsObject* JsObject::copy(ScriptMutex* mtx, const ExpOperation& oper) const
@@ -583,30 +649,48 @@ const HashList* JsObject::getHashListParams() const
 
 bool JsObject::hasField(ObjList& stack, const String& name, GenObject* context) const
 {
-    if (ScriptContext::hasField(stack,name,context))
-	return true;
-    const ScriptContext* proto = YOBJECT(ScriptContext,params().getParam(protoName()));
-    if (proto && proto->hasField(stack,name,context))
-	return true;
-    NamedList* np = nativeParams();
-    return np && np->getParam(name);
+    return getField(stack,name,context) != 0;
 }
 
 NamedString* JsObject::getField(ObjList& stack, const String& name, GenObject* context) const
 {
-    NamedString* fld = ScriptContext::getField(stack,name,context);
+    NamedString* fld = 0;
+    if (m_fieldCache && m_fieldCache->find(this,name,fld))
+	return fld;
+    fld = ScriptContext::getField(stack,name,context);
     if (fld)
 	return fld;
     const ScriptContext* proto = YOBJECT(ScriptContext,params().getParam(protoName()));
-    if (proto) {
+    if (proto)
 	fld = proto->getField(stack,name,context);
-	if (fld)
-	    return fld;
+    if (!fld) {
+	NamedList* np = nativeParams();
+	if (np)
+	    fld = np->getParam(name);
     }
-    NamedList* np = nativeParams();
-    if (np)
-	return np->getParam(name);
-    return 0;
+    cacheField(name,proto,fld);
+    return fld;
+}
+
+// Remember a field resolved past own fields if the lookup path is simple enough
+void JsObject::cacheField(const String& name, const ScriptContext* proto, NamedString* field) const
+{
+    if (proto) {
+	// deeper prototype chains are not cached
+	if (proto->nativeParams())
+	    return;
+	const JsObject* jso = YOBJECT(JsObject,proto);
+	if (jso && jso->params().getParam(protoName()))
+	    return;
+    }
+    else if (!nativeParams())
+	return;
+    if (!m_fieldCache) {
+	if (++m_fieldMisses < s_fieldCacheAfter)
+	    return;
+	m_fieldCache = new JsFieldCache;
+    }
+    m_fieldCache->store(this,name,proto,field);
 }
 
 JsObject* JsObject::runConstructor(ObjList& stack, const ExpOperation& oper, GenObject* context)
@@ -905,6 +905,33 @@ protected:
      */
     virtual bool runAssign(ObjList& stack, const ExpOperation& oper, GenObject* context = 0) const;
 
+    /**
+     * Store a Number result in an operand already popped off the stack.
+     * The operand is reused if it holds a plain value, destroyed otherwise
+     * @param oper Operand owned by the caller, may be NULL
+     * @param value Number to store, ExpOperation::nonInteger() for NaN
+     * @return Operation holding the result, to be pushed on the stack
+     */
+    static ExpOperation* numberResult(ExpOperation* oper, int64_t value);
+
+    /**
+     * Store a Boolean result in an operand already popped off the stack.
+     * The operand is reused if it holds a plain value, destroyed otherwise
+     * @param oper Operand owned by the caller, may be NULL
+     * @param value Boolean to store
+     * @return Operation holding the result, to be pushed on the stack
+     */
+    static ExpOperation* boolResult(ExpOperation* oper, bool value);
+
+    /**
+     * Store a String concatenation result in an operand already popped off the stack.
+     * The operand is reused if it holds a plain value, destroyed otherwise
+     * @param oper Left side operand owned by the caller, may be NULL
+     * @param value String to append to the value of the left side operand
+     * @return Operation holding the result, to be pushed on the stack
+     */
+    static ExpOperation* concatResult(ExpOperation* oper, const String& value);
+
     /**
      * Dump a single operation according to current operators dictionary
      * @param oper Operation to dump
@@ -2031,6 +2058,7 @@ private:
 };
 
 class JsFunction;
+class JsFieldCache;
 
 /**
  * Javascript Object class, base for all JS objects
@@ -2474,10 +2502,14 @@ protected:
 
 private:
     static void internalToJSON(const GenObject* obj, bool isStr, String& buf, int spaces, int indent = 0);    
+    void cacheField(const String& name, const ScriptContext* proto, NamedString* field) const;
     static const String s_protoName;
     bool m_frozen;
     ScriptMutex* m_mutex;
     unsigned int m_lineNo; // creation line for this object;
+    // fields found through prototype or native parameters, serialized by m_mutex
+    mutable JsFieldCache* m_fieldCache;
+    mutable unsigned int m_fieldMisses;
 };
 
 /**
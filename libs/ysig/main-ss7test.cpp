@@ -41,9 +41,153 @@ public:
 	}
 };
 
-int main()
+// TCAP user accepting all indications
+class LoadTCAPUser : public TCAPUser
+{
+public:
+    inline LoadTCAPUser()
+	: TCAPUser("tcapload"), m_indications(0)
+	{ }
+    virtual bool tcapIndication(NamedList& params)
+	{ m_indications++; return true; }
+    virtual int managementState()
+	{ return SCCPManagement::UserInService; }
+    unsigned int m_indications;
+};
+
+// Pushes TCAP messages from its own thread, numbered in the data
+class LoadProducer : public Thread
+{
+public:
+    inline LoadProducer(SS7TCAP* tcap, unsigned int id, unsigned int count)
+	: Thread("TCAP producer"), m_tcap(tcap), m_id(id), m_count(count)
+	{ }
+    virtual void run()
+	{
+	    for (unsigned int i = 0; i < m_count; i++) {
+		NamedList params("");
+		unsigned int tmp[2] = { m_id, i };
+		DataBlock data(tmp,sizeof(tmp));
+		m_tcap->enqueue(new SS7TCAPMessage(params,data));
+	    }
+	}
+private:
+    SS7TCAP* m_tcap;
+    unsigned int m_id;
+    unsigned int m_count;
+};
+
+static unsigned int nsPer(u_int64_t usec, unsigned int count)
+{
+    return count ? (unsigned int)(1000 * usec / count) : 0;
+}
+
+// Open many dialogues on a TCAP, look them up, run its timer and close them
+static int tcapLoad(unsigned int count)
+{
+    Output("TCAP load test with %u transactions",count);
+    NamedList params("tcapload");
+    params.addParam("transact_timeout","60");
+    SS7TCAPITU* tcap = new SS7TCAPITU(params);
+    tcap->initialize(&params);
+    LoadTCAPUser* user = new LoadTCAPUser;
+    user->attach(tcap);
+
+    String* ids = new String[count];
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < count; i++) {
+	NamedList req("");
+	req.addParam("tcap.request.type","Begin");
+	req.addParam("tcap.user",user->toString());
+	tcap->userRequest(req);
+	ids[i] = req.getValue("tcap.transaction.localTID");
+    }
+    Output("Opened %u dialogues: %u ns each",count,nsPer(Time::now() - t,count));
+
+    unsigned int found = 0;
+    t = Time::now();
+    for (unsigned int n = 0; n < 4; n++) {
+	for (unsigned int i = 0; i < count; i++) {
+	    SS7TCAPTransaction* tr = tcap->getTransaction(ids[(i * 7919) % count]);
+	    if (tr)
+		found++;
+	    TelEngine::destruct(tr);
+	}
+    }
+    Output("Looked up %u of %u transactions: %u ns each",found,4 * count,nsPer(Time::now() - t,4 * count));
+
+    Time now;
+    t = Time::now();
+    tcap->timerTick(now);
+    Output("First timer tick: %u us",(unsigned int)(Time::now() - t));
+    t = Time::now();
+    for (unsigned int i = 1; i <= 100; i++)
+	tcap->timerTick(Time(now.usec() + 20000 * i));
+    Output("Next 100 timer ticks: %u us each",(unsigned int)((Time::now() - t) / 100));
+
+    // MPSC inbound queue, consumed here while producers run
+    unsigned int producers = 4;
+    unsigned int msgs = count;
+    unsigned int* next = new unsigned int[producers];
+    LoadProducer** threads = new LoadProducer*[producers];
+    for (unsigned int p = 0; p < producers; p++) {
+	next[p] = 0;
+	threads[p] = new LoadProducer(tcap,p,msgs);
+    }
+    unsigned int got = 0;
+    unsigned int bad = 0;
+    t = Time::now();
+    for (unsigned int p = 0; p < producers; p++)
+	threads[p]->startup();
+    while (got < producers * msgs) {
+	SS7TCAPMessage* msg = tcap->dequeue();
+	if (!msg) {
+	    Thread::yield();
+	    continue;
+	}
+	const unsigned int* tmp = (const unsigned int*)msg->msgData().data();
+	if (tmp[0] >= producers || tmp[1] != next[tmp[0]]++)
+	    bad++;
+	got++;
+	TelEngine::destruct(msg);
+    }
+    Output("Queued %u messages from %u threads: %u out of order, %u ns each",
+	got,producers,bad,nsPer(Time::now() - t,got));
+    delete[] threads;
+    delete[] next;
+
+    t = Time::now();
+    for (unsigned int i = 0; i < count; i++) {
+	NamedList req("");
+	req.addParam("tcap.request.type","End");
+	req.addParam("tcap.transaction.localTID",ids[i]);
+	req.addParam("tcap.transaction.terminationBasic","true");
+	tcap->userRequest(req);
+    }
+    tcap->timerTick(Time(now.usec() + 3000000));
+    unsigned int left = 0;
+    for (unsigned int i = 0; i < count; i++) {
+	SS7TCAPTransaction* tr = tcap->getTransaction(ids[i]);
+	if (tr)
+	    left++;
+	TelEngine::destruct(tr);
+    }
+    Output("Ended %u dialogues: %u ns each, %u left",count,nsPer(Time::now() - t,count),left);
+    delete[] ids;
+    user->attach(0);
+    TelEngine::destruct(user);
+    TelEngine::destruct(tcap);
+    return (found == 4 * count && !bad && !left) ? 0 : 1;
+}
+
+int main(int argc, const char** argv)
 {
     Debugger::enableOutput(true,true);
+    if (argc > 1 && (YSTRING("tcap") == argv[1])) {
+	debugLevel(DebugWarn);
+	int count = String(argc > 2 ? argv[2] : "").toInteger(100000,0,1);
+	return tcapLoad(count);
+    }
     debugLevel(DebugAll);
     Output("SS7 library test starting");
     SS7PointCode scp(2,141,4);
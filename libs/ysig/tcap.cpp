@@ -112,6 +112,56 @@ struct PrimitiveMapping {
 
 static bool s_extendedDbg = false;
 static bool s_printMsgs = false;
+// Transactions are checked in timer wheel slots of 10ms, at least once per second
+static const unsigned int s_checkSlotMsec = 10;
+static const unsigned int s_checkSlots = 128;
+static const unsigned int s_checkMaxMsec = 1000;
+// Number of transaction table shards, each one a full size HashList
+static const unsigned int s_shards = 16;
+
+namespace TelEngine {
+
+// Transactions sharing a lock, hashed by local ID
+class SS7TCAPShard
+{
+public:
+    inline SS7TCAPShard()
+	: m_mutex(false,"TCAPTransactions"), m_list(1024)
+	{ }
+    // Pick the shard of an ID, HashList uses the low bits of the hash
+    static inline SS7TCAPShard& get(SS7TCAPShard* shards, const String& id)
+	{ return shards[(id.hash() >> 10) % s_shards]; }
+    inline void append(SS7TCAPTransaction* tr)
+	{ Lock lock(m_mutex); m_list.append(tr); }
+    inline bool contains(SS7TCAPTransaction* tr)
+	{ Lock lock(m_mutex); return 0 != m_list.find(tr,tr->toString().hash()); }
+    inline SS7TCAPTransaction* find(const String& id)
+	{
+	    Lock lock(m_mutex);
+	    ObjList* o = m_list.find(id);
+	    SS7TCAPTransaction* tr = o ? static_cast<SS7TCAPTransaction*>(o->get()) : 0;
+	    return (tr && tr->ref()) ? tr : 0;
+	}
+    inline bool remove(SS7TCAPTransaction* tr)
+	{ Lock lock(m_mutex); return 0 != m_list.remove(tr,false,true); }
+    inline unsigned int count()
+	{ Lock lock(m_mutex); return m_list.count(); }
+    static unsigned int count(SS7TCAPShard* shards);
+private:
+    Mutex m_mutex;
+    HashList m_list;
+};
+
+}; // namespace TelEngine
+
+unsigned int SS7TCAPShard::count(SS7TCAPShard* shards)
+{
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < s_shards; i++)
+	n += shards[i].count();
+    return n;
+}
+
 static const String s_checkAddr = "tcap.checkAddress";
 static const String s_localPC = "LocalPC";
 static const String s_remotePC = "RemotePC";
@@ -258,7 +308,8 @@ const TokenDict SS7TCAP::s_compOperClasses[] = {
 SS7TCAP::SS7TCAP(const NamedList& params)
     : SCCPUser(params),
       m_usersMtx(true,"TCAPUsers"),
-      m_inQueueMtx(true,"TCAPPendingMsg"),
+      m_inPushed(0), m_inQueue(0),
+      m_inQueueMtx(false,"TCAPPendingMsg"),
       m_SSN(0),
       m_defaultRemoteSSN(0),
       m_defaultHopCounter(0),
@@ -266,6 +317,9 @@ SS7TCAP::SS7TCAP(const NamedList& params)
       m_remoteTypePC(SS7PointCode::Other),
       m_trTimeout(300),
       m_transactionsMtx(true,"TCAPTransactions"),
+      m_transactions(new SS7TCAPShard[s_shards]),
+      m_checkWheel(new ObjList[s_checkSlots]),
+      m_checkSlot(Time::msecNow() / s_checkSlotMsec),
       m_tcapType(UnknownTCAP),
       m_idsPool(0)
 {
@@ -290,9 +344,10 @@ SS7TCAP::~SS7TCAP()
 	}
 	m_users.setDelete(false);
     }
-    m_transactions.clear();
-    m_inQueue.clear();
-
+    delete[] m_checkWheel;
+    delete[] m_transactions;
+    while (SS7TCAPMessage* msg = dequeue())
+	TelEngine::destruct(msg);
 }
 
 bool SS7TCAP::initialize(const NamedList* config)
@@ -491,12 +546,27 @@ void SS7TCAP::detach(TCAPUser* user)
     }
 }
 
+// Producers push messages on a stack, the consumer takes the whole stack at once
+//  and reverses it so there is no ABA problem and no producer ever waits
 void SS7TCAP::enqueue(SS7TCAPMessage* msg)
 {
     if (!msg)
 	return;
+#ifdef ATOMIC_OPS
+    SS7TCAPMessage* head;
+    do {
+	head = m_inPushed;
+	msg->m_next = head;
+#ifdef _WINDOWS
+    } while (InterlockedCompareExchangePointer((PVOID*)&m_inPushed,msg,head) != head);
+#else
+    } while (!__sync_bool_compare_and_swap(&m_inPushed,head,msg));
+#endif
+#else
     Lock lock(m_inQueueMtx);
-    m_inQueue.append(msg);
+    msg->m_next = m_inPushed;
+    m_inPushed = msg;
+#endif
     XDebug(this,DebugAll,"SS7TCAP::enqueue(). Enqueued transaction wrapper (%p) [%p]",msg,this);
 }
 
@@ -505,11 +575,29 @@ SS7TCAPMessage* SS7TCAP::dequeue()
     Lock lock(m_inQueueMtx,SignallingEngine::maxLockWait());
     if (!lock.locked())
 	return 0;
-    ObjList* obj = m_inQueue.skipNull();
-    if (!obj)
-	return 0;
-    SS7TCAPMessage* msg = static_cast<SS7TCAPMessage*>(obj->get());
-    m_inQueue.remove(msg,false);
+    if (!m_inQueue) {
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+	SS7TCAPMessage* pushed = (SS7TCAPMessage*)InterlockedExchangePointer((PVOID*)&m_inPushed,0);
+#else
+	SS7TCAPMessage* pushed = __sync_lock_test_and_set(&m_inPushed,(SS7TCAPMessage*)0);
+#endif
+#else
+	SS7TCAPMessage* pushed = m_inPushed;
+	m_inPushed = 0;
+#endif
+	while (pushed) {
+	    SS7TCAPMessage* next = pushed->m_next;
+	    pushed->m_next = m_inQueue;
+	    m_inQueue = pushed;
+	    pushed = next;
+	}
+	if (!m_inQueue)
+	    return 0;
+    }
+    SS7TCAPMessage* msg = m_inQueue;
+    m_inQueue = msg->m_next;
+    msg->m_next = 0;
     XDebug(this,DebugAll,"SS7TCAP::dequeue(). Dequeued transaction wrapper (%p) [%p]",msg,this);
     return msg;
 }
@@ -599,20 +687,39 @@ void SS7TCAP::userStatus(NamedList& status)
 
 SS7TCAPTransaction* SS7TCAP::getTransaction(const String& tid)
 {
-    SS7TCAPTransaction* tr = 0;
-    Lock lock(m_transactionsMtx);
-    ObjList* o = m_transactions.find(tid);
-    if (o)
-	tr = static_cast<SS7TCAPTransaction*>(o->get());
-    if (tr && tr->ref())
-	return tr;
-    return 0;
+    return SS7TCAPShard::get(m_transactions,tid).find(tid);
 }
 
 void SS7TCAP::removeTransaction(SS7TCAPTransaction* tr)
 {
+    if (!tr)
+	return;
     Lock lock(m_transactionsMtx);
-    m_transactions.remove(tr);
+    // any entry left in the timer wheel is dropped when its slot is reached
+    tr->m_checkSlot = 0;
+    bool removed = SS7TCAPShard::get(m_transactions,tr->toString()).remove(tr);
+    lock.drop();
+    if (removed)
+	TelEngine::destruct(tr);
+}
+
+void SS7TCAP::scheduleCheck(SS7TCAPTransaction* tr, u_int64_t when)
+{
+    if (!tr)
+	return;
+    u_int64_t slot = when / s_checkSlotMsec + 1;
+    Lock lock(m_transactionsMtx);
+    if (slot <= m_checkSlot)
+	slot = m_checkSlot + 1;
+    else if (slot >= m_checkSlot + s_checkSlots)
+	slot = m_checkSlot + s_checkSlots - 1;
+    // already scheduled earlier or removed?
+    if (tr->m_checkSlot && tr->m_checkSlot <= slot)
+	return;
+    if (!SS7TCAPShard::get(m_transactions,tr->toString()).contains(tr) || !tr->ref())
+	return;
+    tr->m_checkSlot = slot;
+    m_checkWheel[slot % s_checkSlots].insert(tr);
 }
 
 void SS7TCAP::timerTick(const Time& when)
@@ -627,38 +734,56 @@ void SS7TCAP::timerTick(const Time& when)
 	msg = dequeue();
     }
 
-    // update/handle rest of transactions
+    // update/handle transactions that changed or whose timers may have expired
+    u_int64_t now = when.msec();
+    u_int64_t slot = now / s_checkSlotMsec;
     Lock lock(m_transactionsMtx);
-    ListIterator iter(m_transactions);
-    for (;;) {
-	SS7TCAPTransaction* tr = static_cast<SS7TCAPTransaction*>(iter.get());
-	// End of iteration?
-	if (!tr)
-	    break;
-	if (!tr->ref())
-	    continue;
-	lock.drop();
-	NamedList params("");
-	DataBlock data;
-	if (tr->transactionState() != SS7TCAPTransaction::Idle)
-	    tr->checkComponents();
-	if (tr->endNow())
-	    tr->setState(SS7TCAPTransaction::Idle);
-	if (tr->timedOut()) {
-	    DDebug(this,DebugInfo,"SS7TCAP::timerTick() - transaction with id=%s(%p) timed out [%p]",tr->toString().c_str(),tr,this);
-	    tr->updateToEnd();
-	    buildSCCPData(params,tr);
-	    if (!tr->basicEnd())
-		tr->transactionData(params);
-	    sendToUser(params);
-	    tr->setState(SS7TCAPTransaction::Idle);
-	}
+    if (slot <= m_checkSlot)
+	return;
+    u_int64_t s = m_checkSlot + 1;
+    if (slot - m_checkSlot > s_checkSlots)
+	s = slot - s_checkSlots + 1;
+    for (; s <= slot; s++) {
+	m_checkSlot = s;
+	ObjList& list = m_checkWheel[s % s_checkSlots];
+	for (;;) {
+	    SS7TCAPTransaction* tr = static_cast<SS7TCAPTransaction*>(list.remove(false));
+	    if (!tr)
+		break;
+	    // skip entries of removed or rescheduled transactions
+	    if (!tr->m_checkSlot || tr->m_checkSlot > s) {
+		TelEngine::destruct(tr);
+		continue;
+	    }
+	    tr->m_checkSlot = 0;
+	    lock.drop();
+	    NamedList params("");
+	    if (tr->transactionState() != SS7TCAPTransaction::Idle)
+		tr->checkComponents();
+	    if (tr->endNow())
+		tr->setState(SS7TCAPTransaction::Idle);
+	    if (tr->timedOut()) {
+		DDebug(this,DebugInfo,"SS7TCAP::timerTick() - transaction with id=%s(%p) timed out [%p]",tr->toString().c_str(),tr,this);
+		tr->updateToEnd();
+		buildSCCPData(params,tr);
+		if (!tr->basicEnd())
+		    tr->transactionData(params);
+		sendToUser(params);
+		tr->setState(SS7TCAPTransaction::Idle);
+	    }
 
-	if (tr->transactionState() == SS7TCAPTransaction::Idle)
-	    removeTransaction(tr);
-	TelEngine::destruct(tr);
-	if (!lock.acquire(m_transactionsMtx))
-	    break;
+	    if (tr->transactionState() == SS7TCAPTransaction::Idle)
+		removeTransaction(tr);
+	    else {
+		u_int64_t next = tr->nextTimeout();
+		if (!next || next > now + s_checkMaxMsec)
+		    next = now + s_checkMaxMsec;
+		scheduleCheck(tr,next);
+	    }
+	    TelEngine::destruct(tr);
+	    if (!lock.acquire(m_transactionsMtx))
+		return;
+	}
     }
 }
 
@@ -703,9 +828,8 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 		allocTransactionID(newID);
 		tr = buildTransaction(type,newID,msgParams,false);
 		tr->ref();
-		m_transactionsMtx.lock();
-		m_transactions.append(tr);
-		m_transactionsMtx.unlock();
+		SS7TCAPShard::get(m_transactions,tr->toString()).append(tr);
+		scheduleCheck(tr);
 		msgParams.setParam(s_tcapLocalTID,newID);
 	    }
 	    break;
@@ -726,6 +850,8 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 		transactError.setError(SS7TCAPError::Transact_UnassignedTransactionID);
 		return handleError(transactError,msgParams,msgData);
 	    }
+	    // state changes are handled on next timer tick
+	    scheduleCheck(tr);
 	    transactError = tr->update((SS7TCAP::TCAPUserTransActions)type,msgParams,false);
 	    if (transactError.error() != SS7TCAPError::NoError) {
 		result = handleError(transactError,msgParams,msgData,tr);
@@ -825,9 +951,8 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
 		if (!TelEngine::null(user))
 		    tr->setUserName(user);
 		tr->ref();
-		m_transactionsMtx.lock();
-		m_transactions.append(tr);
-		m_transactionsMtx.unlock();
+		SS7TCAPShard::get(m_transactions,tr->toString()).append(tr);
+		scheduleCheck(tr);
 		break;
 	    case SS7TCAP::TC_Continue:
 	    case SS7TCAP::TC_ConversationWithPerm:
@@ -870,12 +995,10 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
     }
     if (tr) {
 	error = tr->handleDialogPortion(params,true);
+	if (error.error() == SS7TCAPError::NoError)
+	    error = tr->handleComponents(params,true);
 	if (error.error() != SS7TCAPError::NoError) {
-	    TelEngine::destruct(tr);
-	    return error;
-	}
-	error = tr->handleComponents(params,true);
-	if (error.error() != SS7TCAPError::NoError) {
+	    scheduleCheck(tr);
 	    TelEngine::destruct(tr);
 	    return error;
 	}
@@ -886,6 +1009,8 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
 	}
 	else if (tr->transmitState() == SS7TCAPTransaction::NoTransmit)
 	    removeTransaction(tr);
+	// state changes are handled on next timer tick
+	scheduleCheck(tr);
 	TelEngine::destruct(tr);
     }
     return error;
@@ -1223,7 +1348,8 @@ SS7TCAPTransaction::SS7TCAPTransaction(SS7TCAP* tcap, SS7TCAP::TCAPUserTransActi
 	const String& transactID, NamedList& params, u_int64_t timeout, bool initLocal)
     : Mutex(true,"TcapTransaction"),
       m_tcap(tcap), m_tcapType(SS7TCAP::UnknownTCAP), m_userName(""), m_localID(transactID), m_type(type),
-      m_localSCCPAddr(""), m_remoteSCCPAddr(""), m_basicEnd(true), m_endNow(false), m_timeout(timeout)
+      m_localSCCPAddr(""), m_remoteSCCPAddr(""), m_basicEnd(true), m_endNow(false), m_timeout(timeout),
+      m_checkSlot(0)
 {
 
     DDebug(m_tcap,DebugAll,"SS7TCAPTransaction(tcap = '%s' [%p], transactID = %s) created [%p]",
@@ -1520,6 +1646,18 @@ void SS7TCAPTransaction::checkComponents()
     }
 }
 
+u_int64_t SS7TCAPTransaction::nextTimeout()
+{
+    Lock l(this);
+    u_int64_t next = m_timeout.started() ? m_timeout.fireTime() : 0;
+    for (ObjList* o = m_components.skipNull(); o; o = o->skipNext()) {
+	u_int64_t t = static_cast<SS7TCAPComponent*>(o->get())->fireTime();
+	if (t && (!next || t < next))
+	    next = t;
+    }
+    return next;
+}
+
 void SS7TCAPTransaction::setTransmitState(TransactionTransmit state)
 {
     Lock l(this);
@@ -1856,7 +1994,7 @@ SS7TCAPANSI::SS7TCAPANSI(const NamedList& params)
 SS7TCAPANSI::~SS7TCAPANSI()
 {
     DDebug(this,DebugAll,"SS7TCAPANSI::~SS7TCAPANSI() [%p] destroyed with %d transactions, refCount=%d",
-		this,m_transactions.count(),refcount());
+		this,SS7TCAPShard::count(m_transactions),refcount());
 }
 
 SS7TCAPTransaction* SS7TCAPANSI::buildTransaction(SS7TCAP::TCAPUserTransActions type, const String& transactID, NamedList& params,
@@ -3103,7 +3241,7 @@ SS7TCAPITU::SS7TCAPITU(const NamedList& params)
 SS7TCAPITU::~SS7TCAPITU()
 {
     DDebug(this,DebugAll,"SS7TCAPITU::~SS7TCAPITU() [%p] destroyed with %d transactions, refCount=%d",
-	this,m_transactions.count(),refcount());
+	this,SS7TCAPShard::count(m_transactions),refcount());
 }
 
 SS7TCAPTransaction* SS7TCAPITU::buildTransaction(SS7TCAP::TCAPUserTransActions type, const String& transactID, NamedList& params,
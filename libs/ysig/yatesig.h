@@ -123,6 +123,7 @@ class SS7TCAPMessage;                    // SS7 TCAP message wrapper
 class SS7TCAPError;                      // SS7 TCAP errors
 class SS7TCAP;                           // SS7 TCAP implementation
 class SS7TCAPTransaction;                // SS7 TCAP transaction base class
+class SS7TCAPShard;                      // SS7 TCAP transactions sharing a lock
 class SS7TCAPComponent;                  // SS7 TCAP component
 class SS7TCAPANSI;                       // SS7 ANSI TCAP implementation
 class SS7TCAPTransactionANSI;            // SS7 TCAP ANSI Transaction
@@ -5164,6 +5165,7 @@ class YSIG_API ASPUser
  */
 class YSIG_API GTT : virtual public SignallingComponent
 {
+    YCLASS(GTT,SignallingComponent)
 public:
     /**
      * Constructor
@@ -10740,6 +10742,7 @@ class YSIG_API SS7SUA : public SIGAdaptUser, public SCCP
  */
 class YSIG_API SS7TCAPMessage : public GenObject
 {
+    friend class SS7TCAP;
 public:
     /**
      * Constructor
@@ -10748,7 +10751,7 @@ public:
      * @param notice Flag if this is a notification, true if it is, false if it's a message
      */
     inline SS7TCAPMessage(NamedList& params, DataBlock& data, bool notice = false)
-	: m_msgParams(params), m_msgData(data), m_notice(notice)
+	: m_msgParams(params), m_msgData(data), m_notice(notice), m_next(0)
 	{}
 
     /**
@@ -10776,6 +10779,7 @@ private:
     NamedList m_msgParams;
     DataBlock m_msgData;
     bool m_notice;
+    SS7TCAPMessage* m_next;              // Next message in the TCAP processing queue
 };
 
 /**
@@ -10941,13 +10945,15 @@ public:
 	{ m_tcapType = type; }
 
     /**
-     * Enqueue data received from SCCP as a TCAP message, kept in a processing queue
+     * Enqueue data received from SCCP as a TCAP message, kept in a processing queue.
+     * Producers don't lock each other or the consumer if atomic operations are available
      * @param msg A SS7TCAPMessage pointer containing all data received from SSCP
      */
     virtual void enqueue(SS7TCAPMessage* msg);
 
     /**
-     * Dequeue a TCAP message when ready to process it
+     * Dequeue a TCAP message when ready to process it, messages are returned in
+     *  the order they were enqueued by each producer
      * @return A SS7TCAPMessage pointer dequeued from the queue
      */
     virtual SS7TCAPMessage* dequeue();
@@ -11008,6 +11014,13 @@ public:
      */
     void removeTransaction(SS7TCAPTransaction* tr);
 
+    /**
+     * Schedule a transaction to be checked for state changes and timeouts
+     * @param tr The transaction to check
+     * @param when Time in milliseconds when to check it, 0 to check on next timer tick
+     */
+    void scheduleCheck(SS7TCAPTransaction* tr, u_int64_t when = 0);
+
     /**
      * Method called periodically to do processing and timeout checks
      * @param when Time to use as computing base for events and timeouts
@@ -11149,8 +11162,9 @@ protected:
     ObjList m_users;
     Mutex m_usersMtx;
 
-    // list of messages received from sublayer, waiting to be processed
-    ObjList m_inQueue;
+    // messages received from sublayer, waiting to be processed
+    SS7TCAPMessage* m_inPushed;          // Last enqueued, linked to older ones
+    SS7TCAPMessage* m_inQueue;           // Taken by the consumer, oldest first
     Mutex m_inQueueMtx;
 
     unsigned int m_SSN;
@@ -11160,9 +11174,13 @@ protected:
     SS7PointCode::Type m_remoteTypePC;
     u_int64_t m_trTimeout;
 
-    // list of current TCAP transactions
+    // protects transaction ID allocation and the timer wheel
     Mutex m_transactionsMtx;
-    ObjList m_transactions;
+    // current TCAP transactions, hashed by local ID into separately locked shards
+    SS7TCAPShard* m_transactions;
+    // transactions to check, in timer wheel slots
+    ObjList* m_checkWheel;
+    u_int64_t m_checkSlot;
     // type of TCAP
     TCAPType m_tcapType;
 
@@ -11309,6 +11327,7 @@ private:
  */
 class YSIG_API SS7TCAPTransaction : public RefObject, public Mutex
 {
+    friend class SS7TCAP;
 public:
     enum TransactionState {
 	Idle                      = 0,
@@ -11517,6 +11536,12 @@ public:
     inline bool timedOut()
 	{ return m_timeout.timeout(); }
 
+    /**
+     * Retrieve the earliest time when the transaction or one of its components times out
+     * @return Time in milliseconds, 0 if no timer is running
+     */
+    u_int64_t nextTimeout();
+
     /**
      * Find a component with given id
      * @param id Id of component to find
@@ -11585,6 +11610,9 @@ protected:
     bool m_basicEnd; // basic or prearranged end (specified by user when sending a Response)
     bool m_endNow; // delete immediately after sending
     SignallingTimer m_timeout;
+
+private:
+    u_int64_t m_checkSlot; // timer wheel slot of the TCAP where the transaction is checked
 };
 
 /**
@@ -11694,6 +11722,13 @@ public:
     inline bool timedOut()
 	{ return m_opTimer.timeout(); }
 
+    /**
+     * Retrieve the time when the component times out
+     * @return Time in milliseconds, 0 if the operation timer is not running
+     */
+    inline u_int64_t fireTime() const
+	{ return m_opTimer.fireTime(); }
+
     /**
      * Set component state
      * @param state The state to be set
@@ -29,6 +29,14 @@
 
 using namespace TelEngine;
 
+// Number of buckets in the Call-ID and branch transaction hashes
+#define SIP_TRANS_HASH 4099
+// Timer wheel has 4096 slots of 8.192 msec each, a turn takes about 33.5 sec
+#define SIP_WHEEL_SHIFT 13
+#define SIP_WHEEL_SIZE 4096
+// Outer wheel has one slot per inner turn and covers about 35 minutes
+#define SIP_WHEEL_OUTER 64
+
 static TokenDict sip_responses[] = {
     { "Trying", 100 },
     { "Ringing", 180 },
@@ -169,6 +177,9 @@ SIPEvent::~SIPEvent()
 
 SIPEngine::SIPEngine(const char* userAgent)
     : Mutex(true,"SIPEngine"),
+      m_transList(SIP_TRANS_HASH), m_branchList(SIP_TRANS_HASH),
+      m_timerWheel(0), m_timerTick(Time::now() >> SIP_WHEEL_SHIFT),
+      m_wakeup(1,"SIPEngineWakeup"),
       m_t1(500000), m_t4(5000000), m_reqTransCount(5), m_rspTransCount(6),
       m_maxForwards(70),
       m_flags(0), m_lazyTrying(false),
@@ -178,6 +189,7 @@ SIPEngine::SIPEngine(const char* userAgent)
 {
     debugName("sipengine");
     DDebug(this,DebugInfo,"SIPEngine::SIPEngine() [%p]",this);
+    m_timerWheel = new ObjList[SIP_WHEEL_SIZE + SIP_WHEEL_OUTER];
     m_seq = new SIPSequence;
     m_seq->deref();
     if (m_userAgent.null())
@@ -191,6 +203,39 @@ SIPEngine::SIPEngine(const char* userAgent)
 SIPEngine::~SIPEngine()
 {
     DDebug(this,DebugInfo,"SIPEngine::~SIPEngine() [%p]",this);
+    clearTransactions();
+    delete[] m_timerWheel;
+}
+
+// Try to match a message to the transactions of a hash bucket
+static SIPTransaction* matchList(ObjList* l, SIPMessage* message, const String& branch,
+    const String* callid, SIPTransaction*& forked)
+{
+    for (; l; l = l->next()) {
+	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	if (!t)
+	    continue;
+	if (callid) {
+	    if (t->getCallID() != *callid)
+		continue;
+	    // already tried when matching by branch
+	    if (branch && (t->getBranch() == branch))
+		continue;
+	}
+	else if (t->getBranch() != branch)
+	    continue;
+	switch (t->processMessage(message,branch)) {
+	    case SIPTransaction::Matched:
+		return t;
+	    case SIPTransaction::NoDialog:
+		forked = t;
+		break;
+	    case SIPTransaction::NoMatch:
+	    default:
+		break;
+	}
+    }
+    return 0;
 }
 
 SIPTransaction* SIPEngine::addMessage(SIPParty* ep, const char* buf, int len)
@@ -229,22 +274,17 @@ SIPTransaction* SIPEngine::addMessage(SIPMessage* message, bool* autoChangeParty
 	branch = *br;
     Lock lock(this);
     SIPTransaction* forked = 0;
-    ObjList* l = &m_transList;
-    for (; l; l = l->next()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	if (!t)
-	    continue;
-	switch (t->processMessage(message,branch)) {
-	    case SIPTransaction::Matched:
-		return t;
-	    case SIPTransaction::NoDialog:
-		forked = t;
-		break;
-	    case SIPTransaction::NoMatch:
-	    default:
-		break;
-	}
+    SIPTransaction* t = 0;
+    // a RFC 3261 branch must match except for ACKs to incoming INVITEs
+    if (branch)
+	t = matchList(m_branchList.getHashList(branch.hash()),message,branch,0,forked);
+    // RFC 2543 transactions and ACKs are matched by Call-ID
+    if (!t && (branch.null() || message->isACK())) {
+	const String& callid = message->getHeaderValue("Call-ID");
+	t = matchList(m_transList.getHashList(callid.hash()),message,branch,&callid,forked);
     }
+    if (t)
+	return t;
     if (forked)
 	return forkInvite(message,forked);
 
@@ -280,36 +320,265 @@ bool SIPEngine::process()
 SIPEvent* SIPEngine::getEvent()
 {
     Lock lock(this);
-    ObjList* l = m_transList.skipNull();
+    u_int64_t time = Time::now();
+    runTimers(time);
+    ObjList* l = m_readyList.skipNull();
     if (!l)
 	return 0;
-    u_int64_t time = Time::now();
     for (; l; l = l->skipNext()) {
 	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
 	SIPEvent* e = t->getEvent(true,time);
 	if (e) {
 	    DDebug(this,DebugInfo,"Got pending event %p (state %s) from transaction %p [%p]",
 		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
+	    if (t->getState() == SIPTransaction::Invalid) {
+		remove(t);
+		t->deref();
+	    }
 	    return e;
 	}
     }
     time = Time::now();
-    for (l = m_transList.skipNull(); l; l = l->skipNext()) {
+    for (l = m_readyList.skipNull(); l; ) {
 	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	// a wakeup while polling queues the transaction again at the end
+	t->m_ready = false;
 	SIPEvent* e = t->getEvent(false,time);
+	bool woken = t->m_ready;
 	if (e) {
 	    DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
 		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
+	    if (woken)
+		l->remove(false);
+	    else
+		t->m_ready = true;
+	    if (t->getState() == SIPTransaction::Invalid) {
+		remove(t);
+		t->deref();
+	    }
 	    return e;
 	}
+	l->remove(false);
+	// nothing to do until changed or timer expires
+	if (!woken)
+	    schedule(t,time);
+	l = l->skipNull();
     }
     return 0;
 }
 
+void SIPEngine::remove(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    if (!transaction->m_listed)
+	return;
+    transaction->m_listed = false;
+    if (transaction->m_ready) {
+	transaction->m_ready = false;
+	m_readyList.remove(transaction,false);
+    }
+    unschedule(transaction);
+    if (transaction->getBranch())
+	m_branchList.remove(transaction,transaction->getBranch().hash(),false);
+    m_transList.remove(transaction,transaction->getCallID().hash(),false);
+}
+
+void SIPEngine::append(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    if (transaction->m_listed)
+	return;
+    transaction->m_listed = true;
+    m_transList.append(transaction,transaction->getCallID().hash());
+    if (transaction->getBranch())
+	m_branchList.append(transaction,transaction->getBranch().hash())->setDelete(false);
+    ready(transaction,false);
+}
+
+void SIPEngine::insert(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    if (transaction->m_listed)
+	return;
+    transaction->m_listed = true;
+    unsigned int hash = transaction->getCallID().hash();
+    ObjList* l = m_transList.getHashList(hash);
+    if (l)
+	l->insert(transaction);
+    else
+	m_transList.append(transaction,hash);
+    if (transaction->getBranch()) {
+	hash = transaction->getBranch().hash();
+	l = m_branchList.getHashList(hash);
+	if (l)
+	    l->insert(transaction)->setDelete(false);
+	else
+	    m_branchList.append(transaction,hash)->setDelete(false);
+    }
+    ready(transaction,true);
+}
+
+void SIPEngine::clearTransactions()
+{
+    Lock lock(this);
+    m_readyList.clear();
+    for (unsigned int i = 0; i < SIP_WHEEL_SIZE + SIP_WHEEL_OUTER; i++)
+	m_timerWheel[i].clear();
+    m_branchList.clear();
+    for (unsigned int i = 0; i < m_transList.length(); i++) {
+	ObjList* l = m_transList.getList(i);
+	for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	    SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	    t->m_listed = false;
+	    t->m_ready = false;
+	    t->m_timerSlot = 0;
+	}
+    }
+    m_transList.clear();
+}
+
+void SIPEngine::wakeup(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    if (!transaction->m_listed || transaction->m_ready)
+	return;
+    unschedule(transaction);
+    ready(transaction,false);
+}
+
+void SIPEngine::changeBranch(SIPTransaction* transaction, const String& branch)
+{
+    Lock lock(this);
+    if (transaction->m_branch == branch)
+	return;
+    if (transaction->m_listed && transaction->m_branch)
+	m_branchList.remove(transaction,transaction->m_branch.hash(),false);
+    transaction->m_branch = branch;
+    if (transaction->m_listed && branch)
+	m_branchList.append(transaction,branch.hash())->setDelete(false);
+}
+
+void SIPEngine::waitEvent(unsigned long maxwait)
+{
+    lock();
+    u_int64_t time = Time::now();
+    u_int64_t next = time + maxwait;
+    if (m_readyList.skipNull())
+	next = time;
+    else {
+	// timers in later slots can't expire before the earliest one found
+	for (u_int64_t tick = m_timerTick; (tick - m_timerTick) < SIP_WHEEL_SIZE; tick++) {
+	    if ((tick << SIP_WHEEL_SHIFT) >= next)
+		break;
+	    ObjList* l = m_timerWheel[tick % SIP_WHEEL_SIZE].skipNull();
+	    for (; l; l = l->skipNext()) {
+		u_int64_t tout = static_cast<SIPTransaction*>(l->get())->m_timeout;
+		if (tout < next)
+		    next = tout;
+	    }
+	}
+    }
+    unlock();
+    if (next > time)
+	m_wakeup.lock((long)(next - time));
+}
+
+// Queue a transaction for polling, engine must be locked
+void SIPEngine::ready(SIPTransaction* transaction, bool first)
+{
+    bool idle = !m_readyList.skipNull();
+    transaction->m_ready = true;
+    if (first)
+	m_readyList.insert(transaction)->setDelete(false);
+    else
+	m_readyList.append(transaction)->setDelete(false);
+    if (idle)
+	m_wakeup.unlock();
+}
+
+// Put an idle transaction in the timer wheels, engine must be locked
+void SIPEngine::schedule(SIPTransaction* transaction, u_int64_t time)
+{
+    if (!transaction->m_timeout)
+	return;
+    // expired or within the current tick timers fire on next poll
+    u_int64_t tick = transaction->m_timeout >> SIP_WHEEL_SHIFT;
+    if (tick < m_timerTick)
+	tick = m_timerTick;
+    ObjList* slot = m_timerWheel;
+    if ((tick - m_timerTick) < SIP_WHEEL_SIZE)
+	slot += tick % SIP_WHEEL_SIZE;
+    else
+	slot += SIP_WHEEL_SIZE + (tick / SIP_WHEEL_SIZE) % SIP_WHEEL_OUTER;
+    transaction->m_timerSlot = slot;
+    slot->append(transaction)->setDelete(false);
+}
+
+// Remove a transaction from the timer wheels, engine must be locked
+void SIPEngine::unschedule(SIPTransaction* transaction)
+{
+    if (!transaction->m_timerSlot)
+	return;
+    transaction->m_timerSlot->remove(transaction,false);
+    transaction->m_timerSlot = 0;
+}
+
+// Move transactions with expired timers to the ready list, engine must be locked
+void SIPEngine::runTimers(u_int64_t time)
+{
+    u_int64_t tick = time >> SIP_WHEEL_SHIFT;
+    if (tick < m_timerTick)
+	tick = m_timerTick;
+    // the current slot is always checked again as it may hold timers due later
+    u_int64_t slots = tick - m_timerTick + 1;
+    if (slots > SIP_WHEEL_SIZE)
+	slots = SIP_WHEEL_SIZE;
+    for (u_int64_t i = 0; i < slots; i++) {
+	ObjList* l = m_timerWheel[(m_timerTick + i) % SIP_WHEEL_SIZE].skipNull();
+	while (l) {
+	    SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	    if (t->m_timeout > time) {
+		l = l->skipNext();
+		continue;
+	    }
+	    l->remove(false);
+	    t->m_timerSlot = 0;
+	    t->m_ready = true;
+	    m_readyList.append(t)->setDelete(false);
+	    l = l->skipNull();
+	}
+    }
+    u_int64_t turn = m_timerTick / SIP_WHEEL_SIZE;
+    m_timerTick = tick;
+    // entering a new turn of the inner wheel moves its far timers into it
+    u_int64_t turns = tick / SIP_WHEEL_SIZE - turn;
+    if (turns > SIP_WHEEL_OUTER)
+	turns = SIP_WHEEL_OUTER;
+    for (u_int64_t i = 1; i <= turns; i++) {
+	ObjList* slot = m_timerWheel + SIP_WHEEL_SIZE + (turn + i) % SIP_WHEEL_OUTER;
+	ObjList far;
+	for (ObjList* l = slot->skipNull(); l; l = l->skipNext())
+	    far.append(l->get())->setDelete(false);
+	slot->clear();
+	for (ObjList* l = far.skipNull(); l; l = l->skipNext()) {
+	    SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	    t->m_timerSlot = 0;
+	    if (t->m_timeout > time)
+		schedule(t,time);
+	    else {
+		t->m_ready = true;
+		m_readyList.append(t)->setDelete(false);
+	    }
+	}
+    }
+}
+
 void SIPEngine::processEvent(SIPEvent *event)
 {
     if (!event)
@@ -386,105 +386,266 @@ int SIPMessage::copyAllHeaders(const SIPMessage* message, const char* name, cons
     return c;
 }
 
+// Header names the parser must recognize while tokenizing
+enum SIPHeaderId {
+    HdrOther = 0,
+    HdrCSeq,
+    HdrContentLength,
+    HdrAuth,
+};
+
+static inline bool isBlank(char c)
+{
+    return (c == ' ') || (c == '\t');
+}
+
+static inline bool isSpace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '\v') || (c == '\f');
+}
+
+static inline bool isDigit(char c)
+{
+    return ('0' <= c) && (c <= '9');
+}
+
+static inline bool isAlpha(char c)
+{
+    return (('a' <= c) && (c <= 'z')) || (('A' <= c) && (c <= 'Z'));
+}
+
+// Match a SIP/<digit>.<digits> version token, return its length or 0
+static int versionLength(const char* s, int len)
+{
+    if ((len < 7) || ::strncasecmp(s,"SIP/",4) || !isDigit(s[4]) || (s[5] != '.') || !isDigit(s[6]))
+	return 0;
+    int n = 7;
+    while ((n < len) && isDigit(s[n]))
+	n++;
+    return n;
+}
+
+// Identify the headers that need special handling, compact forms must be expanded
+static SIPHeaderId headerId(const char* name, int len)
+{
+    switch (len) {
+	case 4:
+	    if (!::strncasecmp(name,"CSeq",4))
+		return HdrCSeq;
+	    break;
+	case 13:
+	    if (!::strncasecmp(name,"Authorization",13))
+		return HdrAuth;
+	    break;
+	case 14:
+	    if (!::strncasecmp(name,"Content-Length",14))
+		return HdrContentLength;
+	    break;
+	case 16:
+	    if (!::strncasecmp(name,"WWW-Authenticate",16))
+		return HdrAuth;
+	    break;
+	case 18:
+	    if (!::strncasecmp(name,"Proxy-Authenticate",18))
+		return HdrAuth;
+	    break;
+	case 19:
+	    if (!::strncasecmp(name,"Proxy-Authorization",19))
+		return HdrAuth;
+	    break;
+    }
+    return HdrOther;
+}
+
+// Find the next unfolded line in a buffer, trimmed of blanks like
+//  MimeBody::getUnfoldedLine() does. The line points into the buffer,
+//  only folded lines are copied to the provided string
+static void getLine(const char*& buf, int& len, const char*& line, int& lineLen, String& folded)
+{
+    folded.clear();
+    const char* s = buf;
+    int e = 0;
+    while (len > 0) {
+	char c = *buf;
+	if ((c == '\r') || (c == '\n')) {
+	    ++buf;
+	    --len;
+	    // CR is optional but skip over it if exists
+	    if ((c == '\r') && (len > 0) && (*buf == '\n')) {
+		++buf;
+		--len;
+	    }
+	    if ((e || folded) && (len > 0) && isBlank(*buf)) {
+		// Continuation line, skip over blanks at start of it
+		folded.append(s,e);
+		while ((len > 0) && isBlank(*buf)) {
+		    ++buf;
+		    --len;
+		}
+		s = buf;
+		e = 0;
+		continue;
+	    }
+	    break;
+	}
+	if (!c) {
+	    // Should not happen - but let's accept what we got
+	    while ((len > 0) && !*buf) {
+		++buf;
+		--len;
+	    }
+	    if (len)
+		Debug(DebugMild,"Unexpected NUL character while unfolding lines");
+	    // End parsing
+	    buf += len;
+	    len = 0;
+	    break;
+	}
+	++buf;
+	--len;
+	++e;
+    }
+    if (folded) {
+	folded.append(s,e);
+	s = folded.c_str();
+	e = folded.length();
+    }
+    while (e && isBlank(*s)) {
+	++s;
+	--e;
+    }
+    while (e && isBlank(s[e - 1]))
+	--e;
+    line = s;
+    lineLen = e;
+}
+
 bool SIPMessage::parseFirst(String& line)
 {
     XDebug(DebugAll,"SIPMessage::parse firstline= '%s'",line.c_str());
     if (line.null())
 	return false;
-    static Regexp r("^\\([Ss][Ii][Pp]/[0-9]\\.[0-9]\\+\\)[[:space:]]\\+\\([0-9][0-9][0-9]\\)[[:space:]]\\+\\(.*\\)$");
-    if (line.matches(r)) {
-	// Answer: <version> <code> <reason-phrase>
-	m_answer = true;
-	version = line.matchString(1).toUpper();
-	code = line.matchString(2).toInteger();
-	reason = line.matchString(3);
-	DDebug(DebugAll,"got answer version='%s' code=%d reason='%s'",
-	    version.c_str(),code,reason.c_str());
-    }
-    else {
-	static Regexp r2("^\\([[:alpha:]]\\+\\)[[:space:]]\\+\\([^[:space:]]\\+\\)[[:space:]]\\+\\([Ss][Ii][Pp]/[0-9]\\.[0-9]\\+\\)$");
-	if (line.matches(r2)) {
-	    // Request: <method> <uri> <version>
-	    m_answer = false;
-	    method = line.matchString(1).toUpper();
-	    uri = line.matchString(2);
-	    version = line.matchString(3).toUpper();
-	    DDebug(DebugAll,"got request method='%s' uri='%s' version='%s'",
-		method.c_str(),uri.c_str(),version.c_str());
-	    if (method == YSTRING("ACK"))
-		m_ack = true;
-	}
-	else {
-	    TraceDebug(msgTraceId,DebugAll,"Invalid SIP line '%s'",line.c_str());
-	    return false;
+    const char* s = line.c_str();
+    int len = line.length();
+    int n = versionLength(s,len);
+    if (n && (n < len) && isSpace(s[n])) {
+	int p = n;
+	while ((p < len) && isSpace(s[p]))
+	    p++;
+	if (((p + 3) < len) && isDigit(s[p]) && isDigit(s[p + 1]) && isDigit(s[p + 2]) &&
+	    isSpace(s[p + 3])) {
+	    // Answer: <version> <code> <reason-phrase>
+	    int r = p + 3;
+	    while ((r < len) && isSpace(s[r]))
+		r++;
+	    m_answer = true;
+	    version.assign(s,n).toUpper();
+	    code = 100 * (s[p] - '0') + 10 * (s[p + 1] - '0') + (s[p + 2] - '0');
+	    reason.assign(s + r,len - r);
+	    DDebug(DebugAll,"got answer version='%s' code=%d reason='%s'",
+		version.c_str(),code,reason.c_str());
+	    return true;
 	}
     }
+    // Request: <method> <uri> <version>
+    int m = 0;
+    while ((m < len) && isAlpha(s[m]))
+	m++;
+    int u = m;
+    while ((u < len) && isSpace(s[u]))
+	u++;
+    int ue = u;
+    while ((ue < len) && !isSpace(s[ue]))
+	ue++;
+    int v = ue;
+    while ((v < len) && isSpace(s[v]))
+	v++;
+    if (!m || (u == m) || (ue == u) || (v == ue) || ((v + versionLength(s + v,len - v)) != len)) {
+	TraceDebug(msgTraceId,DebugAll,"Invalid SIP line '%s'",line.c_str());
+	return false;
+    }
+    m_answer = false;
+    method.assign(s,m).toUpper();
+    uri.assign(s + u,ue - u);
+    version.assign(s + v,len - v).toUpper();
+    DDebug(DebugAll,"got request method='%s' uri='%s' version='%s'",
+	method.c_str(),uri.c_str(),version.c_str());
+    if (method == YSTRING("ACK"))
+	m_ack = true;
     return true;
 }
 
+// Tokenize the message in place, only header names and values are copied
 bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
 {
     DDebug(DebugAll,"SIPMessage::parse(%p,%d) [%p]",buf,len,this);
-    String* line = 0;
+    String folded;
+    const char* line = 0;
+    int lineLen = 0;
     while (len > 0) {
-	line = MimeBody::getUnfoldedLine(buf,len);
-	if (!line->null())
+	getLine(buf,len,line,lineLen,folded);
+	if (lineLen)
 	    break;
 	// Skip any initial empty lines
-	TelEngine::destruct(line);
     }
-    if (!line)
+    if (!lineLen)
 	return false;
-    if (!parseFirst(*line)) {
-	line->destruct();
+    String first(line,lineLen);
+    if (!parseFirst(first))
 	return false;
-    }
-    line->destruct();
     int clen = -1;
     while (len > 0) {
-	line = MimeBody::getUnfoldedLine(buf,len);
-	if (line->null()) {
+	getLine(buf,len,line,lineLen,folded);
+	if (!lineLen)
 	    // Found end of headers
-	    line->destruct();
 	    break;
-	}
-	int col = line->find(':');
-	if (col <= 0) {
-	    line->destruct();
+	const char* col = (const char*)::memchr(line,':',lineLen);
+	if (!col || (col == line))
 	    return false;
+	int nameLen = col - line;
+	while (nameLen && isBlank(line[nameLen - 1]))
+	    nameLen--;
+	const char* val = col + 1;
+	int valLen = lineLen - (val - line);
+	while (valLen && isBlank(*val)) {
+	    val++;
+	    valLen--;
 	}
-	String name = line->substr(0,col);
-	name.trimBlanks();
-	if (name.null()) {
-	    line->destruct();
-	    return false;
+	String name;
+	if (nameLen == 1) {
+	    char compact[2] = { line[0], 0 };
+	    name = uncompactForm(compact);
 	}
-	name = uncompactForm(name);
-	*line >> ":";
-	line->trimBlanks();
-	XDebug(DebugAll,"SIPMessage::parse header='%s' value='%s'",name.c_str(),line->c_str());
-
-	if ((name &= "WWW-Authenticate") ||
-	    (name &= "Proxy-Authenticate") ||
-	    (name &= "Authorization") ||
-	    (name &= "Proxy-Authorization"))
-	    header.append(new MimeAuthLine(name,*line));
 	else
-	    header.append(new MimeHeaderLine(name,*line));
-
-	if ((clen < 0) && (name &= "Content-Length"))
-	    clen = line->toInteger(-1,10);
-	else if ((m_cseq < 0) && (name &= "CSeq")) {
-	    int sep = line->find(' ');
-	    if (sep > 0) {
-		m_cseq = line->substr(0,sep).toInteger(-1,10);
-		if (m_answer) {
-		    method = line->substr(sep + 1);
-		    method.trimBlanks().toUpper();
+	    name.assign(line,nameLen);
+	String value(val,valLen);
+	XDebug(DebugAll,"SIPMessage::parse header='%s' value='%s'",name.c_str(),value.c_str());
+
+	switch (headerId(name.c_str(),name.length())) {
+	    case HdrAuth:
+		header.append(new MimeAuthLine(name,value));
+		break;
+	    case HdrContentLength:
+		header.append(new MimeHeaderLine(name,value));
+		if (clen < 0)
+		    clen = value.toInteger(-1,10);
+		break;
+	    case HdrCSeq:
+		header.append(new MimeHeaderLine(name,value));
+		if (m_cseq < 0) {
+		    int sep = value.find(' ');
+		    if (sep > 0) {
+			m_cseq = value.substr(0,sep).toInteger(-1,10);
+			if (m_answer) {
+			    method = value.substr(sep + 1);
+			    method.trimBlanks().toUpper();
+			}
+		    }
 		}
-	    }
+		break;
+	    default:
+		header.append(new MimeHeaderLine(name,value));
 	}
-	line->destruct();
     }
     if (!bodyLen) {
 	if (clen >= 0) {
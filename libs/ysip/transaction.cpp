@@ -33,7 +33,8 @@ SIPTransaction::SIPTransaction(SIPMessage* message, SIPEngine* engine, bool outg
       m_response(0), m_timeouts(0), m_timeout(0),
       m_firstMessage(message), m_lastMessage(0), m_pending(0), m_engine(engine), m_private(0),
       m_autoChangeParty(autoChangeParty ? *autoChangeParty : engine->autoChangeParty()),
-      m_autoAck(true), m_silent(false)
+      m_autoAck(true), m_silent(false),
+      m_listed(false), m_ready(false), m_timerSlot(0)
 {
     DDebug(getEngine(),DebugAll,"SIPTransaction::SIPTransaction(%p,%p,%d) [%p]",
 	message,engine,outgoing,this);
@@ -88,7 +89,8 @@ SIPTransaction::SIPTransaction(SIPTransaction& original, SIPMessage* answer)
       m_pending(0), m_engine(original.m_engine),
       m_branch(original.m_branch), m_callid(original.m_callid), m_tag(original.m_tag),
       m_private(0), m_autoChangeParty(original.m_autoChangeParty),
-      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId())
+      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId()),
+      m_listed(false), m_ready(false), m_timerSlot(0)
 {
     DDebug(getEngine(),DebugAll,"SIPTransaction::SIPTransaction(&%p,%p) [%p]",
 	&original,answer,this);
@@ -99,10 +101,10 @@ SIPTransaction::SIPTransaction(SIPTransaction& original, SIPMessage* answer)
     msg->complete(m_engine);
     msg->addHeader(auth);
     const NamedString* ns = msg->getParam("Via","branch",true);
+    String branch;
     if (ns)
-	original.m_branch = *ns;
-    else
-	original.m_branch.clear();
+	branch = *ns;
+    m_engine->changeBranch(&original,branch);
     ns = msg->getParam("To","tag");
     if (ns)
 	original.m_tag = *ns;
@@ -134,7 +136,8 @@ SIPTransaction::SIPTransaction(const SIPTransaction& original, const String& tag
       m_pending(0), m_engine(original.m_engine),
       m_branch(original.m_branch), m_callid(original.m_callid), m_tag(tag),
       m_private(0), m_autoChangeParty(original.m_autoChangeParty),
-      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId())
+      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId()),
+      m_listed(false), m_ready(false), m_timerSlot(0)
 {
     if (m_firstMessage)
 	m_firstMessage->ref();
@@ -199,6 +202,7 @@ bool SIPTransaction::changeState(int newstate)
     DDebug(getEngine(),DebugAll,"SIPTransaction state changed from %s to %s [%p]",
 	stateName(m_state),stateName(newstate),this);
     m_state = newstate;
+    m_engine->wakeup(this);
     return true;
 }
 
@@ -212,6 +216,12 @@ void SIPTransaction::setDialogTag(const char* tag)
 	m_tag = tag;
 }
 
+void SIPTransaction::setTransmit()
+{
+    m_transmit = true;
+    m_engine->wakeup(this);
+}
+
 void SIPTransaction::setLatestMessage(SIPMessage* message)
 {
     if (m_lastMessage == message)
@@ -245,6 +255,8 @@ void SIPTransaction::setPendingEvent(SIPEvent* event, bool replace)
 	    delete event;
     else
 	m_pending = event;
+    if (m_pending)
+	m_engine->wakeup(this);
 }
 
 void SIPTransaction::setTransCount(int count)
@@ -269,6 +281,8 @@ void SIPTransaction::setTimeout(u_int64_t delay, unsigned int count)
 	TraceDebugObj(this,getEngine(),DebugAll,"SIPTransaction new %d timeouts initially " FMT64U " usec apart [%p]",
 	    m_timeouts,m_delay,this);
 #endif
+    // let the engine reschedule us
+    m_engine->wakeup(this);
 }
 
 SIPEvent* SIPTransaction::getEvent(bool pendingOnly, u_int64_t time)
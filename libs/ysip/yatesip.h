@@ -770,6 +770,7 @@ protected:
  */
 class YSIP_API SIPTransaction : public RefObject
 {
+    friend class SIPEngine;
 public:
     /**
      * Current state of the transaction
@@ -948,8 +949,7 @@ public:
      * Set the (re)transmission flag that allows the latest outgoing message
      *  to be send over the wire
      */
-    inline void setTransmit()
-	{ m_transmit = true; }
+    void setTransmit();
 
     /**
      * Change transaction status to Cleared
@@ -1204,6 +1204,12 @@ protected:
     bool m_autoAck;
     bool m_silent;
     String m_traceId;
+
+private:
+    // Engine bookkeeping, protected by the engine mutex
+    bool m_listed;
+    bool m_ready;
+    ObjList* m_timerSlot;
 };
 
 /**
@@ -1397,6 +1403,8 @@ public:
      * This method mainly looks into the transaction list and get all kind of
      * events, like an incoming request (INVITE, REGISTRATION), a timer, an
      * outgoing message.
+     * Only transactions that changed since last polled or whose timer expired
+     * are looked at.
      * This method is thread safe
      */
     SIPEvent *getEvent();
@@ -1579,22 +1587,45 @@ public:
      * Remove a transaction from the list without dereferencing it
      * @param transaction Pointer to transaction to remove
      */
-    inline void remove(SIPTransaction* transaction)
-	{ lock(); m_transList.remove(transaction,false); unlock(); }
+    void remove(SIPTransaction* transaction);
 
     /**
      * Append a transaction to the end of the list
      * @param transaction Pointer to transaction to append
      */
-    inline void append(SIPTransaction* transaction)
-	{ lock(); m_transList.append(transaction); unlock(); }
+    void append(SIPTransaction* transaction);
 
     /**
      * Insert a transaction at the start of the list
      * @param transaction Pointer to transaction to insert
      */
-    inline void insert(SIPTransaction* transaction)
-	{ lock(); m_transList.insert(transaction); unlock(); }
+    void insert(SIPTransaction* transaction);
+
+    /**
+     * Remove and dereference all transactions
+     */
+    void clearTransactions();
+
+    /**
+     * Mark a transaction as having work to do so the next getEvent() polls it
+     * @param transaction Pointer to a transaction owned by this engine
+     */
+    void wakeup(SIPTransaction* transaction);
+
+    /**
+     * Change the branch of a transaction and update the branch index
+     * @param transaction Pointer to a transaction owned by this engine
+     * @param branch New RFC 3261 branch, empty if the transaction has none
+     */
+    void changeBranch(SIPTransaction* transaction, const String& branch);
+
+    /**
+     * Wait until a transaction needs to be polled by getEvent() or a timer
+     *  is due, whichever comes first, but no longer than the given interval.
+     * The wait is interrupted when a transaction is woken up from another thread
+     * @param maxwait Maximum time to wait in microseconds
+     */
+    void waitEvent(unsigned long maxwait);
 
     /**
      * Get the number of active SIP transactions
@@ -1605,9 +1636,35 @@ public:
 
 protected:
     /**
-     * The list that holds all the SIP transactions.
+     * The list that holds all the SIP transactions, hashed by Call-ID
      */
-    ObjList m_transList;
+    HashList m_transList;
+
+    /**
+     * Transactions with a RFC 3261 branch, hashed by branch, not owned
+     */
+    HashList m_branchList;
+
+    /**
+     * Transactions that must be polled for events, not owned
+     */
+    ObjList m_readyList;
+
+    /**
+     * Timer wheels of idle transactions waiting for their timeout, not owned.
+     * The inner wheel is followed by an outer one holding the far timers
+     */
+    ObjList* m_timerWheel;
+
+    /**
+     * Last processed timer wheel tick
+     */
+    u_int64_t m_timerTick;
+
+    /**
+     * Signaled when the ready list stops being empty
+     */
+    Semaphore m_wakeup;
 
     u_int64_t m_t1;
     u_int64_t m_t4;
@@ -1625,6 +1682,12 @@ protected:
     u_int32_t m_nonce_time;
     Mutex m_nonce_mutex;
     bool m_autoChangeParty;
+
+private:
+    void schedule(SIPTransaction* transaction, u_int64_t time);
+    void unschedule(SIPTransaction* transaction);
+    void runTimers(u_int64_t time);
+    void ready(SIPTransaction* transaction, bool first);
 };
 
 }
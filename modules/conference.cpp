@@ -23,6 +23,11 @@
 
 #include <yatephone.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIX_X86
+#include <immintrin.h>
+#endif
+
 using namespace TelEngine;
 namespace { // anonymous
 
@@ -48,6 +53,12 @@ namespace { // anonymous
 #define DECAY_STORE 995
 #define ATTACK_RATE (DECAY_TOTAL-DECAY_STORE)
 
+// Maximum number of mixer threads
+#define MAX_MIXERS 64
+
+// Clock of the mixer threads in usec
+#define MIX_INTERVAL 20000
+
 // Shift for noise margin
 #define SHIFT_LEVEL 5
 // Shift for noise decay rate
@@ -65,6 +76,18 @@ namespace { // anonymous
 class ConfConsumer;
 class ConfSource;
 class ConfChan;
+class ConfMixer;
+
+// Set of mixing kernels working on 16 bit samples and 32 bit sums
+struct MixKernels {
+    const char* name;
+    // Accumulate samples into the sum
+    void (*add)(int* acc, const int16_t* src, unsigned int n);
+    // Saturate symmetrically the sum minus a channel's own samples
+    void (*sub)(int16_t* dst, const int* mix, const int16_t* own, unsigned int n);
+    // Saturate symmetrically the sum
+    void (*sat)(int16_t* dst, const int* mix, unsigned int n);
+};
 
 // The list of conference rooms
 static ObjList s_rooms;
@@ -75,10 +98,21 @@ static Mutex s_srcMutex(false,"Conference");
 // Hold the number of the newest allocated dynamic room
 static int s_roomAlloc = 0;
 
+// Mixing kernels in use
+static const MixKernels* s_mix = 0;
+
+// Pool of the audio buffers, NULL to use the system allocator
+static DataPool* s_pool = 0;
+
+// Mixer threads, their list of rooms is protected by the mutex
+static ConfMixer* s_mixers[MAX_MIXERS];
+static Mutex s_mixMutex(false,"ConfMixers");
+
 // The conference room holds a list of connected channels and does the mixing.
 // It does also act as a data source for the sum of all channels
 class ConfRoom : public DataSource
 {
+    friend class ConfMixer;
 public:
     virtual void destroyed();
     static ConfRoom* get(const String& name, const NamedList* params = 0);
@@ -106,6 +140,8 @@ public:
 	{ return m_minBuffer; }
     inline unsigned int maxBuffer() const
 	{ return m_maxBuffer; }
+    inline bool pooled() const
+	{ return 0 != m_mixer; }
     void mix(ConfConsumer* cons = 0);
     void addChannel(ConfChan* chan, bool player = false);
     void delChannel(ConfChan* chan);
@@ -146,6 +182,25 @@ private:
     unsigned int m_minBuffer;
     unsigned int m_maxBuffer;
     unsigned int m_dataChunk;
+    ConfMixer* m_mixer;
+};
+
+// Thread that mixes the rooms assigned to it on a fixed clock
+class ConfMixer : public Thread
+{
+public:
+    ConfMixer(unsigned int index);
+    virtual ~ConfMixer();
+    virtual void run();
+    static void assign(ConfRoom* room);
+    static void release(ConfRoom* room);
+    static bool setCount(unsigned int count);
+    static unsigned int count();
+private:
+    unsigned int m_index;
+    ObjList m_rooms;
+    unsigned int m_count;
+    bool m_stopping;
 };
 
 // A conference channel is just a dumb holder of its data channels
@@ -190,7 +245,11 @@ public:
     ConfConsumer(ConfRoom* room, bool smart = false)
 	: m_room(room), m_src(0), m_muted(false), m_smart(smart), m_speak(false),
 	  m_energy2(ENERGY_MIN), m_noise2(ENERGY_MIN), m_envelope2(ENERGY_MIN)
-	{ DDebug(DebugAll,"ConfConsumer::ConfConsumer(%p,%s) [%p]",room,String::boolText(smart),this); m_format = room->getFormat(); }
+	{
+	    DDebug(DebugAll,"ConfConsumer::ConfConsumer(%p,%s) [%p]",room,String::boolText(smart),this);
+	    m_format = room->getFormat();
+	    m_buffer.pool(s_pool);
+	}
     ~ConfConsumer()
 	{ DDebug(DebugAll,"ConfConsumer::~ConfConsumer() [%p]",this); }
     virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags);
@@ -304,6 +363,277 @@ static unsigned int binLog(unsigned int x)
 }
 
 
+static void mixAddScalar(int* acc, const int16_t* src, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+	acc[i] += src[i];
+}
+
+static void mixSubScalar(int16_t* dst, const int* mix, const int16_t* own, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++) {
+	int val = mix[i] - own[i];
+	dst[i] = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+    }
+}
+
+static void mixSatScalar(int16_t* dst, const int* mix, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++) {
+	int val = mix[i];
+	dst[i] = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+    }
+}
+
+static const MixKernels s_mixScalar = { "scalar", mixAddScalar, mixSubScalar, mixSatScalar };
+
+#ifdef MIX_X86
+// Vector kernels are built for their instruction set and picked at runtime
+//  so they do not depend on the compiler flags of the whole build
+
+__attribute__((target("sse2")))
+static void mixAddSSE2(int* acc, const int16_t* src, unsigned int n)
+{
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+	__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+	// sign extend samples by unpacking them in the high halves
+	__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s,s),16);
+	__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s,s),16);
+	__m128i* a = (__m128i*)(acc + i);
+	_mm_storeu_si128(a,_mm_add_epi32(_mm_loadu_si128(a),lo));
+	_mm_storeu_si128(a + 1,_mm_add_epi32(_mm_loadu_si128(a + 1),hi));
+    }
+    mixAddScalar(acc + i,src + i,n - i);
+}
+
+__attribute__((target("sse2")))
+static void mixSubSSE2(int16_t* dst, const int* mix, const int16_t* own, unsigned int n)
+{
+    const __m128i lim = _mm_set1_epi16(-32767);
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+	__m128i s = _mm_loadu_si128((const __m128i*)(own + i));
+	__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s,s),16);
+	__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s,s),16);
+	lo = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(mix + i)),lo);
+	hi = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(mix + i + 4)),hi);
+	// packing saturates to -32768..32767, raise the low limit to be symmetric
+	_mm_storeu_si128((__m128i*)(dst + i),_mm_max_epi16(_mm_packs_epi32(lo,hi),lim));
+    }
+    mixSubScalar(dst + i,mix + i,own + i,n - i);
+}
+
+__attribute__((target("sse2")))
+static void mixSatSSE2(int16_t* dst, const int* mix, unsigned int n)
+{
+    const __m128i lim = _mm_set1_epi16(-32767);
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+	__m128i lo = _mm_loadu_si128((const __m128i*)(mix + i));
+	__m128i hi = _mm_loadu_si128((const __m128i*)(mix + i + 4));
+	_mm_storeu_si128((__m128i*)(dst + i),_mm_max_epi16(_mm_packs_epi32(lo,hi),lim));
+    }
+    mixSatScalar(dst + i,mix + i,n - i);
+}
+
+__attribute__((target("avx2")))
+static void mixAddAVX2(int* acc, const int16_t* src, unsigned int n)
+{
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16) {
+	__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+	__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+	__m256i* a = (__m256i*)(acc + i);
+	_mm256_storeu_si256(a,_mm256_add_epi32(_mm256_loadu_si256(a),lo));
+	_mm256_storeu_si256(a + 1,_mm256_add_epi32(_mm256_loadu_si256(a + 1),hi));
+    }
+    mixAddScalar(acc + i,src + i,n - i);
+}
+
+__attribute__((target("avx2")))
+static void mixSubAVX2(int16_t* dst, const int* mix, const int16_t* own, unsigned int n)
+{
+    const __m256i lim = _mm256_set1_epi16(-32767);
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16) {
+	__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i)));
+	__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i + 8)));
+	lo = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(mix + i)),lo);
+	hi = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(mix + i + 8)),hi);
+	// packing works per 128 bit lane, put the 64 bit quarters back in order
+	__m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xd8);
+	_mm256_storeu_si256((__m256i*)(dst + i),_mm256_max_epi16(p,lim));
+    }
+    mixSubScalar(dst + i,mix + i,own + i,n - i);
+}
+
+__attribute__((target("avx2")))
+static void mixSatAVX2(int16_t* dst, const int* mix, unsigned int n)
+{
+    const __m256i lim = _mm256_set1_epi16(-32767);
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16) {
+	__m256i lo = _mm256_loadu_si256((const __m256i*)(mix + i));
+	__m256i hi = _mm256_loadu_si256((const __m256i*)(mix + i + 8));
+	__m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xd8);
+	_mm256_storeu_si256((__m256i*)(dst + i),_mm256_max_epi16(p,lim));
+    }
+    mixSatScalar(dst + i,mix + i,n - i);
+}
+
+static const MixKernels s_mixSSE2 = { "sse2", mixAddSSE2, mixSubSSE2, mixSatSSE2 };
+static const MixKernels s_mixAVX2 = { "avx2", mixAddAVX2, mixSubAVX2, mixSatAVX2 };
+#endif
+
+// Pick the fastest kernels the CPU supports unless vector code is disabled
+static const MixKernels* mixKernels(bool simd)
+{
+#ifdef MIX_X86
+    if (simd) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	    return &s_mixAVX2;
+	if (__builtin_cpu_supports("sse2"))
+	    return &s_mixSSE2;
+    }
+#endif
+    return &s_mixScalar;
+}
+
+
+ConfMixer::ConfMixer(unsigned int index)
+    : Thread("ConfMixer"),
+      m_index(index), m_count(0), m_stopping(false)
+{
+    DDebug(&__plugin,DebugAll,"ConfMixer::ConfMixer(%u) [%p]",index,this);
+    m_rooms.setDelete(false);
+    s_mixers[m_index] = this;
+}
+
+// Rooms left without a mixer are mixed again by the threads delivering data
+ConfMixer::~ConfMixer()
+{
+    DDebug(&__plugin,DebugAll,"ConfMixer::~ConfMixer() %u [%p]",m_index,this);
+    Lock lock(s_mixMutex);
+    s_mixers[m_index] = 0;
+    while (ConfRoom* room = static_cast<ConfRoom*>(m_rooms.remove(false)))
+	room->m_mixer = 0;
+}
+
+// Mix all rooms every 20ms, skip ticks instead of catching up if late
+void ConfMixer::run()
+{
+    ObjList work;
+    u_int64_t next = Time::now() + MIX_INTERVAL;
+    while (!check(false)) {
+	u_int64_t now = Time::now();
+	if (now < next) {
+	    Thread::usleep(next - now);
+	    continue;
+	}
+	next += MIX_INTERVAL;
+	if (next <= now)
+	    next = now + MIX_INTERVAL;
+	// keep the rooms referenced while we mix them without holding the lock
+	s_mixMutex.lock();
+	ObjList* add = &work;
+	for (ObjList* l = m_rooms.skipNull(); l; l = l->skipNext()) {
+	    ConfRoom* room = static_cast<ConfRoom*>(l->get());
+	    if (room->ref())
+		add = add->append(room);
+	}
+	s_mixMutex.unlock();
+	while (ConfRoom* room = static_cast<ConfRoom*>(work.remove(false))) {
+	    room->mix();
+	    room->deref();
+	}
+    }
+}
+
+// Assign a room to the least loaded mixer thread, if any
+void ConfMixer::assign(ConfRoom* room)
+{
+    Lock lock(s_mixMutex);
+    ConfMixer* mixer = 0;
+    for (unsigned int i = 0; i < MAX_MIXERS; i++) {
+	// a stopping mixer would drop the room as soon as it exits
+	if (!s_mixers[i] || s_mixers[i]->m_stopping)
+	    continue;
+	if (!(mixer && (mixer->m_count <= s_mixers[i]->m_count)))
+	    mixer = s_mixers[i];
+    }
+    room->m_mixer = mixer;
+    if (!mixer)
+	return;
+    mixer->m_rooms.append(room);
+    mixer->m_count++;
+}
+
+// Remove a room from its mixer thread
+void ConfMixer::release(ConfRoom* room)
+{
+    Lock lock(s_mixMutex);
+    ConfMixer* mixer = room->m_mixer;
+    if (!mixer)
+	return;
+    room->m_mixer = 0;
+    if (mixer->m_rooms.remove(room,false) && mixer->m_count)
+	mixer->m_count--;
+}
+
+// Start or stop mixer threads to match the requested count
+// Return false if some stopped mixer threads are still running
+bool ConfMixer::setCount(unsigned int count)
+{
+    Lock lock(s_mixMutex);
+    for (unsigned int i = count; i < MAX_MIXERS; i++) {
+	if (s_mixers[i] && !s_mixers[i]->m_stopping) {
+	    s_mixers[i]->m_stopping = true;
+	    s_mixers[i]->cancel(false);
+	}
+    }
+    // Mixers clear their slot when destroyed, wait for the stopped ones
+    unsigned int stopping = 0;
+    for (unsigned int n = 100; n; n--) {
+	stopping = 0;
+	for (unsigned int i = 0; i < MAX_MIXERS; i++)
+	    if (s_mixers[i] && s_mixers[i]->m_stopping)
+		stopping++;
+	if (!stopping)
+	    break;
+	lock.drop();
+	Thread::idle();
+	lock.acquire(s_mixMutex);
+    }
+    if (stopping)
+	Debug(&__plugin,DebugMild,"%u mixer threads are still running",stopping);
+    for (unsigned int i = 0; i < count; i++) {
+	if (s_mixers[i])
+	    continue;
+	ConfMixer* mixer = new ConfMixer(i);
+	if (!mixer->startup()) {
+	    Debug(&__plugin,DebugWarn,"Failed to start mixer thread %u",i);
+	    // the destructor clears the slot holding the lock
+	    lock.drop();
+	    delete mixer;
+	    break;
+	}
+    }
+    return !stopping;
+}
+
+unsigned int ConfMixer::count()
+{
+    Lock lock(s_mixMutex);
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < MAX_MIXERS; i++)
+	if (s_mixers[i])
+	    n++;
+    return n;
+}
+
+
 // Get a pointer to a conference by name, optionally creates it with given parameters
 // If a pointer is returned it must be dereferenced by the caller
 // Thread safe
@@ -329,7 +659,8 @@ ConfRoom* ConfRoom::get(const String& name, const NamedList* params)
 ConfRoom::ConfRoom(const String& name, const NamedList& params)
     : m_name(name), m_lonely(false), m_created(true), m_record(0),
       m_rate(8000), m_users(0), m_maxusers(10), m_maxLock(200),
-      m_expire(0), m_lonelyInterval(0), m_nextNotify(0), m_nextSpeakers(0)
+      m_expire(0), m_lonelyInterval(0), m_nextNotify(0), m_nextSpeakers(0),
+      m_mixer(0)
 {
     m_rate = params.getIntValue("rate",m_rate,8000,48000);
     m_maxusers = params.getIntValue("maxusers",m_maxusers);
@@ -359,6 +690,8 @@ ConfRoom::ConfRoom(const String& name, const NamedList& params)
     m_maxBuffer = 6 * tenMs;
     for (int i = 0; i < MAX_SPEAKERS; i++)
 	m_speakers[i] = 0;
+    if (params.getBoolValue("pooled",true))
+	ConfMixer::assign(this);
     s_rooms.append(this);
     // possibly create outgoing call to room record utility channel
     setRecording(params);
@@ -385,6 +718,7 @@ void ConfRoom::destroyed()
     // plugin must be locked as the destructor is called when room is dereferenced
     Lock lock(&__plugin);
     s_rooms.remove(this,false);
+    ConfMixer::release(this);
     if (m_expire)
 	__plugin.setConfToutCount(false);
     m_chans.clear();
@@ -694,7 +1028,9 @@ void ConfRoom::mix(ConfConsumer* cons)
 	speakChan[spk] = 0;
     }
     len = len * m_dataChunk / sizeof(int16_t);
-    DataBlock mixbuf(0,len*sizeof(int));
+    DataBlock mixbuf;
+    mixbuf.pool(s_pool);
+    mixbuf.assign(0,len*sizeof(int));
     int* buf = (int*)mixbuf.data();
     for (l = m_chans.skipNull(); l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
@@ -719,9 +1055,7 @@ void ConfRoom::mix(ConfConsumer* cons)
 #endif
 		if (n > len)
 		    n = len;
-		const int16_t* p = (const int16_t*)co->m_buffer.data();
-		for (unsigned int i=0; i < n; i++)
-		    buf[i] += *p++;
+		s_mix->add(buf,(const int16_t*)co->m_buffer.data(),n);
 	    }
 	    if (m_trackSpeakers && m_notify && !ch->isUtility() && co->speaking()) {
 		int vol = co->envelope();
@@ -745,13 +1079,11 @@ void ConfRoom::mix(ConfConsumer* cons)
 	if (co)
 	    co->consumed(buf,len);
     }
-    DataBlock data(0,len*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < len; i++) {
-	int val = buf[i];
-	// saturate symmetrically the result of addition
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
-    }
+    DataBlock data;
+    data.pool(s_pool);
+    data.assign(0,len*sizeof(int16_t));
+    // saturate symmetrically the result of addition
+    s_mix->sat((int16_t*)data.data(),buf,len);
     mixbuf.clear();
     Message* m = 0;
     while (m_trackSpeakers && m_notify) {
@@ -949,7 +1281,8 @@ unsigned long ConfConsumer::Consume(const DataBlock& data, unsigned long tStamp,
 	m_buffer.append(data.data(),len);
 
     m_room->unlock();
-    if (m_buffer.length() >= m_room->minBuffer())
+    // pooled rooms are mixed on the clock of their mixer thread
+    if ((m_buffer.length() >= m_room->minBuffer()) && !m_room->pooled())
 	m_room->mix(this);
     return invalidStamp();
 }
@@ -991,18 +1324,17 @@ void ConfConsumer::dataForward(const int* mixed, unsigned int samples)
     if (!src)
 	return;
 
-    int16_t* d = (int16_t*)m_buffer.data();
-    unsigned int n = m_buffer.length() / 2;
-    DataBlock data(0,samples*sizeof(int16_t));
+    // substract our own data if we contributed - only as much as we have
+    unsigned int n = shouldMix() ? m_buffer.length() / 2 : 0;
+    if (n > samples)
+	n = samples;
+    DataBlock data;
+    data.pool(s_pool);
+    data.assign(0,samples*sizeof(int16_t));
     int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < samples; i++) {
-	int val = *mixed++;
-	// substract our own data if we contributed - only as much as we have
-	if ((i < n) && shouldMix())
-	    val -= d[i];
-	// saturate symmetrically the result of additions and substraction
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
-    }
+    // saturate symmetrically the result of additions and substraction
+    s_mix->sub(p,mixed,(const int16_t*)m_buffer.data(),n);
+    s_mix->sat(p + n,mixed + n,samples - n);
     src->Forward(data);
 }
 
@@ -1370,6 +1702,8 @@ bool ConferenceDriver::received(Message &msg, int id)
 	"notify" - ID used for "chan.notify" room notifications, an empty
 	    string (default) will disable notifications
 	"record" - route that will make an outgoing record-only call
+	"pooled" - set to false to mix the room in the threads that deliver
+	    data even if mixer threads are configured
     Input parameters - per conference leg:
 	"utility" - true creates a channel that is used for housekeeping
 	    tasks like recording or playing prompts to everybody
@@ -1444,6 +1778,8 @@ bool ConferenceDriver::unload()
 	return false;
     if (isBusy() || s_rooms.count())
 	return false;
+    if (!ConfMixer::setCount(0))
+	return false;
     uninstallRelays();
     Engine::uninstall(m_handler);
     m_handler = 0;
@@ -1498,11 +1834,16 @@ void ConferenceDriver::statusParams(String& str)
 {
     Driver::statusParams(str);
     str.append("rooms=",",") << s_rooms.count();
+    str << ",mixers=" << ConfMixer::count() << ",simd=" << s_mix->name;
 }
 
 void ConferenceDriver::initialize()
 {
     Output("Initializing module Conference");
+    Configuration cfg(Engine::configFile("conference"));
+    s_mix = mixKernels(cfg.getBoolValue("general","simd",true));
+    ConfMixer::setCount(cfg.getIntValue("general","mixers",0,0,MAX_MIXERS));
+    s_pool = cfg.getBoolValue("general","bufpool",true) ? DataPool::get("conference") : 0;
     // install intercept relays with a priority slightly higher than default
     installRelay(Tone,75);
     installRelay(Text,75);
@@ -69,6 +69,10 @@ GsmCodec::GsmCodec(const char* sFormat, const char* dFormat, bool encoding)
 	sFormat,dFormat, m_encoding ? "en" : "de",this);
     count++;
     m_gsm = ::gsm_create();
+    // frames are buffered and produced at a steady rate
+    DataPool* pool = DataPool::get("gsmcodec");
+    m_data.pool(pool);
+    m_outdata.pool(pool);
 }
 
 GsmCodec::~GsmCodec()
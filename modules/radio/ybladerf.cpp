@@ -29,10 +29,6 @@
 #include <sys/types.h>
 #include <pthread.h>
 
-#ifdef __MMX__
-#include <mmintrin.h>
-#endif
-
 #ifdef BRF_DEBUG
 #define BRF_DEBUG_TX
 #define BRF_DEBUG_RX
@@ -803,49 +799,11 @@ static bool energize(const float* samples, int16_t* dest,
     // len is number of complex pairs
     // N is number of scalars
     const unsigned N = len * 2;
-#ifdef __MMX__
+    // apply I/Q correction and scaling to the 16 bit range and saturate
     const float rescale = 32767.0 / s_sampleEnergize;
-    const float is2 = iScale * rescale;
-    const float qs2 = qScale * rescale;
-
-    // Intel intrinstics
-    int32_t i32[4];
-    const __m64* s32A = (__m64*) &i32[0];
-    const __m64* s32B = (__m64*) &i32[2];
-    for (unsigned i = 0; i < N; i += 4) {
-	// apply I/Q correction and scaling and convert samples to 32 bits
-	// gcc -O2/-O3 on intel uses cvttss2si or cvttps2dq depending on the processor
-	i32[0] = is2 * samples[i + 0];
-	i32[1] = qs2 * samples[i + 1];
-	i32[2] = is2 * samples[i + 2];
-	i32[3] = qs2 * samples[i + 3];
-	// saturate 32 bits to 16
-	// process 4 16-bit samples in a 64-bit block
-	__m64* d64 = (__m64*) &dest[i];
-	*d64 = _mm_packs_pi32(*s32A, *s32B);
-    }
     // shift 16 bit down to 12 bits for BladeRF
     // This has to be done after saturation.
-    for (unsigned i = 0; i < N; i++)
-	dest[i] = dest[i] >> 4;
-#else
-    for (unsigned i = 0; i < N; i += 2) {
-	// scale and saturate
-	float iv = iScale * samples[i];
-	if (iv > 2047)
-	    iv = 2047;
-	else if (iv < -2047)
-	    iv = -2047;
-	float qv = qScale * samples[i + 1];
-	if (qv > 2047)
-	    qv = 2047;
-	else if (qv < -2047)
-	    qv = -2047;
-	// convert and save
-	dest[i] = iv;
-	dest[i + 1] = qv;
-    }
-#endif
+    Math::floatToInt16(dest,samples,N,iScale * rescale,qScale * rescale,4);
     return true;
 }
 
@@ -1363,20 +1321,13 @@ public:
 	    m_testOk = res.testOk;
 	}
     inline bool calculate(BrfBbCalDataResult& res) {
-	    const Complex* last = 0;
-	    const Complex* b = m_buffer.data(0,m_buffer.length(),last);
-	    const Complex* calTone = m_calTone.data();
-	    const Complex* testTone = m_testTone.data();
-	    Complex calSum;
-	    Complex testSum;
-	    res.total = 0;
+	    const Complex* b = m_buffer.data();
+	    unsigned int n = m_buffer.length();
 	    // Calculate calibrate/test energy using the narrow band integrator
+	    Complex calSum = Math::sumMul(m_calTone.data(),b,n);
+	    Complex testSum = Math::sumMul(m_testTone.data(),b,n);
 	    // Calculate total buffer energy (power)
-	    for (; b != last; ++b, ++calTone, ++testTone) {
-		calSum += *calTone * *b;
-		testSum += *testTone * *b;
-		res.total += b->norm2();
-	    }
+	    res.total = Math::sumNorm2(b,n);
 	    res.cal = calSum.norm2() / samples();
 	    res.test = testSum.norm2() / samples();
 	    res.cal_test = res.test ? (res.cal / res.test) : -1;
@@ -5863,13 +5814,10 @@ unsigned int BrfLibUsbDevice::recv(uint64_t& ts, float* data, unsigned int& samp
 	    // We have some valid data: reset samples in the past counter
 	    if (avail)
 		nSamplesInPast = 0;
-	    int16_t* last = start + avail * 2;
 	    // Copy data
 	    static const float s_mul = 1.0 / 2048;
-	    while (start != last) {
-		*cpDest++ = *start++ * s_mul;
-		*cpDest++ = *start++ * s_mul;
-	    }
+	    Math::int16ToFloat(cpDest,start,avail * 2,s_mul);
+	    cpDest += avail * 2;
 	    samplesCopied += avail;
 	    samplesLeft -= avail;
 	    m_rxTimestamp += avail;
@@ -9472,14 +9420,8 @@ unsigned int BrfLibUsbDevice::loopbackCheck(String* error)
 	    if (testPattern.length())
 		buf.copy(testPattern,testPattern.length());
 	    // Calculate test / total signal
-	    const Complex* last = 0;
-	    const Complex* b = buf.data(0,buf.length(),last);
-	    Complex testSum;
-	    float total = 0;
-	    for (const Complex* tt = testTone.data(); b != last; ++b, ++tt) {
-		total += b->norm2();
-		testSum += *tt * *b;
-	    }
+	    float total = Math::sumNorm2(buf.data(),buf.length());
+	    Complex testSum = Math::sumMul(testTone.data(),buf.data(),buf.length());
 	    float test = testSum.norm2() / buf.length();
 	    bool ok = ((0.5 * total) < test) && (test <= total);
 	    float ratio = total ? test / total : -1;
@@ -9659,14 +9601,8 @@ unsigned int BrfLibUsbDevice::testVga(const char* loc, bool tx, bool preMixer,
 	    BRF_FUNC_CALL_BREAK(checkSampleLimit((float*)buf.data(),buf.length(),
 		limit,&e));
 	    // Calculate test / total signal
-	    const Complex* last = 0;
-	    const Complex* b = buf.data(0,buf.length(),last);
-	    Complex testSum;
-	    float tmpTotal = 0;
-	    for (const Complex* tt = testTone.data(); b != last; ++b, ++tt) {
-		tmpTotal += b->norm2();
-		testSum += *tt * *b;
-	    }
+	    float tmpTotal = Math::sumNorm2(buf.data(),buf.length());
+	    Complex testSum = Math::sumMul(testTone.data(),buf.data(),buf.length());
 	    float tmpTest = testSum.norm2() / buf.length();
 	    if (div) {
 		tmpTotal /= buf.length();
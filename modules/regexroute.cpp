@@ -36,14 +36,132 @@ static const char* s_trackName = 0;
 static bool s_extended;
 static bool s_insensitive;
 static bool s_prerouteall;
-static int s_maxDepth = 5;
 static String s_defRule;
-static Mutex s_mutex(true,"RegexRoute");
+static Mutex s_mutex(false,"RegexRoute");
+static Mutex s_varsMutex(true,"RegexRouteVars");
 static ObjList s_extra;
 static NamedList s_vars("");
 static int s_dispatching = 0;
 
 
+// One match condition of a rule, parsed and compiled at load time
+class RouteMatch : public GenObject
+{
+public:
+    enum Type {
+	MatchString,
+	MatchParam,
+	MatchFunc,
+	BadParam,
+	BadFunc,
+	NoParamRule,
+	NoFuncRule,
+	NoCond,
+	Malformed,
+    };
+    enum Oper {
+	CondFirst,
+	CondAnd,
+	CondOr,
+    };
+    RouteMatch(const String& rule, int oper = CondFirst, bool assign = true);
+    bool matches(Message& msg, String& match, const String& context, unsigned int rule,
+	const String& trace, ObjList* traceLst) const;
+    inline const String& rule() const
+	{ return m_rule; }
+    inline int oper() const
+	{ return m_oper; }
+    inline bool missing() const
+	{ return (NoCond == m_type) || (Malformed == m_type); }
+    inline bool malformed() const
+	{ return (Malformed == m_type); }
+private:
+    int m_type;
+    int m_oper;
+    bool m_reverse;
+    String m_rule;
+    Regexp m_regexp;
+    String m_text;
+    String m_default;
+};
+
+// One line of a context with its conditions and preprocessed action
+class RouteRule : public GenObject
+{
+public:
+    enum Action {
+	ActSet,
+	ActEcho,
+	ActBlock,
+	ActDispatch,
+	ActEnqueue,
+    };
+    RouteRule(const NamedString& line, unsigned int index);
+    virtual ~RouteRule();
+    bool matches(Message& msg, const String& str, String& match, const String& context,
+	const String& trace, ObjList* traceLst) const;
+    inline unsigned int index() const
+	{ return m_index; }
+    inline const String& name() const
+	{ return m_name; }
+    inline const String& value() const
+	{ return m_value; }
+    inline bool blockEnd() const
+	{ return m_close; }
+    inline bool blockStart() const
+	{ return m_open; }
+    inline int action() const
+	{ return m_action; }
+    inline int level() const
+	{ return m_level; }
+    inline const String& text() const
+	{ return m_text; }
+    inline const ObjList* parts() const
+	{ return m_parts; }
+private:
+    unsigned int m_index;
+    String m_name;
+    String m_value;
+    bool m_close;
+    bool m_open;
+    ObjList m_conds;
+    int m_action;
+    int m_level;
+    String m_text;
+    ObjList* m_parts;
+};
+
+// Compiled rules of a configuration section
+class RouteContext : public String
+{
+public:
+    RouteContext(const NamedList& sect);
+    inline const ObjList& rules() const
+	{ return m_rules; }
+private:
+    ObjList m_rules;
+};
+
+// Immutable set of compiled contexts, replaced as a whole on reload
+class RoutePlan : public RefObject
+{
+public:
+    RoutePlan(const Configuration& cfg, int maxDepth);
+    inline const RouteContext* context(const String& name) const
+	{ return static_cast<const RouteContext*>(m_contexts[name]); }
+    inline int maxDepth() const
+	{ return m_maxDepth; }
+    inline unsigned int rules() const
+	{ return m_rules; }
+private:
+    HashList m_contexts;
+    int m_maxDepth;
+    unsigned int m_rules;
+};
+
+static RoutePlan* s_plan = 0;
+
+
 class RouteHandler : public MessageHandler
 {
 public:
@@ -124,6 +242,7 @@ static String& vars(String& s, String* vName = 0)
 	s.trimBlanks();
 	if (vName)
 	    *vName = s;
+	Lock lock(s_varsMutex);
 	s = s_vars.getValue(s);
     }
     return s;
@@ -216,12 +335,14 @@ static void evalFunc(String& str, Message& msg)
 	;
     else if (str.startSkip("++",false)) {
 	String tmp;
+	Lock lock(s_varsMutex);
 	str = vars(str,&tmp).toInteger(0,10) + 1;
 	if (tmp)
 	    s_vars.setParam(tmp,str);
     }
     else if (str.startSkip("--",false)) {
 	String tmp;
+	Lock lock(s_varsMutex);
 	str = vars(str,&tmp).toInteger(0,10) - 1;
 	if (tmp)
 	    s_vars.setParam(tmp,str);
@@ -328,6 +449,7 @@ static void evalFunc(String& str, Message& msg)
 	else if ((sep > 0) && ((str == YSTRING("index")) || (str == YSTRING("rotate")))) {
 	    bool rotate = (str == YSTRING("rotate"));
 	    String vname;
+	    Lock lock(s_varsMutex);
 	    str = par.substr(0,sep);
 	    par = par.substr(sep+1).trimBlanks();
 	    int idx = vars(str,&vname).toInteger(0,10);
@@ -405,6 +527,7 @@ static void evalFunc(String& str, Message& msg)
 	    }
 	    else
 		str.clear();
+	    Lock lock(s_varsMutex);
 	    if (par.null() || par == YSTRING("count"))
 		str = s_vars.count();
 	    else if (par == YSTRING("list")) {
@@ -445,15 +568,19 @@ static void evalFunc(String& str, Message& msg)
 	    str.append(fmts,",");
 	    TelEngine::destruct(fmts);
 	}
-	else if (str == YSTRING("dispatching"))
+	else if (str == YSTRING("dispatching")) {
+	    Lock lock(s_varsMutex);
 	    str = s_dispatching;
+	}
 	else if (str == YSTRING("timestamp")) {
 	    char buf[24];
 	    Debugger::formatTime(buf);
 	    str = buf;
 	}
-	else if (bare && str.trimBlanks())
+	else if (bare && str.trimBlanks()) {
+	    Lock lock(s_varsMutex);
 	    str = s_vars.getValue(str);
+	}
 	else {
 	    Debug("RegexRoute",DebugWarn,"Invalid function '%s'",str.c_str());
 	    str.clear();
@@ -482,48 +609,62 @@ static void replaceFuncs(String &str, Message& msg)
     }
 }
 
+// apply match, parameter and function replacements to a template
+static void substitute(String& str, const String& match, Message& msg)
+{
+    if (str.find('\\') >= 0)
+	str = match.replaceMatches(str);
+    if (str.find('$') >= 0) {
+	msg.replaceParams(str);
+	replaceFuncs(str,msg);
+    }
+}
+
 // handle ;paramname[=value] assignments
-static void setMessage(const String& match, Message& msg, String& line, Message* target = 0)
+static void setMessage(const String& match, Message& msg, const ObjList* parts, String& line,
+    Message* target = 0)
 {
     if (!target)
 	target = &msg;
-    ObjList *strs = line.split(';');
     bool first = true;
-    for (ObjList *p = strs; p; p=p->next()) {
-	String *s = static_cast<String*>(p->get());
-	if (s) {
-	    *s = match.replaceMatches(*s);
-	    msg.replaceParams(*s);
-	    replaceFuncs(*s,msg);
+    for (const ObjList* p = parts; p; p = p->next()) {
+	const String* t = static_cast<const String*>(p->get());
+	String s;
+	if (t) {
+	    s = *t;
+	    substitute(s,match,msg);
 	}
 	if (first) {
 	    first = false;
-	    line = s ? *s : String::empty();
+	    line = s;
 	    continue;
 	}
-	if (s && !s->trimBlanks().null()) {
-	    int q = s->find('=');
+	if (t && !s.trimBlanks().null()) {
+	    int q = s.find('=');
 	    if (q > 0) {
-		String n = s->substr(0,q);
-		String v = s->substr(q+1);
+		String n = s.substr(0,q);
+		String v = s.substr(q+1);
 		n.trimBlanks();
 		v.trimBlanks();
 		DDebug("RegexRoute",DebugAll,"Setting '%s' to '%s'",n.c_str(),v.c_str());
-		if (n.startSkip("$",false))
+		if (n.startSkip("$",false)) {
+		    Lock lock(s_varsMutex);
 		    s_vars.setParam(n,v);
+		}
 		else
 		    target->setParam(n,v);
 	    }
 	    else {
-		DDebug("RegexRoute",DebugAll,"Clearing parameter '%s'",s->c_str());
-		if (s->startSkip("$",false))
-		    s_vars.clearParam(*s);
+		DDebug("RegexRoute",DebugAll,"Clearing parameter '%s'",s.c_str());
+		if (s.startSkip("$",false)) {
+		    Lock lock(s_varsMutex);
+		    s_vars.clearParam(s);
+		}
 		else
-		    target->clearParam(*s);
+		    target->clearParam(s);
 	    }
 	}
     }
-    strs->destruct();
 }
 
 // helper function to set the default regexp
@@ -573,72 +714,266 @@ do { \
     } \
 } while (false)
 
-// helper function to process one match attempt
-static bool oneMatch(Message& msg, Regexp& reg, String& match, const String& context,
-        unsigned int rule, const String& trace = String::empty(), ObjList* traceLst = 0)
+
+// Parse the rule and compile the regular expression once
+RouteMatch::RouteMatch(const String& rule, int oper, bool assign)
+    : m_type(MatchString), m_oper(oper), m_reverse(false),
+      m_rule(rule), m_regexp(rule,s_extended,s_insensitive)
 {
-    if (reg.startsWith("${")) {
+    if (!assign) {
+	// no '=' after 'if', 'and' or 'or'
+	m_type = Malformed;
+	return;
+    }
+    if ((CondFirst != oper) && m_regexp.null()) {
+	m_type = NoCond;
+	return;
+    }
+    if (m_regexp.startsWith("${")) {
 	// handle special matching by param ${paramname}regexp
-	int p = reg.find('}');
+	int p = m_regexp.find('}');
 	if (p < 3) {
-	    TRACE_DBG(DebugWarn,trace,traceLst,"Invalid parameter match '%s' in rule #%u in context '%s'",
-		reg.c_str(),rule,context.c_str());
-	    return false;
+	    m_type = BadParam;
+	    return;
 	}
-	match = reg.substr(2,p-2);
-	reg = reg.substr(p+1);
-	match.trimBlanks();
-	reg.trimBlanks();
-	String def;
-	p = match.find('$');
+	m_text = m_regexp.substr(2,p-2);
+	m_regexp = m_regexp.substr(p+1);
+	m_text.trimBlanks();
+	m_regexp.trimBlanks();
+	p = m_text.find('$');
 	if (p >= 0) {
 	    // param is in ${<name>$<default>} format
-	    def = match.substr(p+1);
-	    match = match.substr(0,p);
-	    match.trimBlanks();
+	    m_default = m_text.substr(p+1);
+	    m_text = m_text.substr(0,p);
+	    m_text.trimBlanks();
 	}
-	setDefault(reg);
-	if (match.null() || reg.null()) {
-	    TRACE_DBG(DebugWarn,trace,traceLst,"Missing parameter or rule in rule #%u in context '%s'",
-		rule,context.c_str());
-	    return false;
+	setDefault(m_regexp);
+	if (m_text.null() || m_regexp.null()) {
+	    m_type = NoParamRule;
+	    return;
 	}
-	DDebug("RegexRoute",DebugAll,"Using message parameter '%s' default '%s'",
-	    match.c_str(),def.c_str());
-	match = msg.getValue(match,def);
+	m_type = MatchParam;
     }
-    else if (reg.startsWith("$(")) {
+    else if (m_regexp.startsWith("$(")) {
 	// handle special matching by param $(function)regexp
-	int p = reg.find(')');
+	int p = m_regexp.find(')');
 	if (p < 3) {
+	    m_type = BadFunc;
+	    return;
+	}
+	m_text = m_regexp.substr(0,p+1);
+	m_regexp = m_regexp.substr(p+1);
+	m_regexp.trimBlanks();
+	setDefault(m_regexp);
+	if (m_regexp.null()) {
+	    m_type = NoFuncRule;
+	    return;
+	}
+	m_type = MatchFunc;
+    }
+    if (m_regexp.endsWith("^")) {
+	// reverse match on final ^ (makes no sense in a regexp)
+	m_reverse = true;
+	m_regexp = m_regexp.substr(0,m_regexp.length()-1);
+    }
+    // compile now so concurrent matching never modifies the regexp
+    m_regexp.compile();
+}
+
+// Process one match attempt, match holds the default string to match
+bool RouteMatch::matches(Message& msg, String& match, const String& context, unsigned int rule,
+    const String& trace, ObjList* traceLst) const
+{
+    switch (m_type) {
+	case MatchParam:
+	    DDebug("RegexRoute",DebugAll,"Using message parameter '%s' default '%s'",
+		m_text.c_str(),m_default.c_str());
+	    match = msg.getValue(m_text,m_default);
+	    break;
+	case MatchFunc:
+	    DDebug("RegexRoute",DebugAll,"Using function '%s'",m_text.c_str());
+	    match = m_text;
+	    msg.replaceParams(match);
+	    replaceFuncs(match,msg);
+	    break;
+	case BadParam:
+	    TRACE_DBG(DebugWarn,trace,traceLst,"Invalid parameter match '%s' in rule #%u in context '%s'",
+		m_rule.c_str(),rule,context.c_str());
+	    return false;
+	case BadFunc:
 	    TRACE_DBG(DebugWarn,trace,traceLst,"Invalid function match '%s' in rule #%u in context '%s'",
-		reg.c_str(),rule,context.c_str());
+		m_rule.c_str(),rule,context.c_str());
 	    return false;
-	}
-	match = reg.substr(0,p+1);
-	reg = reg.substr(p+1);
-	reg.trimBlanks();
-	setDefault(reg);
-	if (reg.null()) {
+	case NoParamRule:
+	    TRACE_DBG(DebugWarn,trace,traceLst,"Missing parameter or rule in rule #%u in context '%s'",
+		rule,context.c_str());
+	    return false;
+	case NoFuncRule:
 	    TRACE_DBG(DebugWarn,trace,traceLst,"Missing rule in rule #%u in context '%s'",
 		rule,context.c_str());
 	    return false;
-	}
-	DDebug("RegexRoute",DebugAll,"Using function '%s'",match.c_str());
-	msg.replaceParams(match);
-	replaceFuncs(match,msg);
+	case NoCond:
+	case Malformed:
+	    return false;
     }
     match.trimBlanks();
+    return (match.matches(m_regexp) != m_reverse);
+}
 
-    bool doMatch = true;
-    if (reg.endsWith("^")) {
-	// reverse match on final ^ (makes no sense in a regexp)
-	doMatch = false;
-	reg = reg.substr(0,reg.length()-1);
+
+// Split the line in conditions and action, preprocess the action
+RouteRule::RouteRule(const NamedString& line, unsigned int index)
+    : m_index(index), m_name(line.name()), m_value(line),
+      m_close(false), m_open(false),
+      m_action(ActSet), m_level(0), m_parts(0)
+{
+    String reg(m_name);
+    if (reg.startSkip("}",false)) {
+	m_close = true;
+	if (reg.trimBlanks().null())
+	    reg = ".*";
+    }
+    static Regexp s_blockStart("^\\(.*=[[:space:]]*\\)\\?{$");
+    m_open = s_blockStart.matches(m_value);
+    m_conds.append(new RouteMatch(reg));
+
+    String val(m_value);
+    for (;;) {
+	int oper = RouteMatch::CondOr;
+	if (!val.startSkip("or")) {
+	    if (!(val.startSkip("if") || val.startSkip("and")))
+		break;
+	    oper = RouteMatch::CondAnd;
+	}
+	int p = val.find('=');
+	if (p < 0) {
+	    m_conds.append(new RouteMatch(val,oper,false));
+	    return;
+	}
+	reg = val.substr(0,p);
+	val = val.substr(p+1);
+	reg.trimBlanks();
+	val.trimBlanks();
+	m_conds.append(new RouteMatch((p >= 1) ? reg : String::empty(),oper));
+    }
+
+    if (val.startSkip("echo") || val.startSkip("output")
+	    || (val.startSkip("debug") && ((m_level = DebugAll)))) {
+	if (m_level) {
+	    val >> m_level;
+	    val.trimBlanks();
+	    if (m_level < DebugTest)
+		m_level = DebugTest;
+	    else if (m_level > DebugAll)
+		m_level = DebugAll;
+	}
+	// special case: display the line but don't set params
+	m_action = ActEcho;
+	m_text = val;
+	return;
+    }
+    if (val == "{") {
+	m_action = ActBlock;
+	return;
+    }
+    if (val.startSkip("dispatch"))
+	m_action = ActDispatch;
+    else if (val.startSkip("enqueue"))
+	m_action = ActEnqueue;
+    else {
+	m_parts = val.split(';');
+	return;
+    }
+    // new message needs a name
+    if (val && (val[0] != ';'))
+	m_parts = val.split(';');
+}
+
+RouteRule::~RouteRule()
+{
+    TelEngine::destruct(m_parts);
+}
+
+// Evaluate the chain of conditions, match is left with the last matched string
+bool RouteRule::matches(Message& msg, const String& str, String& match, const String& context,
+    const String& trace, ObjList* traceLst) const
+{
+    const ObjList* l = m_conds.skipNull();
+    const RouteMatch* cond = static_cast<const RouteMatch*>(l->get());
+    for (;;) {
+	match = str;
+	bool ok = cond->matches(msg,match,context,m_index+1,trace,traceLst);
+	l = l->skipNext();
+	const RouteMatch* next = l ? static_cast<const RouteMatch*>(l->get()) : 0;
+	if (ok) {
+	    if (!next)
+		return true;
+	    if (RouteMatch::CondOr == next->oper()) {
+		// skip all remaining conditions
+		for (; l; l = l->skipNext()) {
+		    if (static_cast<const RouteMatch*>(l->get())->malformed()) {
+			TRACE_DBG(DebugWarn,trace,traceLst,"Malformed 'or' rule #%u in context '%s'",
+			    m_index+1,context.c_str());
+			return false;
+		    }
+		}
+		return true;
+	    }
+	}
+	else if (!next || (RouteMatch::CondOr != next->oper()))
+	    return false;
+	if (next->missing()) {
+	    TRACE_DBG(DebugWarn,trace,traceLst,"Missing 'if' in rule #%u in context '%s'",
+		m_index+1,context.c_str());
+	    return false;
+	}
+	NDebug("RegexRoute",DebugAll,"Secondary match rule '%s' by rule #%u in context '%s'",
+	    next->rule().c_str(),m_index+1,context.c_str());
+	cond = next;
     }
-    return (match.matches(reg) == doMatch);
 }
 
+
+RouteContext::RouteContext(const NamedList& sect)
+    : String(sect)
+{
+    ObjList* last = &m_rules;
+    unsigned int len = sect.length();
+    for (unsigned int i = 0; i < len; i++) {
+	const NamedString* n = sect.getParam(i);
+	if (n)
+	    last = last->append(new RouteRule(*n,i));
+    }
+}
+
+
+RoutePlan::RoutePlan(const Configuration& cfg, int maxDepth)
+    : m_contexts(cfg.sections() > 17 ? 101 : 17),
+      m_maxDepth(maxDepth), m_rules(0)
+{
+    unsigned int n = cfg.sections();
+    for (unsigned int i = 0; i < n; i++) {
+	const NamedList* sect = cfg.getSection(i);
+	// variable initialization sections are not routing contexts
+	if (!sect || (*sect == YSTRING("$once")) || (*sect == YSTRING("$init")))
+	    continue;
+	if (m_contexts[*sect])
+	    continue;
+	m_contexts.append(new RouteContext(*sect));
+	m_rules += sect->length();
+    }
+    DDebug("RegexRoute",DebugInfo,"Compiled %u rules in %u contexts [%p]",
+	m_rules,m_contexts.count(),this);
+}
+
+static bool getPlan(RefPointer<RoutePlan>& plan)
+{
+    Lock lock(s_mutex);
+    plan = s_plan;
+    return (0 != plan);
+}
+
+
 enum BlockState {
     BlockRun  = 0,
     BlockSkip = 1,
@@ -646,44 +981,38 @@ enum BlockState {
 };
 
 // process one context, can call itself recursively
-static bool oneContext(Message &msg, String &str, const String &context, String &ret,
+static bool oneContext(const RoutePlan& plan, Message &msg, String &str, const String &context, String &ret,
     const String& trace = String::empty(), int traceLevel = DebugNote, ObjList* traceLst = 0,
     bool warn = false, int depth = 0)
 {
     if (context.null())
 	return false;
-    if (depth > s_maxDepth) {
+    if (depth > plan.maxDepth()) {
 	TRACE_DBG(DebugWarn,trace,traceLst,"Possible loop detected, current context '%s'",context.c_str());
 	return false;
     }
 
     TRACE_RULE(traceLevel,trace,traceLst,"Searching match for %s",str.c_str());
-    NamedList *l = s_cfg.getSection(context);
-    if (l) {
+    const RouteContext* ctx = plan.context(context);
+    if (ctx) {
 	unsigned int blockDepth = 0;
 	BlockState blockStack[BLOCK_STACK];
-	unsigned int len = l->length();
-	for (unsigned int i = 0; i < len; i++) {
-	    const NamedString* n = l->getParam(i);
-	    if (!n)
-		continue;
+	for (const ObjList* o = ctx->rules().skipNull(); o; o = o->skipNext()) {
+	    const RouteRule* r = static_cast<const RouteRule*>(o->get());
+	    unsigned int i = r->index();
 	    BlockState blockThis = (blockDepth > 0) ? blockStack[blockDepth-1] : BlockRun;
 	    BlockState blockLast = BlockSkip;
-	    Regexp reg(n->name(),s_extended,s_insensitive);
-	    if (reg.startSkip("}",false)) {
+	    if (r->blockEnd()) {
 		if (!blockDepth) {
 		    TRACE_DBG(DebugWarn,trace,traceLst,"Got '}' outside block in line #%u in context '%s'",
 			i+1,context.c_str());
 		    continue;
 		}
-		if (reg.trimBlanks().null())
-		    reg = ".*";
 		blockDepth--;
 		blockLast = blockThis;
 		blockThis = (blockDepth > 0) ? blockStack[blockDepth-1] : BlockRun;
 	    }
-	    static Regexp s_blockStart("^\\(.*=[[:space:]]*\\)\\?{$");
-	    if (s_blockStart.matches(*n)) {
+	    if (r->blockStart()) {
 		// start of a new block
 		if (blockDepth >= BLOCK_STACK) {
 		    TRACE_DBG(DebugWarn,trace,traceLst,"Block stack overflow in line #%u in context '%s'",
@@ -705,118 +1034,69 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 		blockThis = BlockDone;
 	    XDebug("RegexRoute",DebugAll,"%s:%d(%u:%s) %s=%s",context.c_str(),i+1,
 		blockDepth,String::boolText(BlockRun == blockThis),
-		n->name().c_str(),n->c_str());
+		r->name().c_str(),r->value().c_str());
 	    if (BlockRun != blockThis)
 		continue;
 
-	    String val(*n);
 	    String match;
-	    bool ok;
-	    do {
-		match = str;
-		ok = oneMatch(msg,reg,match,context,i+1,trace,traceLst);
-		if (ok) {
-		    if (val.startSkip("or")) {
-			do {
-			    int p = val.find('=');
-			    if (p < 0) {
-				TRACE_DBG(DebugWarn,trace,traceLst,"Malformed 'or' rule #%u in context '%s'",
-				    i+1,context.c_str());
-				ok = false;
-				break;
-			    }
-			    val = val.substr(p+1);
-			    val.trimBlanks();
-			} while (ok && (val.startSkip("or") || val.startSkip("if") || val.startSkip("and")));
-			break;
-		    }
-		    if (!(val.startSkip("if") || val.startSkip("and")))
-			break;
-		}
-		else if (val.startSkip("or"))
-		    ok = true;
-		if (ok) {
-		    int p = val.find('=');
-		    if (p >= 1) {
-			reg = val.substr(0,p);
-			val = val.substr(p+1);
-			reg.trimBlanks();
-			val.trimBlanks();
-			if (!reg.null()) {
-			    NDebug("RegexRoute",DebugAll,"Secondary match rule '%s' by rule #%u in context '%s'",
-				reg.c_str(),i+1,context.c_str());
-			    continue;
-			}
-		    }
-		    TRACE_DBG(DebugWarn,trace,traceLst,"Missing 'if' in rule #%u in context '%s'",
-			i+1,context.c_str());
-		    ok = false;
-		}
-	    } while (ok);
+	    bool ok = r->matches(msg,str,match,context,trace,traceLst);
 	    TRACE_RULE(traceLevel,trace,traceLst,"Matched:%s %s:%d - %s=%s",
-		     String::boolText(ok),context.c_str(),i,n->name().c_str(),n->safe());
+		     String::boolText(ok),context.c_str(),i,r->name().c_str(),r->value().safe());
 	    if (!ok)
 		continue;
 
-	    int level = 0;
-	    if (val.startSkip("echo") || val.startSkip("output")
-		    || (val.startSkip("debug") && ((level = DebugAll)))) {
-		if (level) {
-		    val >> level;
-		    val.trimBlanks();
-		    if (level < DebugTest)
-			level = DebugTest;
-		    else if (level > DebugAll)
-			level = DebugAll;
-		}
-		// special case: display the line but don't set params
-		val = match.replaceMatches(val);
-		msg.replaceParams(val);
-		replaceFuncs(val,msg);
-		if (level)
-		    Debug(level,"%s",val.safe());
-		else
-		    Output("%s",val.safe());
-		continue;
-	    }
-	    else if (val == "{") {
-		// mark block as being processed now
-		if (blockDepth)
-		    blockStack[blockDepth-1] = BlockRun;
-		else
-		    TRACE_DBG(DebugWarn,trace,traceLst,"Got '{' outside block in line #%u in context '%s'",
-			i+1,context.c_str());
-		continue;
-	    }
-	    bool disp = val.startSkip("dispatch");
-	    if (disp || val.startSkip("enqueue")) {
-		// special case: enqueue or dispatch a new message
-		if (val && (val[0] != ';')) {
-		    Message* m = new Message("");
-		    // parameters are set in the new message
-		    setMessage(match,msg,val,m);
-		    val.trimBlanks();
-		    if (val) {
-			*m = val;
-			m->userData(msg.userData());
-			NDebug("RegexRoute",DebugAll,"%s new message '%s' by rule #%u '%s' in context '%s'",
-			    (disp ? "Dispatching" : "Enqueueing"),
-			    val.c_str(),i+1,n->name().c_str(),context.c_str());
-			if (disp) {
-			    s_dispatching++;
-			    Engine::dispatch(m);
-			    s_dispatching--;
-			}
-			else {
-			    Engine::enqueue(m);
-			    m = 0;
+	    String val;
+	    switch (r->action()) {
+		case RouteRule::ActEcho:
+		    val = r->text();
+		    substitute(val,match,msg);
+		    if (r->level())
+			Debug(r->level(),"%s",val.safe());
+		    else
+			Output("%s",val.safe());
+		    continue;
+		case RouteRule::ActBlock:
+		    // mark block as being processed now
+		    if (blockDepth)
+			blockStack[blockDepth-1] = BlockRun;
+		    else
+			TRACE_DBG(DebugWarn,trace,traceLst,"Got '{' outside block in line #%u in context '%s'",
+			    i+1,context.c_str());
+		    continue;
+		case RouteRule::ActDispatch:
+		case RouteRule::ActEnqueue:
+		    // special case: enqueue or dispatch a new message
+		    if (r->parts()) {
+			bool disp = (RouteRule::ActDispatch == r->action());
+			Message* m = new Message("");
+			// parameters are set in the new message
+			setMessage(match,msg,r->parts(),val,m);
+			val.trimBlanks();
+			if (val) {
+			    *m = val;
+			    m->userData(msg.userData());
+			    NDebug("RegexRoute",DebugAll,"%s new message '%s' by rule #%u '%s' in context '%s'",
+				(disp ? "Dispatching" : "Enqueueing"),
+				val.c_str(),i+1,r->name().c_str(),context.c_str());
+			    if (disp) {
+				s_varsMutex.lock();
+				s_dispatching++;
+				s_varsMutex.unlock();
+				Engine::dispatch(m);
+				s_varsMutex.lock();
+				s_dispatching--;
+				s_varsMutex.unlock();
+			    }
+			    else {
+				Engine::enqueue(m);
+				m = 0;
+			    }
 			}
+			TelEngine::destruct(m);
 		    }
-		    TelEngine::destruct(m);
-		}
-		continue;
+		    continue;
 	    }
-	    setMessage(match,msg,val);
+	    setMessage(match,msg,r->parts(),val);
 	    warn = true;
 	    val.trimBlanks();
 	    if (val.null() || val.startSkip("noop")) {
@@ -832,14 +1112,14 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 	    else if (val.startSkip("goto") || val.startSkip("jump") ||
 		((val.startSkip("@goto") || val.startSkip("@jump")) && !(warn = false))) {
 		NDebug("RegexRoute",DebugAll,"Jumping to context '%s' by rule #%u '%s'",
-		    val.c_str(),i+1,n->name().c_str());
-		return oneContext(msg,str,val,ret,trace,traceLevel,traceLst,warn,depth+1);
+		    val.c_str(),i+1,r->name().c_str());
+		return oneContext(plan,msg,str,val,ret,trace,traceLevel,traceLst,warn,depth+1);
 	    }
 	    else if (val.startSkip("include") || val.startSkip("call") ||
 		((val.startSkip("@include") || val.startSkip("@call")) && !(warn = false))) {
 		NDebug("RegexRoute",DebugAll,"Including context '%s' by rule #%u '%s'",
-		    val.c_str(),i+1,n->name().c_str());
-		if (oneContext(msg,str,val,ret,trace,traceLevel,traceLst,warn,depth+1)) {
+		    val.c_str(),i+1,r->name().c_str());
+		if (oneContext(plan,msg,str,val,ret,trace,traceLevel,traceLst,warn,depth+1)) {
 		    DDebug("RegexRoute",DebugAll,"Returning true from context '%s'", context.c_str());
 		    return true;
 		}
@@ -847,25 +1127,25 @@ static bool oneContext(Message &msg, String &str, const String &context, String
 	    else if (val.startSkip("match") || val.startSkip("newmatch")) {
 		if (!val.null()) {
 		    NDebug("RegexRoute",DebugAll,"Setting match string '%s' by rule #%u '%s' in context '%s'",
-			val.c_str(),i+1,n->name().c_str(),context.c_str());
+			val.c_str(),i+1,r->name().c_str(),context.c_str());
 		    str = val;
 		}
 	    }
 	    else if (val.startSkip("rename")) {
 		if (!val.null()) {
 		    NDebug("RegexRoute",DebugAll,"Renaming message '%s' to '%s' by rule #%u '%s' in context '%s'",
-			msg.c_str(),val.c_str(),i+1,n->name().c_str(),context.c_str());
+			msg.c_str(),val.c_str(),i+1,r->name().c_str(),context.c_str());
 		    msg = val;
 		}
 	    }
 	    else if (val.startSkip("retval")) {
 		NDebug("RegexRoute",DebugAll,"Setting retValue length %u by rule #%u '%s' in context '%s'",
-			val.length(),i+1,n->name().c_str(),context.c_str());
+			val.length(),i+1,r->name().c_str(),context.c_str());
 		ret = val;
 	    }
 	    else {
 		DDebug("RegexRoute",DebugAll,"Returning '%s' for '%s' in context '%s' by rule #%u '%s'",
-		    val.c_str(),str.c_str(),context.c_str(),i+1,n->name().c_str());
+		    val.c_str(),str.c_str(),context.c_str(),i+1,r->name().c_str());
 		ret = val;
 		return true;
 	    }
@@ -905,9 +1185,11 @@ bool RouteHandler::received(Message &msg)
     const char *context = msg.getValue(YSTRING("context"),"default");
     const String& traceID = msg[YSTRING("trace_id")];
     int traceLvl = msg.getIntValue(YSTRING("trace_lvl"),DebugNote,DebugGoOn,DebugAll);
+    RefPointer<RoutePlan> plan;
+    if (!getPlan(plan))
+	return false;
     ObjList* traceLst = msg.getBoolValue(YSTRING("trace_to_msg"),false) ? new ObjList() : 0;
-    Lock lock(s_mutex);
-    if (oneContext(msg,called,context,msg.retValue(),traceID,traceLvl,traceLst)) {
+    if (oneContext(*plan,msg,called,context,msg.retValue(),traceID,traceLvl,traceLst)) {
 	TRACE_DBG_ONLY(DebugInfo,traceID,traceLst,"Routing %s to '%s' in context '%s' via '%s' in " FMT64U " usec",
 	    msg.getValue(YSTRING("route_type"),"call"),called.c_str(),context,
 	    msg.retValue().c_str(),Time::now()-tmr);
@@ -932,12 +1214,14 @@ bool PrerouteHandler::received(Message &msg)
     if (!s_prerouteall && caller.null())
 	return false;
 
+    RefPointer<RoutePlan> plan;
+    if (!getPlan(plan))
+	return false;
     String ret;
     const String& traceID = msg[YSTRING("trace_id")];
     int traceLvl = msg.getIntValue(YSTRING("trace_lvl"),DebugNote,DebugGoOn,DebugAll);
     ObjList* traceLst = msg.getBoolValue(YSTRING("trace_to_msg"),false) ? new ObjList() : 0;
-    Lock lock(s_mutex);
-    if (oneContext(msg,caller,"contexts",ret,traceID,traceLvl,traceLst)) {
+    if (oneContext(*plan,msg,caller,"contexts",ret,traceID,traceLvl,traceLst)) {
 	TRACE_DBG_ONLY(DebugInfo,traceID,traceLst,"Classifying caller '%s' in context '%s' in " FMT64 " usec",
 	    caller.c_str(),ret.c_str(),Time::now()-tmr);
 	if (ret == YSTRING("-") || ret == YSTRING("error"))
@@ -957,6 +1241,9 @@ bool PrerouteHandler::received(Message &msg)
 bool GenericHandler::received(Message &msg)
 {
     DDebug(DebugAll,"Handling message '%s' [%p]",c_str(),this);
+    RefPointer<RoutePlan> plan;
+    if (!getPlan(plan))
+	return false;
     String what(m_match);
     if (what)
 	what = msg.getValue(what);
@@ -965,8 +1252,7 @@ bool GenericHandler::received(Message &msg)
     const String& traceID = msg[YSTRING("trace_id")];
     int traceLvl = msg.getIntValue(YSTRING("trace_lvl"),DebugNote,DebugGoOn,DebugAll);
     ObjList* traceLst = msg.getBoolValue(YSTRING("trace_to_msg"),false) ? new ObjList() : 0;
-    Lock lock(s_mutex);
-    bool ok = oneContext(msg,what,m_context,msg.retValue(),traceID,traceLvl,traceLst);
+    bool ok = oneContext(*plan,msg,what,m_context,msg.retValue(),traceID,traceLvl,traceLst);
     dumpTraceToMsg(msg,traceLst);
     return ok;
 }
@@ -980,9 +1266,14 @@ bool StatusHandler::received(Message &msg)
     const String& dest = msg[YSTRING("module")];
     if (dest && (dest != __plugin.name()))
 	return false;
-    Lock lock(s_mutex);
+    s_mutex.lock();
+    unsigned int sections = s_cfg.count();
+    unsigned int rules = s_plan ? s_plan->rules() : 0;
+    s_mutex.unlock();
+    Lock lock(s_varsMutex);
     msg.retValue() << "name=" << __plugin.name()
-	<< ",type=route;sections=" << s_cfg.count()
+	<< ",type=route;sections=" << sections
+	<< ",rules=" << rules
 	<< ",extra=" << s_extra.count()
 	<< ",variables=" << s_vars.count() << "\r\n";
     return !dest.null();
@@ -1014,6 +1305,7 @@ void RegexRoutePlugin::initVars(NamedList* sect)
 {
     if (!sect)
 	return;
+    Lock lock(s_varsMutex);
     unsigned int len = sect->length();
     for (unsigned int i=0; i<len; i++) {
 	NamedString* n = sect->getParam(i);
@@ -1030,9 +1322,10 @@ void RegexRoutePlugin::initialize()
     TelEngine::destruct(m_status);
     TelEngine::destruct(m_command);
     s_extra.clear();
-    Lock lock(s_mutex);
+    s_mutex.lock();
     s_cfg = Engine::configFile(name());
     s_cfg.load();
+    s_mutex.unlock();
     if (m_first) {
 	m_first = false;
 	initVars(s_cfg.getSection("$once"));
@@ -1043,6 +1336,19 @@ void RegexRoutePlugin::initialize()
     s_extended = s_cfg.getBoolValue("priorities","extended",false);
     s_insensitive = s_cfg.getBoolValue("priorities","insensitive",false);
     s_prerouteall = s_cfg.getBoolValue("priorities","prerouteall",false);
+    int depth = s_cfg.getIntValue("priorities","maxdepth",5);
+    if (depth < 5)
+	depth = 5;
+    else if (depth > 100)
+	depth = 100;
+    s_defRule = s_cfg.getValue("priorities","defaultrule",DEFAULT_RULE);
+    // compile all contexts, routing threads keep using the old plan until swapped
+    RoutePlan* plan = new RoutePlan(s_cfg,depth);
+    s_mutex.lock();
+    RoutePlan* old = s_plan;
+    s_plan = plan;
+    s_mutex.unlock();
+    TelEngine::destruct(old);
     unsigned priority = s_cfg.getIntValue("priorities","preroute",100);
     if (priority)
 	Engine::install(m_preroute = new PrerouteHandler(priority));
@@ -1054,13 +1360,6 @@ void RegexRoutePlugin::initialize()
 	Engine::install(m_status = new StatusHandler(priority));
 	Engine::install(m_command = new CommandHandler(priority));
     }
-    int depth = s_cfg.getIntValue("priorities","maxdepth",5);
-    if (depth < 5)
-	depth = 5;
-    else if (depth > 100)
-	depth = 100;
-    s_maxDepth = depth;
-    s_defRule = s_cfg.getValue("priorities","defaultrule",DEFAULT_RULE);
     NamedList* l = s_cfg.getSection("extra");
     if (l) {
 	unsigned int len = l->length();
@@ -1075,7 +1374,7 @@ void RegexRoutePlugin::initialize()
 		const char* context = TelEngine::c_str(static_cast<const String*>(o->at(2)));
 		if (TelEngine::null(context))
 		    context = n->name().c_str();
-		if (s_cfg.getSection(context))
+		if (plan->context(context))
 		    Engine::install(new GenericHandler(n->name(),prio,context,match));
 		else
 		    Debug(DebugWarn,"Missing context [%s] for handling %s",context,n->name().c_str());
@@ -20,12 +20,15 @@
  */
 
 #include <yatephone.h>
+#include <string.h>
 
 
 using namespace TelEngine;
 namespace { // anonymous
 
 class CacheItem;                         // A cache item
+class CacheSlot;                         // Cache items expiring in the same interval
+class CacheItemRef;                      // Reference to a cache item to remove
 class Cache;                             // A cache hash list
 class CacheThread;                       // Base class for cache threads
 class CacheExpireThread;                 // Cache expire thread
@@ -37,27 +40,63 @@ class CacheModule;
 #define EXPIRE_CHECK_MAX 300
 // Min value for cache reload interval in seconds
 #define CACHE_RELOAD_MIN 10
+// Max number of items collected for removal while holding the expire lock
+#define EXPIRE_BATCH 1000
 
-class CacheItem : public NamedList
+// A cache item keeps its parameters in a single buffer as pairs of
+//  NUL terminated name and value
+class CacheItem : public GenObject
 {
     friend class Cache;
+    friend class CacheSlot;
 public:
-    inline CacheItem(const String& id, const NamedList& p, const String& copy,
-	u_int64_t expires)
-	: NamedList(id), m_expires(0)
-	{ update(p,copy,expires); }
-    inline void update(const NamedList& p, const String& copy, u_int64_t expires) {
-	    m_expires = expires;
-	    if (copy)
-		copyParams(p,copy);
-	    else
-		copyParams(p);
-	}
+    CacheItem(const String& id, const NamedList& p, const String& copy, u_int64_t expires);
+    ~CacheItem();
+    virtual const String& toString() const
+	{ return m_id; }
     inline u_int64_t expires() const
 	{ return m_expires; }
     inline bool timeout(const Time& time) const
 	{ return m_expires && m_expires < time; }
+    // Copy parameters to a list, all of them or only the names in a list
+    // Listed parameters missing from item are cleared from destination
+    void copyTo(NamedList& list, const ObjList* names = 0) const;
+#ifdef XDEBUG
+    // Dump id and parameters to a string
+    void dump(String& buf, const char* separator) const;
+#endif
 protected:
+    String m_id;
+    u_int64_t m_expires;
+    char* m_data;
+    unsigned int m_length;
+    // expire order, protected by the cache expire mutex
+    CacheSlot* m_slot;
+    CacheItem* m_prev;
+    CacheItem* m_next;
+};
+
+// Cache items expiring in the same time interval, in the order they were added
+class CacheSlot : public GenObject
+{
+public:
+    inline CacheSlot(u_int64_t time = 0)
+	: m_time(time), m_first(0), m_last(0)
+	{ }
+    void append(CacheItem* item);
+    void remove(CacheItem* item);
+    u_int64_t m_time;                    // Slot index, expire time divided by slot interval
+    CacheItem* m_first;
+    CacheItem* m_last;
+};
+
+// Identify a cache item to remove outside the expire lock
+class CacheItemRef : public String
+{
+public:
+    inline CacheItemRef(const CacheItem& item)
+	: String(item.toString()), m_expires(item.expires())
+	{ }
     u_int64_t m_expires;
 };
 
@@ -74,7 +113,7 @@ public:
     // Check if the cache has reload set
     inline bool canReload()
 	{ return m_loadInterval != 0 || m_reload != 0; }
-    // Retrieve the mutex protecting a given list
+    // Retrieve the index of the list holding an item
     inline unsigned int index(const String& str) const
 	{ return str.hash() % m_list.length(); }
     // Safely retrieve the id matching parameter
@@ -112,18 +151,13 @@ public:
     bool copyParams(const String& id, NamedList& list, const String* cpParams);
     // Add an item to the cache. Remove an existing one
     // Set dbSave=false when loading from database to avoid saving it again
-    void add(const String& id, const NamedList& params, const String* cpParams,
-	bool dbSave = true) {
-	    Lock lock(this);
-	    addUnsafe(id,params,cpParams,dbSave);
-	}
+    // Return false if the item was not added
+    bool add(const String& id, const NamedList& params, const String* cpParams,
+	bool dbSave = true);
     // Add items from NamedList list. Return the number of added items
     unsigned int add(ObjList& list);
-    // Add an item from an Array row
-    inline void add(Array& array, int row, int cols) {
-	    Lock lock(this);
-	    addUnsafe(array,row,cols);
-	}
+    // Add an item from an Array row, return its id
+    String add(Array& array, int row, int cols);
     // Add items from Array rows. Return the number of added rows
     unsigned int addRows(Array& array);
     // Clear the cache
@@ -144,20 +178,28 @@ protected:
     virtual void destroyed();
     // (Re)init
     void doUpdate(const NamedList& params, bool first);
-    // Add an item to the cache. Remove an existing one
-    CacheItem* addUnsafe(const String& id, const NamedList& params, const String* cpParams,
-	bool dbSave = true);
-    // Add an item from an Array row
-    CacheItem* addUnsafe(Array& array, int row, int cols);
-    // Find a cache item. This method is not thread safe
-    CacheItem* find(const String& id);
-    // Find a cache item or prefix. This method is not thread safe
-    CacheItem* findPrefix(const String& id);
+    // Find a cache item and copy its parameters, lock its list while doing it
+    bool copyItem(const String& id, NamedList& list, const ObjList* names);
+    // Find a cache item or prefix and copy its parameters
+    bool copyPrefix(const String& id, NamedList& list, const ObjList* names);
+    // Remove items from a list of ids, only if their expire time was not changed
+    unsigned int removeItems(ObjList& ids);
+    // Put an item in expire order. The expire mutex must be locked
+    void linkItem(CacheItem* item);
+    // Remove an item from expire order. The expire mutex must be locked
+    void unlinkItem(CacheItem* item);
     // Adjust cache length to limit
-    void adjustToLimit(CacheItem* skipAdded);
+    void adjustToLimit();
 
     String m_name;                       // Cache name
     HashList m_list;                     // The list holding the cache
+    Mutex* m_locks;                      // Mutexes protecting each list of m_list
+    Mutex m_expireMutex;                 // Protects the expire order and items counter
+    ObjList m_slots;                     // Items ordered by expire time interval
+    CacheSlot* m_lastSlot;               // Slot with the latest expire time
+    CacheSlot m_never;                   // Items that don't expire
+    u_int64_t m_slotLen;                 // Time interval of an expire slot (in us)
+    bool m_adjusting;                    // Removing oldest items over limit
     u_int64_t m_cacheTtl;                // Cache item TTL (in us)
     unsigned int m_count;                // Current number of items
     unsigned int m_limit;                // Limit the number of cache items
@@ -401,12 +443,137 @@ static void fillList(NamedList& list, String& buf)
 }
 
 
+// Split a list of parameter names, trim blanks from names
+static ObjList* splitNames(const String& names)
+{
+    ObjList* list = names.split(',',false);
+    for (ObjList* o = list->skipNull(); o; o = o->skipNext())
+	static_cast<String*>(o->get())->trimBlanks();
+    return list;
+}
+
+
+/*
+ * CacheItem
+ */
+CacheItem::CacheItem(const String& id, const NamedList& p, const String& copy,
+    u_int64_t expires)
+    : m_id(id), m_expires(expires), m_data(0), m_length(0),
+    m_slot(0), m_prev(0), m_next(0)
+{
+    NamedList tmp("");
+    if (copy)
+	tmp.copyParams(p,copy);
+    else
+	tmp.copyParams(p);
+    NamedIterator iter(tmp);
+    for (const NamedString* ns = 0; 0 != (ns = iter.get());)
+	m_length += ns->name().length() + ns->length() + 2;
+    if (!m_length)
+	return;
+    m_data = new char[m_length];
+    char* d = m_data;
+    iter.reset();
+    for (const NamedString* ns = 0; 0 != (ns = iter.get());) {
+	::memcpy(d,ns->name().c_str(),ns->name().length() + 1);
+	d += ns->name().length() + 1;
+	::memcpy(d,ns->safe(),ns->length() + 1);
+	d += ns->length() + 1;
+    }
+}
+
+CacheItem::~CacheItem()
+{
+    delete[] m_data;
+}
+
+// Copy parameters to a list, all of them or only the names in a list
+void CacheItem::copyTo(NamedList& list, const ObjList* names) const
+{
+    const char* end = m_data + m_length;
+    if (!names) {
+	for (const char* n = m_data; n < end;) {
+	    const char* v = n + ::strlen(n) + 1;
+	    list.setParam(n,v);
+	    n = v + ::strlen(v) + 1;
+	}
+	return;
+    }
+    for (names = names->skipNull(); names; names = names->skipNext()) {
+	const String& name = names->get()->toString();
+	if (!name)
+	    continue;
+	const char* val = 0;
+	for (const char* n = m_data; n < end;) {
+	    const char* v = n + ::strlen(n) + 1;
+	    if (name == n) {
+		val = v;
+		break;
+	    }
+	    n = v + ::strlen(v) + 1;
+	}
+	if (val)
+	    list.setParam(name,val);
+	else
+	    list.clearParam(name);
+    }
+}
+
+#ifdef XDEBUG
+// Dump parameters to a string
+void CacheItem::dump(String& buf, const char* separator) const
+{
+    buf.append(m_id,separator);
+    const char* end = m_data + m_length;
+    for (const char* n = m_data; n < end;) {
+	const char* v = n + ::strlen(n) + 1;
+	String tmp;
+	tmp << n << "=" << v;
+	buf.append(tmp,separator);
+	n = v + ::strlen(v) + 1;
+    }
+}
+#endif
+
+
+/*
+ * CacheSlot
+ */
+void CacheSlot::append(CacheItem* item)
+{
+    item->m_slot = this;
+    item->m_next = 0;
+    item->m_prev = m_last;
+    if (m_last)
+	m_last->m_next = item;
+    else
+	m_first = item;
+    m_last = item;
+}
+
+void CacheSlot::remove(CacheItem* item)
+{
+    if (item->m_prev)
+	item->m_prev->m_next = item->m_next;
+    else
+	m_first = item->m_next;
+    if (item->m_next)
+	item->m_next->m_prev = item->m_prev;
+    else
+	m_last = item->m_prev;
+    item->m_slot = 0;
+    item->m_prev = item->m_next = 0;
+}
+
+
 /*
  * Cache
  */
 Cache::Cache(const String& name, int size, const NamedList& params)
     : Mutex(false,"Cache"),
-    m_name(name), m_list(size), m_cacheTtl(0), m_count(0), m_limit(0),
+    m_name(name), m_list(size), m_locks(0), m_expireMutex(false,"CacheExpire"),
+    m_lastSlot(0), m_slotLen(s_checkToutInterval ? s_checkToutInterval : 1000000),
+    m_adjusting(false), m_cacheTtl(0), m_count(0), m_limit(0),
     m_limitOverflow(0), m_loadChunk(0), m_prefixMin(0), m_prefixMask(0),
     m_loadPrio(Thread::Normal),
     m_loading(false), m_loadInterval(0), m_nextLoad(0),
@@ -415,6 +582,7 @@ Cache::Cache(const String& name, int size, const NamedList& params)
 {
     Debug(&__plugin,DebugInfo,"Cache(%s) size=%u [%p]",
 	m_name.c_str(),m_list.length(),this);
+    m_locks = new Mutex[m_list.length()];
     m_expireParam << "cache_" << m_name << "_expires";
     doUpdate(params,true);
 }
@@ -494,25 +662,28 @@ void Cache::endLoad(bool triggerReload)
 bool Cache::copyParams(const String& id, NamedList& list, const String* cpParams)
 {
     lock();
-    CacheItem* item = findPrefix(id);
-    if (!item && m_account && m_queryLoadItem) {
+    ObjList* names = splitNames(!cpParams ? m_copyParams : *cpParams);
+    String account = m_account;
+    String query = m_queryLoadItem;
+    unlock();
+    bool found = copyPrefix(id,list,names);
+    if (!found && account && query) {
 	// Load from database
-	String query = m_queryLoadItem;
 	NamedList p("");
 	p.addParam("id",id);
 	p.replaceParams(query);
 	Message m("database");
-	m.addParam("account",m_account);
+	m.addParam("account",account);
 	m.addParam("query",query);
-	unlock();
 	bool ok = Engine::dispatch(m);
-	lock();
 	const char* error = m.getValue("error");
 	if (ok && !error) {
 	    Array* a = static_cast<Array*>(m.userObject(YATOM("Array")));
 	    int rows = a ? a->getRows() : 0;
-	    if (rows > 0)
-		item = addUnsafe(*a,1,a->getColumns());
+	    if (rows > 0) {
+		String added = add(*a,1,a->getColumns());
+		found = added && copyItem(added,list,names);
+	    }
 	    else
 		DDebug(&__plugin,DebugAll,"Cache(%s) item '%s' not found in database [%p]",
 		    m_name.c_str(),id.c_str(),this);
@@ -521,12 +692,8 @@ bool Cache::copyParams(const String& id, NamedList& list, const String* cpParams
 	    Debug(&__plugin,DebugNote,"Cache(%s) failed to load item '%s' %s [%p]",
 		m_name.c_str(),id.c_str(),TelEngine::c_safe(error),this);
     }
-    if (item) {
-	list.copyParams(*item,!cpParams ? m_copyParams : *cpParams);
-	dumpItem(*this,*item,"found in cache");
-    }
-    unlock();
-    return item != 0;
+    TelEngine::destruct(names);
+    return found;
 }
 
 // Safely retrieve DB load info
@@ -612,42 +779,175 @@ void Cache::expire(const Time& time)
 	m->addParam("results",String::boolText(false));
 	Engine::enqueue(m);
     }
-    unsigned int oldCount = m_count;
-    for (unsigned int i = 0; i < m_list.length(); i++) {
-	if (exiting())
-	    break;
-	ObjList* list = m_list.getHashList(i);
-	if (list)
-	    list = list->skipNull();
-	// Stop when found a non timed out item:
-	//  we put them in the list in ascending order of timeout
-	for (; list; list = list->skipNull()) {
-	    CacheItem* item = static_cast<CacheItem*>(list->get());
-	    if (!item->timeout(time))
+    lck.drop();
+    // Slots are ordered by time: only the ones starting before current time
+    //  may hold timed out items
+    u_int64_t slot = time / m_slotLen;
+    unsigned int removed = 0;
+    while (!exiting()) {
+	ObjList expired;
+	ObjList* tail = &expired;
+	unsigned int n = 0;
+	Lock lckExp(m_expireMutex);
+	for (ObjList* o = m_slots.skipNull(); o && n < EXPIRE_BATCH; o = o->skipNext()) {
+	    CacheSlot* s = static_cast<CacheSlot*>(o->get());
+	    if (s->m_time > slot)
 		break;
-	    dumpItem(*this,*item,"removing timed out");
-	    list->remove();
-	    m_count--;
+	    for (CacheItem* item = s->m_first; item && n < EXPIRE_BATCH; item = item->m_next) {
+		if (!item->timeout(time))
+		    continue;
+		tail = tail->append(new CacheItemRef(*item));
+		n++;
+	    }
 	}
+	lckExp.drop();
+	if (!n)
+	    break;
+	removed += removeItems(expired);
+	if (n < EXPIRE_BATCH)
+	    break;
     }
-    if (oldCount != m_count)
+    if (removed)
 	dump("Cache::expire()");
 }
 
+// Add an item to the cache. Remove an existing one
+// Return false if the item was not added
+bool Cache::add(const String& id, const NamedList& params, const String* cpParams,
+    bool dbSave)
+{
+    XDebug(&__plugin,DebugAll,"Cache::add(%s,%p,'%s',%u) [%p]",
+	id.c_str(),&params,TelEngine::c_safe(cpParams),dbSave,this);
+    lock();
+    String copy = cpParams ? *cpParams : m_copyParams;
+    String account;
+    String query;
+    if (dbSave && m_account && m_querySave) {
+	account = m_account;
+	query = m_querySave;
+    }
+    unsigned int limitOverflow = m_limitOverflow;
+    unlock();
+    u_int64_t expires = m_cacheTtl;
+    if (dbSave) {
+	int tmp = params.getIntValue(m_expireParam);
+	if (tmp > 0)
+	    expires = (u_int64_t)tmp * 1000000;
+    }
+    else {
+	String* exp = params.getParam("expires");
+	if (exp) {
+	    int tmp = (int)exp->toInteger();
+	    if (tmp > 0)
+		expires = (u_int64_t)tmp * 1000000;
+	    else {
+		XDebug(&__plugin,DebugAll,"Cache(%s) item '%s' already expired [%p]",
+		    m_name.c_str(),id.c_str(),this);
+		return false;
+	    }
+	}
+    }
+    if (expires)
+	expires += Time::now();
+    // Build the item before locking its list
+    CacheItem* item = new CacheItem(id,params,copy,expires);
+    CacheItem* old = 0;
+    NamedList* save = 0;
+    bool over = false;
+    unsigned int idx = index(id);
+    Lock lck(m_locks[idx]);
+    // Look for an existing item and the list end in a single pass
+    ObjList* last = m_list.getHashList(idx);
+    ObjList* o = last ? last->skipNull() : 0;
+    for (; o; o = o->skipNext()) {
+	last = o;
+	if (id == o->get()->toString())
+	    break;
+    }
+    if (o) {
+	old = static_cast<CacheItem*>(o->get());
+	if (old->expires() > expires) {
+	    // Deny update for oldest item
+	    lck.drop();
+	    TelEngine::destruct(item);
+	    return true;
+	}
+	o->set(item,false);
+    }
+    else if (last)
+	last->append(item);
+    else
+	m_list.append(item);
+    Lock lckExp(m_expireMutex);
+    if (old)
+	unlinkItem(old);
+    else {
+	m_count++;
+	over = limitOverflow && m_count > limitOverflow;
+    }
+    linkItem(item);
+    unsigned int len = id.length();
+    if (len > 0 && len <= 32)
+	m_prefixMask |= (1 << (len - 1));
+    lckExp.drop();
+    if (query) {
+	save = new NamedList("");
+	item->copyTo(*save);
+    }
+    dumpItem(*this,*item,!old ? "added" : "updated");
+    lck.drop();
+    TelEngine::destruct(old);
+    if (save) {
+	save->setParam("id",id);
+	save->setParam("expires",String((unsigned int)(m_cacheTtl / 1000000)));
+	save->replaceParams(query);
+	Message* m = new Message("database");
+	m->addParam("account",account);
+	m->addParam("query",query);
+	m->addParam("results",String::boolText(false));
+	Engine::enqueue(m);
+	TelEngine::destruct(save);
+    }
+    if (over)
+	adjustToLimit();
+    return true;
+}
+
 // Add items from NamedList list
 // Return the number of added items
 unsigned int Cache::add(ObjList& list)
 {
     unsigned int added = 0;
-    Lock lck(this);
     for (ObjList* o = list.skipNull(); o; o = o->skipNext()) {
 	NamedList* nl = static_cast<NamedList*>(o->get());
-	if (addUnsafe(*nl,*nl,0,false))
+	if (add(*nl,*nl,0,false))
 	    added++;
     }
     return added;
 }
 
+// Add an item from an Array row, return its id
+String Cache::add(Array& array, int row, int cols)
+{
+    XDebug(&__plugin,DebugAll,"Cache::add(%p,%d,%d) [%p]",&array,row,cols,this);
+    NamedList p("");
+    for (int col = 0; col < cols; col++) {
+	String* colName = YOBJECT(String,array.get(col,0));
+	if (TelEngine::null(colName))
+	    continue;
+	String* colVal = YOBJECT(String,array.get(col,row));
+	if (!colVal)
+	    continue;
+	if (*colName == s_id)
+	    p.assign(*colVal);
+	else
+	    p.addParam(*colName,*colVal);
+    }
+    if (p && add(p,p,0,false))
+	return p;
+    return String::empty();
+}
+
 // Add items from Array rows. Return the number of added rows
 unsigned int Cache::addRows(Array& array)
 {
@@ -724,10 +1024,22 @@ unsigned int Cache::addRows(Array& array)
 // Clear the cache
 unsigned int Cache::clear()
 {
-    Lock lck(this);
-    m_list.clear();
-    unsigned int n = m_count;
-    m_count = 0;
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < m_list.length(); i++) {
+	Lock lck(m_locks[i]);
+	ObjList* list = m_list.getHashList(i);
+	if (!list)
+	    continue;
+	Lock lckExp(m_expireMutex);
+	for (ObjList* o = list->skipNull(); o; o = o->skipNext()) {
+	    unlinkItem(static_cast<CacheItem*>(o->get()));
+	    m_count--;
+	    n++;
+	}
+	lckExp.drop();
+	list->clear();
+    }
+    Lock lckExp(m_expireMutex);
     m_prefixMask = 0;
     return n;
 }
@@ -738,34 +1050,42 @@ unsigned int Cache::remove(const String& id, bool regexp)
     if (!id)
 	return 0;
     if (!regexp) {
-	Lock lck(this);
-	ObjList* list = m_list.getHashList(id);
+	unsigned int idx = index(id);
+	Lock lck(m_locks[idx]);
+	ObjList* list = m_list.getHashList(idx);
 	GenObject* gen = list ? list->remove(id,false) : 0;
 	if (!gen)
 	    return 0;
 	CacheItem* item = static_cast<CacheItem*>(gen);
 	dumpItem(*this,*item,"removed");
+	Lock lckExp(m_expireMutex);
+	unlinkItem(item);
 	m_count--;
+	lckExp.drop();
+	lck.drop();
 	TelEngine::destruct(item);
 	return 1;
     }
     unsigned int removed = 0;
     for (unsigned int i = 0; i < m_list.length(); i++) {
-	Lock lck(this);
+	Lock lck(m_locks[i]);
 	ObjList* list = m_list.getHashList(i);
 	if (list)
 	    list = list->skipNull();
 	while (list) {
 	    CacheItem* item = static_cast<CacheItem*>(list->get());
-	    if (!id.matches(*item)) {
+	    if (!id.matches(item->toString())) {
 		list = list->skipNext();
 		continue;
 	    }
 	    dumpItem(*this,*item,"removed");
+	    Lock lckExp(m_expireMutex);
+	    unlinkItem(item);
+	    m_count--;
+	    lckExp.drop();
 	    list->remove();
 	    list = list->skipNull();
 	    removed++;
-	    m_count--;
 	}
 	lck.drop();
 	if (exiting())
@@ -788,11 +1108,11 @@ void Cache::dump(const char* oper)
 #ifdef XDEBUG
     if (!__plugin.debugAt(DebugAll))
 	return;
-    Lock lck(locked() ? 0 : this);
     String data("\r\n-----");
     unsigned int n = 0;
     int64_t now = (int64_t)Time::now();
     for (unsigned int i = 0; i < m_list.length(); i++) {
+	Lock lck(m_locks[i]);
 	ObjList* list = m_list.getHashList(i);
 	if (list)
 	    list = list->skipNull();
@@ -831,6 +1151,8 @@ void Cache::destroyed()
 {
     Debug(&__plugin,DebugInfo,"Cache(%s) destroyed [%p]",m_name.c_str(),this);
     clear();
+    delete[] m_locks;
+    m_locks = 0;
     TelEngine::destruct(m_reloadItems);
     RefObject::destroyed();
 }
@@ -905,179 +1227,148 @@ void Cache::doUpdate(const NamedList& params, bool first)
 	m_copyParams.safe(),all.safe(),this);
 }
 
-// Add an item to the cache. Remove an existing one
-CacheItem* Cache::addUnsafe(const String& id, const NamedList& params, const String* cpParams,
-    bool dbSave)
+// Find a cache item and copy its parameters, lock its list while doing it
+bool Cache::copyItem(const String& id, NamedList& list, const ObjList* names)
 {
-    XDebug(&__plugin,DebugAll,"Cache::add(%s,%p,'%s',%u) [%p]",
-	id.c_str(),&params,TelEngine::c_safe(cpParams),dbSave,this);
     unsigned int idx = index(id);
-    ObjList* list = m_list.getHashList(idx);
-    if (list)
-	list = list->skipNull();
-    u_int64_t expires = m_cacheTtl;
-    if (dbSave) {
-	int tmp = params.getIntValue(m_expireParam);
-	if (tmp > 0)
-	    expires = (u_int64_t)tmp * 1000000;
-    }
-    else {
-	String* exp = params.getParam("expires");
-	if (exp) {
-	    int tmp = (int)exp->toInteger();
-	    if (tmp > 0)
-		expires = (u_int64_t)tmp * 1000000;
-	    else {
-		XDebug(&__plugin,DebugAll,"Cache(%s) item '%s' already expired [%p]",
-		    m_name.c_str(),id.c_str(),this);
-		return 0;
-	    }
-	}
-    }
-    if (expires)
-	expires += Time::now();
-    // Search for insert/add point and existing item
-    ObjList* insert = 0;
-    bool found = false;
-    while (list) {
-	CacheItem* crt = static_cast<CacheItem*>(list->get());
-	if (!insert && crt->expires() > expires) {
-	    insert = list;
-	    if (found)
-		break;
-	}
-	if (!found && id == crt->toString()) {
-	    if (crt->expires() > expires) {
-		// Deny update for oldest item
-		return crt;
-	    }
-	    if (insert == list)
-		insert = 0;
-	    list->remove();
-	    found = true;
-	    if (insert)
-		break;
-	}
-	ObjList* next = list->skipNext();
-	if (next)
-	    list = next;
-	else
-	    break;
-    }
-    CacheItem* item = new CacheItem(id,params,cpParams ? *cpParams : m_copyParams,expires);
-    if (insert)
-	insert->insert(item);
-    else if (list)
-	list->append(item);
-    else
-	m_list.append(item);
+    Lock lck(m_locks[idx]);
+    ObjList* l = m_list.getHashList(idx);
+    ObjList* o = l ? l->find(id) : 0;
+    if (!o)
+	return false;
+    CacheItem* item = static_cast<CacheItem*>(o->get());
+    item->copyTo(list,names);
+    dumpItem(*this,*item,"found in cache");
+    return true;
+}
+
+// Find a cache item or prefix and copy its parameters
+bool Cache::copyPrefix(const String& id, NamedList& list, const ObjList* names)
+{
+    if (copyItem(id,list,names))
+	return true;
+    u_int32_t prefixMin = m_prefixMin;
+    if (!prefixMin)
+	return false;
     unsigned int len = id.length();
-    if (len > 0 && len <= 32)
-	m_prefixMask |= (1 << (len - 1));
-    if (dbSave && m_account && m_querySave) {
-	String query = m_querySave;
-	NamedList p(*item);
-	p.setParam("id",item->toString());
-	p.setParam("expires",String((unsigned int)(m_cacheTtl / 1000000)));
-	p.replaceParams(query);
-	Message* m = new Message("database");
-	m->addParam("account",m_account);
-	m->addParam("query",query);
-	m->addParam("results",String::boolText(false));
-	Engine::enqueue(m);
+    if (len == 0)
+	return false;
+    len--;
+    if (len > 32)
+	len = 32;
+    for (; len >= prefixMin; len--) {
+	if ((m_prefixMask & (1 << (len - 1))) && copyItem(id.substr(0,len),list,names))
+	    return true;
     }
-    dumpItem(*this,*item,!found ? "added" : "updated");
-    if (found)
-	return item;
-    m_count++;
-    if (m_limitOverflow && m_count > m_limitOverflow)
-	adjustToLimit(item);
-    return item;
+    return false;
 }
 
-// Add an item from an Array row
-CacheItem* Cache::addUnsafe(Array& array, int row, int cols)
+// Remove items from a list of ids, only if their expire time was not changed
+unsigned int Cache::removeItems(ObjList& ids)
 {
-    XDebug(&__plugin,DebugAll,"Cache::add(%p,%d,%d) [%p]",&array,row,cols,this);
-    NamedList p("");
-    for (int col = 0; col < cols; col++) {
-	String* colName = YOBJECT(String,array.get(col,0));
-	if (TelEngine::null(colName))
-	    continue;
-	String* colVal = YOBJECT(String,array.get(col,row));
-	if (!colVal)
+    unsigned int removed = 0;
+    for (ObjList* o = ids.skipNull(); o; o = o->skipNext()) {
+	CacheItemRef* ref = static_cast<CacheItemRef*>(o->get());
+	unsigned int idx = index(*ref);
+	Lock lck(m_locks[idx]);
+	ObjList* list = m_list.getHashList(idx);
+	ObjList* found = list ? list->find(*ref) : 0;
+	CacheItem* item = found ? static_cast<CacheItem*>(found->get()) : 0;
+	if (!item || item->expires() != ref->m_expires)
 	    continue;
-	if (*colName == s_id)
-	    p.assign(*colVal);
-	else
-	    p.addParam(*colName,*colVal);
+	dumpItem(*this,*item,"removing");
+	Lock lckExp(m_expireMutex);
+	unlinkItem(item);
+	m_count--;
+	lckExp.drop();
+	found->remove(false);
+	lck.drop();
+	TelEngine::destruct(item);
+	removed++;
     }
-    return p ? addUnsafe(p,p,0,false) : 0;
+    return removed;
 }
 
-// Find a cache item. This method is not thread safe
-CacheItem* Cache::find(const String& id)
+// Put an item in expire order. The expire mutex must be locked
+void Cache::linkItem(CacheItem* item)
 {
-    ObjList* o = m_list.find(id);
-    return o ? static_cast<CacheItem*>(o->get()) : 0;
+    if (!item->expires()) {
+	m_never.append(item);
+	return;
+    }
+    u_int64_t time = item->expires() / m_slotLen;
+    if (!m_lastSlot) {
+	// Retrieve the last slot
+	for (ObjList* o = m_slots.skipNull(); o; o = o->skipNext())
+	    m_lastSlot = static_cast<CacheSlot*>(o->get());
+    }
+    // Most items are added with the same TTL so they go at the end
+    if (!m_lastSlot || m_lastSlot->m_time < time) {
+	m_lastSlot = new CacheSlot(time);
+	m_slots.append(m_lastSlot);
+	m_lastSlot->append(item);
+	return;
+    }
+    if (m_lastSlot->m_time == time) {
+	m_lastSlot->append(item);
+	return;
+    }
+    for (ObjList* o = m_slots.skipNull(); o; o = o->skipNext()) {
+	CacheSlot* s = static_cast<CacheSlot*>(o->get());
+	if (s->m_time < time)
+	    continue;
+	if (s->m_time > time) {
+	    s = new CacheSlot(time);
+	    o->insert(s);
+	}
+	s->append(item);
+	return;
+    }
 }
 
-// Find a cache item or prefix. This method is not thread safe
-CacheItem* Cache::findPrefix(const String& id)
+// Remove an item from expire order. The expire mutex must be locked
+void Cache::unlinkItem(CacheItem* item)
 {
-    CacheItem* it = find(id);
-    if (it || !m_prefixMin)
-	return it;
-    unsigned int len = id.length();
-    if (len == 0)
-	return 0;
-    len--;
-    if (len > 32)
-	len = 32;
-    for (; len >= m_prefixMin; len--) {
-	if (m_prefixMask & (1 << (len - 1))) {
-	    it = find(id.substr(0,len));
-	    if (it)
-		return it;
-	}
-    }
-    return 0;
+    CacheSlot* s = item->m_slot;
+    if (!s)
+	return;
+    s->remove(item);
+    if (s == &m_never || s->m_first)
+	return;
+    if (s == m_lastSlot)
+	m_lastSlot = 0;
+    m_slots.remove(s);
 }
 
 // Adjust cache length to limit
-void Cache::adjustToLimit(CacheItem* skipAdded)
+void Cache::adjustToLimit()
 {
-    if (!m_limit || m_count <= m_limit)
+    lock();
+    unsigned int limit = m_limit;
+    unlock();
+    Lock lckExp(m_expireMutex);
+    if (m_adjusting || !limit || m_count <= limit)
 	return;
     Debug(&__plugin,DebugAll,"Cache(%s) adjusting to limit %u count=%u [%p]",
-	m_name.c_str(),m_limit,m_count,this);
-    while (m_count > m_limit) {
-	CacheItem* found = 0;
-	for (unsigned int i = 0; i < m_list.length(); i++) {
-	    ObjList* list = m_list.getHashList(i);
-	    if (list)
-		list = list->skipNull();
-	    CacheItem* item = list ? static_cast<CacheItem*>(list->get()) : 0;
-	    if (!item || item == skipAdded)
-		continue;
-	    if (!found || found->m_expires > item->m_expires)
-		found = item;
-	}
-	if (found) {
-	    dumpItem(*this,*found,"removing oldest");
-	    m_list.remove(found);
-	    m_count--;
-	    continue;
-	}
-	Debug(&__plugin,DebugCrit,
-	    "Cache(%s) can't find the oldest item count=%u limit=%u [%p]",
-	    m_name.c_str(),m_count,m_limit,this);
-	m_count = m_list.count();
-	break;
+	m_name.c_str(),limit,m_count,this);
+    m_adjusting = true;
+    // Items that don't expire go first, then the ones expiring sooner
+    ObjList oldest;
+    ObjList* tail = &oldest;
+    unsigned int n = m_count - limit;
+    for (CacheItem* item = m_never.m_first; item && n; item = item->m_next, n--)
+	tail = tail->append(new CacheItemRef(*item));
+    for (ObjList* o = m_slots.skipNull(); o && n; o = o->skipNext()) {
+	CacheSlot* s = static_cast<CacheSlot*>(o->get());
+	for (CacheItem* item = s->m_first; item && n; item = item->m_next, n--)
+	    tail = tail->append(new CacheItemRef(*item));
     }
+    lckExp.drop();
+    removeItems(oldest);
+    lckExp.acquire(m_expireMutex);
+    m_adjusting = false;
 }
 
-
 /*
  * CacheThread
  */
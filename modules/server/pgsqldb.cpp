@@ -22,18 +22,71 @@
 #include <yatephone.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <libpq-fe.h>
 
+#ifndef _WINDOWS
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PG_ASYNC
+#endif
+
 using namespace TelEngine;
 namespace { // anonymous
 
 class PGConn;                            // A database connection
 class PgAccount;                         // Database account holding the connection(s)
+class PgQuery;                           // A query of an asynchronous account
+class PgIoThread;                        // Thread processing asynchronous connections
+
+// Upper limits of the query latency histogram in milliseconds, last bucket holds the rest
+static const unsigned int s_latency[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+#define PG_LATENCY_BUCKETS (sizeof(s_latency) / sizeof(unsigned int) + 1)
 
 static ObjList s_accounts;
 Mutex s_conmutex(false,"PgSQL::acc");
 static unsigned int s_failedConns;
 
+// A query of an asynchronous account, results are kept until picked by the waiting thread
+class PgQuery : public RefObject
+{
+public:
+    PgQuery(const char* query, const Message* msg, u_int64_t timeout);
+    ~PgQuery();
+    // Build the parameter values to send, must be released by caller
+    const char** values() const;
+    // Wake up the thread waiting for the result
+    inline void finished(int result) {
+	    m_result = result;
+	    m_done.unlock();
+	}
+    String m_query;
+    int m_nParams;                       // Negative if not a query template
+    String* m_params;
+    bool* m_nulls;
+    u_int64_t m_start;
+    u_int64_t m_timeout;
+    Semaphore m_done;
+    Message m_reply;                     // Result parameters and data
+    int m_result;
+    int m_rows;
+    int m_affected;
+    bool m_failed;                       // Received an error result
+    bool m_preparing;                    // Waiting for the result of statement preparation
+    String m_stmt;                       // Prepared statement to execute
+};
+
+// A prepared statement of a connection
+class PgStatement : public String
+{
+public:
+    inline PgStatement(const String& query, const String& name)
+	: String(query), m_name(name)
+	{ }
+    String m_name;
+};
+
 // A database connection
 class PgConn : public String
 {
@@ -54,16 +107,62 @@ public:
     // Return number of rows, -1 for non-retryable errors and -2 to retry
     int queryDb(const char* query, Message* dest);
     virtual void destruct();
+#ifdef PG_ASYNC
+    // Asynchronous mode: start connecting without waiting
+    bool startConnect();
+    // Asynchronous mode: poll events the connection waits for, 0 if none
+    short pollEvents() const;
+    // Asynchronous mode: process socket events
+    void processIo(short revents);
+    // Asynchronous mode: check connect and query timeouts
+    void checkTimeout(u_int64_t now);
+    // Asynchronous mode: send a query, return false if it failed
+    bool sendQuery(PgQuery* q);
+    // Asynchronous mode: check if more queries can be sent now
+    inline bool canSend() const
+	{ return !m_connecting && testDb() && (m_sentCount < m_maxSent); }
+    inline unsigned int sentCount() const
+	{ return m_sentCount; }
+    inline bool connecting() const
+	{ return m_connecting; }
+#endif
 private:
     // Init DB connection
     bool initDbInternal(int retry);
     // Perform the query, fill the message with data
     // Return number of rows, -1 for non-retryable errors and -2 to retry
-    int queryDbInternal(const char* query, Message* dest);
+    int queryDbInternal(const char* query, Message* dest, const PgQuery* q = 0);
+    // Add the data of a query result to the message
+    void collectResult(PGresult* res, const char* query, Message* dest,
+	int& totalRows, int& affectedRows);
+    // Connection established, set it up
+    void connected();
+    // Fail all queries sent on the connection
+    void failQueries(const char* error, int result);
+#ifdef PG_ASYNC
+    // Asynchronous mode helpers
+    void connectPoll();
+    void processInput();
+    bool flush();
+    bool sendExec(PgQuery* q);
+    void finishQuery(PgQuery* q);
+    void forgetStatement(const String& query);
+#endif
 
     PgAccount* m_account;
     bool m_busy;
     PGconn* m_conn;
+    // asynchronous mode data, used only by the I/O thread
+    bool m_connecting;
+    PostgresPollingStatusType m_polling;
+    u_int64_t m_connTimeout;
+    bool m_flush;                        // Output is pending
+    bool m_pipeline;                     // Connection is in pipeline mode
+    ObjList m_sent;                      // Queries sent, in order of results
+    unsigned int m_sentCount;
+    unsigned int m_maxSent;
+    ObjList m_statements;                // Prepared statements
+    unsigned int m_stmtCount;
 };
 
 // Database account holding the connection(s)
@@ -77,6 +176,29 @@ public:
     // Make a query
     int queryDb(const char* query, Message* dest);
     bool hasConn();
+    inline bool async() const
+	{ return m_async; }
+    inline unsigned int poolSize() const
+	{ return m_connPoolSize; }
+#ifdef PG_ASYNC
+    // Asynchronous mode: add the poll entries of connections
+    unsigned int pollFill(struct pollfd* fds, PgConn** conns, unsigned int max);
+    // Asynchronous mode: check timeouts, reconnect, send waiting queries
+    void service(u_int64_t now);
+    // Asynchronous mode: a connection failed to connect
+    void connectFailed();
+    // Asynchronous mode: a connection connected
+    inline void connectOk()
+	{ m_connFailures = 0; }
+    inline void thread(PgIoThread* thr)
+	{ m_thread = thr; }
+    // Asynchronous mode: ask the I/O thread to stop, return true if there is one
+    bool stopThread();
+    // Asynchronous mode: fail the queries waiting for a connection
+    void failQueue(const char* error);
+#endif
+    // Append query latency histogram to a string
+    void latency(String& str);
     virtual const String& toString() const
 	{ return m_name; }
     virtual void destroyed();
@@ -98,6 +220,10 @@ protected:
 
 private:
     void dropDb();
+#ifdef PG_ASYNC
+    // Queue a query for the I/O thread and wait for its result
+    int queryAsync(const char* query, Message* dest);
+#endif
 
     String m_name;
     String m_connection;
@@ -106,14 +232,45 @@ private:
     u_int64_t m_timeout;
     PgConn* m_connPool;
     unsigned int m_connPoolSize;
+    // asynchronous mode
+    bool m_async;
+    unsigned int m_pipeline;             // Queries sent on a connection without waiting results
+    unsigned int m_prepared;             // Prepared statements kept on each connection
+    ObjList m_queue;                     // Queries waiting for a connection
+    bool m_autoConnect;
+    u_int64_t m_reconnect;               // Time to attempt connecting again
+    unsigned int m_connFailures;
+    PgIoThread* m_thread;
     // stat counters
     Mutex* m_statsMutex;
     unsigned int m_totalQueries;
     unsigned int m_failedQueries;
     unsigned int m_errorQueries;
     u_int64_t m_queryTime;
+    unsigned int m_latency[PG_LATENCY_BUCKETS];
 };
 
+#ifdef PG_ASYNC
+// Thread waiting for the sockets of asynchronous accounts
+class PgIoThread : public Thread
+{
+public:
+    PgIoThread(unsigned int index);
+    ~PgIoThread();
+    virtual void run();
+    inline bool valid() const
+	{ return m_pipe[0] >= 0; }
+    // Add an account to be served by this thread
+    void addAccount(PgAccount* acc);
+    // Interrupt the wait for sockets
+    void wake();
+private:
+    int m_pipe[2];
+    ObjList m_accounts;
+    unsigned int m_conns;
+};
+#endif
+
 class PgModule : public Module
 {
 public:
@@ -125,6 +282,7 @@ protected:
     virtual void statusParams(String& str);
     virtual void statusDetail(String& str);
     virtual void genUpdate(Message& msg);
+    virtual bool received(Message& msg, int id);
 private:
     bool m_init;
 };
@@ -142,12 +300,60 @@ public:
 };
 
 
+//
+// PgQuery
+//
+PgQuery::PgQuery(const char* query, const Message* msg, u_int64_t timeout)
+    : m_query(query), m_nParams(-1), m_params(0), m_nulls(0),
+      m_start(Time::now()), m_timeout(m_start + timeout),
+      m_done(1,"PgQuery",0), m_reply("database"),
+      m_result(-1), m_rows(0), m_affected(0),
+      m_failed(false), m_preparing(false)
+{
+    if (!msg)
+	return;
+    m_nParams = msg->getIntValue(YSTRING("params"),-1,-1,65535);
+    if (m_nParams > 0) {
+	m_params = new String[m_nParams];
+	m_nulls = new bool[m_nParams];
+	for (int i = 0; i < m_nParams; i++) {
+	    // a missing parameter is passed as NULL
+	    const String* p = msg->getParam("param." + String(i + 1));
+	    m_nulls[i] = !p;
+	    if (p)
+		m_params[i] = *p;
+	}
+    }
+    const String* res = msg->getParam(YSTRING("results"));
+    if (res)
+	m_reply.addParam("results",*res);
+}
+
+PgQuery::~PgQuery()
+{
+    delete[] m_params;
+    delete[] m_nulls;
+}
+
+const char** PgQuery::values() const
+{
+    if (m_nParams <= 0)
+	return 0;
+    const char** vals = new const char*[m_nParams];
+    for (int i = 0; i < m_nParams; i++)
+	vals[i] = m_nulls[i] ? 0 : m_params[i].safe();
+    return vals;
+}
+
+
 //
 // PgConn
 //
 PgConn::PgConn(PgAccount* account)
     : m_account(account), m_busy(false),
-    m_conn(0)
+    m_conn(0),
+    m_connecting(false), m_polling(PGRES_POLLING_FAILED), m_connTimeout(0),
+    m_flush(false), m_pipeline(false), m_sentCount(0), m_maxSent(1), m_stmtCount(0)
 {
 }
 
@@ -177,6 +383,12 @@ void PgConn::dropDb()
 {
     if (!m_conn)
 	return;
+    failQueries("connection dropped",-2);
+    m_connecting = false;
+    m_flush = false;
+    m_pipeline = false;
+    m_statements.clear();
+    m_stmtCount = 0;
     PGconn* tmp = m_conn;
     m_conn = 0;
     XDebug(&module,DebugAll,"Connection '%s' dropped [%p]",c_str(),m_account);
@@ -187,15 +399,19 @@ void PgConn::dropDb()
 // Return number of rows, -1 for non-retryable errors and -2 to retry
 int PgConn::queryDb(const char* query, Message* dest)
 {
+    // a query template is sent with its parameters
+    PgQuery* q = (dest && dest->getParam(YSTRING("params"))) ? new PgQuery(query,dest,0) : 0;
     int retry = m_account->m_retry;
+    int res = -2;
     for (int i = 0; i < retry; i++) {
 	XDebug(&module,DebugAll,"Connection '%s' performing query (retry=%d): %s [%p]",
 	    c_str(),i + 1,query,m_account);
-	int res = queryDbInternal(query,dest);
+	res = queryDbInternal(query,dest,q);
 	if (res > -2)
-	    return res;
+	    break;
     }
-    return -2;
+    TelEngine::destruct(q);
+    return res;
 }
 
 void PgConn::destruct()
@@ -269,10 +485,7 @@ bool PgConn::initDbInternal(int retry)
 		return false;
 	    case CONNECTION_OK:
 		Debug(&module,DebugAll,"Connection for '%s' succeeded [%p]",c_str(),m_account);
-		if (m_account->m_encoding && PQsetClientEncoding(m_conn,m_account->m_encoding))
-		    Debug(&module,DebugWarn,
-			"Failed to set encoding '%s' on connection '%s' [%p]",
-			m_account->m_encoding.c_str(),c_str(),m_account);
+		connected();
 		return true;
 	    default:
 		break;
@@ -286,15 +499,56 @@ bool PgConn::initDbInternal(int retry)
     return false;
 }
 
+// Connection established, set it up
+void PgConn::connected()
+{
+    if (m_account->m_encoding && PQsetClientEncoding(m_conn,m_account->m_encoding))
+	Debug(&module,DebugWarn,
+	    "Failed to set encoding '%s' on connection '%s' [%p]",
+	    m_account->m_encoding.c_str(),c_str(),m_account);
+    m_maxSent = 1;
+#ifdef LIBPQ_HAS_PIPELINING
+    if (m_account->m_async && (m_account->m_pipeline > 1)) {
+	if (PQenterPipelineMode(m_conn)) {
+	    m_pipeline = true;
+	    m_maxSent = m_account->m_pipeline;
+	}
+	else
+	    Debug(&module,DebugWarn,"Connection '%s' failed to enter pipeline mode: %s [%p]",
+		c_str(),PQerrorMessage(m_conn),m_account);
+    }
+#endif
+}
+
+// Fail all queries sent on the connection
+void PgConn::failQueries(const char* error, int result)
+{
+    while (PgQuery* q = static_cast<PgQuery*>(m_sent.remove(false))) {
+	if (error && !q->m_reply.getParam(YSTRING("error")))
+	    q->m_reply.setParam("error",error);
+	q->finished(result);
+	TelEngine::destruct(q);
+    }
+    m_sentCount = 0;
+}
+
 // Perform the query, fill the message with data
 // Return number of rows, -1 for non-retryable errors and -2 to retry
-int PgConn::queryDbInternal(const char* query, Message* dest)
+int PgConn::queryDbInternal(const char* query, Message* dest, const PgQuery* q)
 {
     if (!initDb())
 	// no retry - initDb already tried and failed...
 	return -1;
     u_int64_t timeout = Time::now() + m_account->m_timeout;
-    if (!PQsendQuery(m_conn,query)) {
+    int ok = 0;
+    if (q && (q->m_nParams >= 0)) {
+	const char** vals = q->values();
+	ok = PQsendQueryParams(m_conn,query,q->m_nParams,0,vals,0,0,0);
+	delete[] vals;
+    }
+    else
+	ok = PQsendQuery(m_conn,query);
+    if (!ok) {
 	// a connection failure cannot be detected at this point so any
 	//  error must be caused by the query itself - bad syntax or so
 	Debug(&module,DebugWarn,"Query '%s' for '%s' failed: %s [%p]",
@@ -316,10 +570,19 @@ int PgConn::queryDbInternal(const char* query, Message* dest)
 
     int totalRows = 0;
     int affectedRows = 0;
+    struct timeval tm;
+    Time::toTimeval(&tm,Thread::idleUsec());
     while (Time::now() < timeout) {
 	PQconsumeInput(m_conn);
 	if (PQisBusy(m_conn)) {
-	    Thread::yield();
+	    // sleep until the server sends something instead of spinning
+	    Socket sock(PQsocket(m_conn));
+	    bool readOk = false;
+	    if (!(sock.canSelect() && sock.select(&readOk,0,0,&tm)))
+		Thread::idle();
+	    sock.detach();
+	    if (Thread::check(false))
+		break;
 	    continue;
 	}
 	PGresult* res = PQgetResult(m_conn);
@@ -333,81 +596,340 @@ int PgConn::queryDbInternal(const char* query, Message* dest)
 	    }
 	    return totalRows;
 	}
-	ExecStatusType stat = PQresultStatus(res);
-	switch (stat) {
-	    case PGRES_TUPLES_OK:
-		// we got some data - but maybe zero rows or binary...
-		if (dest) {
-		    affectedRows += String(PQcmdTuples(res)).toInteger();
-		    int columns = PQnfields(res);
-		    int rows = PQntuples(res);
-		    if (rows > 0) {
-			totalRows += rows;
-			dest->setParam("columns",String(columns));
-			if (dest->getBoolValue("results",true) && !PQbinaryTuples(res)) {
-			    Array *a = new Array(columns,rows+1);
-			    for (int k = 0; k < columns; k++) {
-				ObjList* column = a->getColumn(k);
-				if (column)
-				    column->set(new String(PQfname(res,k)));
-				else {
+	collectResult(res,query,dest,totalRows,affectedRows);
+	PQclear(res);
+    }
+    Debug(&module,DebugWarn,"Query timed out for '%s' [%p]",c_str(),m_account);
+    if (dest)
+	dest->setParam("error","query timeout");
+    dropDb();
+    return -2;
+}
+
+// Add the data of a query result to the message
+void PgConn::collectResult(PGresult* res, const char* query, Message* dest,
+    int& totalRows, int& affectedRows)
+{
+    ExecStatusType stat = PQresultStatus(res);
+    switch (stat) {
+	case PGRES_TUPLES_OK:
+	    // we got some data - but maybe zero rows or binary...
+	    if (dest) {
+		affectedRows += String(PQcmdTuples(res)).toInteger();
+		int columns = PQnfields(res);
+		int rows = PQntuples(res);
+		if (rows > 0) {
+		    totalRows += rows;
+		    dest->setParam("columns",String(columns));
+		    if (dest->getBoolValue("results",true) && !PQbinaryTuples(res)) {
+			Array *a = new Array(columns,rows+1);
+			for (int k = 0; k < columns; k++) {
+			    ObjList* column = a->getColumn(k);
+			    if (column)
+				column->set(new String(PQfname(res,k)));
+			    else {
+				Debug(&module,DebugCrit,
+				    "Query '%s' for '%s': No array column for %d [%p]",
+				    query,c_str(),k,m_account);
+				continue;
+			    }
+			    for (int j = 0; j < rows; j++) {
+				column = column->next();
+				if (!column) {
+				    // Stop now: we won't get the next row
 				    Debug(&module,DebugCrit,
-					"Query '%s' for '%s': No array column for %d [%p]",
-					query,c_str(),k,m_account);
-				    continue;
-				}
-				for (int j = 0; j < rows; j++) {
-				    column = column->next();
-				    if (!column) {
-					// Stop now: we won't get the next row
-					Debug(&module,DebugCrit,
-					    "Query '%s' for '%s': No array row %d in column %d [%p]",
-					    query,c_str(),j + 1,k,m_account);
-					break;
-				    }
-				    // skip over NULL values
-				    if (PQgetisnull(res,j,k))
-					continue;
-				    GenObject* v = 0;
-				    if (PQfformat(res,k))
-					v = new DataBlock(PQgetvalue(res,j,k),PQgetlength(res,j,k));
-				    else
-					v = new String(PQgetvalue(res,j,k));
-				    column->set(v);
+					"Query '%s' for '%s': No array row %d in column %d [%p]",
+					query,c_str(),j + 1,k,m_account);
+				    break;
 				}
+				// skip over NULL values
+				if (PQgetisnull(res,j,k))
+				    continue;
+				GenObject* v = 0;
+				if (PQfformat(res,k))
+				    v = new DataBlock(PQgetvalue(res,j,k),PQgetlength(res,j,k));
+				else
+				    v = new String(PQgetvalue(res,j,k));
+				column->set(v);
 			    }
-			    dest->userData(a);
-			    a->deref();
 			}
+			dest->userData(a);
+			a->deref();
 		    }
 		}
+	    }
+	    break;
+	case PGRES_COMMAND_OK:
+	    if (dest)
+		affectedRows += String(PQcmdTuples(res)).toInteger();
+	    // no data returned
+	    break;
+	case PGRES_COPY_IN:
+	case PGRES_COPY_OUT:
+	    // data transfers - ignore them
+	    break;
+	default:
+	    Debug(&module,DebugWarn,"Query '%s' for '%s' error: %s [%p]",
+		query,c_str(),PQresultErrorMessage(res),m_account);
+	    if (dest)
+		dest->setParam("error",PQresultErrorMessage(res));
+	    m_account->incErrorQueriesSafe();
+	    module.changed();
+    }
+}
+
+#ifdef PG_ASYNC
+// Start connecting without waiting, the I/O thread will poll the connection
+bool PgConn::startConnect()
+{
+    dropDb();
+    Debug(&module,DebugAll,"'%s' starting connection \"%s\" [%p]",
+	c_str(),m_account->m_connection.c_str(),m_account);
+    m_conn = PQconnectStart(m_account->m_connection.c_str());
+    if (!m_conn) {
+	Debug(&module,DebugCrit,"Could not start connection for '%s' [%p]",c_str(),m_account);
+	return false;
+    }
+    if (CONNECTION_BAD == PQstatus(m_conn)) {
+	Debug(&module,DebugWarn,"Connection for '%s' failed: %s [%p]",
+	    c_str(),PQerrorMessage(m_conn),m_account);
+	dropDb();
+	return false;
+    }
+    PQsetnonblocking(m_conn,1);
+    m_connecting = true;
+    m_polling = PGRES_POLLING_WRITING;
+    m_connTimeout = Time::now() + m_account->m_timeout;
+    return true;
+}
+
+// Socket events the connection waits for
+short PgConn::pollEvents() const
+{
+    if (!m_conn)
+	return 0;
+    if (m_connecting)
+	return (PGRES_POLLING_READING == m_polling) ? POLLIN : POLLOUT;
+    return m_flush ? (POLLIN | POLLOUT) : POLLIN;
+}
+
+// Process socket events, called by the I/O thread
+void PgConn::processIo(short revents)
+{
+    Lock mylock(m_account);
+    if (!m_conn)
+	return;
+    if (m_connecting) {
+	connectPoll();
+	return;
+    }
+    if ((revents & POLLOUT) && !flush())
+	return;
+    if (revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+	processInput();
+}
+
+// Advance the connection setup
+void PgConn::connectPoll()
+{
+    m_polling = PQconnectPoll(m_conn);
+    switch (m_polling) {
+	case PGRES_POLLING_FAILED:
+	    Debug(&module,DebugWarn,"Connection for '%s' failed: %s [%p]",
+		c_str(),PQerrorMessage(m_conn),m_account);
+	    dropDb();
+	    m_account->connectFailed();
+	    break;
+	case PGRES_POLLING_OK:
+	    Debug(&module,DebugAll,"Connection for '%s' succeeded [%p]",c_str(),m_account);
+	    m_connecting = false;
+	    connected();
+	    m_account->connectOk();
+	    break;
+	default:
+	    break;
+    }
+}
+
+// Check connect and query timeouts
+void PgConn::checkTimeout(u_int64_t now)
+{
+    if (m_connecting) {
+	if (now < m_connTimeout)
+	    return;
+	Debug(&module,DebugWarn,"Connection for '%s' timed out [%p]",c_str(),m_account);
+	dropDb();
+	m_account->connectFailed();
+	return;
+    }
+    // results come in order so only the oldest query can be late
+    PgQuery* q = static_cast<PgQuery*>(m_sent.get());
+    if (!q || (now < q->m_timeout))
+	return;
+    Debug(&module,DebugWarn,"Query timed out for '%s', %u queries pending [%p]",
+	c_str(),m_sentCount,m_account);
+    failQueries("query timeout",-2);
+    dropDb();
+}
+
+// Send as much pending output as possible without blocking
+bool PgConn::flush()
+{
+    int res = PQflush(m_conn);
+    m_flush = (res > 0);
+    if (res >= 0)
+	return true;
+    Debug(&module,DebugWarn,"Flush for '%s' failed: %s [%p]",
+	c_str(),PQerrorMessage(m_conn),m_account);
+    failQueries(PQerrorMessage(m_conn),-2);
+    dropDb();
+    return false;
+}
+
+// Send the execution of a query, prepared or not
+bool PgConn::sendExec(PgQuery* q)
+{
+    const char** vals = q->values();
+    int ok = 0;
+    if (q->m_stmt)
+	ok = PQsendQueryPrepared(m_conn,q->m_stmt,q->m_nParams,vals,0,0,0);
+    else if (m_pipeline || (q->m_nParams >= 0))
+	// the simple query protocol is not allowed in pipeline mode
+	ok = PQsendQueryParams(m_conn,q->m_query,(q->m_nParams > 0) ? q->m_nParams : 0,
+	    0,vals,0,0,0);
+    else
+	ok = PQsendQuery(m_conn,q->m_query);
+    delete[] vals;
+    return ok != 0;
+}
+
+// Send a query, prepare its statement first if it's a new template
+bool PgConn::sendQuery(PgQuery* q)
+{
+    if ((q->m_nParams >= 0) && m_account->m_prepared) {
+	PgStatement* st = static_cast<PgStatement*>(m_statements[q->m_query]);
+	if (st)
+	    q->m_stmt = st->m_name;
+	else if (m_stmtCount < m_account->m_prepared) {
+	    q->m_stmt = "yate_" + String(++m_stmtCount);
+	    m_statements.append(new PgStatement(q->m_query,q->m_stmt));
+	    q->m_preparing = true;
+	}
+    }
+    bool ok = true;
+    if (q->m_preparing)
+	ok = 0 != PQsendPrepare(m_conn,q->m_stmt,q->m_query,(q->m_nParams > 0) ? q->m_nParams : 0,0);
+    // without pipelining the execution is sent after the prepare result
+    if (ok && (m_pipeline || !q->m_preparing))
+	ok = sendExec(q);
+#ifdef LIBPQ_HAS_PIPELINING
+    if (ok && m_pipeline)
+	ok = 0 != PQpipelineSync(m_conn);
+#endif
+    if (!ok) {
+	Debug(&module,DebugWarn,"Query '%s' for '%s' failed: %s [%p]",
+	    q->m_query.c_str(),c_str(),PQerrorMessage(m_conn),m_account);
+	q->m_reply.setParam("error",PQerrorMessage(m_conn));
+	if (q->m_preparing)
+	    forgetStatement(q->m_query);
+	// a partially sent pipeline cannot be recovered
+	if (m_pipeline)
+	    dropDb();
+	return false;
+    }
+    m_sent.append(q);
+    m_sentCount++;
+    flush();
+    return true;
+}
+
+// Remove a prepared statement that failed
+void PgConn::forgetStatement(const String& query)
+{
+    m_statements.remove(query);
+}
+
+// Process received data and results of sent queries
+void PgConn::processInput()
+{
+    if (!PQconsumeInput(m_conn)) {
+	Debug(&module,DebugWarn,"Connection '%s' failed: %s [%p]",
+	    c_str(),PQerrorMessage(m_conn),m_account);
+	failQueries(PQerrorMessage(m_conn),-2);
+	dropDb();
+	return;
+    }
+    bool ended = false;
+    while (m_conn && !PQisBusy(m_conn)) {
+	PgQuery* q = static_cast<PgQuery*>(m_sent.get());
+	if (!q)
+	    break;
+	PGresult* res = PQgetResult(m_conn);
+	bool end = !res;
+	if (end && ended)
+	    // nothing more available in pipeline mode
+	    break;
+	ended = end;
+	if (!res) {
+	    // end of the results of a command
+	    if (q->m_preparing) {
+		q->m_preparing = false;
+		if (m_pipeline)
+		    continue;
+		if (!q->m_failed && sendExec(q)) {
+		    flush();
+		    continue;
+		}
+		if (!q->m_failed)
+		    q->m_reply.setParam("error",PQerrorMessage(m_conn));
+	    }
+	    else if (m_pipeline)
+		// the query ends at the synchronization point
+		continue;
+	    finishQuery(q);
+	    continue;
+	}
+	ExecStatusType stat = PQresultStatus(res);
+	switch (stat) {
+#ifdef LIBPQ_HAS_PIPELINING
+	    case PGRES_PIPELINE_SYNC:
+		finishQuery(q);
 		break;
-	    case PGRES_COMMAND_OK:
-		if (dest)
-		    affectedRows += String(PQcmdTuples(res)).toInteger();
-		// no data returned
+	    case PGRES_PIPELINE_ABORTED:
+		// an earlier command of the query failed
+		q->m_failed = true;
 		break;
+#endif
+	    case PGRES_TUPLES_OK:
+	    case PGRES_COMMAND_OK:
 	    case PGRES_COPY_IN:
 	    case PGRES_COPY_OUT:
-		// data transfers - ignore them
+		collectResult(res,q->m_query,&q->m_reply,q->m_rows,q->m_affected);
 		break;
 	    default:
-		Debug(&module,DebugWarn,"Query '%s' for '%s' error: %s [%p]",
-		    query,c_str(),PQresultErrorMessage(res),m_account);
-		if (dest)
-		    dest->setParam("error",PQresultErrorMessage(res));
-		m_account->incErrorQueriesSafe();
-		module.changed();
+		q->m_failed = true;
+		if (q->m_preparing)
+		    forgetStatement(q->m_query);
+		collectResult(res,q->m_query,&q->m_reply,q->m_rows,q->m_affected);
 	}
 	PQclear(res);
     }
-    Debug(&module,DebugWarn,"Query timed out for '%s' [%p]",c_str(),m_account);
-    if (dest)
-	dest->setParam("error","query timeout");
-    dropDb();
-    return -2;
 }
 
+// All results of a query were received, wake up its waiting thread
+void PgConn::finishQuery(PgQuery* q)
+{
+    m_sent.remove(q,false);
+    m_sentCount--;
+    Debug(&module,DebugAll,"Query for '%s' returned %d rows, %d affected [%p]",
+	c_str(),q->m_rows,q->m_affected,m_account);
+    q->m_reply.setParam("rows",String(q->m_rows));
+    q->m_reply.setParam("affected",String(q->m_affected));
+    q->finished(q->m_rows);
+    TelEngine::destruct(q);
+}
+#endif // PG_ASYNC
+
 
 //
 // PgAccount
@@ -416,10 +938,14 @@ PgAccount::PgAccount(const NamedList& sect)
     : Mutex(true,"PgAccount"),
       m_name(sect),
       m_connPool(0), m_connPoolSize(0),
+      m_async(false), m_pipeline(1), m_prepared(0),
+      m_autoConnect(false), m_reconnect(0), m_connFailures(0), m_thread(0),
       m_statsMutex(&s_conmutex),
       m_totalQueries(0), m_failedQueries(0),
       m_errorQueries(0), m_queryTime(0)
 {
+    for (unsigned int i = 0; i < PG_LATENCY_BUCKETS; i++)
+	m_latency[i] = 0;
     m_connection = sect.getValue("connection");
     if (m_connection.null()) {
 	// build connection string from pieces
@@ -442,13 +968,33 @@ PgAccount::PgAccount(const NamedList& sect)
     m_retry = sect.getIntValue("retry",5);
     m_encoding = sect.getValue("encoding");
     m_connPoolSize = sect.getIntValue("poolsize",1,1);
+    m_async = sect.getBoolValue("async");
+#ifndef PG_ASYNC
+    if (m_async) {
+	Debug(&module,DebugConf,"Asynchronous mode not supported, disabled for '%s'",
+	    m_name.c_str());
+	m_async = false;
+    }
+#endif
+    if (m_async) {
+	m_autoConnect = sect.getBoolValue("autostart",true);
+	m_pipeline = sect.getIntValue("pipeline",1,1,1000);
+#ifndef LIBPQ_HAS_PIPELINING
+	if (m_pipeline > 1) {
+	    Debug(&module,DebugConf,"Pipelining not supported by libpq, disabled for '%s'",
+		m_name.c_str());
+	    m_pipeline = 1;
+	}
+#endif
+	m_prepared = sect.getIntValue("prepared",16,0,1000);
+    }
     m_connPool = new PgConn[m_connPoolSize];
     for (unsigned int i = 0; i < m_connPoolSize; i++) {
 	m_connPool[i].m_account = this;
 	m_connPool[i].assign(m_name + "." + String(i + 1));
     }
-    Debug(&module,DebugInfo,"Database account '%s' created poolsize=%u [%p]",
-	m_name.c_str(),m_connPoolSize,this);
+    Debug(&module,DebugInfo,"Database account '%s' created poolsize=%u async=%s pipeline=%u [%p]",
+	m_name.c_str(),m_connPoolSize,String::boolText(m_async),m_pipeline,this);
 }
 
 // Init the connections the connection
@@ -465,6 +1011,9 @@ void PgAccount::destroyed()
     s_conmutex.lock();
     s_accounts.remove(this,false);
     s_conmutex.unlock();
+#ifdef PG_ASYNC
+    failQueue("failure");
+#endif
     dropDb();
     if (m_connPool)
 	delete[] m_connPool;
@@ -495,6 +1044,11 @@ int PgAccount::queryDb(const char* query, Message* dest)
     // Use a while() to break to the end to update statistics
     int res = -1;
     u_int64_t start = Time::now();
+#ifdef PG_ASYNC
+    if (m_async)
+	res = queryAsync(query,dest);
+    else
+#endif
     while (true) {
 	Lock mylock(this,(long)m_timeout);
 	if (!mylock.locked()) {
@@ -551,6 +1105,11 @@ int PgAccount::queryDb(const char* query, Message* dest)
 	    m_failedQueries++;
 	u_int64_t finish = Time::now() - start;
 	m_queryTime += finish;
+	unsigned int i = 0;
+	for (; i < PG_LATENCY_BUCKETS - 1; i++)
+	    if (finish <= 1000 * (u_int64_t)s_latency[i])
+		break;
+	m_latency[i]++;
     }
     stats.drop();
     module.changed();
@@ -567,6 +1126,248 @@ bool PgAccount::hasConn()
     return false;
 }
 
+// Append query latency histogram as upper limit in msec and count
+void PgAccount::latency(String& str)
+{
+    Lock stats(m_statsMutex);
+    for (unsigned int i = 0; i < PG_LATENCY_BUCKETS; i++) {
+	if (i < PG_LATENCY_BUCKETS - 1)
+	    str.append(String(s_latency[i])," ");
+	else
+	    str.append("+"," ");
+	str << ":" << m_latency[i];
+    }
+}
+
+#ifdef PG_ASYNC
+// Queue a query for the I/O thread and wait for its result
+int PgAccount::queryAsync(const char* query, Message* dest)
+{
+    PgQuery* q = new PgQuery(query,dest,m_timeout);
+    Lock mylock(this);
+    if (!m_thread) {
+	mylock.drop();
+	Debug(&module,DebugWarn,"Account '%s' has no I/O thread [%p]",m_name.c_str(),this);
+	TelEngine::destruct(q);
+	return -1;
+    }
+    // the queue holds its own reference
+    q->ref();
+    m_queue.append(q);
+    m_thread->wake();
+    mylock.drop();
+    // the I/O thread expires the query first, this is just a safety net
+    int res = -2;
+    if (q->m_done.lock((long)(m_timeout + 1000000))) {
+	res = q->m_result;
+	if (dest) {
+	    dest->copyParams(q->m_reply);
+	    if (q->m_reply.userData())
+		dest->userData(q->m_reply.userData());
+	}
+    }
+    else {
+	Debug(&module,DebugWarn,"Query timed out waiting for '%s' [%p]",m_name.c_str(),this);
+	lock();
+	m_queue.remove(q);
+	unlock();
+	if (dest)
+	    dest->setParam("error","query timeout");
+    }
+    TelEngine::destruct(q);
+    return res;
+}
+
+// Ask the I/O thread to stop, it will detach itself from accounts
+bool PgAccount::stopThread()
+{
+    Lock mylock(this);
+    if (!m_thread)
+	return false;
+    m_thread->cancel(false);
+    m_thread->wake();
+    return true;
+}
+
+// Fail the queries waiting for a connection
+void PgAccount::failQueue(const char* error)
+{
+    Lock mylock(this);
+    while (PgQuery* q = static_cast<PgQuery*>(m_queue.remove(false))) {
+	q->m_reply.setParam("error",error);
+	q->finished(-1);
+	TelEngine::destruct(q);
+    }
+}
+
+// A connection failed to connect, give up on waiting queries after retries
+void PgAccount::connectFailed()
+{
+    Lock mylock(this);
+    m_connFailures++;
+    if (m_queue.skipNull() && (m_connFailures < (unsigned int)m_retry))
+	return;
+    failQueue("failure");
+    m_connFailures = 0;
+    m_reconnect = Time::now() + 1000000;
+}
+
+// Check timeouts, start connections, send waiting queries to the least loaded connection
+void PgAccount::service(u_int64_t now)
+{
+    Lock mylock(this);
+    for (ObjList* o = m_queue.skipNull(); o; ) {
+	PgQuery* q = static_cast<PgQuery*>(o->get());
+	if (now < q->m_timeout) {
+	    o = o->skipNext();
+	    continue;
+	}
+	Debug(&module,DebugWarn,"Query expired waiting for a connection of '%s' [%p]",
+	    m_name.c_str(),this);
+	q->m_reply.setParam("error","query timeout");
+	q->finished(-1);
+	o->remove();
+	o = o->skipNull();
+    }
+    for (unsigned int i = 0; i < m_connPoolSize; i++)
+	m_connPool[i].checkTimeout(now);
+    if ((m_queue.skipNull() || m_autoConnect) && (now >= m_reconnect)) {
+	for (unsigned int i = 0; i < m_connPoolSize; i++) {
+	    PgConn& c = m_connPool[i];
+	    if (!(c.connecting() || c.testDb() || c.startConnect()))
+		connectFailed();
+	}
+    }
+    while (ObjList* o = m_queue.skipNull()) {
+	PgConn* conn = 0;
+	for (unsigned int i = 0; i < m_connPoolSize; i++) {
+	    PgConn& c = m_connPool[i];
+	    if (c.canSend() && (!conn || (c.sentCount() < conn->sentCount())))
+		conn = &c;
+	}
+	if (!conn)
+	    break;
+	PgQuery* q = static_cast<PgQuery*>(o->remove(false));
+	if (!conn->sendQuery(q)) {
+	    q->finished(-1);
+	    TelEngine::destruct(q);
+	}
+    }
+}
+
+// Add the poll entries of connections waiting for socket events
+unsigned int PgAccount::pollFill(struct pollfd* fds, PgConn** conns, unsigned int max)
+{
+    Lock mylock(this);
+    unsigned int n = 0;
+    for (unsigned int i = 0; (i < m_connPoolSize) && (n < max); i++) {
+	PgConn& c = m_connPool[i];
+	short ev = c.pollEvents();
+	if (!ev)
+	    continue;
+	int fd = PQsocket(c.m_conn);
+	if (fd < 0)
+	    continue;
+	fds[n].fd = fd;
+	fds[n].events = ev;
+	fds[n].revents = 0;
+	conns[n] = &c;
+	n++;
+    }
+    return n;
+}
+
+
+//
+// PgIoThread
+//
+PgIoThread::PgIoThread(unsigned int index)
+    : Thread("PgSQL I/O"),
+      m_conns(0)
+{
+    if (::pipe(m_pipe)) {
+	Debug(&module,DebugWarn,"I/O thread %u failed to create pipe: %s (%d)",
+	    index,::strerror(errno),errno);
+	m_pipe[0] = m_pipe[1] = -1;
+	return;
+    }
+    ::fcntl(m_pipe[0],F_SETFL,O_NONBLOCK);
+    ::fcntl(m_pipe[1],F_SETFL,O_NONBLOCK);
+}
+
+PgIoThread::~PgIoThread()
+{
+    for (ObjList* o = m_accounts.skipNull(); o; o = o->skipNext()) {
+	PgAccount* acc = static_cast<PgAccount*>(o->get());
+	Lock lck(acc);
+	acc->thread(0);
+	lck.drop();
+	acc->failQueue("failure");
+    }
+    m_accounts.clear();
+    if (m_pipe[0] >= 0) {
+	::close(m_pipe[0]);
+	::close(m_pipe[1]);
+    }
+}
+
+// Called before the thread is started
+void PgIoThread::addAccount(PgAccount* acc)
+{
+    if (!(acc && acc->ref()))
+	return;
+    m_accounts.append(acc);
+    m_conns += acc->poolSize();
+    Lock lck(acc);
+    acc->thread(this);
+}
+
+void PgIoThread::wake()
+{
+    char c = 0;
+    if (::write(m_pipe[1],&c,1) < 0) {
+	// pipe full, the thread is already woken up
+    }
+}
+
+void PgIoThread::run()
+{
+    struct pollfd* fds = new struct pollfd[m_conns + 1];
+    PgConn** conns = new PgConn*[m_conns + 1];
+    while (!Thread::check(false)) {
+	u_int64_t now = Time::now();
+	fds[0].fd = m_pipe[0];
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	unsigned int n = 1;
+	for (ObjList* o = m_accounts.skipNull(); o; o = o->skipNext()) {
+	    PgAccount* acc = static_cast<PgAccount*>(o->get());
+	    acc->service(now);
+	    n += acc->pollFill(fds + n,conns + n,m_conns + 1 - n);
+	}
+	// wake up periodically to check timeouts
+	int res = ::poll(fds,n,100);
+	if (res < 0) {
+	    if (errno != EINTR)
+		Thread::idle();
+	    continue;
+	}
+	if (!res)
+	    continue;
+	if (fds[0].revents) {
+	    char buf[64];
+	    while (::read(m_pipe[0],buf,sizeof(buf)) > 0)
+		;
+	}
+	for (unsigned int i = 1; i < n; i++)
+	    if (fds[i].revents)
+		conns[i]->processIo(fds[i].revents);
+    }
+    delete[] fds;
+    delete[] conns;
+}
+#endif // PG_ASYNC
+
 static PgAccount* findDb(const String& account)
 {
     if (account.null())
@@ -607,7 +1408,7 @@ PgModule::~PgModule()
 void PgModule::statusModule(String& str)
 {
     Module::statusModule(str);
-    str.append("format=Total|Failed|Errors|AvgExecTime",",");
+    str.append("format=Total|Failed|Errors|AvgExecTime|Latency",",");
 }
 
 void PgModule::statusParams(String& str)
@@ -629,6 +1430,8 @@ void PgModule::statusDetail(String& str)
 	    str << (acc->queryTime() / (acc->total() - acc->failed()) / 1000); //miliseconds
         else
 	    str << "0";
+	str << "|";
+	acc->latency(str);
     }
     s_conmutex.unlock();
 }
@@ -642,6 +1445,7 @@ void PgModule::initialize()
     Output("Initializing module PostgreSQL");
     Configuration cfg(Engine::configFile("pgsqldb"));
     Engine::install(new PgHandler(cfg.getIntValue("general","priority",100)));
+    installRelay(Halt);
     unsigned int i;
     for (i = 0; i < cfg.sections(); i++) {
 	NamedList* sec = cfg.getSection(i);
@@ -657,6 +1461,54 @@ void PgModule::initialize()
 	    s_failedConns++;
 	s_conmutex.unlock();
     }
+#ifdef PG_ASYNC
+    // asynchronous accounts are spread over the I/O threads
+    unsigned int threads = cfg.getIntValue("general","async_threads",1,1,64);
+    PgIoThread** thr = new PgIoThread*[threads];
+    for (i = 0; i < threads; i++)
+	thr[i] = 0;
+    i = 0;
+    s_conmutex.lock();
+    for (ObjList* o = s_accounts.skipNull(); o; o = o->skipNext()) {
+	PgAccount* acc = static_cast<PgAccount*>(o->get());
+	if (!acc->async())
+	    continue;
+	PgIoThread*& t = thr[i++ % threads];
+	if (!t)
+	    t = new PgIoThread(i);
+	t->addAccount(acc);
+    }
+    s_conmutex.unlock();
+    for (i = 0; i < threads; i++) {
+	if (!thr[i])
+	    continue;
+	if (!(thr[i]->valid() && thr[i]->startup())) {
+	    Debug(&module,DebugWarn,"Failed to start I/O thread %u",i + 1);
+	    delete thr[i];
+	}
+    }
+    delete[] thr;
+#endif
+}
+
+bool PgModule::received(Message& msg, int id)
+{
+#ifdef PG_ASYNC
+    if (id == Halt) {
+	// stop the I/O threads while the engine still runs
+	for (unsigned int i = 0; i < 100; i++) {
+	    bool running = false;
+	    s_conmutex.lock();
+	    for (ObjList* o = s_accounts.skipNull(); o; o = o->skipNext())
+		running = static_cast<PgAccount*>(o->get())->stopThread() || running;
+	    s_conmutex.unlock();
+	    if (!running)
+		break;
+	    Thread::idle();
+	}
+    }
+#endif
+    return Module::received(msg,id);
 }
 
 void PgModule::genUpdate(Message& msg)
@@ -22,18 +22,33 @@
 #include <yatephone.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <sqlite3.h>
 
 using namespace TelEngine;
 namespace { // anonymous
 
 class SqlConn;
+class SqlJob;
 
 static ObjList s_accounts;
 Mutex s_conmutex(false,"SQLite::acc");
 static unsigned int s_failedConns;
 static bool s_sharedCache = false;
 
+// A prepared statement kept by a connection, named by the query text
+class SqlStatement : public String
+{
+public:
+    inline SqlStatement(const char* query, unsigned int len, sqlite3_stmt* stmt)
+	: String(query), m_stmt(stmt), m_length(len)
+	{ }
+    inline ~SqlStatement()
+	{ sqlite3_finalize(m_stmt); }
+    sqlite3_stmt* m_stmt;
+    unsigned int m_length;               // Length of the query text used by the statement
+};
+
 // Database account holding the connection(s)
 class SqlAccount : public RefObject, public Mutex
 {
@@ -66,14 +81,26 @@ protected:
 
 private:
     void dropDb();
+    // Pick a connection and mark it busy, wait for one if needed
+    SqlConn* pickConn();
+    // Run a write query in a transaction shared with other queued writes
+    int queryBatch(const char* query, Message* dest);
+    // Run queued writes in a single transaction
+    void runBatch(SqlJob* own);
 
     String m_name;
     String m_database;
     String m_initialize;
+    String m_journalMode;
+    String m_synchronous;
     int m_retry;
     u_int64_t m_timeout;
     SqlConn* m_connPool;
     unsigned int m_connPoolSize;
+    unsigned int m_cacheSize;            // Prepared statements kept by each connection
+    unsigned int m_batchSize;            // Writes grouped in a transaction
+    ObjList m_batch;                     // Writes waiting for a transaction
+    bool m_batching;                     // A thread is running a transaction of writes
     // stat counters
     Mutex* m_statsMutex;
     unsigned int m_totalQueries;
@@ -103,11 +130,38 @@ public:
     // Perform the query, fill the message with data, retry in case of errors
     // Return number of rows, -1 for non-retryable errors and -2 for busy / timeout
     int queryDb(const char* query, Message* dest);
+    // Execute a statement that returns no data, like a transaction control
+    bool execDb(const char* query);
+    // Check if a transaction is open, SQLite rolls back some failures itself
+    inline bool inTransaction() const
+	{ return m_conn && !sqlite3_get_autocommit(m_conn); }
     virtual void destruct();
 private:
+    // Get a statement from the cache or prepare it
+    int prepare(const char* query, sqlite3_stmt*& stmt, const char*& tail, SqlStatement*& cached);
+    // Reset a statement and keep it in the cache or finalize it
+    void release(sqlite3_stmt* stmt, SqlStatement* cached, const char* query, const char* tail);
     SqlAccount* m_account;
     bool m_busy;
     sqlite3* m_conn;
+    ObjList m_stmts;                     // Prepared statements, most recently used first
+    unsigned int m_stmtCount;
+};
+
+// A write query waiting to be executed in a batch transaction
+class SqlJob : public GenObject
+{
+public:
+    inline SqlJob(const char* query, Message* dest)
+	: m_query(query), m_dest(dest), m_done(1,"SqlJob",0),
+	  m_result(-1), m_lead(false), m_aborted(false)
+	{ }
+    const char* m_query;
+    Message* m_dest;
+    Semaphore m_done;
+    int m_result;
+    bool m_lead;                         // Woken up to run the next batch
+    bool m_aborted;                      // Failed and rolled back the transaction
 };
 
 class SqlModule : public Module
@@ -143,7 +197,7 @@ public:
 //
 SqlConn::SqlConn(SqlAccount* account)
     : m_account(account), m_busy(false),
-    m_conn(0)
+    m_conn(0), m_stmtCount(0)
 {
 }
 
@@ -166,6 +220,14 @@ bool SqlConn::initDb()
 	dropDb();
 	return false;
     }
+    if (m_account->m_journalMode &&
+	    !execDb("PRAGMA journal_mode=" + m_account->m_journalMode))
+	Debug(&module,DebugWarn,"Failed to set journal mode '%s' for '%s'",
+	    m_account->m_journalMode.c_str(),c_str());
+    if (m_account->m_synchronous &&
+	    !execDb("PRAGMA synchronous=" + m_account->m_synchronous))
+	Debug(&module,DebugWarn,"Failed to set synchronous '%s' for '%s'",
+	    m_account->m_synchronous.c_str(),c_str());
     return true;
 }
 
@@ -174,6 +236,9 @@ void SqlConn::dropDb()
 {
     if (!m_conn)
 	return;
+    // statements must be finalized before closing
+    m_stmts.clear();
+    m_stmtCount = 0;
     sqlite3* tmp = m_conn;
     m_conn = 0;
     XDebug(&module,DebugAll,"Database '%s' dropped [%p]",c_str(),m_account);
@@ -182,6 +247,88 @@ void SqlConn::dropDb()
 	    c_str(),sqlite3_errmsg(tmp));
 }
 
+// Get a statement from the cache or prepare it, retry in case of contention
+// Return 0 on success, -1 for non-retryable errors and -2 for busy / timeout
+int SqlConn::prepare(const char* query, sqlite3_stmt*& stmt, const char*& tail, SqlStatement*& cached)
+{
+    cached = 0;
+    if (m_stmtCount) {
+	ObjList* o = m_stmts.find(String(query));
+	if (o) {
+	    cached = static_cast<SqlStatement*>(o->remove(false));
+	    m_stmtCount--;
+	    stmt = cached->m_stmt;
+	    tail = query + cached->m_length;
+	    return 0;
+	}
+    }
+    int retry = retries();
+    for (int i = 0; ; i++) {
+	if (i)
+	    Thread::idle();
+	stmt = 0;
+	tail = 0;
+	switch (sqlite3_prepare_v2(m_conn,query,-1,&stmt,&tail)) {
+	    case SQLITE_OK:
+		return 0;
+	    case SQLITE_BUSY:
+	    case SQLITE_LOCKED:
+		sqlite3_finalize(stmt);
+		if (i >= retry)
+		    return -2;
+		continue;
+	    default:
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+    }
+}
+
+// Reset a statement and keep it as most recently used or finalize it
+void SqlConn::release(sqlite3_stmt* stmt, SqlStatement* cached, const char* query, const char* tail)
+{
+    if (!stmt)
+	return;
+    sqlite3_reset(stmt);
+    unsigned int max = m_account->m_cacheSize;
+    if (!(cached || max)) {
+	sqlite3_finalize(stmt);
+	return;
+    }
+    sqlite3_clear_bindings(stmt);
+    if (!cached)
+	cached = new SqlStatement(query,tail ? (unsigned int)(tail - query) : ::strlen(query),stmt);
+    m_stmts.insert(cached);
+    if (++m_stmtCount <= max)
+	return;
+    // drop the least recently used
+    unsigned int n = 0;
+    for (ObjList* o = m_stmts.skipNull(); o; o = o->skipNext()) {
+	if (++n > max) {
+	    o->remove();
+	    break;
+	}
+    }
+    m_stmtCount = max;
+}
+
+// Bind the parameters of a query template from param.1 ... param.N
+static void bindParams(sqlite3_stmt* stmt, const Message* msg)
+{
+    if (!msg)
+	return;
+    int n = msg->getIntValue(YSTRING("params"),0,0);
+    int count = sqlite3_bind_parameter_count(stmt);
+    if (n > count)
+	n = count;
+    for (int i = 1; i <= n; i++) {
+	// a missing parameter stays NULL, the values outlive the statement execution
+	const String* p = msg->getParam("param." + String(i));
+	if (p)
+	    sqlite3_bind_text(stmt,i,p->safe(),p->length(),SQLITE_STATIC);
+    }
+}
+
 // Perform the query, fill the message with data, retry in case of errors
 // Return number of rows, -1 for non-retryable errors and -2 for busy / timeout
 int SqlConn::queryDb(const char* query, Message* dest)
@@ -200,39 +347,29 @@ int SqlConn::queryDb(const char* query, Message* dest)
 	if (!*query)
 	    break;
 	int retry = retries();
-	sqlite3_stmt* stmt;
-	const char* tail;
-	int i;
+	sqlite3_stmt* stmt = 0;
+	const char* tail = 0;
+	SqlStatement* cached = 0;
 	// Prepare statement, leave whatever unparsed in tail
-	for (i = 0; i >= 0; i++) {
-	    if (i)
-		Thread::idle();
-	    stmt = 0;
-	    tail = 0;
-	    switch (sqlite3_prepare_v2(m_conn,query,-1,&stmt,&tail)) {
-		case SQLITE_OK:
-		    i = -2;
-		    break;
-		case SQLITE_BUSY:
-		case SQLITE_LOCKED:
-		    sqlite3_finalize(stmt);
-		    if (i >= retry)
-			return -2;
-		    continue;
-		default:
-		    {
-			const char* errStr = sqlite3_errmsg(m_conn);
-			Debug(&module,DebugWarn,"Query '%s' for '%s' prepare error: %s [%p]",
-			    query,c_str(),errStr,m_account);
-			if (dest)
-			    dest->setParam("error",errStr);
-		    }
-		    sqlite3_finalize(stmt);
-		    if (results)
-			dest->userData(0);
-		    return -1;
+	int i = prepare(query,stmt,tail,cached);
+	if (i < 0) {
+	    if (i == -1) {
+		const char* errStr = sqlite3_errmsg(m_conn);
+		Debug(&module,DebugWarn,"Query '%s' for '%s' prepare error: %s [%p]",
+		    query,c_str(),errStr,m_account);
+		if (dest)
+		    dest->setParam("error",errStr);
 	    }
+	    if (results)
+		dest->userData(0);
+	    return i;
 	}
+	if (!stmt) {
+	    // comment or white space only
+	    query = tail;
+	    continue;
+	}
+	bindParams(stmt,dest);
 	int lr = 0;
 	int lc = 0;
 	Array* a = 0;
@@ -285,8 +422,7 @@ int SqlConn::queryDb(const char* query, Message* dest)
 		case SQLITE_BUSY:
 		case SQLITE_LOCKED:
 		    if (i++ >= retry) {
-			sqlite3_reset(stmt);
-			sqlite3_finalize(stmt);
+			release(stmt,cached,query,tail);
 			TelEngine::destruct(a);
 			if (results)
 			    dest->userData(0);
@@ -301,8 +437,7 @@ int SqlConn::queryDb(const char* query, Message* dest)
 			if (dest)
 			    dest->setParam("error",errStr);
 		    }
-		    sqlite3_reset(stmt);
-		    sqlite3_finalize(stmt);
+		    release(stmt,cached,query,tail);
 		    TelEngine::destruct(a);
 		    if (results)
 			dest->userData(0);
@@ -311,8 +446,7 @@ int SqlConn::queryDb(const char* query, Message* dest)
 	    }
 	}
 	// Clean up statement and advance to next one
-	sqlite3_reset(stmt);
-	sqlite3_finalize(stmt);
+	release(stmt,cached,query,tail);
 	TelEngine::destruct(a);
 	query = tail;
     }
@@ -326,6 +460,30 @@ int SqlConn::queryDb(const char* query, Message* dest)
     return rows;
 }
 
+// Execute a statement that returns no data, like a transaction control
+bool SqlConn::execDb(const char* query)
+{
+    if (!m_conn)
+	return false;
+    int retry = retries();
+    for (int i = 0; ; i++) {
+	if (i)
+	    Thread::idle();
+	char* err = 0;
+	int res = sqlite3_exec(m_conn,query,0,0,&err);
+	if (SQLITE_OK == res)
+	    return true;
+	if (((SQLITE_BUSY == res) || (SQLITE_LOCKED == res)) && (i < retry)) {
+	    sqlite3_free(err);
+	    continue;
+	}
+	Debug(&module,DebugWarn,"Query '%s' for '%s' failed: %s [%p]",
+	    query,c_str(),err ? err : sqlite3_errstr(res),m_account);
+	sqlite3_free(err);
+	return false;
+    }
+}
+
 void SqlConn::destruct()
 {
     dropDb();
@@ -340,6 +498,7 @@ SqlAccount::SqlAccount(const NamedList& sect)
     : Mutex(true,"SqlAccount"),
       m_name(sect),
       m_connPool(0), m_connPoolSize(0),
+      m_cacheSize(0), m_batchSize(0), m_batching(false),
       m_statsMutex(&s_conmutex),
       m_totalQueries(0), m_failedQueries(0),
       m_errorQueries(0), m_queryTime(0)
@@ -376,6 +535,10 @@ SqlAccount::SqlAccount(const NamedList& sect)
     if (m_timeout < 100000)
 	m_timeout = 100000;
     m_retry = sect.getIntValue("retry",5,0,100,false);
+    m_journalMode = sect.getValue("journal_mode");
+    m_synchronous = sect.getValue("synchronous");
+    m_cacheSize = sect.getIntValue("statements",16,0,1000);
+    m_batchSize = sect.getIntValue("batch",0,0,10000);
     // Can create just one connection to temporary or non shared cache in-memory databases
     bool shared = s_sharedCache && !m_database.null();
     shared = shared && (m_database.find(":memory:") < 0) && (m_database.find("mode=memory") < 0);
@@ -391,8 +554,8 @@ SqlAccount::SqlAccount(const NamedList& sect)
 	m_connPool[i].m_account = this;
 	m_connPool[i].assign(m_name + "." + String(i + 1));
     }
-    Debug(&module,DebugInfo,"Database account '%s' created poolsize=%u [%p]",
-	m_name.c_str(),m_connPoolSize,this);
+    Debug(&module,DebugInfo,"Database account '%s' created poolsize=%u statements=%u batch=%u [%p]",
+	m_name.c_str(),m_connPoolSize,m_cacheSize,m_batchSize,this);
 }
 
 // Init the connections for the account, run init query
@@ -433,63 +596,195 @@ static bool failure(Message* m)
     return false;
 }
 
-int SqlAccount::queryDb(const char* query, Message* dest)
+// Pick a connection and mark it busy, wait for one if needed
+SqlConn* SqlAccount::pickConn()
 {
-    if (TelEngine::null(query))
-	return -1;
-    Debug(&module,DebugAll,"Performing query \"%s\" for '%s'",
-	query,m_name.c_str());
-    // Use a while() to break to the end to update statistics
-    int res = -1;
-    u_int64_t start = Time::now();
-    while (true) {
-	Lock mylock(this,(long)m_timeout);
-	if (!mylock.locked()) {
-	    Debug(&module,DebugWarn,"Failed to lock '%s' for " FMT64U " usec",
-		m_name.c_str(),m_timeout);
+    Lock mylock(this,(long)m_timeout);
+    if (!mylock.locked()) {
+	Debug(&module,DebugWarn,"Failed to lock '%s' for " FMT64U " usec",
+	    m_name.c_str(),m_timeout);
+	return 0;
+    }
+    // Find a non busy connection
+    SqlConn* conn = 0;
+    SqlConn* notConnected = 0;
+    for (unsigned int i = 0; i < m_connPoolSize; i++) {
+	if (m_connPool[i].isBusy())
+	    continue;
+	if (m_connPool[i].testDb()) {
+	    conn = &(m_connPool[i]);
 	    break;
 	}
-	// Find a non busy connection
-	SqlConn* conn = 0;
-	SqlConn* notConnected = 0;
-	for (unsigned int i = 0; i < m_connPoolSize; i++) {
-	    if (m_connPool[i].isBusy())
-		continue;
-	    if (m_connPool[i].testDb()) {
-		conn = &(m_connPool[i]);
+	if (!notConnected)
+	    notConnected = &(m_connPool[i]);
+    }
+    if (!conn)
+	conn = notConnected;
+    if (!conn) {
+	// Wait for a connection to become non-busy
+	// Round up the number of intervals to wait
+	unsigned int n = (unsigned int)((m_timeout + 999999) / Thread::idleUsec());
+	for (unsigned int i = 0; i < n; i++) {
+	    for (unsigned int j = 0; j < m_connPoolSize; j++) {
+		if (!m_connPool[j].isBusy() && m_connPool[j].testDb()) {
+		    conn = &(m_connPool[j]);
+		    break;
+		}
+	    }
+	    if (conn || Thread::check(false))
 		break;
+	    Thread::idle();
+	}
+    }
+    if (conn)
+	conn->setBusy(true);
+    else
+	Debug(&module,DebugWarn,"Account '%s' failed to pick a connection [%p]",m_name.c_str(),this);
+    return conn;
+}
+
+// Check if a query only changes data so it can be batched with other writes
+static bool isWrite(const char* query)
+{
+    String start(query,32);
+    start.trimBlanks();
+    return start.startsWith("INSERT",true,true) || start.startsWith("UPDATE",true,true)
+	|| start.startsWith("DELETE",true,true) || start.startsWith("REPLACE",true,true);
+}
+
+// Run a write query in a transaction shared with other queued writes
+// The first writer runs the transaction, the others wait for their result
+int SqlAccount::queryBatch(const char* query, Message* dest)
+{
+    SqlJob job(query,dest);
+    lock();
+    m_batch.append(&job)->setDelete(false);
+    bool lead = !m_batching;
+    m_batching = true;
+    unlock();
+    if (!lead) {
+	if (!job.m_done.lock((long)(m_timeout * 2))) {
+	    // a transaction should not take this long, try to withdraw
+	    Lock mylock(this);
+	    if (!job.m_lead && m_batch.remove(&job,false)) {
+		mylock.drop();
+		Debug(&module,DebugWarn,"Batched query timed out for '%s' [%p]",m_name.c_str(),this);
+		return -2;
 	    }
-	    if (!notConnected)
-		notConnected = &(m_connPool[i]);
-        }
+	    mylock.drop();
+	    // already taken by a transaction or made leader
+	    job.m_done.lock();
+	}
+	if (!job.m_lead)
+	    return job.m_result;
+    }
+    runBatch(&job);
+    return job.m_result;
+}
+
+// Run queued writes in a single transaction, pass the lead to a waiting writer
+void SqlAccount::runBatch(SqlJob* own)
+{
+    ObjList jobs;
+    ObjList* add = &jobs;
+    lock();
+    for (unsigned int n = 0; n < m_batchSize; n++) {
+	ObjList* o = m_batch.skipNull();
+	if (!o)
+	    break;
+	add = add->append(o->remove(false));
+	add->setDelete(false);
+    }
+    unlock();
+    SqlConn* conn = pickConn();
+    unsigned int count = 0;
+    ObjList* start = jobs.skipNull();
+    while (start) {
+	const char* error = 0;
 	if (!conn)
-	    conn = notConnected;
-	if (!conn) {
-	    // Wait for a connection to become non-busy
-	    // Round up the number of intervals to wait
-	    unsigned int n = (unsigned int)((m_timeout + 999999) / Thread::idleUsec());
-	    for (unsigned int i = 0; i < n; i++) {
-		for (unsigned int j = 0; j < m_connPoolSize; j++) {
-		    if (!m_connPool[j].isBusy() && m_connPool[j].testDb()) {
-			conn = &(m_connPool[j]);
-			break;
-		    }
-		}
-		if (conn || Thread::check(false))
-		    break;
-		Thread::idle();
+	    error = "no connection";
+	else if (!conn->execDb("BEGIN"))
+	    error = "begin failed";
+	ObjList* o = start;
+	for (; o && !error; o = o->skipNext()) {
+	    SqlJob* job = static_cast<SqlJob*>(o->get());
+	    if (job->m_aborted)
+		continue;
+	    job->m_result = conn->queryDb(job->m_query,job->m_dest);
+	    count++;
+	    // most failed statements are undone alone but some errors (full,
+	    //  I/O, out of memory, ON CONFLICT ROLLBACK) roll back everything
+	    if (!conn->inTransaction())
+		break;
+	}
+	if (o && !error) {
+	    SqlJob* job = static_cast<SqlJob*>(o->get());
+	    o = o->skipNext();
+	    if (job->m_result >= 0) {
+		// the query ended the transaction itself, the writes so far stay
+		start = o;
+		continue;
 	    }
+	    // run the writes undone by the failed one again in a new transaction
+	    Debug(&module,DebugMild,"Query '%s' for '%s' rolled back the transaction [%p]",
+		job->m_query,m_name.c_str(),this);
+	    job->m_aborted = true;
+	    continue;
 	}
-	if (conn)
-	    conn->setBusy(true);
-	else
-	    Debug(&module,DebugWarn,"Account '%s' failed to pick a connection [%p]",m_name.c_str(),this);
-	mylock.drop();
+	if (!error) {
+	    if (conn->execDb("COMMIT"))
+		break;
+	    conn->execDb("ROLLBACK");
+	    error = "commit failed";
+	}
+	for (o = start; o; o = o->skipNext()) {
+	    SqlJob* job = static_cast<SqlJob*>(o->get());
+	    if (job->m_aborted)
+		continue;
+	    job->m_result = -2;
+	    if (job->m_dest)
+		job->m_dest->setParam("error",error);
+	}
+	break;
+    }
+    if (conn)
+	conn->setBusy(false);
+    XDebug(&module,DebugAll,"Account '%s' ran %u writes in a transaction [%p]",
+	m_name.c_str(),count,this);
+    for (ObjList* o = jobs.skipNull(); o; o = o->skipNext()) {
+	SqlJob* job = static_cast<SqlJob*>(o->get());
+	if (job != own)
+	    job->m_done.unlock();
+    }
+    // hand the next batch to the first waiting writer, it's still queued
+    lock();
+    ObjList* o = m_batch.skipNull();
+    if (o) {
+	SqlJob* next = static_cast<SqlJob*>(o->get());
+	next->m_lead = true;
+	next->m_done.unlock();
+    }
+    else
+	m_batching = false;
+    unlock();
+}
+
+int SqlAccount::queryDb(const char* query, Message* dest)
+{
+    if (TelEngine::null(query))
+	return -1;
+    Debug(&module,DebugAll,"Performing query \"%s\" for '%s'",
+	query,m_name.c_str());
+    int res = -1;
+    u_int64_t start = Time::now();
+    if (m_batchSize && isWrite(query))
+	res = queryBatch(query,dest);
+    else {
+	SqlConn* conn = pickConn();
 	if (conn) {
 	    res = conn->queryDb(query,dest);
 	    conn->setBusy(false);
 	}
-	break;
     }
     Lock stats(m_statsMutex);
     m_totalQueries++;
@@ -501,7 +796,8 @@ int SqlAccount::queryDb(const char* query, Message* dest)
     }
     stats.drop();
     module.changed();
-    if (res < 0)
+    // keep the reason set by a failed batch
+    if ((res < 0) && !(res == -2 && dest && dest->getParam(YSTRING("error"))))
 	failure(dest);
     return res;
 }
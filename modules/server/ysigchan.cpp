@@ -46,6 +46,7 @@ class IsupEncodeHandler;                 // Handler for "isup.encode" message
 class SigNotifier;                       // Class for handling received notifications
 class SigSS7Tcap;                        // SS7 TCAP - Transaction Capabilities Application Part
 class SigTCAPUser;                       // Default TCAP user
+class GTTranslator;                      // SCCP Global Title Translator using yate messages
 
 // The signalling channel
 class SigChannel : public Channel
@@ -353,8 +354,10 @@ public:
 	{ }
     virtual ~SigSccpGtt();
     virtual bool initialize(NamedList& params);
+    // Return the status of this component
+    virtual void status(String& retVal);
 private:
-    GTT* m_gtt;
+    GTTranslator* m_gtt;
 };
 
 // MTP Traffic Testing
@@ -810,6 +813,22 @@ public:
     virtual void cleanup();
 };
 
+// A translated Global Title kept in the GTT cache
+// Holds only the translation result, the request parameters are not kept
+class GTCacheEntry : public NamedList
+{
+public:
+    inline GTCacheEntry(const String& key, const char* name, u_int64_t expires)
+	: NamedList(name), m_key(key), m_expires(expires), m_suffix(false)
+	{ }
+    virtual const String& toString() const
+	{ return m_key; }
+    String m_key;
+    u_int64_t m_expires;
+    // Digits not used in key must be appended to the translated gt
+    bool m_suffix;
+};
+
 // Implementation for a SCCP Global Title Translator
 class GTTranslator : public GTT
 {
@@ -821,6 +840,23 @@ public:
 	    const String& nextPrefix);
     virtual bool initialize(const NamedList* config);
     virtual void updateTables(const NamedList& params);
+    // Drop all cached translations
+    void flushCache();
+    // Append cache status to a component status
+    void status(String& retVal);
+private:
+    bool cacheKey(String& key, const NamedList& gt, const String& prefix);
+    void cacheRoute(const String& key, const NamedList& route, const NamedList& gt,
+	const String& prefix, const String& nextPrefix, u_int64_t now);
+    Mutex m_cacheMutex;
+    HashList* m_cache;
+    unsigned int m_cacheCount;
+    unsigned int m_cacheSize;
+    unsigned int m_cacheTtl;
+    unsigned int m_cacheDigits;
+    u_int64_t m_cachePurge;
+    unsigned int m_cacheHits;
+    unsigned int m_cacheMisses;
 };
 
 class SCCPUserDummy : public SCCPUser
@@ -3380,6 +3416,13 @@ bool SigSccpGtt::initialize(NamedList& params)
     return m_gtt && m_gtt->initialize(&params);
 }
 
+void SigSccpGtt::status(String& retVal)
+{
+    retVal << "type=" << (m_gtt ? m_gtt->componentType() : "");
+    if (m_gtt)
+	m_gtt->status(retVal);
+}
+
 /**
  * SigTesting
  */
@@ -4985,9 +5028,23 @@ bool SCCPUserDummy::managementNotify(SCCP::Type type, NamedList &params)
  * class GTTranslator
  */
 
+// Parameters of sccp.route copied from the request, not kept in cache
+static const TokenDict s_gtRequest[] = {
+    { "component",     1 },
+    { "translator",    1 },
+    { "HopCounter",    1 },
+    { "MessageReturn", 1 },
+    { "LocalPC",       1 },
+    { "generated",     1 },
+    { 0, 0 }
+};
+
 GTTranslator::GTTranslator(const NamedList& params)
     : SignallingComponent(params.safe("GTT"),&params,"ss7-gtt"),
-      GTT(params)
+      GTT(params),
+      m_cacheMutex(false,"GTTCache"), m_cache(0), m_cacheCount(0),
+      m_cacheSize(0), m_cacheTtl(0), m_cacheDigits(0), m_cachePurge(0),
+      m_cacheHits(0), m_cacheMisses(0)
 {
     DDebug(this,DebugAll,"Crated Global Title Translator [%p]",this);
 }
@@ -4995,14 +5052,157 @@ GTTranslator::GTTranslator(const NamedList& params)
 GTTranslator::~GTTranslator()
 {
     DDebug(this,DebugAll,"Destroying Global Title Translator [%p]",this);
+    delete m_cache;
+}
+
+// Build the cache key from the local point code and the parameters of the
+//  translated address, optionally keeping only the leading digits of the GT
+bool GTTranslator::cacheKey(String& key, const NamedList& gt, const String& prefix)
+{
+    if (!m_cache)
+	return false;
+    String digits = prefix + ".gt";
+    key << gt.getValue(YSTRING("LocalPC"));
+    unsigned int len = prefix.length() + 1;
+    for (const ObjList* o = gt.paramList()->skipNull(); o; o = o->skipNext()) {
+	const NamedString* ns = static_cast<const NamedString*>(o->get());
+	if (!(ns->name().startsWith(prefix) && ns->name().at(prefix.length()) == '.'))
+	    continue;
+	key << "|" << ns->name().substr(len) << "=";
+	if (m_cacheDigits && ns->name() == digits) {
+	    key << ns->substr(0,m_cacheDigits);
+	    // longer GTs don't share translations with the one made of the prefix
+	    if (ns->length() > m_cacheDigits)
+		key << "*";
+	}
+	else
+	    key << *ns;
+    }
+    return true;
+}
+
+// Remember a translation, purges expired entries at most once per second if full
+// Only the translation result is kept, not the parameters copied from the
+//  request, so a cache hit doesn't carry the addresses of the first message
+void GTTranslator::cacheRoute(const String& key, const NamedList& route, const NamedList& gt,
+    const String& prefix, const String& nextPrefix, u_int64_t now)
+{
+    // a route that rewrote the other address depends on more than the key
+    String next = nextPrefix + ".";
+    unsigned int count = 0;
+    for (const ObjList* o = gt.paramList()->skipNull(); o; o = o->skipNext()) {
+	const NamedString* ns = static_cast<const NamedString*>(o->get());
+	if (ns->name().startsWith(next))
+	    count++;
+    }
+    GTCacheEntry* e = new GTCacheEntry(key,route.c_str(),now + 1000 * (u_int64_t)m_cacheTtl);
+    for (const ObjList* o = route.paramList()->skipNull(); o; o = o->skipNext()) {
+	const NamedString* ns = static_cast<const NamedString*>(o->get());
+	if (ns->name().startsWith(next)) {
+	    const NamedString* orig = gt.getParam(ns->name());
+	    if (!orig || (*orig != *ns) || !count--) {
+		DDebug(this,DebugAll,"Not caching translation '%s', %s was changed",
+		    key.c_str(),ns->name().c_str());
+		TelEngine::destruct(e);
+		return;
+	    }
+	    continue;
+	}
+	if (lookup(ns->name(),s_gtRequest))
+	    continue;
+	e->addParam(ns->name(),*ns);
+    }
+    if (count) {
+	DDebug(this,DebugAll,"Not caching translation '%s', %s was changed",
+	    key.c_str(),nextPrefix.c_str());
+	TelEngine::destruct(e);
+	return;
+    }
+    if (m_cacheDigits) {
+	// keep the translated gt without the digits left out of the key
+	const String& digits = gt[prefix + ".gt"];
+	NamedString* res = e->getParam(YSTRING("gt"));
+	if (res && (digits.length() > m_cacheDigits)) {
+	    String suffix = digits.substr(m_cacheDigits);
+	    if (res->endsWith(suffix)) {
+		*res = res->substr(0,res->length() - suffix.length());
+		e->m_suffix = true;
+	    }
+	}
+    }
+    Lock lock(m_cacheMutex);
+    if (!m_cache) {
+	TelEngine::destruct(e);
+	return;
+    }
+    if (m_cacheCount >= m_cacheSize) {
+	if (now < m_cachePurge) {
+	    TelEngine::destruct(e);
+	    return;
+	}
+	m_cachePurge = now + 1000000;
+	for (unsigned int i = 0; i < m_cache->length(); i++) {
+	    ObjList* l = m_cache->getList(i);
+	    while (l) {
+		GTCacheEntry* c = static_cast<GTCacheEntry*>(l->get());
+		if (c && c->m_expires <= now) {
+		    l->remove();
+		    m_cacheCount--;
+		}
+		else
+		    l = l->next();
+	    }
+	}
+	if (m_cacheCount >= m_cacheSize) {
+	    TelEngine::destruct(e);
+	    return;
+	}
+    }
+    m_cache->append(e);
+    m_cacheCount++;
+}
+
+void GTTranslator::flushCache()
+{
+    Lock lock(m_cacheMutex);
+    if (m_cache)
+	m_cache->clear();
+    m_cacheCount = 0;
+    m_cachePurge = 0;
+}
+
+void GTTranslator::status(String& retVal)
+{
+    Lock lock(m_cacheMutex);
+    retVal << ";cached=" << m_cacheCount;
+    retVal << ",hits=" << m_cacheHits;
+    retVal << ",misses=" << m_cacheMisses;
 }
 
 NamedList* GTTranslator::routeGT(const NamedList& gt, const String& prefix, const String& nextPrefix)
 {
-    // TODO keep a cache!!
-    // Verify if the requested gt exists in cache
-    // if exists return the cached translation of th GT
-    // if not exists send it for translation
+    String key;
+    u_int64_t now = 0;
+    if (cacheKey(key,gt,prefix)) {
+	now = Time::now();
+	Lock lock(m_cacheMutex);
+	GTCacheEntry* e = m_cache ? static_cast<GTCacheEntry*>((*m_cache)[key]) : 0;
+	if (e && e->m_expires > now) {
+	    m_cacheHits++;
+	    NamedList* route = new NamedList(*e);
+	    if (e->m_suffix) {
+		NamedString* res = route->getParam(YSTRING("gt"));
+		if (res)
+		    *res << gt[prefix + ".gt"].substr(m_cacheDigits);
+	    }
+	    return route;
+	}
+	if (e) {
+	    m_cache->remove(e,true,true);
+	    m_cacheCount--;
+	}
+	m_cacheMisses++;
+    }
     Message* msg = new Message("sccp.route");
     const char* name = sccp() ? sccp()->toString().c_str() : (const char*)0;
     msg->addParam("component",name,false);
@@ -5013,14 +5213,19 @@ NamedList* GTTranslator::routeGT(const NamedList& gt, const String& prefix, cons
     msg->copyParam(gt,YSTRING("generated"));
     msg->copySubParams(gt,nextPrefix + ".",false);
     msg->copySubParams(gt,prefix + ".");
-    if (Engine::dispatch(msg)) // Append the translated GT to cache
+    if (Engine::dispatch(msg)) {
+	if (key)
+	    cacheRoute(key,*msg,gt,prefix,nextPrefix,now);
 	return msg;
+    }
     TelEngine::destruct(msg);
     return 0;
 }
 
 void GTTranslator::updateTables(const NamedList& params)
 {
+    // routes may depend on the state of remote SCCPs or subsystems
+    flushCache();
     Message* msg = new Message("sccp.update");
     msg->copyParams(params);
     Engine::enqueue(msg);
@@ -5028,6 +5233,24 @@ void GTTranslator::updateTables(const NamedList& params)
 
 bool GTTranslator::initialize(const NamedList* config)
 {
+    if (config) {
+	Lock lock(m_cacheMutex);
+	// a HashList holds at most 1024 lists, keep few entries in each
+	unsigned int size = config->getIntValue(YSTRING("cache_size"),0,0,16384);
+	if (size != m_cacheSize) {
+	    delete m_cache;
+	    m_cache = 0;
+	    m_cacheCount = 0;
+	    m_cacheSize = size;
+	    if (size) {
+		size /= 4;
+		m_cache = new HashList(size < 17 ? 17 : (size > 1024 ? 1024 : size));
+	    }
+	}
+	m_cacheTtl = config->getIntValue(YSTRING("cache_ttl"),30000,100,86400000);
+	m_cacheDigits = config->getIntValue(YSTRING("cache_digits"),0,0,32);
+    }
+    flushCache();
     return GTT::initialize(config);
 }
 
@@ -0,0 +1,261 @@
+/**
+ * cachebench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Cache module lookup benchmark
+ *
+ * Answers the cache load queries of a fake database account and looks up
+ *  LNP cache items from several threads while the cache is loading, e.g.:
+ *  [cachebench]
+ *  items=200000
+ *  threads=8
+ *  count=100000
+ * The LNP cache must be configured to load from the benchmark account:
+ *  [lnp]
+ *  enable=yes
+ *  account=cachebench
+ *  query_loadcache=load ${chunk} ${offset}
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Upper limits of the latency histogram in microseconds, last bucket holds the rest
+static const unsigned int s_limits[] = { 5, 10, 20, 50, 100, 200, 500, 1000, 5000, 20000 };
+#define BENCH_BUCKETS (sizeof(s_limits) / sizeof(unsigned int) + 1)
+
+class CacheBenchThread : public Thread
+{
+public:
+    inline CacheBenchThread()
+	: Thread("CacheBench")
+	{ }
+    virtual void run();
+};
+
+class CacheBenchDb : public MessageHandler
+{
+public:
+    inline CacheBenchDb()
+	: MessageHandler("database",50,"cachebench")
+	{ }
+    virtual bool received(Message& msg);
+};
+
+class CacheBench : public Plugin
+{
+public:
+    CacheBench();
+    virtual ~CacheBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static Mutex s_mutex(false,"CacheBench");
+static unsigned int s_items = 0;
+static unsigned int s_count = 0;
+static unsigned int s_running = 0;
+static unsigned int s_index = 0;
+static unsigned int s_hits = 0;
+static unsigned int s_done = 0;
+static u_int64_t s_time = 0;
+static u_int64_t s_maxTime = 0;
+static unsigned int s_hist[BENCH_BUCKETS];
+static u_int64_t s_start = 0;
+static u_int64_t s_loaded = 0;
+
+INIT_PLUGIN(CacheBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+// Print the results once the last thread finished
+static void report(u_int64_t total)
+{
+    String hist;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++) {
+	if (i < BENCH_BUCKETS - 1)
+	    hist.append(String(s_limits[i])," ");
+	else
+	    hist.append("+"," ");
+	hist << ":" << s_hist[i];
+    }
+    Output("Cache benchmark: %u lookups (%u hits) in %u ms, " FMT64U " per second, load queries done after %u ms",
+	s_done,s_hits,(unsigned int)(total / 1000),
+	total ? (1000000 * (u_int64_t)s_done / total) : 0,
+	s_loaded ? (unsigned int)((s_loaded - s_start) / 1000) : 0);
+    Output("Cache benchmark: latency average %u us, max %u us, histogram %s",
+	s_done ? (unsigned int)(s_time / s_done) : 0,(unsigned int)s_maxTime,hist.c_str());
+    Output("Cache benchmark finished");
+}
+
+
+// Answer cache load queries with generated rows: "load [chunk offset]"
+bool CacheBenchDb::received(Message& msg)
+{
+    if (msg[YSTRING("account")] != YSTRING("cachebench"))
+	return false;
+    const String& query = msg[YSTRING("query")];
+    if (!query.startsWith("load"))
+	return false;
+    unsigned int chunk = s_items;
+    unsigned int offset = 0;
+    ObjList* words = query.split(' ',false);
+    ObjList* o = words->skipNull();
+    if (o && (o = o->skipNext())) {
+	chunk = o->get()->toString().toInteger(s_items,0,0);
+	if ((o = o->skipNext()))
+	    offset = o->get()->toString().toInteger(0,0,0);
+    }
+    TelEngine::destruct(words);
+    unsigned int rows = (offset < s_items) ? s_items - offset : 0;
+    if (rows > chunk)
+	rows = chunk;
+    // fill the columns directly, Array::set() walks the column for each cell
+    Array* a = new Array(2,rows + 1);
+    ObjList* id = a->getColumn(0);
+    ObjList* routing = a->getColumn(1);
+    id->set(new String("id"));
+    routing->set(new String("routing"));
+    for (unsigned int i = 0; i < rows; i++) {
+	id = id->next();
+	routing = routing->next();
+	id->set(new String(offset + i));
+	routing->set(new String("bench"));
+    }
+    msg.userData(a);
+    TelEngine::destruct(a);
+    msg.setParam("rows",String(rows));
+    if (rows < chunk) {
+	Lock lck(s_mutex);
+	if (!s_loaded)
+	    s_loaded = Time::now();
+    }
+    return true;
+}
+
+
+void CacheBenchThread::run()
+{
+    // lookups start together with the cache load at engine start
+    while (!(Engine::started() || Engine::exiting()))
+	Thread::idle();
+    s_mutex.lock();
+    unsigned int index = ++s_index;
+    if (index == 1)
+	s_start = Time::now();
+    s_mutex.unlock();
+    // private generator, a shared one would serialize the threads
+    u_int32_t seed = 2654435761u * index;
+    unsigned int done = 0;
+    unsigned int hits = 0;
+    u_int64_t time = 0;
+    u_int64_t maxTime = 0;
+    unsigned int hist[BENCH_BUCKETS];
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+	hist[i] = 0;
+    for (; (done < s_count) && !Engine::exiting(); done++) {
+	seed = seed * 1103515245 + 12345;
+	Message m("call.route");
+	m.addParam("called",String((seed >> 8) % s_items));
+	m.addParam("querylnp",String::boolText(true));
+	u_int64_t t = Time::now();
+	Engine::dispatch(m);
+	t = Time::now() - t;
+	if (!m.getBoolValue(YSTRING("querylnp"),true))
+	    hits++;
+	time += t;
+	if (t > maxTime)
+	    maxTime = t;
+	unsigned int i = 0;
+	for (; i < BENCH_BUCKETS - 1; i++)
+	    if (t <= s_limits[i])
+		break;
+	hist[i]++;
+    }
+    Lock lck(s_mutex);
+    s_done += done;
+    s_hits += hits;
+    s_time += time;
+    if (maxTime > s_maxTime)
+	s_maxTime = maxTime;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+	s_hist[i] += hist[i];
+    if (--s_running)
+	return;
+    report(Time::now() - s_start);
+}
+
+
+CacheBench::CacheBench()
+    : Plugin("cachebench","misc"),
+      m_first(true)
+{
+    Output("Loaded module CacheBench");
+}
+
+CacheBench::~CacheBench()
+{
+    Output("Unloading module CacheBench");
+}
+
+bool CacheBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_running;
+}
+
+void CacheBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module CacheBench");
+    const NamedList* cfg = Engine::config().getSection("cachebench");
+    if (!cfg) {
+	Output("Cache benchmark needs a [cachebench] section");
+	return;
+    }
+    Engine::install(new CacheBenchDb);
+    Lock lock(s_mutex);
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+	s_hist[i] = 0;
+    s_items = cfg->getIntValue(YSTRING("items"),100000,1);
+    s_count = cfg->getIntValue(YSTRING("count"),100000,1);
+    unsigned int threads = cfg->getIntValue(YSTRING("threads"),8,1,1000);
+    for (unsigned int i = 0; i < threads; i++) {
+	CacheBenchThread* t = new CacheBenchThread;
+	s_running++;
+	if (!t->startup()) {
+	    s_running--;
+	    delete t;
+	}
+    }
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,160 @@
+/**
+ * chanbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Channel creation, lookup and timer check benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+class BenchChan : public Channel
+{
+public:
+    inline BenchChan(Driver* driver)
+	: Channel(driver,0,true)
+	{ }
+    inline bool expired() const
+	{ return getStatus() == YSTRING("noanswer"); }
+};
+
+class ChanBench : public Driver
+{
+public:
+    ChanBench();
+    virtual void initialize();
+    virtual bool msgExecute(Message& msg, String& dest)
+	{ return false; }
+private:
+    void run(unsigned int count, unsigned int lookups, const NamedList& cfg);
+    bool m_first;
+};
+
+INIT_PLUGIN(ChanBench);
+
+
+ChanBench::ChanBench()
+    : Driver("chanbench","varchans"),
+      m_first(true)
+{
+    Output("Hello, I am module ChanBench");
+}
+
+void ChanBench::run(unsigned int count, unsigned int lookups, const NamedList& cfg)
+{
+    unsigned int expiring = count * cfg.getIntValue(YSTRING("expiring"),1,0,100) / 100;
+    ObjList chans;
+    ObjList* add = &chans;
+    String* ids = new String[count];
+    u_int64_t now = Time::now();
+    u_int64_t tCreate = 0;
+    u_int64_t maxCreate = 0;
+    for (unsigned int i = 0; i < count; i++) {
+	u_int64_t t = Time::now();
+	BenchChan* c = new BenchChan(this);
+	c->initChan();
+	// a slow creation shows the channel index being rebuilt
+	t = Time::now() - t;
+	tCreate += t;
+	if (t > maxCreate)
+	    maxCreate = t;
+	// few channels expire now, the others are far from their timeout
+	if (i < expiring)
+	    c->maxcall(now + 100000);
+	else
+	    c->timeout(now + 3600000000);
+	ids[i] = c->id();
+	add = add->append(c);
+    }
+
+    Output("Channel benchmark %6u channels: create %u ns average, %u us max",
+	count,(unsigned int)(1000 * tCreate / count),(unsigned int)maxCreate);
+
+    // channel lookup by id, as done for messages routed to a channel
+    unsigned int found = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < lookups; i++) {
+	Lock lck(this);
+	if (find(ids[Random::random() % count]))
+	    found++;
+    }
+    u_int64_t tIndex = Time::now() - t;
+    // same lookups searching the list of channels
+    unsigned int linear = lookups / 10 + 1;
+    t = Time::now();
+    for (unsigned int i = 0; i < linear; i++) {
+	Lock lck(this);
+	if (channels().find(ids[Random::random() % count]))
+	    found++;
+    }
+    u_int64_t tList = Time::now() - t;
+    Output("Channel benchmark %6u channels: lookup %u ns indexed, %u ns in list, %u/%u found",
+	count,(unsigned int)(1000 * tIndex / lookups),(unsigned int)(1000 * tList / linear),
+	found,lookups + linear);
+
+    // timer check once the maxcall of the expiring channels has passed
+    Thread::msleep(1200);
+    Message msg("engine.timer");
+    t = Time::now();
+    received(msg,Timer);
+    u_int64_t tExpire = Time::now() - t;
+    unsigned int dropped = 0;
+    for (ObjList* l = chans.skipNull(); l; l = l->skipNext())
+	if (static_cast<BenchChan*>(l->get())->expired())
+	    dropped++;
+    // next second nothing expires, compare with visiting every channel
+    Thread::msleep(1000);
+    t = Time::now();
+    received(msg,Timer);
+    u_int64_t tWheel = Time::now() - t;
+    t = Time::now();
+    Time tmr;
+    for (ObjList* l = chans.skipNull(); l; l = l->skipNext())
+	static_cast<Channel*>(l->get())->checkTimers(msg,tmr);
+    u_int64_t tAll = Time::now() - t;
+    Output("Channel benchmark %6u channels: timer %u us expiring %u/%u, idle %u us with wheel, %u us checking all",
+	count,(unsigned int)tExpire,dropped,expiring,(unsigned int)tWheel,(unsigned int)tAll);
+    delete[] ids;
+}
+
+void ChanBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module ChanBench");
+    setup();
+    const NamedList* cfg = Engine::config().getSection("chanbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    unsigned int lookups = cfg->getIntValue(YSTRING("lookups"),100000,1000);
+    ObjList* counts = String(cfg->getValue(YSTRING("channels"),"100,1000,20000")).split(',',false);
+    for (ObjList* l = counts->skipNull(); l; l = l->skipNext()) {
+	int count = static_cast<String*>(l->get())->toInteger(0);
+	if (count > 0)
+	    run(count,lookups,*cfg);
+    }
+    TelEngine::destruct(counts);
+    Output("Channel benchmark finished");
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,284 @@
+/**
+ * confbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Conference mixing benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+
+#include <math.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Samples in a 20ms block at 8kHz
+#define BLOCK_SAMPLES 160
+
+// Counts the mixed data a participant receives
+class BenchConsumer : public DataConsumer
+{
+public:
+    inline BenchConsumer()
+	: m_received(0)
+	{ }
+    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+	{ m_received += data.length(); return invalidStamp(); }
+    inline u_int64_t received() const
+	{ return m_received; }
+private:
+    u_int64_t m_received;
+};
+
+// One conference participant talking all the time
+class BenchEndpoint : public CallEndpoint
+{
+public:
+    BenchEndpoint(const String& id, unsigned int phase);
+    virtual ~BenchEndpoint();
+    bool join(const String& room, unsigned int users, bool pooled);
+    void send(const DataBlock* blocks, unsigned int count, unsigned long tStamp);
+    inline u_int64_t received() const
+	{ return m_cons->received(); }
+private:
+    DataSource* m_src;
+    BenchConsumer* m_cons;
+    unsigned int m_phase;
+};
+
+class BenchThread : public Thread
+{
+public:
+    inline BenchThread()
+	: Thread("ConfBench")
+	{ }
+    virtual void run();
+private:
+    bool runTest(unsigned int rooms, unsigned int users, bool pooled, const NamedList& cfg);
+};
+
+class ConfBench : public Plugin
+{
+public:
+    ConfBench();
+    virtual ~ConfBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static Mutex s_mutex(false,"ConfBench");
+static bool s_running = false;
+
+// Number of different blocks of voice like data
+static const unsigned int s_blocks = 16;
+
+INIT_PLUGIN(ConfBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+BenchEndpoint::BenchEndpoint(const String& id, unsigned int phase)
+    : CallEndpoint(id),
+      m_src(new DataSource), m_cons(new BenchConsumer), m_phase(phase)
+{
+    setSource(m_src);
+    setConsumer(m_cons);
+}
+
+BenchEndpoint::~BenchEndpoint()
+{
+    TelEngine::destruct(m_src);
+    TelEngine::destruct(m_cons);
+}
+
+bool BenchEndpoint::join(const String& room, unsigned int users, bool pooled)
+{
+    Message m("call.execute");
+    m.userData(this);
+    m.addParam("id",id());
+    m.addParam("callto",room);
+    m.addParam("maxusers",String(users));
+    m.addParam("pooled",String::boolText(pooled));
+    m.addParam("lonely",String::boolText(true));
+    return Engine::dispatch(m);
+}
+
+void BenchEndpoint::send(const DataBlock* blocks, unsigned int count, unsigned long tStamp)
+{
+    m_src->Forward(blocks[(m_phase + tStamp / BLOCK_SAMPLES) % count],tStamp);
+}
+
+
+bool BenchThread::runTest(unsigned int rooms, unsigned int users, bool pooled, const NamedList& cfg)
+{
+    int duration = cfg.getIntValue(YSTRING("duration"),5000,500,60000);
+    unsigned int total = rooms * users;
+    // a tone with a slowly changing pitch and some noise is detected as speech
+    DataBlock blocks[s_blocks];
+    for (unsigned int b = 0; b < s_blocks; b++) {
+	blocks[b].assign(0,BLOCK_SAMPLES * sizeof(int16_t));
+	int16_t* p = (int16_t*)blocks[b].data();
+	for (unsigned int i = 0; i < BLOCK_SAMPLES; i++) {
+	    double t = (b * BLOCK_SAMPLES + i) / 8000.0;
+	    p[i] = (int16_t)(6000 * ::sin(2 * M_PI * (300 + 20 * b) * t) + (Random::random() % 1000) - 500);
+	}
+    }
+
+    ObjList list;
+    ObjList* add = &list;
+    unsigned int joined = 0;
+    for (unsigned int r = 0; r < rooms; r++) {
+	String room;
+	room << "conf/bench-" << r;
+	for (unsigned int u = 0; u < users; u++) {
+	    String id;
+	    id << "confbench/" << r << "-" << u;
+	    BenchEndpoint* ep = new BenchEndpoint(id,r + u);
+	    add = add->append(ep);
+	    if (ep->join(room,users,pooled))
+		joined++;
+	}
+    }
+    if (joined != total) {
+	Debug("confbench",DebugWarn,"Only %u of %u participants joined, is the conference module loaded?",
+	    joined,total);
+	for (ObjList* l = list.skipNull(); l; l = l->skipNext())
+	    static_cast<BenchEndpoint*>(l->get())->disconnect();
+	list.clear();
+	return false;
+    }
+
+    u_int64_t cpu = SysUsage::usecRunTime(SysUsage::UserTime) + SysUsage::usecRunTime(SysUsage::KernelTime);
+    u_int64_t start = Time::now();
+    u_int64_t stop = start + 1000 * (u_int64_t)duration;
+    u_int64_t next = start;
+    unsigned long tStamp = 0;
+    unsigned int sent = 0;
+    while (!Engine::exiting()) {
+	u_int64_t now = Time::now();
+	if (now >= stop)
+	    break;
+	if (now < next) {
+	    Thread::usleep(next - now);
+	    continue;
+	}
+	next += 20000;
+	for (ObjList* l = list.skipNull(); l; l = l->skipNext())
+	    static_cast<BenchEndpoint*>(l->get())->send(blocks,s_blocks,tStamp);
+	tStamp += BLOCK_SAMPLES;
+	sent++;
+    }
+    // let the mixers flush the buffered data
+    Thread::msleep(100);
+    u_int64_t elapsed = Time::now() - start;
+    cpu = SysUsage::usecRunTime(SysUsage::UserTime) + SysUsage::usecRunTime(SysUsage::KernelTime) - cpu;
+    u_int64_t received = 0;
+    for (ObjList* l = list.skipNull(); l; l = l->skipNext()) {
+	BenchEndpoint* ep = static_cast<BenchEndpoint*>(l->get());
+	received += ep->received();
+	ep->disconnect();
+    }
+    list.clear();
+
+    u_int64_t expected = (u_int64_t)sent * total * BLOCK_SAMPLES * sizeof(int16_t);
+    unsigned int load = elapsed ? (unsigned int)(100000 * cpu / elapsed) : 0;
+    unsigned int perUser = load * 100 / total;
+    Output("Conference benchmark %-6s %4u rooms x %3u users: CPU %u.%u%% (%u.%03u%% per 100 users), %u%% of mix delivered",
+	(pooled ? "pooled" : "inline"),rooms,users,load / 1000,(load % 1000) / 100,
+	perUser / 1000,perUser % 1000,
+	(unsigned int)(expected ? (100 * received / expected) : 0));
+    // let the rooms go away
+    Thread::msleep(200);
+    return true;
+}
+
+void BenchThread::run()
+{
+    const NamedList* cfg = Engine::config().getSection("confbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    // wait for the engine to finish initializing the other modules
+    while (!(Engine::started() || Engine::exiting()))
+	Thread::idle();
+    Message m("engine.status");
+    m.addParam("module","conf");
+    Engine::dispatch(m);
+    m.retValue().trimBlanks();
+    Output("Conference benchmark: %s",m.retValue().c_str());
+    // each test is rooms x users
+    ObjList* tests = String(cfg->getValue(YSTRING("tests"),"100x3,20x20,5x100,1x200")).split(',',false);
+    bool pooled = cfg->getBoolValue(YSTRING("pooled"),true);
+    for (ObjList* l = tests->skipNull(); l && !Engine::exiting(); l = l->skipNext()) {
+	String* t = static_cast<String*>(l->get());
+	int x = t->find('x');
+	if (x <= 0)
+	    continue;
+	int rooms = t->substr(0,x).toInteger(0);
+	int users = t->substr(x + 1).toInteger(0);
+	if ((rooms <= 0) || (users <= 0))
+	    continue;
+	if (!runTest(rooms,users,false,*cfg))
+	    break;
+	if (pooled && !Engine::exiting())
+	    runTest(rooms,users,true,*cfg);
+    }
+    TelEngine::destruct(tests);
+    Output("Conference benchmark finished");
+    Lock lock(s_mutex);
+    s_running = false;
+}
+
+
+ConfBench::ConfBench()
+    : Plugin("confbench","misc"),
+      m_first(true)
+{
+    Output("Loaded module ConfBench");
+}
+
+ConfBench::~ConfBench()
+{
+    Output("Unloading module ConfBench");
+}
+
+bool ConfBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_running;
+}
+
+void ConfBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module ConfBench");
+    s_running = true;
+    (new BenchThread)->startup();
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,228 @@
+/**
+ * dbbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Database query throughput and latency benchmark
+ *
+ * Dispatches "database" messages for an account from several threads, e.g.:
+ *  [dbbench]
+ *  account=default
+ *  query=SELECT $1::int + 1
+ *  params=1
+ *  param.1=${seq}
+ *  threads=16
+ *  count=1000
+ * Parameter values can use ${seq} (query number) and ${thread} (thread number).
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Upper limits of the latency histogram in microseconds, last bucket holds the rest
+static const unsigned int s_limits[] = { 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+#define BENCH_BUCKETS (sizeof(s_limits) / sizeof(unsigned int) + 1)
+
+class DbBenchThread : public Thread
+{
+public:
+    inline DbBenchThread()
+	: Thread("DbBench")
+	{ }
+    virtual void run();
+};
+
+class DbBench : public Plugin
+{
+public:
+    DbBench();
+    virtual ~DbBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static Mutex s_mutex(false,"DbBench");
+static NamedList s_cfg("");
+static unsigned int s_running = 0;
+static unsigned int s_ok = 0;
+static unsigned int s_failed = 0;
+static u_int64_t s_time = 0;
+static u_int64_t s_maxTime = 0;
+static unsigned int s_hist[BENCH_BUCKETS];
+static unsigned int s_index = 0;
+static unsigned int s_count = 0;
+static u_int64_t s_start = 0;
+
+INIT_PLUGIN(DbBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+// Print the results once the last thread finished
+static void report(u_int64_t total)
+{
+    String hist;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++) {
+	if (i < BENCH_BUCKETS - 1)
+	    hist.append(String(s_limits[i])," ");
+	else
+	    hist.append("+"," ");
+	hist << ":" << s_hist[i];
+    }
+    unsigned int done = s_ok + s_failed;
+    Output("Database benchmark '%s': %u queries (%u failed) in %u ms, " FMT64U " per second",
+	s_cfg.getValue(YSTRING("account")),done,s_failed,(unsigned int)(total / 1000),
+	total ? (1000000 * (u_int64_t)done / total) : 0);
+    Output("Database benchmark '%s': latency average %u us, max %u us, histogram %s",
+	s_cfg.getValue(YSTRING("account")),done ? (unsigned int)(s_time / done) : 0,
+	(unsigned int)s_maxTime,hist.c_str());
+    Output("Database benchmark finished");
+}
+
+
+void DbBenchThread::run()
+{
+    // wait for the engine to finish initializing the database modules
+    while (!(Engine::started() || Engine::exiting()))
+	Thread::idle();
+    Thread::msleep(s_cfg.getIntValue(YSTRING("delay"),1000,0,60000));
+    s_mutex.lock();
+    unsigned int index = ++s_index;
+    if (index == 1)
+	s_start = Time::now();
+    NamedList cfg(s_cfg);
+    s_mutex.unlock();
+    const String& account = cfg[YSTRING("account")];
+    const String& query = cfg[YSTRING("query")];
+    int params = cfg.getIntValue(YSTRING("params"),-1,-1,100);
+    unsigned int ok = 0;
+    unsigned int failed = 0;
+    u_int64_t time = 0;
+    u_int64_t maxTime = 0;
+    unsigned int hist[BENCH_BUCKETS];
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+	hist[i] = 0;
+    for (unsigned int n = 0; (n < s_count) && !Engine::exiting(); n++) {
+	Message m("database");
+	m.addParam("account",account);
+	m.addParam("query",query);
+	m.addParam("results",String::boolText(cfg.getBoolValue(YSTRING("results"))));
+	if (params >= 0) {
+	    NamedList vars("");
+	    vars.addParam("seq",String(index * s_count + n));
+	    vars.addParam("thread",String(index));
+	    m.addParam("params",String(params));
+	    for (int i = 1; i <= params; i++) {
+		String name("param.");
+		name << i;
+		const String* p = cfg.getParam(name);
+		if (!p)
+		    continue;
+		String val = *p;
+		vars.replaceParams(val);
+		m.addParam(name,val);
+	    }
+	}
+	u_int64_t t = Time::now();
+	bool done = Engine::dispatch(m) && !m.getParam(YSTRING("error"));
+	t = Time::now() - t;
+	if (done)
+	    ok++;
+	else {
+	    if (!failed)
+		Debug("dbbench",DebugWarn,"Query failed: %s",m.getValue(YSTRING("error"),"not handled"));
+	    failed++;
+	}
+	time += t;
+	if (t > maxTime)
+	    maxTime = t;
+	unsigned int i = 0;
+	for (; i < BENCH_BUCKETS - 1; i++)
+	    if (t <= s_limits[i])
+		break;
+	hist[i]++;
+    }
+    Lock lck(s_mutex);
+    s_ok += ok;
+    s_failed += failed;
+    s_time += time;
+    if (maxTime > s_maxTime)
+	s_maxTime = maxTime;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+	s_hist[i] += hist[i];
+    if (--s_running)
+	return;
+    report(Time::now() - s_start);
+}
+
+
+DbBench::DbBench()
+    : Plugin("dbbench","misc"),
+      m_first(true)
+{
+    Output("Loaded module DbBench");
+}
+
+DbBench::~DbBench()
+{
+    Output("Unloading module DbBench");
+}
+
+bool DbBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_running;
+}
+
+void DbBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module DbBench");
+    const NamedList* cfg = Engine::config().getSection("dbbench");
+    if (!(cfg && cfg->getValue(YSTRING("account")) && cfg->getValue(YSTRING("query")))) {
+	Output("Database benchmark needs an account and a query in section [dbbench]");
+	return;
+    }
+    Lock lock(s_mutex);
+    s_cfg = *cfg;
+    for (unsigned int i = 0; i < BENCH_BUCKETS; i++)
+	s_hist[i] = 0;
+    unsigned int threads = cfg->getIntValue(YSTRING("threads"),8,1,1000);
+    s_count = cfg->getIntValue(YSTRING("count"),1000,1);
+    for (unsigned int i = 0; i < threads; i++) {
+	DbBenchThread* t = new DbBenchThread;
+	s_running++;
+	if (!t->startup()) {
+	    s_running--;
+	    delete t;
+	}
+    }
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
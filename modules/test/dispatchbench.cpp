@@ -0,0 +1,218 @@
+/**
+ * dispatchbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Message dispatcher contention benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Names the benchmark handlers are spread on, the first ones are dispatched
+static const char* s_names[] = {
+    "bench.route", "bench.notify", "bench.execute", "bench.cdr",
+    "bench.status", "bench.timer", "bench.update", "bench.hangup",
+    0
+};
+
+class BenchHandler : public MessageHandler
+{
+public:
+    inline BenchHandler(const char* name, unsigned prio, bool accept)
+	: MessageHandler(name,prio,"dispatchbench"), m_accept(accept)
+	{ }
+    virtual bool received(Message& msg);
+private:
+    bool m_accept;
+};
+
+class BenchWorker : public Thread
+{
+public:
+    inline BenchWorker(u_int64_t stop)
+	: Thread("DispatchBench"), m_stop(stop)
+	{ }
+    virtual void run();
+private:
+    u_int64_t m_stop;
+};
+
+class BenchThread : public Thread
+{
+public:
+    inline BenchThread()
+	: Thread("DispatchBenchMain")
+	{ }
+    virtual void run();
+};
+
+class DispatchBench : public Plugin
+{
+public:
+    DispatchBench();
+    virtual ~DispatchBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static ObjList s_handlers;
+static Mutex s_mutex(false,"DispatchBench");
+static u_int64_t s_count = 0;
+static int s_running = 0;
+
+INIT_PLUGIN(DispatchBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+bool BenchHandler::received(Message& msg)
+{
+    // some typical parameter probing
+    if (msg.getParam(YSTRING("nonexistent")))
+	return false;
+    return m_accept && msg.getBoolValue(YSTRING("accept"),true);
+}
+
+
+void BenchWorker::run()
+{
+    unsigned int n = 0;
+    u_int64_t count = 0;
+    while (!Engine::exiting()) {
+	// check the clock only once in a while
+	if (!(count & 0xff) && (Time::now() >= m_stop))
+	    break;
+	Message m(s_names[n]);
+	m.addParam("id","bench/1");
+	m.addParam("caller","1234");
+	m.addParam("called","5678");
+	n = (n + 1) % 4;
+	Engine::dispatch(m);
+	count++;
+    }
+    Lock lock(s_mutex);
+    s_count += count;
+    s_running--;
+}
+
+
+void BenchThread::run()
+{
+    const NamedList* cfg = Engine::config().getSection("dispatchbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    int handlers = cfg->getIntValue(YSTRING("handlers"),300,10,10000);
+    int broadcast = cfg->getIntValue(YSTRING("broadcast"),4,0,100);
+    int maxThreads = cfg->getIntValue(YSTRING("threads"),32,1,256);
+    int duration = cfg->getIntValue(YSTRING("duration"),2000,100,60000);
+
+    int named = 0;
+    while (s_names[named])
+	named++;
+    for (int i = 0; i < handlers; i++) {
+	// the last handler of each name accepts the message
+	bool accept = (i >= handlers - named);
+	BenchHandler* h = new BenchHandler(s_names[i % named],10 + i,accept);
+	s_handlers.append(h);
+	Engine::install(h);
+    }
+    for (int i = 0; i < broadcast; i++) {
+	BenchHandler* h = new BenchHandler(0,5 + i * 20,false);
+	s_handlers.append(h);
+	Engine::install(h);
+    }
+    Output("Dispatch benchmark: %d handlers on %d names, %d broadcast, %d msec per run",
+	handlers,named,broadcast,duration);
+
+    u_int64_t single = 0;
+    for (int threads = 1; threads <= maxThreads && !Engine::exiting(); threads *= 2) {
+	s_mutex.lock();
+	s_count = 0;
+	s_running = threads;
+	s_mutex.unlock();
+	u_int64_t start = Time::now();
+	u_int64_t stop = start + 1000 * (u_int64_t)duration;
+	for (int i = 0; i < threads; i++) {
+	    BenchWorker* w = new BenchWorker(stop);
+	    if (!w->startup()) {
+		Debug("dispatchbench",DebugWarn,"Failed to start worker thread");
+		delete w;
+		Lock lock(s_mutex);
+		s_running--;
+	    }
+	}
+	for (;;) {
+	    Thread::idle();
+	    Lock lock(s_mutex);
+	    if (s_running <= 0)
+		break;
+	}
+	u_int64_t elapsed = Time::now() - start;
+	u_int64_t rate = elapsed ? (1000000 * s_count / elapsed) : 0;
+	if (threads == 1)
+	    single = rate;
+	Output("Dispatch benchmark: %2d threads " FMT64U " msg/s (" FMT64U " per thread) scaling %u%%",
+	    threads,rate,rate / threads,(unsigned int)(single ? (100 * rate / single) : 0));
+    }
+
+    for (ObjList* l = s_handlers.skipNull(); l; l = l->skipNext())
+	Engine::uninstall(static_cast<MessageHandler*>(l->get()));
+    s_handlers.clear();
+    Output("Dispatch benchmark finished");
+}
+
+
+DispatchBench::DispatchBench()
+    : Plugin("dispatchbench","misc"),
+      m_first(true)
+{
+    Output("Loaded module DispatchBench");
+}
+
+DispatchBench::~DispatchBench()
+{
+    Output("Unloading module DispatchBench");
+}
+
+bool DispatchBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_handlers.skipNull();
+}
+
+void DispatchBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module DispatchBench");
+    (new BenchThread)->startup();
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
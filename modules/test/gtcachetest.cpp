@@ -0,0 +1,178 @@
+/**
+ * gtcachetest.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Global Title translation cache test
+ *
+ * Routes addresses through a ysigchan GTT with the cache enabled and checks
+ *  that cached translations don't leak the addresses of other messages, e.g.:
+ *  [gtcachetest]
+ *  gtt=gtt-test
+ * The GTT must use a 5 digit cache key, in ysigchan.conf:
+ *  [sccp-test]
+ *  type=ss7-sccp
+ *  pointcodetype=ITU
+ *  localpointcode=1-1-1
+ *  [gtt-test]
+ *  type=ss7-gtt
+ *  sccp=sccp-test
+ *  cache_size=100
+ *  cache_digits=5
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+#include <yatesig.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+class GTCacheTestThread : public Thread
+{
+public:
+    inline GTCacheTestThread()
+	: Thread("GTCacheTest")
+	{ }
+    virtual void run();
+};
+
+// Translates "40xxx" into "0xxx", rewrites the calling party of "999xxx"
+class GTCacheRoute : public MessageHandler
+{
+public:
+    inline GTCacheRoute()
+	: MessageHandler("sccp.route",50,"gtcachetest")
+	{ }
+    virtual bool received(Message& msg);
+};
+
+class GTCacheTest : public Plugin
+{
+public:
+    GTCacheTest();
+    virtual ~GTCacheTest();
+    virtual void initialize();
+private:
+    bool m_first;
+};
+
+static String s_gtt;
+static int s_routed = 0;
+static unsigned int s_failed = 0;
+
+INIT_PLUGIN(GTCacheTest);
+
+
+bool GTCacheRoute::received(Message& msg)
+{
+    // the translated address comes without prefix
+    const String& called = msg[YSTRING("gt")];
+    if (!called)
+	return false;
+    s_routed++;
+    msg.setParam("pointcode","2-2-2");
+    msg.setParam("ssn","6");
+    if (called.startsWith("999"))
+	msg.setParam("CallingPartyAddress.gt","000");
+    if (called.startsWith("40"))
+	msg.setParam("gt","0" + called.substr(2));
+    return true;
+}
+
+
+// Route one address, check the translated GT, calling party and dispatch count
+static void checkRoute(GTT* gtt, const char* called, const char* calling,
+    const char* expGt, const char* expCalling, int expRouted)
+{
+    NamedList gt("");
+    gt.addParam("LocalPC","1-1-1");
+    gt.addParam("CalledPartyAddress.gt",called);
+    gt.addParam("CalledPartyAddress.route","gt");
+    gt.addParam("CallingPartyAddress.gt",calling);
+    gt.addParam("CallingPartyAddress.ssn","8");
+    NamedList* route = gtt->routeGT(gt,"CalledPartyAddress","CallingPartyAddress");
+    const char* resGt = route ? route->getValue(YSTRING("gt")) : 0;
+    // the calling party of the message is kept if the route doesn't hold one
+    const char* resCalling = route ?
+	route->getValue(YSTRING("CallingPartyAddress.gt"),calling) : 0;
+    if (String(resGt) != expGt || String(resCalling) != expCalling || s_routed != expRouted) {
+	Output("GT cache test FAILED: %s from %s translated to gt=%s calling=%s"
+	    " after %d routes, expected gt=%s calling=%s after %d routes",
+	    called,calling,resGt,resCalling,s_routed,expGt,expCalling,expRouted);
+	s_failed++;
+    }
+    TelEngine::destruct(route);
+}
+
+void GTCacheTestThread::run()
+{
+    while (!(Engine::started() || Engine::exiting()))
+	Thread::idle();
+    RefPointer<GTT> gtt;
+    SignallingEngine* engine = SignallingEngine::self();
+    if (engine)
+	gtt = YOBJECT(GTT,engine->find(s_gtt,YSTRING("GTT")));
+    if (!gtt) {
+	Output("GT cache test: GTT '%s' not found",s_gtt.c_str());
+	Output("GT cache test finished");
+	return;
+    }
+    // two calling parties sharing the cache key of the called address
+    checkRoute(gtt,"40721000001","111","0721000001","111",1);
+    checkRoute(gtt,"40721000002","222","0721000002","222",1);
+    checkRoute(gtt,"40721000001","333","0721000001","333",1);
+    // the GT made of the key digits alone is translated on its own
+    checkRoute(gtt,"40721","444","0721","444",2);
+    checkRoute(gtt,"40721000003","555","0721000003","555",2);
+    // routes rewriting the calling party are never reused
+    checkRoute(gtt,"99912345678","666","99912345678","000",3);
+    checkRoute(gtt,"99912345678","777","99912345678","000",4);
+    Output("GT cache test %s, %d routes dispatched",s_failed ? "FAILED" : "passed",s_routed);
+    Output("GT cache test finished");
+}
+
+
+GTCacheTest::GTCacheTest()
+    : Plugin("gtcachetest","misc"),
+      m_first(true)
+{
+    Output("Loaded module GTCacheTest");
+}
+
+GTCacheTest::~GTCacheTest()
+{
+    Output("Unloading module GTCacheTest");
+}
+
+void GTCacheTest::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module GTCacheTest");
+    const NamedList* cfg = Engine::config().getSection("gtcachetest");
+    if (!cfg) {
+	Output("GT cache test needs a [gtcachetest] section");
+	return;
+    }
+    s_gtt = cfg->getValue(YSTRING("gtt"),"gtt-test");
+    Engine::install(new GTCacheRoute);
+    (new GTCacheTestThread)->startup();
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,231 @@
+/**
+ * jsbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Javascript interpreter benchmark with routing script patterns
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+#include <yatescript.h>
+
+using namespace TelEngine;
+
+class JsBench : public Plugin
+{
+public:
+    JsBench();
+    virtual void initialize();
+private:
+    void run(ScriptRun* runner, const char* func, const char* desc, unsigned int calls, int arg);
+    bool m_first;
+};
+
+// Message-like object resolving unknown fields from a native parameters list
+class BenchMessage : public JsObject
+{
+public:
+    inline BenchMessage(ScriptMutex* mtx)
+	: JsObject(mtx,"[object Message]",0),
+	  m_msg("call.route")
+	{ }
+    virtual NamedList* nativeParams() const
+	{ return const_cast<NamedList*>(&m_msg); }
+    NamedList m_msg;
+};
+
+// Small helpers called for every route like typical regexroute replacements do
+static const char* s_script =
+    "var prefixes = { '4021':'bucharest', '4026':'cluj', '4023':'iasi' };\n"
+    "var gateways = ['gw0','gw1','gw2','gw3'];\n"
+    "var hits = 0;\n"
+    "function normalize(num)\n"
+    "{\n"
+    "    if (num.startsWith('+'))\n"
+    "\tnum = num.substr(1);\n"
+    "    else if (num.startsWith('00'))\n"
+    "\tnum = num.substr(2);\n"
+    "    else if (num.startsWith('0'))\n"
+    "\tnum = '40' + num.substr(1);\n"
+    "    return num;\n"
+    "}\n"
+    "function isLocal(num)\n"
+    "{\n"
+    "    return num.length <= 4;\n"
+    "}\n"
+    "function pick(num)\n"
+    "{\n"
+    "    var sum = 0;\n"
+    "    for (var i = num.length - 4; i < num.length; i++)\n"
+    "\tsum += parseInt(num.charAt(i));\n"
+    "    return sum % gateways.length;\n"
+    "}\n"
+    "function route(called, caller)\n"
+    "{\n"
+    "    var num = normalize(called);\n"
+    "    if (isLocal(num))\n"
+    "\treturn 'sip/sip:' + num + '@local';\n"
+    "    var area = prefixes[num.substr(0,4)];\n"
+    "    if (area)\n"
+    "\thits++;\n"
+    "    switch (caller.substr(0,1)) {\n"
+    "\tcase '1':\n"
+    "\t    return 'sip/sip:' + num + '@' + gateways[0];\n"
+    "\tcase '2':\n"
+    "\t    return 'sip/sip:' + num + '@' + gateways[1];\n"
+    "    }\n"
+    "    return 'sip/sip:' + num + '@' + gateways[pick(num)];\n"
+    "}\n"
+    "function helpers(count)\n"
+    "{\n"
+    "    var n = 0;\n"
+    "    for (var i = 0; i < count; i++) {\n"
+    "\tif (isLocal('' + i))\n"
+    "\t    n++;\n"
+    "\tn += pick('40213' + i);\n"
+    "    }\n"
+    "    return n;\n"
+    "}\n"
+    "function arith(count)\n"
+    "{\n"
+    "    var a = 0, b = 1;\n"
+    "    for (var i = 0; i < count; i++) {\n"
+    "\ta = (a + b * 3) % 1000003;\n"
+    "\tb = (b << 1) ^ (i & 255);\n"
+    "\tif (b > 65535)\n"
+    "\t    b = b - 65535;\n"
+    "    }\n"
+    "    return a;\n"
+    "}\n"
+    "function fields(count)\n"
+    "{\n"
+    "    var n = 0;\n"
+    "    for (var i = 0; i < count; i++) {\n"
+    "\tif (message.called == message.caller)\n"
+    "\t    n++;\n"
+    "\tif (message.billid != '')\n"
+    "\t    n++;\n"
+    "\tn += message.callto.length;\n"
+    "\thits++;\n"
+    "    }\n"
+    "    return n;\n"
+    "}\n";
+
+// Parameters of a typical call.route message
+static const char* s_routeParams[] = {
+    "id", "sip/1234", "module", "sip", "status", "incoming", "address", "10.0.0.1:5060",
+    "billid", "1412345678-12", "answered", "false", "direction", "incoming",
+    "callid", "sip/abcdef@10.0.0.1/1234/", "caller", "1000", "called", "0723123456",
+    "callername", "Alice", "format", "alaw", "formats", "alaw,mulaw,gsm",
+    "rtp_forward", "possible", "sip_uri", "sip:0723123456@10.0.0.2",
+    "sip_from", "sip:1000@10.0.0.1", "sip_to", "sip:0723123456@10.0.0.2",
+    "sip_callid", "abcdef@10.0.0.1", "sip_contact", "<sip:1000@10.0.0.1:5060>",
+    "sip_user-agent", "Phone/1.0", "device", "Phone/1.0", "ip_host", "10.0.0.1",
+    "ip_port", "5060", "ip_transport", "UDP", "callto", "sip/sip:0723123456@10.0.0.2",
+    "handlers", "javascript:15,regexroute:100", 0
+};
+
+JsBench::JsBench()
+    : Plugin("jsbench"),
+      m_first(true)
+{
+    Output("Hello, I am module JsBench");
+}
+
+// Call a script function repeatedly from native code, one call per route
+void JsBench::run(ScriptRun* runner, const char* func, const char* desc, unsigned int calls, int arg)
+{
+    static const char* s_called[] = { "+40215550101", "0040264123456", "0723123456", "1234", 0 };
+    unsigned int ok = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < calls; i++) {
+	ObjList args;
+	if (arg < 0) {
+	    args.append(new ExpOperation(s_called[i & 3]));
+	    args.append(new ExpOperation((i & 4) ? "1000" : "3000"));
+	}
+	else
+	    args.append(new ExpOperation((int64_t)arg));
+	if (ScriptRun::Succeeded == runner->call(func,args))
+	    ok++;
+	TelEngine::destruct(ExpEvaluator::popOne(runner->stack()));
+    }
+    t = Time::now() - t;
+    unsigned int ops = calls * (arg < 0 ? 1 : arg);
+    Output("JS %-8s %-28s: %u/%u calls, %u ns per %s",
+	func,desc,ok,calls,(unsigned int)(ops ? (1000 * t / ops) : 0),
+	(arg < 0 ? "call" : "iteration"));
+}
+
+void JsBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module JsBench");
+    const NamedList* cfg = Engine::config().getSection("jsbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    unsigned int calls = cfg->getIntValue(YSTRING("calls"),20000,100,10000000);
+    unsigned int funcs = cfg->getIntValue(YSTRING("functions"),500,0,100000);
+    // large scripts define many functions before the ones called often
+    String script;
+    for (unsigned int i = 0; i < funcs; i++)
+	script << "function unused" << i << "(a)\n{\n    if (a > " << i << ")\n"
+	    "\treturn a - " << i << ";\n    return a + " << i << ";\n}\n";
+    script << s_script;
+    JsParser parser;
+    parser.link(cfg->getBoolValue(YSTRING("link"),true));
+    u_int64_t t = Time::now();
+    if (!parser.parse(script)) {
+	Debug("jsbench",DebugWarn,"Failed to parse benchmark script");
+	return;
+    }
+    t = Time::now() - t;
+    Output("JS parsed and linked %u bytes with %u extra functions in %u ms",
+	script.length(),funcs,(unsigned int)(t / 1000));
+    ScriptContext* ctx = parser.createContext();
+    ScriptRun* runner = parser.createRunner(ctx,"[jsbench]");
+    // a message with prototype and native parameters like a routing script sees
+    JsObject* proto = new JsObject("Message",0,true);
+    static const char* s_methods[] = { "enqueue", "dispatch", "name", "broadcast", "retValue",
+	"msgTime", "msgAge", "getParam", "setParam", "getColumn", "getRow", "getResult",
+	"copyParams", "clearParam", "trace", 0 };
+    for (const char** m = s_methods; *m; m++)
+	proto->params().addParam(new ExpFunction(*m));
+    JsObject::addConstructor(ctx->params(),"Message",proto);
+    BenchMessage* msg = new BenchMessage(0);
+    for (const char** p = s_routeParams; *p; p += 2)
+	msg->m_msg.addParam(p[0],p[1]);
+    msg->setPrototype(ctx,YSTRING("Message"));
+    JsObject::addObject(ctx->params(),"message",msg);
+    TelEngine::destruct(ctx);
+    if (!runner || runner->run() != ScriptRun::Succeeded) {
+	Debug("jsbench",DebugWarn,"Failed to initialize benchmark script");
+	TelEngine::destruct(runner);
+	return;
+    }
+    run(runner,"route","native call per route",calls,-1);
+    run(runner,"helpers","script calling helpers",10,calls);
+    run(runner,"arith","numeric loop",10,10 * calls);
+    run(runner,"fields","message and global fields",10,calls);
+    TelEngine::destruct(runner);
+}
+
+INIT_PLUGIN(JsBench);
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
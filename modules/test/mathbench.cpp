@@ -0,0 +1,177 @@
+/**
+ * mathbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Math vector operations benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+#include <yatemath.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+class MathBench : public Plugin
+{
+public:
+    MathBench();
+    virtual void initialize();
+private:
+    bool m_first;
+};
+
+// Data the operations work on, the result is kept to check the implementations
+class BenchData
+{
+public:
+    BenchData(unsigned int len);
+    ~BenchData();
+    unsigned int m_len;
+    ComplexVector m_a;
+    ComplexVector m_b;
+    FloatVector m_f;
+    int16_t* m_i16;
+    float m_res[2];
+};
+
+typedef void (*BenchOp)(BenchData& d);
+
+static void opSumF(BenchData& d)
+{
+    d.m_res[0] = d.m_f.sum();
+    d.m_res[1] = 0;
+}
+
+static void opSumMulC(BenchData& d)
+{
+    Complex c = d.m_a.sumMul(d.m_b);
+    d.m_res[0] = c.re();
+    d.m_res[1] = c.im();
+}
+
+static void opSumNorm2(BenchData& d)
+{
+    d.m_res[0] = Math::sumNorm2(d.m_a.data(),d.m_a.length());
+    d.m_res[1] = 0;
+}
+
+static void opToInt16(BenchData& d)
+{
+    Math::floatToInt16(d.m_i16,(const float*)d.m_a.data(),2 * d.m_len,2047 * 16.0F,1900 * 16.0F,4);
+    d.m_res[0] = d.m_i16[0] + d.m_i16[d.m_len];
+    d.m_res[1] = d.m_i16[2 * d.m_len - 1];
+}
+
+static void opToFloat(BenchData& d)
+{
+    Math::int16ToFloat((float*)d.m_b.data(),d.m_i16,2 * d.m_len,1.0F / 2048);
+    d.m_res[0] = d.m_b[0].re() + d.m_b[d.m_len / 2].im();
+    d.m_res[1] = d.m_b[d.m_len - 1].im();
+}
+
+static const struct {
+    const char* name;
+    BenchOp op;
+    unsigned int elements;               // Elements processed for each sample
+} s_ops[] = {
+    { "sum(float)", opSumF, 1 },
+    { "sumMul(complex)", opSumMulC, 1 },
+    { "sumNorm2(complex)", opSumNorm2, 1 },
+    { "floatToInt16", opToInt16, 2 },
+    { "int16ToFloat", opToFloat, 2 },
+    { 0, 0, 0 }
+};
+
+INIT_PLUGIN(MathBench);
+
+
+BenchData::BenchData(unsigned int len)
+    : m_len(len), m_a(len), m_b(len), m_f(len), m_i16(new int16_t[2 * len])
+{
+    // noisy tone with some values out of the 16 bit range after scaling
+    for (unsigned int i = 0; i < len; i++) {
+	float noise = (Random::random() % 2001 - 1000) / 10000.0F;
+	m_a[i].set(::cosf(0.01F * i) + noise,::sinf(0.01F * i) * 1.2F);
+	m_b[i].set(::cosf(0.03F * i),-::sinf(0.03F * i));
+	m_f[i] = m_a[i].re();
+    }
+    Math::floatToInt16(m_i16,(const float*)m_a.data(),2 * len,2047.0F,2047.0F);
+    m_res[0] = m_res[1] = 0;
+}
+
+BenchData::~BenchData()
+{
+    delete[] m_i16;
+}
+
+
+MathBench::MathBench()
+    : Plugin("mathbench"),
+      m_first(true)
+{
+    Output("Hello, I am module MathBench");
+}
+
+// Run an operation, return the time spent for each sample in ns
+static double runOp(BenchOp op, BenchData& d, unsigned int msec, unsigned int elements)
+{
+    u_int64_t samples = 0;
+    u_int64_t start = Time::now();
+    u_int64_t stop = start + 1000 * (u_int64_t)msec;
+    u_int64_t now = start;
+    while (now < stop) {
+	for (int i = 0; i < 16; i++)
+	    op(d);
+	samples += 16 * (u_int64_t)d.m_len * elements;
+	now = Time::now();
+    }
+    return samples ? (1000.0 * (now - start) / samples) : 0;
+}
+
+void MathBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module MathBench");
+    const NamedList* cfg = Engine::config().getSection("mathbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    unsigned int len = cfg->getIntValue(YSTRING("length"),4096,16,1048576);
+    unsigned int msec = cfg->getIntValue(YSTRING("duration"),500,50,10000);
+    String best = Math::simd(true);
+    BenchData d(len);
+    for (unsigned int i = 0; s_ops[i].name; i++) {
+	Math::simd(false);
+	double scalar = runOp(s_ops[i].op,d,msec,s_ops[i].elements);
+	float ref[2] = { d.m_res[0], d.m_res[1] };
+	Math::simd(true);
+	double simd = runOp(s_ops[i].op,d,msec,s_ops[i].elements);
+	// vector sums add in a different order, results differ by rounding
+	float diff = ::fabsf(d.m_res[0] - ref[0]) + ::fabsf(d.m_res[1] - ref[1]);
+	float mag = ::fabsf(ref[0]) + ::fabsf(ref[1]);
+	Output("Math benchmark %-18s %u samples: scalar %.3f ns, %s %.3f ns per sample (x%.1f), relative difference %g",
+	    s_ops[i].name,len,scalar,best.c_str(),simd,simd ? scalar / simd : 0,
+	    mag ? diff / mag : diff);
+    }
+    Output("Math benchmark finished");
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
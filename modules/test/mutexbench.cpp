@@ -0,0 +1,112 @@
+/**
+ * mutexbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Mutex creation and locking benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+
+class MutexBench : public Plugin
+{
+public:
+    MutexBench();
+    virtual void initialize();
+private:
+    void run(unsigned int threads, unsigned int loops);
+    bool m_first;
+};
+
+// Creates, locks and destroys private mutexes like a call setup does
+class ChurnThread : public Thread
+{
+public:
+    inline ChurnThread(unsigned int loops)
+	: Thread("MutexChurn"), m_loops(loops)
+	{ }
+    virtual void run();
+private:
+    unsigned int m_loops;
+};
+
+static Mutex s_mutex(false,"MutexBench");
+static unsigned int s_done = 0;
+
+MutexBench::MutexBench()
+    : Plugin("mutexbench"),
+      m_first(true)
+{
+    Output("Hello, I am module MutexBench");
+}
+
+void ChurnThread::run()
+{
+    for (unsigned int i = 0; i < m_loops; i++) {
+	Mutex m1(false,"Churn");
+	Mutex m2(true,"Churn");
+	Lock l1(m1);
+	Lock l2(m2);
+	m2.lock();
+	m2.unlock();
+    }
+    Lock lock(s_mutex);
+    s_done++;
+}
+
+void MutexBench::run(unsigned int threads, unsigned int loops)
+{
+    s_mutex.lock();
+    s_done = 0;
+    s_mutex.unlock();
+    u_int64_t t = Time::now();
+    unsigned int started = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+	ChurnThread* thr = new ChurnThread(loops);
+	if (thr->startup())
+	    started++;
+    }
+    for (;;) {
+	Thread::msleep(1);
+	Lock lock(s_mutex);
+	if (s_done >= started)
+	    break;
+    }
+    t = Time::now() - t;
+    // each loop creates and destroys 2 mutexes and locks them 3 times
+    u_int64_t total = (u_int64_t)started * loops;
+    Output("Mutex churn %2u threads%s: " FMT64U " loops/s, %u ns per loop",
+	started,(Lockable::safety() ? " with safety" : ""),
+	t ? (1000000 * total / t) : 0,
+	(unsigned int)(total ? (1000 * t / total) : 0));
+}
+
+void MutexBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module MutexBench");
+    static const unsigned int s_threads[] = { 1, 4, 16, 0 };
+    for (const unsigned int* n = s_threads; *n; n++)
+	run(*n,400000 / *n);
+}
+
+INIT_PLUGIN(MutexBench);
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,101 @@
+/**
+ * paramsbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * NamedList parameter lookup benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+
+class ParamsBench : public Plugin
+{
+public:
+    ParamsBench();
+    virtual void initialize();
+private:
+    void run(unsigned int count, unsigned int loops, bool indexed);
+    bool m_first;
+};
+
+ParamsBench::ParamsBench()
+    : Plugin("paramsbench"),
+      m_first(true)
+{
+    Output("Hello, I am module ParamsBench");
+}
+
+// Build a list similar to a call.route message and probe it like handlers do
+void ParamsBench::run(unsigned int count, unsigned int loops, bool indexed)
+{
+    NamedList list("call.route");
+    list.indexParams(indexed);
+    String* names = new String[count];
+    for (unsigned int i = 0; i < count; i++) {
+	names[i] << "param_" << i;
+	list.addParam(names[i],String(i));
+    }
+    String missing("nonexistent");
+    String toggle("toggled");
+    unsigned int found = 0;
+
+    u_int64_t t = Time::now();
+    for (unsigned int l = 0; l < loops; l++) {
+	for (unsigned int i = 0; i < count; i++) {
+	    if (list.getParam(names[(i * 7 + l) % count]))
+		found++;
+	}
+	if (list.getParam(missing))
+	    found++;
+    }
+    u_int64_t get = Time::now() - t;
+
+    t = Time::now();
+    for (unsigned int l = 0; l < loops; l++) {
+	for (unsigned int i = 0; i < count; i += 4)
+	    list.setParam(names[i],"replaced");
+	list.setParam(toggle,"true");
+	list.clearParam(toggle);
+    }
+    u_int64_t set = Time::now() - t;
+
+    unsigned int gets = loops * (count + 1);
+    unsigned int sets = loops * ((count + 3) / 4 + 2);
+    Output("NamedList %3u params %-9s: getParam %5u ns, setParam/clearParam %5u ns (%u found)",
+	count,(list.indexed() ? "indexed" : "unindexed"),
+	(unsigned int)(1000 * get / gets),(unsigned int)(1000 * set / sets),found);
+    delete[] names;
+}
+
+void ParamsBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module ParamsBench");
+    static const unsigned int s_counts[] = { 8, 16, 30, 60, 120, 0 };
+    for (const unsigned int* c = s_counts; *c; c++) {
+	unsigned int loops = 200000 / *c;
+	run(*c,loops,false);
+	run(*c,loops,true);
+    }
+}
+
+INIT_PLUGIN(ParamsBench);
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,145 @@
+/**
+ * poolbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Pooled data buffer allocation benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Most frames in flight for each worker
+#define MAX_DEPTH 64
+
+class PoolBench : public Plugin
+{
+public:
+    PoolBench();
+    virtual void initialize();
+private:
+    void run(unsigned int threads, unsigned int loops, unsigned int size,
+	unsigned int depth, bool pooled);
+    bool m_first;
+};
+
+// Keeps a few frames in flight and replaces the oldest one, like a media leg
+class FrameThread : public Thread
+{
+public:
+    inline FrameThread(unsigned int loops, unsigned int size, unsigned int depth, DataPool* pool)
+	: Thread("PoolFrames"), m_loops(loops), m_size(size), m_depth(depth), m_pool(pool)
+	{ }
+    virtual void run();
+private:
+    unsigned int m_loops;
+    unsigned int m_size;
+    unsigned int m_depth;
+    DataPool* m_pool;
+};
+
+static Mutex s_mutex(false,"PoolBench");
+static unsigned int s_done = 0;
+
+PoolBench::PoolBench()
+    : Plugin("poolbench"),
+      m_first(true)
+{
+    Output("Hello, I am module PoolBench");
+}
+
+void FrameThread::run()
+{
+    DataBlock frames[MAX_DEPTH];
+    for (unsigned int i = 0; i < m_depth; i++)
+	frames[i].pool(m_pool);
+    for (unsigned int i = 0; i < m_loops; i++) {
+	DataBlock& f = frames[i % m_depth];
+	f.clear();
+	f.assign(0,m_size);
+	// touch the data so the buffer is really used
+	*(unsigned char*)f.data() = (unsigned char)i;
+    }
+    Lock lock(s_mutex);
+    s_done++;
+}
+
+void PoolBench::run(unsigned int threads, unsigned int loops, unsigned int size,
+    unsigned int depth, bool pooled)
+{
+    s_mutex.lock();
+    s_done = 0;
+    s_mutex.unlock();
+    DataPool* pool = pooled ? DataPool::get("poolbench") : 0;
+    u_int64_t t = Time::now();
+    unsigned int started = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+	FrameThread* thr = new FrameThread(loops,size,depth,pool);
+	if (thr->startup())
+	    started++;
+    }
+    for (;;) {
+	Thread::msleep(1);
+	Lock lock(s_mutex);
+	if (s_done >= started)
+	    break;
+    }
+    t = Time::now() - t;
+    u_int64_t total = (u_int64_t)started * loops;
+    Output("Frame buffers %2u threads, %u bytes, %s: " FMT64U " frames/s, %u ns per frame",
+	started,size,(pooled ? "pooled" : "malloc"),
+	t ? (1000000 * total / t) : 0,
+	(unsigned int)(total ? (1000 * t / total) : 0));
+}
+
+void PoolBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module PoolBench");
+    const NamedList* cfg = Engine::config().getSection("poolbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    unsigned int loops = cfg->getIntValue(YSTRING("loops"),2000000,1000);
+    unsigned int depth = cfg->getIntValue(YSTRING("depth"),4,1,MAX_DEPTH);
+    ObjList* sizes = String(cfg->getValue(YSTRING("sizes"),"160,320,1280")).split(',',false);
+    static const unsigned int s_threads[] = { 1, 4, 16, 0 };
+    for (ObjList* l = sizes->skipNull(); l; l = l->skipNext()) {
+	int size = static_cast<String*>(l->get())->toInteger(0);
+	if (size <= 0)
+	    continue;
+	for (const unsigned int* n = s_threads; *n; n++) {
+	    run(*n,loops / *n,size,depth,false);
+	    run(*n,loops / *n,size,depth,true);
+	}
+    }
+    TelEngine::destruct(sizes);
+    Message m("engine.status");
+    m.addParam("module","datapool");
+    Engine::dispatch(m);
+    m.retValue().trimBlanks();
+    Output("Frame buffers: %s",m.retValue().c_str());
+}
+
+INIT_PLUGIN(PoolBench);
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,246 @@
+/**
+ * resampbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Sample rate translator benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatephone.h>
+
+#include <math.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Counts the resampled data and optionally its energy
+class BenchConsumer : public DataConsumer
+{
+public:
+    BenchConsumer(const char* format, unsigned int skip)
+	: DataConsumer(format),
+	  m_samples(0), m_skip(skip), m_energy(0), m_measured(0)
+	{ }
+    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags);
+    inline u_int64_t samples() const
+	{ return m_samples; }
+    // Level of the received signal in dB relative to a full scale sine
+    double level() const;
+private:
+    u_int64_t m_samples;
+    unsigned int m_skip;
+    double m_energy;
+    u_int64_t m_measured;
+};
+
+class BenchThread : public Thread
+{
+public:
+    inline BenchThread()
+	: Thread("ResampBench")
+	{ }
+    virtual void run();
+private:
+    bool runRatio(int sRate, int dRate, const NamedList& cfg);
+};
+
+class ResampBench : public Plugin
+{
+public:
+    ResampBench();
+    virtual ~ResampBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static Mutex s_mutex(false,"ResampBench");
+static bool s_running = false;
+
+INIT_PLUGIN(ResampBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+unsigned long BenchConsumer::Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+{
+    unsigned int n = data.length() / 2;
+    m_samples += n;
+    if (!m_skip)
+	return invalidStamp();
+    const int16_t* s = (const int16_t*)data.data();
+    for (unsigned int i = 0; i < n; i++) {
+	// let the filter settle before measuring
+	if (m_samples - n + i < m_skip)
+	    continue;
+	m_energy += (double)s[i] * s[i];
+	m_measured++;
+    }
+    return invalidStamp();
+}
+
+double BenchConsumer::level() const
+{
+    if (!m_measured || (m_energy <= 0))
+	return -200;
+    return 10 * ::log10(m_energy / m_measured / (32767.0 * 32767.0 / 2));
+}
+
+
+static String rateFormat(int rate)
+{
+    String fmt("slin");
+    if (rate != 8000)
+	fmt << "/" << rate;
+    return fmt;
+}
+
+// Feed a tone through a translator, return the output level in dB
+static double toneLevel(const String& sFmt, const String& dFmt, int sRate, int dRate,
+    double freq, u_int64_t* samples = 0, unsigned int msec = 500)
+{
+    DataTranslator* trans = DataTranslator::create(sFmt,dFmt);
+    if (!trans)
+	return -200;
+    BenchConsumer* cons = new BenchConsumer(dFmt,samples ? 0 : dRate / 10);
+    DataSource* src = new DataSource(sFmt);
+    trans->getTransSource()->attach(cons);
+    src->attach(trans);
+    // one second of tone at 1/2 full scale split in 20ms blocks
+    unsigned int block = sRate / 50;
+    DataBlock tone(0,2 * sRate);
+    int16_t* p = (int16_t*)tone.data();
+    for (int i = 0; i < sRate; i++)
+	p[i] = (int16_t)(16384 * ::sin(2 * M_PI * freq * i / sRate));
+    unsigned long tStamp = 0;
+    u_int64_t stop = Time::now() + 1000 * (u_int64_t)msec;
+    unsigned int b = 0;
+    // feed as fast as possible when measuring speed
+    DataBlock data;
+    for (;;) {
+	data.assign(p + block * (b % 50),2 * block,false);
+	src->Forward(data,tStamp);
+	data.clear(false);
+	tStamp += block;
+	b++;
+	if (samples) {
+	    if (!(b & 63) && (Time::now() >= stop))
+		break;
+	}
+	else if (b >= 50 * msec / 1000)
+	    break;
+    }
+    double level = cons->level() + 6.02;
+    if (samples)
+	*samples = (u_int64_t)b * block;
+    src->clear();
+    trans->getTransSource()->clear();
+    TelEngine::destruct(src);
+    TelEngine::destruct(trans);
+    TelEngine::destruct(cons);
+    return level;
+}
+
+bool BenchThread::runRatio(int sRate, int dRate, const NamedList& cfg)
+{
+    int duration = cfg.getIntValue(YSTRING("duration"),2000,200,60000);
+    String sFmt = rateFormat(sRate);
+    String dFmt = rateFormat(dRate);
+    int cost = DataTranslator::cost(sFmt,dFmt);
+    if (cost < 0) {
+	Output("Resampler benchmark %5d -> %5d: no translator",sRate,dRate);
+	return false;
+    }
+    u_int64_t samples = 0;
+    u_int64_t start = Time::now();
+    toneLevel(sFmt,dFmt,sRate,dRate,1000,&samples,duration);
+    u_int64_t elapsed = Time::now() - start;
+    // a 1kHz tone must pass, one between the two Nyquist frequencies must not
+    double pass = toneLevel(sFmt,dFmt,sRate,dRate,1000);
+    String alias;
+    if (dRate < sRate) {
+	double freq = (sRate + dRate) / 4.0;
+	alias.printf(", %.0fHz tone %.1fdB",freq,toneLevel(sFmt,dFmt,sRate,dRate,freq));
+    }
+    Output("Resampler benchmark %5d -> %5d: cost %d, " FMT64U " ksamples/s in (%u ns/sample), 1kHz tone %.1fdB%s",
+	sRate,dRate,cost,elapsed ? samples * 1000 / elapsed : 0,
+	(unsigned int)(samples ? 1000 * elapsed / samples : 0),pass,alias.safe());
+    return true;
+}
+
+void BenchThread::run()
+{
+    const NamedList* cfg = Engine::config().getSection("resampbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    ObjList* ratios = String(cfg->getValue(YSTRING("ratios"),
+	"8000:16000,16000:8000,8000:32000,32000:8000,8000:48000,48000:8000,"
+	"44100:8000,8000:44100,48000:44100,16000:48000,48000:16000")).split(',',false);
+    for (ObjList* l = ratios->skipNull(); l && !Engine::exiting(); l = l->skipNext()) {
+	String* r = static_cast<String*>(l->get());
+	int sep = r->find(':');
+	if (sep <= 0)
+	    continue;
+	int sRate = r->substr(0,sep).toInteger(0);
+	int dRate = r->substr(sep + 1).toInteger(0);
+	if ((sRate > 0) && (dRate > 0) && (sRate != dRate))
+	    runRatio(sRate,dRate,*cfg);
+    }
+    TelEngine::destruct(ratios);
+    Output("Resampler benchmark finished");
+    Lock lock(s_mutex);
+    s_running = false;
+}
+
+
+ResampBench::ResampBench()
+    : Plugin("resampbench","misc"),
+      m_first(true)
+{
+    Output("Loaded module ResampBench");
+}
+
+ResampBench::~ResampBench()
+{
+    Output("Unloading module ResampBench");
+}
+
+bool ResampBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_running;
+}
+
+void ResampBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module ResampBench");
+    s_running = true;
+    (new BenchThread)->startup();
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
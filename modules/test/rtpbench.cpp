@@ -0,0 +1,280 @@
+/**
+ * rtpbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * RTP transport loopback benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+#include <yatertp.h>
+
+#include <string.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// Counts the packets received by a stream
+class BenchCounter : public RTPProcessor
+{
+public:
+    virtual void rtpData(const void* data, int len);
+protected:
+    virtual void timerTick(const Time& when)
+	{ }
+};
+
+// One stream: packets received by the first transport are forwarded
+//  by the second one like a RTP reflector does
+class BenchStream : public GenObject
+{
+public:
+    BenchStream();
+    virtual ~BenchStream();
+    bool init(const SocketAddr& sender, const SocketAddr& drain, int msec);
+    inline const SocketAddr& addr() const
+	{ return m_recv->localAddr(); }
+private:
+    RTPTransport* m_recv;
+    RTPTransport* m_send;
+    BenchCounter* m_counter;
+};
+
+class BenchThread : public Thread
+{
+public:
+    inline BenchThread()
+	: Thread("RTPBench")
+	{ }
+    virtual void run();
+private:
+    bool runMode(const char* mode, bool events, unsigned int sessions, const NamedList& cfg);
+};
+
+class RTPBench : public Plugin
+{
+public:
+    RTPBench();
+    virtual ~RTPBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static Mutex s_mutex(false,"RTPBench");
+static u_int64_t s_received = 0;
+static bool s_running = false;
+
+INIT_PLUGIN(RTPBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+void BenchCounter::rtpData(const void* data, int len)
+{
+    // runs in the group thread, several groups may count at once
+    Lock lock(s_mutex);
+    s_received++;
+}
+
+
+BenchStream::BenchStream()
+    : m_recv(0), m_send(0), m_counter(0)
+{
+}
+
+BenchStream::~BenchStream()
+{
+    TelEngine::destruct(m_recv);
+    TelEngine::destruct(m_send);
+    TelEngine::destruct(m_counter);
+}
+
+bool BenchStream::init(const SocketAddr& sender, const SocketAddr& drain, int msec)
+{
+    m_recv = new RTPTransport;
+    m_send = new RTPTransport;
+    m_counter = new BenchCounter;
+    // with one session per thread each stream gets its own group
+    if (!RTPGroup::joinShared(m_recv,msec,Thread::Normal,String::empty()))
+	return false;
+    m_recv->setProcessor(m_send);
+    m_recv->setMonitor(m_counter);
+    SocketAddr local(sender);
+    local.port(0);
+    if (!m_recv->localAddr(local,false))
+	return false;
+    local.port(0);
+    if (!m_send->localAddr(local,false))
+	return false;
+    SocketAddr tmp(sender);
+    m_recv->remoteAddr(tmp);
+    tmp = drain;
+    m_send->remoteAddr(tmp);
+    return true;
+}
+
+
+bool BenchThread::runMode(const char* mode, bool events, unsigned int sessions, const NamedList& cfg)
+{
+    int streams = cfg.getIntValue(YSTRING("streams"),1000,1,20000);
+    int duration = cfg.getIntValue(YSTRING("duration"),5000,500,60000);
+    int interval = cfg.getIntValue(YSTRING("interval"),20,5,100);
+    int msec = cfg.getIntValue(YSTRING("msleep"),5,1,50);
+    int size = cfg.getIntValue(YSTRING("size"),172,12,1400);
+
+    RTPGroup::setEventDriven(events,sessions);
+    if (events && (sessions > 1) && !RTPGroup::sharedSessions()) {
+	Output("RTP benchmark: %s mode not supported, skipping",mode);
+	return true;
+    }
+    SocketAddr sender(SocketAddr::IPv4);
+    sender.host("127.0.0.1");
+    Socket sendSock;
+    Socket drainSock;
+    if (!(sendSock.create(sender.family(),SOCK_DGRAM) && sendSock.bind(sender) && sendSock.getSockName(sender))) {
+	Debug("rtpbench",DebugWarn,"Failed to create sender socket");
+	return false;
+    }
+    SocketAddr drain(SocketAddr::IPv4);
+    drain.host("127.0.0.1");
+    if (!(drainSock.create(drain.family(),SOCK_DGRAM) && drainSock.bind(drain) && drainSock.getSockName(drain))) {
+	Debug("rtpbench",DebugWarn,"Failed to create drain socket");
+	return false;
+    }
+    sendSock.setBlocking(false);
+
+    ObjList list;
+    ObjList* add = &list;
+    int created = 0;
+    for (; created < streams; created++) {
+	BenchStream* s = new BenchStream;
+	add = add->append(s);
+	if (!s->init(sender,drain,msec)) {
+	    Debug("rtpbench",DebugWarn,"Only %d streams could be created, check file descriptors limit",
+		created);
+	    break;
+	}
+    }
+    if (!created) {
+	list.clear();
+	return false;
+    }
+
+    unsigned char* pkt = new unsigned char[size];
+    ::memset(pkt,0,size);
+    pkt[0] = 0x80;
+    s_mutex.lock();
+    s_received = 0;
+    s_mutex.unlock();
+    u_int64_t sent = 0;
+    u_int64_t cpu = SysUsage::usecRunTime(SysUsage::UserTime) + SysUsage::usecRunTime(SysUsage::KernelTime);
+    u_int64_t start = Time::now();
+    u_int64_t stop = start + 1000 * (u_int64_t)duration;
+    u_int64_t next = start;
+    while (!Engine::exiting()) {
+	u_int64_t now = Time::now();
+	if (now >= stop)
+	    break;
+	if (now < next) {
+	    Thread::usleep(next - now);
+	    continue;
+	}
+	next += 1000 * (u_int64_t)interval;
+	int n = 0;
+	for (ObjList* l = list.skipNull(); l && n < created; l = l->skipNext(), n++) {
+	    const BenchStream* s = static_cast<const BenchStream*>(l->get());
+	    if (sendSock.sendTo(pkt,size,s->addr()) == size)
+		sent++;
+	}
+    }
+    // let the groups drain their sockets
+    Thread::msleep(100);
+    u_int64_t elapsed = Time::now() - start;
+    cpu = SysUsage::usecRunTime(SysUsage::UserTime) + SysUsage::usecRunTime(SysUsage::KernelTime) - cpu;
+    s_mutex.lock();
+    u_int64_t received = s_received;
+    s_mutex.unlock();
+    list.clear();
+    delete[] pkt;
+
+    unsigned int load = elapsed ? (unsigned int)(100000 * cpu / elapsed) : 0;
+    Output("RTP benchmark %-14s: %d streams, " FMT64U " pkt/s sent, " FMT64U " pkt/s forwarded (%u%% lost), CPU %u.%u%% (%u.%u%% per 1k streams)",
+	mode,created,1000000 * sent / elapsed,1000000 * received / elapsed,
+	(unsigned int)(sent ? (100 * (sent - (received < sent ? received : sent)) / sent) : 0),
+	load / 1000,(load % 1000) / 100,
+	(unsigned int)(load * 1000 / created / 1000),(unsigned int)((load * 1000 / created % 1000) / 100));
+    // allow the group threads to exit
+    Thread::msleep(2 * msec + 50);
+    return true;
+}
+
+void BenchThread::run()
+{
+    const NamedList* cfg = Engine::config().getSection("rtpbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    unsigned int old = RTPGroup::sharedSessions();
+    unsigned int sessions = cfg->getIntValue(YSTRING("sessions_per_thread"),100,2,1000);
+    Output("RTP benchmark: reflecting packets from loopback, CPU includes the sender thread");
+    if (runMode("polling",false,1,*cfg) && !Engine::exiting())
+	if (runMode("epoll",true,1,*cfg) && !Engine::exiting())
+	    runMode("epoll+batch",true,sessions,*cfg);
+    RTPGroup::setEventDriven(old > 0,old ? old : 1);
+    Output("RTP benchmark finished");
+    Lock lock(s_mutex);
+    s_running = false;
+}
+
+
+RTPBench::RTPBench()
+    : Plugin("rtpbench","misc"),
+      m_first(true)
+{
+    Output("Loaded module RTPBench");
+}
+
+RTPBench::~RTPBench()
+{
+    Output("Unloading module RTPBench");
+}
+
+bool RTPBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_running;
+}
+
+void RTPBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module RTPBench");
+    s_running = true;
+    (new BenchThread)->startup();
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
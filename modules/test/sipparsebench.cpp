@@ -0,0 +1,194 @@
+/**
+ * sipparsebench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * SIP message parser benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+#include <yatesip.h>
+
+#include <stdio.h>
+
+using namespace TelEngine;
+
+class SIPParseBench : public Plugin
+{
+public:
+    SIPParseBench();
+    virtual void initialize();
+private:
+    void run(const ObjList& msgs, unsigned int loops);
+    bool m_first;
+};
+
+// Messages used when no trace file is configured
+static const char* s_samples[] = {
+    "INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bK776asdhds;rport\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.example.com>\r\n"
+    "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:alice@pc33.atlanta.example.com>\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, INFO, REFER, NOTIFY\r\n"
+    "Supported: replaces, timer\r\n"
+    "User-Agent: SIPBench\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 142\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=alice 2890844526 2890844526 IN IP4 pc33.atlanta.example.com\r\n"
+    "s=-\r\n"
+    "c=IN IP4 192.0.2.101\r\n"
+    "t=0 0\r\n"
+    "m=audio 49172 RTP/AVP 0\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n",
+
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/UDP server10.biloxi.example.com;branch=z9hG4bKnashds8;received=192.0.2.3\r\n"
+    "Via: SIP/2.0/UDP bigbox3.site3.atlanta.example.com;branch=z9hG4bK77ef4c2312983.1;received=192.0.2.2\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bK776asdhds;received=192.0.2.1\r\n"
+    "To: Bob <sip:bob@biloxi.example.com>;tag=a6c85cf\r\n"
+    "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:bob@192.0.2.4>\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+
+    "REGISTER sip:registrar.biloxi.example.com SIP/2.0\r\n"
+    "v: SIP/2.0/UDP bobspc.biloxi.example.com:5060;branch=z9hG4bKnashds7\r\n"
+    "Max-Forwards: 70\r\n"
+    "t: Bob <sip:bob@biloxi.example.com>\r\n"
+    "f: Bob <sip:bob@biloxi.example.com>;tag=456248\r\n"
+    "i: 843817637684230@998sdasdh09\r\n"
+    "CSeq: 1826 REGISTER\r\n"
+    "m: <sip:bob@192.0.2.4>\r\n"
+    "Expires: 7200\r\n"
+    "Authorization: Digest username=\"bob\", realm=\"atlanta.example.com\",\r\n"
+    " nonce=\"ea9c8e88df84f1cec4341ae6cbe5a359\", opaque=\"\",\r\n"
+    " uri=\"sip:registrar.biloxi.example.com\", response=\"dfe56131d1958046689d83306477ecc\"\r\n"
+    "l: 0\r\n"
+    "\r\n",
+
+    "ACK sip:bob@192.0.2.4 SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.example.com;branch=z9hG4bKnashds9\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.example.com>;tag=a6c85cf\r\n"
+    "From: Alice <sip:alice@atlanta.example.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.example.com\r\n"
+    "CSeq: 314159 ACK\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+    0
+};
+
+SIPParseBench::SIPParseBench()
+    : Plugin("sipparsebench"),
+      m_first(true)
+{
+    Output("Hello, I am module SIPParseBench");
+}
+
+// Load messages from a trace, like the ones logged by ysipchan, where each
+//  message is enclosed between lines of dashes
+static void loadTrace(const String& file, ObjList& msgs)
+{
+    FILE* f = ::fopen(file,"r");
+    if (!f) {
+	Debug("sipparsebench",DebugWarn,"Could not open trace file '%s'",file.c_str());
+	return;
+    }
+    String* msg = 0;
+    char buf[4096];
+    while (::fgets(buf,sizeof(buf),f)) {
+	String line(buf);
+	// keep leading blanks of folded lines, drop the line terminator
+	while (line.endsWith("\n") || line.endsWith("\r"))
+	    line = line.substr(0,line.length() - 1);
+	if (line.startsWith("-----")) {
+	    if (msg && *msg)
+		msgs.append(msg);
+	    else
+		TelEngine::destruct(msg);
+	    msg = msg ? 0 : new String;
+	    continue;
+	}
+	if (msg)
+	    *msg << line << "\r\n";
+    }
+    TelEngine::destruct(msg);
+    ::fclose(f);
+}
+
+void SIPParseBench::run(const ObjList& msgs, unsigned int loops)
+{
+    unsigned int count = 0;
+    unsigned int valid = 0;
+    unsigned int bytes = 0;
+    u_int64_t t = Time::now();
+    for (unsigned int l = 0; l < loops; l++) {
+	for (const ObjList* o = msgs.skipNull(); o; o = o->skipNext()) {
+	    const String* s = static_cast<const String*>(o->get());
+	    SIPMessage* m = SIPMessage::fromParsing(0,s->c_str(),s->length());
+	    count++;
+	    bytes += s->length();
+	    if (m) {
+		valid++;
+		// touch the headers a transaction lookup always needs
+		m->getHeader("Via");
+		m->getHeader("Call-ID");
+		m->destruct();
+	    }
+	}
+    }
+    t = Time::now() - t;
+    if (!count)
+	return;
+    Output("SIP parse: %u messages (%u valid), %u ns per message, %u MB/s",
+	count,valid,(unsigned int)(1000 * t / count),
+	(unsigned int)(t ? (bytes / t) : 0));
+}
+
+void SIPParseBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module SIPParseBench");
+    ObjList msgs;
+    const NamedList* cfg = Engine::config().getSection("sipparsebench");
+    if (cfg) {
+	const String& file = (*cfg)["trace"];
+	if (file)
+	    loadTrace(file,msgs);
+    }
+    if (!msgs.skipNull()) {
+	for (const char** s = s_samples; *s; s++)
+	    msgs.append(new String(*s));
+    }
+    unsigned int loops = 200000 / msgs.count();
+    if (!loops)
+	loops = 1;
+    run(msgs,loops);
+}
+
+INIT_PLUGIN(SIPParseBench);
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
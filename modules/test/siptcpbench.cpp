@@ -0,0 +1,313 @@
+/**
+ * siptcpbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * SIP TCP transport load benchmark
+ *
+ * Opens many local connections to a SIP TCP listener and measures the
+ *  connect rate, the RFC5626 keep alive round trip on all of them and
+ *  the threads and memory used by the engine to keep them.
+ * The SIP module must have a TCP listener on the tested address, e.g. in ysipchan.conf:
+ *  [listener bench]
+ *  type=tcp
+ *  addr=127.0.0.1
+ *  port=5070
+ *  backlog=4096
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+#include <stdio.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+class BenchThread : public Thread
+{
+public:
+    inline BenchThread()
+	: Thread("SipTcpBench"),
+	  m_socks(0), m_count(0)
+	{ }
+    virtual ~BenchThread();
+    virtual void run();
+private:
+    unsigned int connect(const SocketAddr& addr, unsigned int count, unsigned int batch);
+    unsigned int ping(unsigned int msec);
+    void closeAll();
+    Socket** m_socks;
+    unsigned int m_count;
+};
+
+class SipTcpBench : public Plugin
+{
+public:
+    SipTcpBench();
+    virtual ~SipTcpBench();
+    virtual void initialize();
+    bool unload();
+private:
+    bool m_first;
+};
+
+static Mutex s_mutex(false,"SipTcpBench");
+static bool s_running = false;
+
+INIT_PLUGIN(SipTcpBench);
+
+UNLOAD_PLUGIN(unloadNow)
+{
+    if (unloadNow)
+	return __plugin.unload();
+    return true;
+}
+
+
+// Threads and resident memory of the process, from /proc on Linux
+static String processUsage()
+{
+    String ret;
+    FILE* f = ::fopen("/proc/self/status","r");
+    if (!f)
+	return "n/a";
+    char line[128];
+    while (::fgets(line,sizeof(line),f)) {
+	String l(line);
+	const char* name = 0;
+	if (l.startSkip("Threads:",false))
+	    name = "threads";
+	else if (l.startSkip("VmRSS:",false))
+	    name = "rss";
+	if (name)
+	    ret.append(name,", ") << "=" << l.trimSpaces();
+    }
+    ::fclose(f);
+    return ret;
+}
+
+static String sipStatus()
+{
+    Message m("engine.status");
+    m.addParam("module","sip");
+    Engine::dispatch(m);
+    String ret = m.retValue();
+    // keep only the module parameters
+    int sep = ret.find(';');
+    if (sep >= 0)
+	ret = ret.substr(sep + 1);
+    sep = ret.find(';');
+    if (sep >= 0)
+	ret = ret.substr(0,sep);
+    return ret.trimBlanks();
+}
+
+
+BenchThread::~BenchThread()
+{
+    closeAll();
+}
+
+// Open connections in batches, return how many got connected
+unsigned int BenchThread::connect(const SocketAddr& addr, unsigned int count, unsigned int batch)
+{
+    m_socks = new Socket*[count];
+    m_count = 0;
+    struct pollfd* fds = new struct pollfd[batch];
+    unsigned int failed = 0;
+    while ((m_count < count) && !Engine::exiting()) {
+	unsigned int n = 0;
+	for (; (n < batch) && (m_count + n < count); n++) {
+	    Socket* s = new Socket(addr.family(),SOCK_STREAM);
+	    m_socks[m_count + n] = s;
+	    fds[n].fd = s->handle();
+	    fds[n].events = POLLOUT;
+	    fds[n].revents = 0;
+	    if (!(s->valid() && s->setBlocking(false)))
+		fds[n].fd = -1;
+	    else if (s->connect(addr))
+		fds[n].events = 0;
+	    else if (!s->inProgress())
+		fds[n].fd = -1;
+	}
+	// wait for the batch to complete connecting
+	u_int64_t stop = Time::now() + 5000000;
+	for (;;) {
+	    unsigned int waiting = 0;
+	    for (unsigned int i = 0; i < n; i++)
+		if ((fds[i].fd >= 0) && fds[i].events && !fds[i].revents)
+		    waiting++;
+	    if (!waiting || (Time::now() > stop))
+		break;
+	    ::poll(fds,n,50);
+	}
+	for (unsigned int i = 0; i < n; i++) {
+	    Socket* s = m_socks[m_count + i];
+	    bool ok = (fds[i].fd >= 0) && !(fds[i].revents & (POLLERR | POLLHUP));
+	    if (ok && fds[i].events)
+		ok = (0 != (fds[i].revents & POLLOUT)) && s->updateError() && !s->error();
+	    if (!ok) {
+		failed++;
+		delete s;
+		m_socks[m_count + i] = 0;
+	    }
+	}
+	m_count += n;
+    }
+    delete[] fds;
+    return m_count - failed;
+}
+
+// Send a keep alive on all connections, wait for the answers
+// Return the number of connections that answered
+unsigned int BenchThread::ping(unsigned int msec)
+{
+    struct pollfd* fds = new struct pollfd[m_count];
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < m_count; i++) {
+	Socket* s = m_socks[i];
+	if (!s || (s->writeData("\r\n\r\n",4) != 4))
+	    continue;
+	fds[n].fd = s->handle();
+	fds[n].events = POLLIN;
+	fds[n].revents = 0;
+	n++;
+    }
+    unsigned int answered = 0;
+    u_int64_t stop = Time::now() + 1000 * (u_int64_t)msec;
+    while (n && (Time::now() < stop) && !Engine::exiting()) {
+	if (::poll(fds,n,10) <= 0)
+	    continue;
+	for (unsigned int i = 0; i < n; ) {
+	    if (!fds[i].revents) {
+		i++;
+		continue;
+	    }
+	    char buf[64];
+	    Socket s(fds[i].fd);
+	    int rd = s.readData(buf,sizeof(buf));
+	    s.detach();
+	    if (rd > 0)
+		answered++;
+	    // answered or broken, stop watching it
+	    fds[i] = fds[--n];
+	}
+    }
+    delete[] fds;
+    return answered;
+}
+
+void BenchThread::closeAll()
+{
+    if (!m_socks)
+	return;
+    for (unsigned int i = 0; i < m_count; i++)
+	delete m_socks[i];
+    delete[] m_socks;
+    m_socks = 0;
+    m_count = 0;
+}
+
+void BenchThread::run()
+{
+    const NamedList* cfg = Engine::config().getSection("siptcpbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    // wait for the engine to finish initializing the other modules
+    while (!(Engine::started() || Engine::exiting()))
+	Thread::idle();
+    Thread::msleep(cfg->getIntValue(YSTRING("delay"),1000,0,60000));
+    unsigned int count = cfg->getIntValue(YSTRING("connections"),20000,1,1000000);
+    unsigned int batch = cfg->getIntValue(YSTRING("batch"),256,1,4096);
+    unsigned int rounds = cfg->getIntValue(YSTRING("rounds"),5,1,1000);
+    unsigned int timeout = cfg->getIntValue(YSTRING("timeout"),10000,100,600000);
+    SocketAddr addr(SocketAddr::IPv4);
+    addr.host(cfg->getValue(YSTRING("addr"),"127.0.0.1"));
+    addr.port(cfg->getIntValue(YSTRING("port"),5070));
+    // both ends of each connection are in this process
+    struct rlimit lim;
+    if (!::getrlimit(RLIMIT_NOFILE,&lim)) {
+	lim.rlim_cur = lim.rlim_max;
+	::setrlimit(RLIMIT_NOFILE,&lim);
+	if (lim.rlim_cur != RLIM_INFINITY) {
+	    unsigned int max = (lim.rlim_cur > 512) ? (unsigned int)(lim.rlim_cur - 256) / 2 : 128;
+	    if (count > max) {
+		Output("SIP TCP benchmark: file limit %u allows only %u connections",
+		    (unsigned int)lim.rlim_cur,max);
+		count = max;
+	    }
+	}
+    }
+    Output("SIP TCP benchmark: %s before connecting, %s",processUsage().c_str(),sipStatus().c_str());
+    u_int64_t t = Time::now();
+    unsigned int ok = connect(addr,count,batch);
+    t = Time::now() - t;
+    Output("SIP TCP benchmark: %u/%u connections to %s in %u ms (" FMT64U " per second)",
+	ok,count,addr.addr().c_str(),(unsigned int)(t / 1000),t ? (1000000 * (u_int64_t)ok / t) : 0);
+    for (unsigned int r = 0; r <= rounds && ok && !Engine::exiting(); r++) {
+	t = Time::now();
+	unsigned int answered = ping(timeout);
+	t = Time::now() - t;
+	// the first round also waits for the engine to accept all connections
+	Output("SIP TCP benchmark: keep alive %s %u/%u answered in %u ms (" FMT64U " per second)",
+	    r ? "round" : "setup",answered,ok,(unsigned int)(t / 1000),
+	    t ? (1000000 * (u_int64_t)answered / t) : 0);
+    }
+    Output("SIP TCP benchmark: %s with %u connections, %s",processUsage().c_str(),ok,sipStatus().c_str());
+    closeAll();
+    // let the engine notice the closed connections
+    Thread::msleep(cfg->getIntValue(YSTRING("linger"),3000,0,60000));
+    Output("SIP TCP benchmark: %s after closing, %s",processUsage().c_str(),sipStatus().c_str());
+    Output("SIP TCP benchmark finished");
+    Lock lock(s_mutex);
+    s_running = false;
+}
+
+
+SipTcpBench::SipTcpBench()
+    : Plugin("siptcpbench","misc"),
+      m_first(true)
+{
+    Output("Loaded module SipTcpBench");
+}
+
+SipTcpBench::~SipTcpBench()
+{
+    Output("Unloading module SipTcpBench");
+}
+
+bool SipTcpBench::unload()
+{
+    Lock lock(s_mutex);
+    return !s_running;
+}
+
+void SipTcpBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module SipTcpBench");
+    s_running = true;
+    (new BenchThread)->startup();
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,137 @@
+/**
+ * xmlbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Streaming XML parser benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2014 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+#include <yatexml.h>
+
+using namespace TelEngine;
+
+class XmlBench : public Plugin
+{
+public:
+    XmlBench();
+    virtual void initialize();
+private:
+    void run(const String& stream, unsigned int chunk);
+    bool m_first;
+};
+
+// Counts the events reported by the parser, like a XMPP stream would
+class BenchParser : public XmlSaxParser
+{
+public:
+    inline BenchParser()
+	: XmlSaxParser("xmlbench"), m_elements(0), m_texts(0)
+	{ }
+    unsigned int m_elements;
+    unsigned int m_texts;
+protected:
+    virtual void gotText(const String& text)
+	{ m_texts++; }
+    virtual void gotCdata(const String& data)
+	{ m_texts++; }
+    virtual void gotElement(const NamedList& element, bool empty)
+	{ m_elements++; }
+    virtual bool completed()
+	{ return false; }
+};
+
+XmlBench::XmlBench()
+    : Plugin("xmlbench"),
+      m_first(true)
+{
+    Output("Hello, I am module XmlBench");
+}
+
+// Build a client to server XMPP stream of roughly the requested size
+static void buildStream(String& stream, unsigned int size)
+{
+    stream = "<?xml version='1.0'?>"
+	"<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'"
+	" to='example.com' version='1.0'>";
+    for (unsigned int i = 0; stream.length() < size; i++) {
+	switch (i % 4) {
+	    case 0:
+		stream << "<message from='juliet@example.com/balcony' to='romeo@example.net'"
+		    " id='msg" << i << "' type='chat'><body>Art thou not Romeo, and a Montague?"
+		    " Caf\xc3\xa9 &amp; cr\xc3\xa8me \xe2\x82\xac" << i << "</body>"
+		    "<active xmlns='http://jabber.org/protocol/chatstates'/></message>";
+		break;
+	    case 1:
+		stream << "<presence from='romeo@example.net/orchard' id='pres" << i << "'>"
+		    "<show>away</show><status>I shall be back soon</status><priority>5</priority>"
+		    "<c xmlns='http://jabber.org/protocol/caps' hash='sha-1' node='http://yate.null.ro'"
+		    " ver='QgayPKawpkPSDYmwT/WM94uAlu0='/></presence>";
+		break;
+	    case 2:
+		stream << "<iq type='result' id='roster" << i << "' to='juliet@example.com/balcony'>"
+		    "<query xmlns='jabber:iq:roster'>"
+		    "<item jid='nurse@example.com' name='Nurse' subscription='both'><group>Servants</group></item>"
+		    "<item jid='romeo@example.net' name='Romeo' subscription='both'><group>Friends</group></item>"
+		    "</query></iq>";
+		break;
+	    default:
+		stream << "\r\n";
+	}
+    }
+}
+
+void XmlBench::run(const String& stream, unsigned int chunk)
+{
+    BenchParser parser;
+    unsigned int len = stream.length();
+    unsigned int calls = 0;
+    bool ok = true;
+    u_int64_t t = Time::now();
+    for (unsigned int pos = 0; ok && pos < len; pos += chunk) {
+	String data(stream.c_str() + pos,(len - pos > chunk) ? chunk : len - pos);
+	ok = parser.parse(data) || (parser.error() == XmlSaxParser::Incomplete);
+	calls++;
+    }
+    t = Time::now() - t;
+    if (!ok)
+	Debug("xmlbench",DebugWarn,"Parser failed after %u calls: %s",calls,parser.getError());
+    Output("XML stream %u bytes in %5u byte chunks: %u elements, %u texts, %u ms, %u MB/s",
+	len,chunk,parser.m_elements,parser.m_texts,(unsigned int)(t / 1000),
+	(unsigned int)(t ? (len / t) : 0));
+}
+
+void XmlBench::initialize()
+{
+    if (!m_first)
+	return;
+    m_first = false;
+    Output("Initializing module XmlBench");
+    const NamedList* cfg = Engine::config().getSection("xmlbench");
+    static const NamedList s_empty("");
+    if (!cfg)
+	cfg = &s_empty;
+    unsigned int size = cfg->getIntValue(YSTRING("size"),4096,64,262144);
+    String stream;
+    buildStream(stream,1024 * size);
+    static const unsigned int s_chunks[] = { 64, 1460, 8192, 65536, 0 };
+    for (const unsigned int* c = s_chunks; *c; c++)
+	run(stream,*c);
+}
+
+INIT_PLUGIN(XmlBench);
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -1915,6 +1915,8 @@ void YRTPPlugin::initialize()
     s_monitor = cfg.getBoolValue("general","monitoring",false);
     s_sleep = cfg.getIntValue("general","defsleep",5);
     RTPGroup::setMinSleep(cfg.getIntValue("general","minsleep"));
+    RTPGroup::setEventDriven(cfg.getBoolValue("general","epoll",false),
+	cfg.getIntValue("general","sessions_per_thread",1,1,1000));
     s_priority = Thread::priority(cfg.getValue("general","thread"));
     s_affinity = cfg.getValue("general","affinity");
     s_rtpWarnSeq = cfg.getBoolValue("general","rtp_warn_seq",true);
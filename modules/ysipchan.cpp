@@ -25,6 +25,13 @@
 
 #include <string.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
 
 using namespace TelEngine;
 namespace { // anonymous
@@ -35,6 +42,7 @@ class YateSIPTransport;                  // SIP transport: keeps a socket, read/
 class YateSIPUDPTransport;               // UDP transport
 class YateSIPTCPTransport;               // TCP/TLS transport
 class YateSIPTransportWorker;            // A transport worker
+class YateSIPTCPReactor;                 // A thread multiplexing TCP/TLS transports
 class YateSIPTCPListener;                // A TCP listener
 class YateUDPParty;                      // A SIP UDP party
 class YateTCPParty;                      // A SIP TCP/TLS party
@@ -54,6 +62,13 @@ class SIPDriver;
 #define TCP_IDLE_DEF 120
 #define TCP_IDLE_MAX 600
 
+// Maximum number of socket events handled by a TCP reactor in one loop
+#define REACTOR_EVENTS 256
+// Longest time a TCP reactor waits for events in milliseconds
+#define REACTOR_WAIT_MAX 100
+// Interval in microseconds to check if outgoing TCP transports are still referenced
+#define REACTOR_REF_CHECK 1000000
+
 // Maximum allowed value for bind retry interval in milliseconds
 // 1 minute
 #define BIND_RETRY_MAX 60000
@@ -481,6 +496,7 @@ class YateSIPTCPTransport : public YateSIPTransport
 {
     YCLASS(YateSIPTCPTransport,YateSIPTransport);
     friend class YateTCPParty;
+    friend class YateSIPTCPReactor;
 public:
     // Build an outgoing transport
     YateSIPTCPTransport(bool tls, const String& laddr, const String& raddr, int rport);
@@ -509,6 +525,8 @@ public:
     bool send(SIPEvent* event);
     // Process data (read/send)
     virtual int process();
+    // Stop processing the transport in the reactor, wait for it if needed
+    void detachReactor();
 protected:
     virtual void destroyed();
     // Status changed notification
@@ -518,6 +536,20 @@ protected:
     // Connect an outgoing transport. Terminate the socket before it
     // Return: 1: OK, 0: retry connect, -1: stop the transport
     int connect(u_int64_t connToutUs = 60000000);
+    // Start connecting, set the socket and remote address
+    // Return: 2: connect in progress, 1: OK, 0: retry connect, -1: stop the transport
+    int connectStart(Socket*& sock, SocketAddr& addr, bool async);
+    // Check a completed connect, start TLS on it
+    // Return: 1: OK, 0: retry connect, -1: stop the transport
+    int connectCheck(Socket*& sock, const SocketAddr& addr, bool ok, bool timeout);
+    // Set the connected socket or drop the failed one
+    int connectEnd(Socket*& sock, int result);
+    // Check the progress of an asynchronous connect started by the reactor
+    int connectAsync();
+    // Update connect retry data after a connect attempt
+    int connectResult(int conn);
+    // Retrieve the socket the reactor should watch and the next time to process us
+    SOCKET reactorWatch(bool& out, u_int64_t& when);
     // Send pending messages or keepalive, return false on failure
     bool sendPending(const Time& time, bool& sent);
     // Read data
@@ -549,7 +581,9 @@ protected:
     bool m_flowTimer;                    // Flow timer flag (RFC5626)
     bool m_keepAlivePending;             // Pending keep alive response
     SIPMessage* m_msg;                   // Partially received SIP message (expecting body)
-    DataBlock m_sipBuffer;               // Accumulated read data
+    DataBlock m_sipBuffer;               // Receive buffer, data is framed in place
+    unsigned int m_sipBufRead;           // Start of unparsed data in receive buffer
+    unsigned int m_sipBufWrite;          // End of received data in receive buffer
     unsigned int m_sipBufOffs;           // Offset in sip buffer for partial sip message
     unsigned int m_contentLen;           // Expected content length for partial sip message
     // Outgoing (re-connect info)
@@ -558,6 +592,67 @@ protected:
     String m_localAddr;                  // Optional local address to bind to
     unsigned int m_connectRetry;         // Number of re-connect
     u_int64_t m_nextConnect;             // Interval to try ro re-connect
+    // Reactor data, unused if the transport has a worker thread
+    YateSIPTCPReactor* m_reactor;        // Reactor processing the transport
+    Socket* m_connSock;                  // Socket with a connect in progress
+    SocketAddr m_connAddr;               // Address being connected
+    u_int64_t m_connTimeout;             // Time to give up connecting
+    SOCKET m_watchFd;                    // Socket watched by the reactor
+    bool m_watchOut;                     // Reactor waits for the socket to be writable
+    bool m_watchFailed;                  // Socket can't be watched, poll it
+    u_int64_t m_timerTime;               // Next time the reactor processes us
+    unsigned int m_timerIndex;           // Position in the reactor timer heap
+    bool m_listed;                       // Listed by the reactor
+    bool m_again;                        // Queued to be processed again
+    bool m_wakeup;                       // Queued to be processed on request (reactor wake mutex)
+    bool m_drop;                         // Reactor must drop us (reactor wake mutex)
+};
+
+// Thread multiplexing many TCP/TLS transports using socket events
+class YateSIPTCPReactor : public Thread, public GenObject
+{
+public:
+    YateSIPTCPReactor();
+    ~YateSIPTCPReactor();
+    virtual void run();
+    inline bool valid() const
+	{ return m_epoll >= 0; }
+    // Queue a transport to be processed, drop it if requested
+    void wake(YateSIPTCPTransport* trans, bool drop = false);
+    // Stop watching the sockets of a transport before they are closed
+    // Must be called from the reactor thread
+    void unwatch(YateSIPTCPTransport* trans);
+    // Hand a transport to the least loaded reactor
+    static bool attach(YateSIPTCPTransport* trans);
+    // Set the number of reactors used for new transports, 0 to use worker threads
+    static void setup(unsigned int count);
+    // Number of reactors used for new transports
+    static inline unsigned int count()
+	{ return s_count; }
+    // Retrieve the number of running reactors and the transports they process
+    static unsigned int load(unsigned int& reactors);
+    // Stop all reactors, wait for them to exit
+    static void stopAll();
+private:
+    void signal();
+    void service(YateSIPTCPTransport* trans);
+    void watch(YateSIPTCPTransport* trans);
+    void remove(YateSIPTCPTransport* trans, bool terminate);
+    void heapPush(YateSIPTCPTransport* trans);
+    void heapRemove(YateSIPTCPTransport* trans);
+    void heapMove(unsigned int index);
+    int m_epoll;
+    int m_pipe[2];
+    void* m_events;
+    int m_eventCount;
+    Mutex m_wakeMutex;
+    ObjList m_wakeList;                  // Transports to process on request
+    ObjList m_again;                     // Transports to process again in next loop
+    YateSIPTCPTransport** m_heap;        // Transports ordered by next process time
+    unsigned int m_heapLen;
+    unsigned int m_heapSize;
+    unsigned int m_load;                 // Attached transports (reactors list mutex)
+    static unsigned int s_count;
 };
 
 // Transport worker
@@ -675,11 +770,6 @@ public:
     bool hasActiveTransaction(YateSIPTransport* trans);
     // Check if the engine has pending transactions
     bool hasInitialTransaction();
-    // Clear transactions
-    inline void clearTransactions() {
-	    Lock lck(this);
-	    m_transList.clear();
-	}
     inline bool prack() const
 	{ return m_prack; }
     inline bool info() const
@@ -1276,6 +1366,7 @@ static unsigned int s_tcpIdle = TCP_IDLE_DEF; // TCP transport idle interval
 static unsigned int s_tcpKeepalive = TCP_IDLE_DEF; // TCP transport keepalive interval
 static unsigned int s_tcpKeepaliveFirst = 0; // TCP transport first keepalive interval
 static unsigned int s_tcpMaxpkt = 1500;  // Maximum packet to accept on TCP connections
+static DataPool* s_tcpPool = 0;          // Pool of TCP receive buffers
 static String s_tcpOutRtpip;             // RTP ip for outgoing tcp/tls transports (protected by plugin mutex)
 static bool s_lineKeepTcpOffline = true; // Lines: keep TCP transports when offline
 static String s_sslCertFile;             // File containing the SSL client certificate to present if requested by the server
@@ -3071,6 +3162,8 @@ void YateSIPTransport::terminate(const char* reason)
 		    m_id.c_str(),this);
 	}
     }
+    if (tcpTransport())
+	tcpTransport()->detachReactor();
     if (!TelEngine::null(reason)) {
 	Lock lock(this);
 	if (!m_reason)
@@ -3429,11 +3522,16 @@ YateSIPTCPTransport::YateSIPTCPTransport(bool tls, const String& laddr, const St
     m_firstKeepalive(0), m_firstKeepaliveSent(false),
     m_idleInterval(TCP_IDLE_DEF), m_idleTimeout(0),
     m_flowTimer(false), m_keepAlivePending(false),
-    m_msg(0), m_sipBufOffs(0), m_contentLen(0),
+    m_msg(0), m_sipBufRead(0), m_sipBufWrite(0), m_sipBufOffs(0), m_contentLen(0),
     m_remoteAddr(raddr), m_remotePort(rport), m_localAddr(laddr),
-    m_connectRetry(s_tcpConnectRetry), m_nextConnect(0)
+    m_connectRetry(s_tcpConnectRetry), m_nextConnect(0),
+    m_reactor(0), m_connSock(0), m_connTimeout(0),
+    m_watchFd(Socket::invalidHandle()), m_watchOut(false), m_watchFailed(false),
+    m_timerTime(0), m_timerIndex(0),
+    m_listed(false), m_again(false), m_wakeup(false), m_drop(false)
 {
     m_maxpkt = s_tcpMaxpkt;
+    m_sipBuffer.pool(s_tcpPool);
     if (m_remotePort <= 0)
 	m_remotePort = sipPort(protocol() != Tls);
     m_id << (tls ? "tls:" : "tcp:") << getTransIndex() << "-";
@@ -3450,10 +3548,15 @@ YateSIPTCPTransport::YateSIPTCPTransport(Socket* sock, bool tls)
     m_firstKeepalive(0), m_firstKeepaliveSent(false),
     m_idleInterval(TCP_IDLE_DEF), m_idleTimeout(0),
     m_flowTimer(false), m_keepAlivePending(false),
-    m_msg(0), m_sipBufOffs(0), m_contentLen(0),
-    m_remotePort(0), m_connectRetry(0), m_nextConnect(0)
+    m_msg(0), m_sipBufRead(0), m_sipBufWrite(0), m_sipBufOffs(0), m_contentLen(0),
+    m_remotePort(0), m_connectRetry(0), m_nextConnect(0),
+    m_reactor(0), m_connSock(0), m_connTimeout(0),
+    m_watchFd(Socket::invalidHandle()), m_watchOut(false), m_watchFailed(false),
+    m_timerTime(0), m_timerIndex(0),
+    m_listed(false), m_again(false), m_wakeup(false), m_drop(false)
 {
     m_maxpkt = s_tcpMaxpkt;
+    m_sipBuffer.pool(s_tcpPool);
     m_id << (tls ? "tls:" : "tcp:");
     if (m_sock) {
     	m_sock->getSockName(m_local);
@@ -3495,7 +3598,7 @@ bool YateSIPTCPTransport::init(const NamedList& params, bool first, Thread::Prio
 	m_id.c_str(),m_maxpkt,m_rtpLocalAddr.c_str(),m_rtpNatAddr.c_str(),
 	(outgoing() ? "keepalive" : "idle"),m_idleInterval,extra.safe(),this);
     if (ok && first)
-	ok = startWorker(prio);
+	ok = YateSIPTCPReactor::attach(this) || startWorker(prio);
     return ok;
 }
 
@@ -3534,12 +3637,17 @@ bool YateSIPTCPTransport::send(SIPEvent* event)
     Debug(&plugin,DebugAll,"Transport(%s) enqueued (%p,%s) [%p]",
 	m_id.c_str(),msg,tmp.c_str(),this);
 #endif
+    if (m_reactor)
+	m_reactor->wake(this);
     return true;
 }
 
 // Process data (read/send)
 int YateSIPTCPTransport::process()
 {
+    // The reactor references outgoing transports too, stop if nobody else does
+    if (m_reactor && m_outgoing && refcount() == 2)
+	return -1;
     if (s_engineHalt) {
 	// Stop processing
 	Lock lck(this);
@@ -3582,22 +3690,28 @@ int YateSIPTCPTransport::process()
 		toString().c_str(),this);
 	    return -1;
 	}
+	if (m_connSock)
+	    return connectAsync();
 	if (!m_connectRetry || s_engineStop)
 	    return -1;
 	if (m_nextConnect > Time::now())
 	    return Thread::idleUsec();
 	m_connectRetry--;
-	int conn = connect();
-	m_firstKeepaliveSent = false;
-	if (conn > 0)
-	    setIdleTimeout();
-	else if (conn < 0)
-	    m_connectRetry = 0;
-	if (conn > 0 || m_connectRetry) {
-	    m_nextConnect = Time::now() + s_tcpConnectInterval;
+	if (!m_reactor)
+	    return connectResult(connect());
+	// Don't block the reactor while connecting
+	resetConnection();
+	Socket* sock = 0;
+	int conn = connectStart(sock,m_connAddr,true);
+	if (conn == 2) {
+	    Lock lck(this);
+	    m_connSock = sock;
+	    m_connTimeout = Time::now() + 60000000;
 	    return Thread::idleUsec();
 	}
-	return -1;
+	if (conn > 0)
+	    conn = connectCheck(sock,m_connAddr,true,false);
+	return connectResult(connectEnd(sock,conn));
     }
     Time time;
     bool sent = false;
@@ -3634,6 +3748,7 @@ int YateSIPTCPTransport::process()
 void YateSIPTCPTransport::destroyed()
 {
     TelEngine::destruct(m_msg);
+    resetSocket(m_connSock,-1);
     YateSIPTransport::destroyed();
 }
 
@@ -3682,138 +3797,192 @@ int YateSIPTCPTransport::connect(u_int64_t connToutUs)
 {
     resetConnection();
     Socket* sock = 0;
-    int retVal = -1;
-    m_reason.clear();
-    // Use a while() to break to the end
-    while (true) {
-	if (!m_remoteAddr) {
-	    m_reason = "Empty remote address";
-	    break;
-	}
-	// Allow connect retry
-	retVal = 0;
-	SocketAddr a(s_ipv6 ? SocketAddr::Unknown : SocketAddr::IPv4);
-	if (!a.host(m_remoteAddr)) {
-	    m_reason << "Failed to resolve '" << m_remoteAddr << "'";
-	    break;
-	}
-	a.port(m_remotePort);
-	sock = new Socket(a.family(),SOCK_STREAM);
-	if (!sock->valid()) {
-	    m_reason << "Failed to create socket";
-	    break;
-	}
-	// Bind to local ip
-	SocketAddr lip(s_ipv6 ? SocketAddr::Unknown : SocketAddr::IPv4);
-	if (m_localAddr) {
-	    if (!lip.host(m_localAddr)) {
-		m_reason << "Invalid local address '" << m_localAddr << "'";
-		// Don't allow connect retry
-		retVal = -1;
-		break;
-	    }
-	    if (!sock->bind(lip)) {
-		m_reason << "Failed to bind on '" << lip.host() << "' (" << m_localAddr << "). ";
-		addSockError(m_reason,*sock);
-		// Don't allow connect retry
-		retVal = -1;
+    SocketAddr a;
+    int retVal = connectStart(sock,a,connToutUs != 0);
+    if (retVal <= 0)
+	return connectEnd(sock,retVal);
+    bool ok = (retVal == 1);
+    bool timeout = false;
+    // Async connect in progress
+    if (!ok) {
+	unsigned int intervals = (unsigned int)(connToutUs / Thread::idleUsec());
+	// Make sure we wait for at least 1 timeout interval
+	if (!intervals)
+	    intervals = 1;
+	bool done = false;
+	bool event = false;
+	bool stop = false;
+	while (intervals && !(done || event || stop)) {
+	    if (!sock->select(0,&done,&event,Thread::idleUsec()))
 		break;
-	    }
-	}
-	// Use async connect
-	if (connToutUs && !(sock->canSelect() && sock->setBlocking(false))) {
-	    connToutUs = 0;
-	    if (sock->canSelect()) {
-		String tmp;
-		addSockError(tmp,*sock);
-		Debug(&plugin,DebugInfo,
-		    "Transport(%s) using sync connect (async set failed).%s [%p]",
-		    m_id.c_str(),tmp.c_str(),this);
-	    }
-	    else
-		Debug(&plugin,DebugInfo,
-		    "Transport(%s) using sync connect (select() not available) [%p]",
-		    m_id.c_str(),this);
-	}
-	u_int64_t start = connToutUs ? Time::now() : 0;
-	unsigned int intervals = 0;
-	if (start) {
-	    intervals = (unsigned int)(connToutUs / Thread::idleUsec());
-	    // Make sure we wait for at least 1 timeout interval
-	    if (!intervals)
-		intervals = 1;
+	    intervals--;
+	    stop = Thread::check(false) || Engine::exiting();
 	}
-	if (plugin.debugAt(DebugAll)) {
-	    String s;
-	    s << "'" << a.addr() << "'";
-	    if (a.host() != m_remoteAddr)
-		s << " (" << m_remoteAddr << ")";
-	    if (m_localAddr)
-		s << " localip=" << lip.addr();
-	    Debug(&plugin,DebugAll,"Transport(%s) attempt to connect to %s [%p]",
-		m_id.c_str(),s.safe(),this);
-	}
-	bool ok = sock->connect(a);
-	bool timeout = false;
-	bool stop = false;
-	// Async connect in progress
-	if (!ok && sock->inProgress()) {
-	    bool done = false;
-	    bool event = false;
-	    while (intervals && !(done || event || stop)) {
-		if (!sock->select(0,&done,&event,Thread::idleUsec()))
-		    break;
-	        intervals--;
-		stop = Thread::check(false) || Engine::exiting();
-	    }
-	    timeout = !intervals && !(done || event);
-	    if (!stop && sock && !sock->error() && (done || event) && sock->updateError())
-		ok = !sock->error();
+	if (stop)
+	    return connectEnd(sock,0);
+	timeout = !intervals && !(done || event);
+	if (!sock->error() && (done || event) && sock->updateError())
+	    ok = !sock->error();
+    }
+    return connectEnd(sock,connectCheck(sock,a,ok,timeout));
+}
+
+// Start connecting, set the socket and remote address
+int YateSIPTCPTransport::connectStart(Socket*& sock, SocketAddr& addr, bool async)
+{
+    m_reason.clear();
+    if (!m_remoteAddr) {
+	m_reason = "Empty remote address";
+	return -1;
+    }
+    addr.assign(s_ipv6 ? SocketAddr::Unknown : SocketAddr::IPv4);
+    if (!addr.host(m_remoteAddr)) {
+	m_reason << "Failed to resolve '" << m_remoteAddr << "'";
+	return 0;
+    }
+    addr.port(m_remotePort);
+    sock = new Socket(addr.family(),SOCK_STREAM);
+    if (!sock->valid()) {
+	m_reason << "Failed to create socket";
+	return 0;
+    }
+    // Bind to local ip
+    SocketAddr lip(s_ipv6 ? SocketAddr::Unknown : SocketAddr::IPv4);
+    if (m_localAddr) {
+	// Don't allow connect retry on local address errors
+	if (!lip.host(m_localAddr)) {
+	    m_reason << "Invalid local address '" << m_localAddr << "'";
+	    return -1;
 	}
-	if (ok) {
-	    // TLS?
-	    if (tls() && !plugin.socketSsl(&sock,false)) {
-		m_reason = "SSL not available locally";
-		retVal = -1;
-		ok = false;
-	    }
-	    if (ok) {
-		if (!Thread::check(false))
-		    retVal = 1;
-		else {
-		    m_reason = "Cancelled";
-		    retVal = -1;
-		}
-	    }
+	if (!sock->bind(lip)) {
+	    m_reason << "Failed to bind on '" << lip.host() << "' (" << m_localAddr << "). ";
+	    addSockError(m_reason,*sock);
+	    return -1;
 	}
-	else if (!stop) {
-	    m_reason << "Failed to connect to '" << a.addr() << "'";
-	    if (a.host() != m_remoteAddr)
-		m_reason << " (" << m_remoteAddr << ")";
-	    if (timeout)
-		m_reason << " . Connect timeout";
-	    else
-		addSockError(m_reason,*sock);
+    }
+    // Use async connect
+    if (async && !((m_reactor || sock->canSelect()) && sock->setBlocking(false))) {
+	async = false;
+	if (m_reactor || sock->canSelect()) {
+	    String tmp;
+	    addSockError(tmp,*sock);
+	    Debug(&plugin,DebugInfo,
+		"Transport(%s) using sync connect (async set failed).%s [%p]",
+		m_id.c_str(),tmp.c_str(),this);
 	}
-	break;
+	else
+	    Debug(&plugin,DebugInfo,
+		"Transport(%s) using sync connect (select() not available) [%p]",
+		m_id.c_str(),this);
     }
-    if (retVal > 0)
+    if (plugin.debugAt(DebugAll)) {
+	String s;
+	s << "'" << addr.addr() << "'";
+	if (addr.host() != m_remoteAddr)
+	    s << " (" << m_remoteAddr << ")";
+	if (m_localAddr)
+	    s << " localip=" << lip.addr();
+	Debug(&plugin,DebugAll,"Transport(%s) attempt to connect to %s [%p]",
+	    m_id.c_str(),s.safe(),this);
+    }
+    if (sock->connect(addr))
+	return 1;
+    if (async && sock->inProgress())
+	return 2;
+    m_reason << "Failed to connect to '" << addr.addr() << "'";
+    if (addr.host() != m_remoteAddr)
+	m_reason << " (" << m_remoteAddr << ")";
+    addSockError(m_reason,*sock);
+    return 0;
+}
+
+// Check a completed connect, start TLS on it
+int YateSIPTCPTransport::connectCheck(Socket*& sock, const SocketAddr& addr, bool ok, bool timeout)
+{
+    if (!ok) {
+	m_reason << "Failed to connect to '" << addr.addr() << "'";
+	if (addr.host() != m_remoteAddr)
+	    m_reason << " (" << m_remoteAddr << ")";
+	if (timeout)
+	    m_reason << " . Connect timeout";
+	else
+	    addSockError(m_reason,*sock);
+	return 0;
+    }
+    // TLS?
+    if (tls() && !plugin.socketSsl(&sock,false)) {
+	m_reason = "SSL not available locally";
+	return -1;
+    }
+    if (!Thread::check(false))
+	return 1;
+    m_reason = "Cancelled";
+    return -1;
+}
+
+// Set the connected socket or drop the failed one
+int YateSIPTCPTransport::connectEnd(Socket*& sock, int result)
+{
+    if (result > 0) {
 	resetConnection(sock);
+	sock = 0;
+	return result;
+    }
+    int level = DebugWarn;
+    if (!m_reason) {
+	if (Thread::check(false) || Engine::exiting()) {
+	    level = DebugInfo;
+	    m_reason = "Connect cancelled";
+	}
+	else
+	    m_reason = "Connect failed";
+    }
+    Debug(&plugin,level,"Transport(%s) %s (remaining %u connect attempts) [%p]",
+	m_id.c_str(),m_reason.c_str(),!result ? m_connectRetry : 0,this);
+    resetSocket(sock,0);
+    return result;
+}
+
+// Check the progress of an asynchronous connect started by the reactor
+int YateSIPTCPTransport::connectAsync()
+{
+    // select() can't handle all descriptors the reactor may use:
+    //  a pending error means failure, knowing the peer means connected
+    bool timeout = false;
+    bool ok = false;
+    if (!m_connSock->updateError() || m_connSock->error())
+	ok = false;
     else {
-	int level = DebugWarn;
-	if (!m_reason) {
-	    if (Thread::check(false) || Engine::exiting()) {
-		level = DebugInfo;
-		m_reason = "Connect cancelled";
-	    }
-	    else
-		m_reason = "Connect failed";
+	SocketAddr peer;
+	ok = m_connSock->getPeerName(peer);
+	if (!ok) {
+	    if (m_connTimeout > Time::now())
+		return Thread::idleUsec();
+	    timeout = true;
 	}
-	Debug(&plugin,level,"Transport(%s) %s (remaining %u connect attempts) [%p]",
-	    m_id.c_str(),m_reason.c_str(),!retVal ? m_connectRetry : 0,this);
-	resetSocket(sock,0);
     }
-    return retVal;
+    if (m_reactor)
+	m_reactor->unwatch(this);
+    lock();
+    Socket* sock = m_connSock;
+    m_connSock = 0;
+    unlock();
+    return connectResult(connectEnd(sock,connectCheck(sock,m_connAddr,ok,timeout)));
+}
+
+// Update connect retry data after a connect attempt
+int YateSIPTCPTransport::connectResult(int conn)
+{
+    m_firstKeepaliveSent = false;
+    if (conn > 0)
+	setIdleTimeout();
+    else if (conn < 0)
+	m_connectRetry = 0;
+    if (conn > 0 || m_connectRetry) {
+	m_nextConnect = Time::now() + s_tcpConnectInterval;
+	return Thread::idleUsec();
+    }
+    return -1;
 }
 
 // Send pending messages, return false on failure
@@ -3890,8 +4059,23 @@ bool YateSIPTCPTransport::sendPending(const Time& time, bool& sent)
 bool YateSIPTCPTransport::readData(const Time& time, bool& read)
 {
     read = false;
-    m_buffer.resize(m_maxpkt + 1);
-    int res = m_sock->readData((void*)m_buffer.data(),m_buffer.length() - 1);
+    // Unparsed data never exceeds maxpkt: the buffer can always receive
+    //  at least maxpkt bytes after moving the unparsed data at its start
+    unsigned int size = 2 * m_maxpkt;
+    if (m_sipBuffer.length() < size) {
+	// Allocated on first read, grows if maxpkt changed
+	DataBlock grow(0,size - m_sipBuffer.length());
+	m_sipBuffer.append(grow);
+    }
+    else
+	size = m_sipBuffer.length();
+    char* base = (char*)m_sipBuffer.data();
+    if (m_sipBufRead && (size - m_sipBufWrite < m_maxpkt)) {
+	m_sipBufWrite -= m_sipBufRead;
+	::memmove(base,base + m_sipBufRead,m_sipBufWrite);
+	m_sipBufRead = 0;
+    }
+    int res = m_sock->readData(base + m_sipBufWrite,size - m_sipBufWrite);
     if (res < 0) {
 	printReadError();
 	return m_sock->canRetry();
@@ -3904,23 +4088,19 @@ bool YateSIPTCPTransport::readData(const Time& time, bool& read)
     read = true;
 #ifdef XDEBUG
 #if 0
-    String nb((const char*)m_buffer.data(),res);
-    String ob((const char*)m_sipBuffer.data(),m_sipBuffer.length());
+    String nb(base + m_sipBufWrite,res);
+    String ob(base + m_sipBufRead,m_sipBufWrite - m_sipBufRead);
 #else
     String nb, ob;
-    nb.hexify(m_buffer.data(),res,' ');
-    ob.hexify(m_sipBuffer.data(),m_sipBuffer.length(),' ');
+    nb.hexify(base + m_sipBufWrite,res,' ');
+    ob.hexify(base + m_sipBufRead,m_sipBufWrite - m_sipBufRead,' ');
 #endif
     Debug(&plugin,DebugAll,"%s current buffer %u '%s' read %d '%s' [%p]",
-	m_id.c_str(),m_sipBuffer.length(),ob.safe(),res,nb.safe(),this);
+	m_id.c_str(),m_sipBufWrite - m_sipBufRead,ob.safe(),res,nb.safe(),this);
 #endif
-    const char* data = (const char*)m_buffer.data();
-    unsigned int len = res;
-    if (m_sipBuffer.length()) {
-	m_sipBuffer.append(m_buffer.data(),len);
-	len = m_sipBuffer.length();
-	data = (const char*)m_sipBuffer.data();
-    }
+    m_sipBufWrite += res;
+    const char* data = base + m_sipBufRead;
+    unsigned int len = m_sipBufWrite - m_sipBufRead;
     bool ok = true;
     unsigned int over = 0;
     bool respond = false;
@@ -3992,9 +4172,9 @@ bool YateSIPTCPTransport::readData(const Time& time, bool& read)
 	m_sipBufOffs = 0;
     }
     if (!len)
-	m_sipBuffer.clear();
+	m_sipBufRead = m_sipBufWrite = 0;
     else
-	m_sipBuffer.assign((void*)data,len);
+	m_sipBufRead = data - base;
     if (!ok) {
 	if (over) {
 	    m_reason = "Buffer overflow (message too long)";
@@ -4024,11 +4204,16 @@ void YateSIPTCPTransport::resetConnection(Socket* sock)
     TelEngine::destruct(m_msg);
     m_sent = -1;
     m_sipBuffer.clear();
+    m_sipBufRead = m_sipBufWrite = 0;
     m_sipBufOffs = 0;
     m_contentLen = 0;
     m_keepAlivePending = false;
     m_flowTimer = false;
     setProtoAddr(false);
+    // The reactor must forget the sockets before they are closed
+    if (m_reactor)
+	m_reactor->unwatch(this);
+    resetSocket(m_connSock,-1);
     // Reset socket and addresses
     if (m_sock) {
 	resetSocket(m_sock,-1);
@@ -4074,6 +4259,477 @@ bool YateSIPTCPTransport::sendKeepAlive(bool request)
 }
 
 
+// Stop processing the transport in the reactor, wait for it if needed
+void YateSIPTCPTransport::detachReactor()
+{
+    lock();
+    YateSIPTCPReactor* reactor = m_reactor;
+    unlock();
+    if (!reactor)
+	return;
+    reactor->wake(this,true);
+    if (Thread::current() == reactor)
+	return;
+    unsigned int n = 500;
+    while (m_reactor && n--)
+	Thread::idle();
+    if (m_reactor)
+	Debug(&plugin,DebugFail,"Transport(%s) terminating with reactor running [%p]",
+	    m_id.c_str(),this);
+}
+
+// Retrieve the socket the reactor should watch and the next time to process us
+SOCKET YateSIPTCPTransport::reactorWatch(bool& out, u_int64_t& when)
+{
+    Lock lck(this);
+    u_int64_t now = Time::now();
+    SOCKET fd = Socket::invalidHandle();
+    out = false;
+    if (m_connSock) {
+	fd = m_connSock->handle();
+	out = true;
+	when = m_connTimeout;
+    }
+    else if (m_sock && m_sock->valid()) {
+	fd = m_sock->handle();
+	// Wait to be able to write if a message is still pending
+	ObjList* o = m_queue.skipNull();
+	out = o && !static_cast<SIPMessage*>(o->get())->dontSend();
+	when = m_idleTimeout;
+    }
+    else
+	when = m_nextConnect;
+    if (m_outgoing && (when > now + REACTOR_REF_CHECK))
+	when = now + REACTOR_REF_CHECK;
+    // Engine halting: flush pending data
+    if (s_engineHalt && (when > now + 2000))
+	when = now + 2000;
+    if (when <= now)
+	when = now + Thread::idleUsec();
+    return fd;
+}
+
+
+unsigned int YateSIPTCPReactor::s_count = 0;
+static ObjList s_reactors;               // TCP reactors, new transports use the first ones
+static Mutex s_reactorsMutex(false,"YSIPReactors");
+
+YateSIPTCPReactor::YateSIPTCPReactor()
+    : Thread("YSIP Reactor"),
+    m_epoll(-1), m_events(0), m_eventCount(0),
+    m_wakeMutex(false,"YSIPReactorWake"),
+    m_heap(0), m_heapLen(0), m_heapSize(0), m_load(0)
+{
+    m_pipe[0] = m_pipe[1] = -1;
+#ifdef HAVE_EPOLL
+    m_epoll = ::epoll_create(REACTOR_EVENTS);
+    if ((m_epoll >= 0) && !::pipe(m_pipe)) {
+	::fcntl(m_pipe[0],F_SETFL,O_NONBLOCK);
+	::fcntl(m_pipe[1],F_SETFL,O_NONBLOCK);
+	struct epoll_event ev;
+	::memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = this;
+	if (!::epoll_ctl(m_epoll,EPOLL_CTL_ADD,m_pipe[0],&ev)) {
+	    m_events = new struct epoll_event[REACTOR_EVENTS];
+	    DDebug(&plugin,DebugAll,"YateSIPTCPReactor created [%p]",this);
+	    return;
+	}
+    }
+    int err = errno;
+    Debug(&plugin,DebugWarn,"Failed to create TCP reactor, using worker threads. Error: %s(%d) [%p]",
+	::strerror(err),err,this);
+    if (m_epoll >= 0)
+	::close(m_epoll);
+    m_epoll = -1;
+#endif
+}
+
+YateSIPTCPReactor::~YateSIPTCPReactor()
+{
+    s_reactorsMutex.lock();
+    s_reactors.remove(this,false);
+    s_reactorsMutex.unlock();
+#ifdef HAVE_EPOLL
+    if (m_epoll >= 0)
+	::close(m_epoll);
+    for (int i = 0; i < 2; i++)
+	if (m_pipe[i] >= 0)
+	    ::close(m_pipe[i]);
+    delete[] static_cast<struct epoll_event*>(m_events);
+#endif
+    delete[] m_heap;
+    DDebug(&plugin,DebugAll,"YateSIPTCPReactor destroyed [%p]",this);
+}
+
+void YateSIPTCPReactor::run()
+{
+#ifdef HAVE_EPOLL
+    struct epoll_event* events = static_cast<struct epoll_event*>(m_events);
+    bool halting = false;
+    while (!Thread::check(false)) {
+	int msec = REACTOR_WAIT_MAX;
+	if (m_again.skipNull())
+	    msec = 0;
+	else if (m_heapLen) {
+	    u_int64_t now = Time::now();
+	    u_int64_t next = m_heap[0]->m_timerTime;
+	    if (next <= now)
+		msec = 0;
+	    else if (next - now < 1000 * (u_int64_t)msec)
+		msec = (int)((next - now + 999) / 1000);
+	}
+	int n = ::epoll_wait(m_epoll,events,REACTOR_EVENTS,msec);
+	m_eventCount = (n > 0) ? n : 0;
+	for (int i = 0; i < m_eventCount; i++) {
+	    void* ptr = events[i].data.ptr;
+	    if (ptr == this) {
+		char buf[64];
+		while (::read(m_pipe[0],buf,sizeof(buf)) > 0)
+		    ;
+	    }
+	    // cleared if the transport was removed while handling the events
+	    else if (ptr)
+		service(static_cast<YateSIPTCPTransport*>(ptr));
+	}
+	m_eventCount = 0;
+	// Transports attached, dropped or having messages to send
+	for (;;) {
+	    m_wakeMutex.lock();
+	    ObjList* o = m_wakeList.skipNull();
+	    YateSIPTCPTransport* trans = o ? static_cast<YateSIPTCPTransport*>(o->remove(false)) : 0;
+	    bool drop = false;
+	    if (trans) {
+		trans->m_wakeup = false;
+		drop = trans->m_drop;
+	    }
+	    m_wakeMutex.unlock();
+	    if (!trans)
+		break;
+	    if (!trans->m_listed) {
+		trans->m_listed = true;
+		trans->m_timerTime = Time::now();
+		heapPush(trans);
+	    }
+	    if (drop)
+		remove(trans,false);
+	    else
+		service(trans);
+	}
+	// Engine halting: process all transports now to flush them
+	if (s_engineHalt && !halting) {
+	    halting = true;
+	    // all entries equal keep the heap ordered
+	    u_int64_t now = Time::now();
+	    for (unsigned int i = 0; i < m_heapLen; i++)
+		m_heap[i]->m_timerTime = now;
+	}
+	u_int64_t now = Time::now();
+	while (m_heapLen && (m_heap[0]->m_timerTime <= now))
+	    service(m_heap[0]);
+	// Transports which may have more data to read
+	for (unsigned int i = m_again.count(); i; i--) {
+	    ObjList* o = m_again.skipNull();
+	    if (!o)
+		break;
+	    YateSIPTCPTransport* trans = static_cast<YateSIPTCPTransport*>(o->remove(false));
+	    trans->m_again = false;
+	    service(trans);
+	}
+    }
+    // Cancelled: release the transports like a cancelled worker does
+    while (m_heapLen)
+	remove(m_heap[0],false);
+    for (;;) {
+	m_wakeMutex.lock();
+	ObjList* o = m_wakeList.skipNull();
+	YateSIPTCPTransport* trans = o ? static_cast<YateSIPTCPTransport*>(o->get()) : 0;
+	m_wakeMutex.unlock();
+	if (!trans)
+	    break;
+	remove(trans,false);
+    }
+#endif
+}
+
+// Queue a transport to be processed, drop it if requested
+void YateSIPTCPReactor::wake(YateSIPTCPTransport* trans, bool drop)
+{
+    Lock lck(m_wakeMutex);
+    // Already removed?
+    if (trans->m_reactor != this)
+	return;
+    if (drop)
+	trans->m_drop = true;
+    if (trans->m_wakeup)
+	return;
+    trans->m_wakeup = true;
+    // Signal the thread only if it has nothing else to pick
+    bool first = !m_wakeList.skipNull();
+    m_wakeList.append(trans)->setDelete(false);
+    lck.drop();
+    if (first)
+	signal();
+}
+
+// Interrupt the thread waiting for events
+void YateSIPTCPReactor::signal()
+{
+#ifdef HAVE_EPOLL
+    if (::write(m_pipe[1],"",1) < 0)
+	DDebug(&plugin,DebugMild,"YateSIPTCPReactor failed to signal thread [%p]",this);
+#endif
+}
+
+// Process a transport, keep waiting for its sockets or drop it
+void YateSIPTCPReactor::service(YateSIPTCPTransport* trans)
+{
+    // Same references as with a worker: ours and another one while processing
+    RefPointer<YateSIPTCPTransport> tmp = trans;
+    int n = trans->process();
+    tmp = 0;
+    if (n < 0) {
+	remove(trans,true);
+	return;
+    }
+    if (!n && !trans->m_again) {
+	trans->m_again = true;
+	m_again.append(trans)->setDelete(false);
+    }
+    watch(trans);
+}
+
+// Update the socket events and the timer of a transport
+void YateSIPTCPReactor::watch(YateSIPTCPTransport* trans)
+{
+#ifdef HAVE_EPOLL
+    bool out = false;
+    u_int64_t when = 0;
+    SOCKET fd = trans->reactorWatch(out,when);
+    if (fd == Socket::invalidHandle())
+	unwatch(trans);
+    else if ((fd != trans->m_watchFd) || (out != trans->m_watchOut)) {
+	struct epoll_event ev;
+	::memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN | (out ? EPOLLOUT : 0);
+	ev.data.ptr = trans;
+	int op = (fd == trans->m_watchFd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	bool ok = !::epoll_ctl(m_epoll,op,fd,&ev);
+	if (!ok && (op == EPOLL_CTL_ADD) && (errno == EEXIST))
+	    ok = !::epoll_ctl(m_epoll,EPOLL_CTL_MOD,fd,&ev);
+	if (!ok && !trans->m_watchFailed) {
+	    int err = errno;
+	    Debug(&plugin,DebugMild,"Transport(%s) failed to watch socket %d, polling it. Error: %s(%d) [%p]",
+		trans->toString().c_str(),fd,::strerror(err),err,this);
+	}
+	trans->m_watchFd = fd;
+	trans->m_watchOut = out;
+	trans->m_watchFailed = !ok;
+    }
+    if (trans->m_watchFailed && (when > Time::now() + Thread::idleUsec()))
+	when = Time::now() + Thread::idleUsec();
+    if (trans->m_listed && (when != trans->m_timerTime)) {
+	trans->m_timerTime = when;
+	heapMove(trans->m_timerIndex);
+    }
+#endif
+}
+
+// Stop watching the sockets of a transport before they are closed
+void YateSIPTCPReactor::unwatch(YateSIPTCPTransport* trans)
+{
+#ifdef HAVE_EPOLL
+    if ((trans->m_watchFd != Socket::invalidHandle()) && !trans->m_watchFailed) {
+	struct epoll_event ev;
+	::memset(&ev,0,sizeof(ev));
+	::epoll_ctl(m_epoll,EPOLL_CTL_DEL,trans->m_watchFd,&ev);
+    }
+#endif
+    trans->m_watchFd = Socket::invalidHandle();
+    trans->m_watchOut = false;
+    trans->m_watchFailed = false;
+}
+
+// Forget a transport, release the reference the reactor holds on it
+void YateSIPTCPReactor::remove(YateSIPTCPTransport* trans, bool terminate)
+{
+    unwatch(trans);
+    if (trans->m_listed) {
+	heapRemove(trans);
+	trans->m_listed = false;
+    }
+    if (trans->m_again) {
+	m_again.remove(trans,false);
+	trans->m_again = false;
+    }
+#ifdef HAVE_EPOLL
+    struct epoll_event* events = static_cast<struct epoll_event*>(m_events);
+    for (int i = 0; i < m_eventCount; i++) {
+	if (events[i].data.ptr == trans)
+	    events[i].data.ptr = 0;
+    }
+#endif
+    // Other threads may be sending through the transport or terminating it
+    trans->lock();
+    m_wakeMutex.lock();
+    trans->m_reactor = 0;
+    if (trans->m_wakeup)
+	m_wakeList.remove(trans,false);
+    trans->m_wakeup = false;
+    trans->m_drop = false;
+    m_wakeMutex.unlock();
+    trans->unlock();
+    s_reactorsMutex.lock();
+    m_load--;
+    s_reactorsMutex.unlock();
+    DDebug(&plugin,DebugAll,"YateSIPTCPReactor removed transport (%p,'%s') terminate=%s [%p]",
+	trans,trans->toString().c_str(),String::boolText(terminate),this);
+    if (terminate)
+	trans->terminate();
+    trans->deref();
+}
+
+// Hand a transport to the least loaded reactor
+bool YateSIPTCPReactor::attach(YateSIPTCPTransport* trans)
+{
+    if (!s_count)
+	return false;
+    Lock lck(s_reactorsMutex);
+    YateSIPTCPReactor* reactor = 0;
+    unsigned int n = 0;
+    for (ObjList* o = s_reactors.skipNull(); o && (n < s_count); o = o->skipNext(), n++) {
+	YateSIPTCPReactor* r = static_cast<YateSIPTCPReactor*>(o->get());
+	if (!reactor || (r->m_load < reactor->m_load))
+	    reactor = r;
+    }
+    if (n < s_count) {
+	YateSIPTCPReactor* r = new YateSIPTCPReactor;
+	if (r->valid() && r->startup()) {
+	    s_reactors.append(r)->setDelete(false);
+	    reactor = r;
+	}
+	else
+	    delete r;
+    }
+    if (!reactor)
+	return false;
+    // Incoming transports come with a reference for their processor
+    if (trans->outgoing() && !trans->ref())
+	return false;
+    reactor->m_load++;
+    lck.drop();
+    trans->lock();
+    trans->m_reactor = reactor;
+    trans->unlock();
+    reactor->wake(trans);
+    return true;
+}
+
+// Set the number of reactors used for new transports
+void YateSIPTCPReactor::setup(unsigned int count)
+{
+#ifndef HAVE_EPOLL
+    if (count)
+	Debug(&plugin,DebugConf,"TCP reactors are not supported on this platform, using worker threads");
+    count = 0;
+#endif
+    if (count != s_count)
+	Debug(&plugin,DebugInfo,"Processing new TCP/TLS transports in %u %s",
+	    count ? count : 1,count ? "reactor thread(s)" : "thread per transport");
+    s_count = count;
+}
+
+// Retrieve the number of running reactors and the transports they process
+unsigned int YateSIPTCPReactor::load(unsigned int& reactors)
+{
+    unsigned int load = 0;
+    Lock lck(s_reactorsMutex);
+    reactors = 0;
+    for (ObjList* o = s_reactors.skipNull(); o; o = o->skipNext()) {
+	reactors++;
+	load += static_cast<YateSIPTCPReactor*>(o->get())->m_load;
+    }
+    return load;
+}
+
+// Stop all reactors, new transports will use worker threads
+void YateSIPTCPReactor::stopAll()
+{
+    Lock lck(s_reactorsMutex);
+    s_count = 0;
+    for (ObjList* o = s_reactors.skipNull(); o; o = o->skipNext()) {
+	YateSIPTCPReactor* r = static_cast<YateSIPTCPReactor*>(o->get());
+	r->cancel(false);
+	r->signal();
+    }
+    // Reactors remove themselves from list when destroyed
+    for (unsigned int n = 100; n && s_reactors.skipNull(); n--) {
+	lck.drop();
+	Thread::idle();
+	lck.acquire(s_reactorsMutex);
+    }
+    if (s_reactors.skipNull())
+	Debug(&plugin,DebugMild,"Exiting with %u TCP reactors running",s_reactors.count());
+}
+
+void YateSIPTCPReactor::heapPush(YateSIPTCPTransport* trans)
+{
+    if (m_heapLen >= m_heapSize) {
+	unsigned int size = m_heapSize ? 2 * m_heapSize : 64;
+	YateSIPTCPTransport** heap = new YateSIPTCPTransport*[size];
+	for (unsigned int i = 0; i < m_heapLen; i++)
+	    heap[i] = m_heap[i];
+	delete[] m_heap;
+	m_heap = heap;
+	m_heapSize = size;
+    }
+    m_heap[m_heapLen] = trans;
+    trans->m_timerIndex = m_heapLen++;
+    heapMove(trans->m_timerIndex);
+}
+
+// Remove a transport from the timer heap
+void YateSIPTCPReactor::heapRemove(YateSIPTCPTransport* trans)
+{
+    unsigned int i = trans->m_timerIndex;
+    if ((i >= m_heapLen) || (m_heap[i] != trans))
+	return;
+    m_heapLen--;
+    if (i < m_heapLen) {
+	m_heap[i] = m_heap[m_heapLen];
+	heapMove(i);
+    }
+}
+
+// Restore heap order after the process time of an entry changed
+void YateSIPTCPReactor::heapMove(unsigned int index)
+{
+    YateSIPTCPTransport* t = m_heap[index];
+    while (index) {
+	unsigned int parent = (index - 1) / 2;
+	if (m_heap[parent]->m_timerTime <= t->m_timerTime)
+	    break;
+	m_heap[index] = m_heap[parent];
+	m_heap[index]->m_timerIndex = index;
+	index = parent;
+    }
+    for (;;) {
+	unsigned int child = 2 * index + 1;
+	if (child >= m_heapLen)
+	    break;
+	if ((child + 1 < m_heapLen) && (m_heap[child + 1]->m_timerTime < m_heap[child]->m_timerTime))
+	    child++;
+	if (t->m_timerTime <= m_heap[child]->m_timerTime)
+	    break;
+	m_heap[index] = m_heap[child];
+	m_heap[index]->m_timerIndex = index;
+	index = child;
+    }
+    m_heap[index] = t;
+    t->m_timerIndex = index;
+}
+
+
 YateSIPTransportWorker::YateSIPTransportWorker(YateSIPTransport* trans,
     Thread::Priority prio)
     : Thread("YSIP Worker",prio), m_transport(trans)
@@ -4709,8 +5365,8 @@ void YateSIPEngine::transportChangedStatus(YateSIPTransport* trans, int stat, co
 	return;
     // Clear transactions
     Lock lock(this);
-    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    ListIterator iter(m_transList);
+    while (SIPTransaction* t = static_cast<SIPTransaction*>(iter.get())) {
 	if (t->initialMessage() && t->initialMessage()->getParty() &&
 	    trans == t->initialMessage()->getParty()->getTransport()) {
 	    bool active = t->isActive();
@@ -4728,8 +5384,8 @@ bool YateSIPEngine::hasActiveTransaction(YateSIPTransport* trans)
     if (!trans)
 	return false;
     Lock lock(this);
-    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    ListIterator iter(m_transList);
+    while (SIPTransaction* t = static_cast<SIPTransaction*>(iter.get())) {
 	if (t->isActive() && t->initialMessage() && t->initialMessage()->getParty() &&
 	    trans == t->initialMessage()->getParty()->getTransport())
 	    return true;
@@ -4741,8 +5397,8 @@ bool YateSIPEngine::hasActiveTransaction(YateSIPTransport* trans)
 bool YateSIPEngine::hasInitialTransaction()
 {
     Lock lock(this);
-    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    ListIterator iter(m_transList);
+    while (SIPTransaction* t = static_cast<SIPTransaction*>(iter.get())) {
 	if (t->getState() == SIPTransaction::Initial)
 	    return true;
     }
@@ -5487,7 +6143,8 @@ void YateSIPEndPoint::run()
 		break;
 	}
 	else
-	    Thread::usleep(Thread::idleUsec());
+	    // sleep until next timer, still check the engine halt now and then
+	    m_engine->waitEvent(20 * Thread::idleUsec());
     }
     plugin.epTerminated(this);
 }
@@ -9334,6 +9991,7 @@ bool SIPDriver::received(Message& msg, int id)
 	if (n)
 	    Debug(this,DebugCrit,"Exiting with %u transports in queue",n);
 	m_endpoint->m_mutex.unlock();
+	YateSIPTCPReactor::stopAll();
 	m_endpoint->cancel();
     }
     else if (id == Status) {
@@ -9470,6 +10128,9 @@ void SIPDriver::initialize()
     }
     s_printMsg = s_cfg.getBoolValue("general","printmsg",true);
     s_tcpMaxpkt = getMaxpkt(s_cfg.getIntValue("general","tcp_maxpkt",4096),4096);
+    if (!s_tcpPool)
+	s_tcpPool = DataPool::get("siptcp");
+    YateSIPTCPReactor::setup(s_cfg.getIntValue("general","tcp_reactors",2,0,64));
     s_lineKeepTcpOffline = s_cfg.getBoolValue("general","line_keeptcpoffline",!Engine::clientMode());
     s_defEncoding = s_cfg.getIntValue("general","body_encoding",SipHandler::s_bodyEnc,SipHandler::BodyBase64);
     s_gen_async = s_cfg.getBoolValue("general","async_generic",true);
@@ -9705,6 +10366,10 @@ void SIPDriver::statusParams(String& str)
     Driver::statusParams(str);
     if (m_endpoint->engine())
 	str.append("transactions=",",") << m_endpoint->engine()->transactionCount();
+    unsigned int reactors = 0;
+    unsigned int load = YateSIPTCPReactor::load(reactors);
+    if (reactors)
+	str << ",reactors=" << reactors << ",reactortransports=" << load;
 }
 
 // Build and dispatch a socket.ssl message
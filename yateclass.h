@@ -3253,6 +3253,7 @@ YATE_API int64_t lookup(const char* str, const TokenDict64* tokens, int64_t defv
 YATE_API const char* lookup(int64_t value, const TokenDict64* tokens, const char* defvalue = 0);
 
 class NamedList;
+class NamedListIndex;
 
 /**
  * Utility method to return from a chan.control handler
@@ -4229,6 +4230,85 @@ private:
     u_int32_t m_random;
 };
 
+/**
+ * Named account of pooled buffer allocations.
+ * Buffers are handed out in power of two size classes and recycled through
+ *  a cache private to each thread backed by lists shared between threads,
+ *  saving a malloc/free pair for each fixed size media frame.
+ * Accounts are created on first request and are never destroyed so they
+ *  can be safely kept by objects of modules that get unloaded.
+ * @short Accounted pool of data buffers
+ */
+class YATE_API DataPool : public String
+{
+    friend class DataBlock;
+    YNOCOPY(DataPool); // no automatic copies please
+public:
+    /**
+     * Find or create a pool account
+     * @param name Name of the account, usually the subsystem using it
+     * @return Pointer to the pool account, NULL only if name is empty
+     */
+    static DataPool* get(const String& name);
+
+    /**
+     * Get the number of buffers requested from this pool
+     * @return Number of allocations, including reused and oversized ones
+     */
+    inline u_int64_t allocs() const
+	{ return m_allocs; }
+
+    /**
+     * Get the number of requests served with a recycled buffer
+     * @return Number of allocations that did not reach the system allocator
+     */
+    inline u_int64_t reused() const
+	{ return m_allocs - m_missed - m_oversized; }
+
+    /**
+     * Get the number of requests too large for any size class
+     * @return Number of allocations passed directly to the system allocator
+     */
+    inline u_int64_t oversized() const
+	{ return m_oversized; }
+
+    /**
+     * Get the number of buffers currently held by data blocks
+     * @return Number of allocated buffers not returned to the pool yet
+     */
+    inline int inUse() const
+	{ return (int)(m_allocs - m_released); }
+
+    /**
+     * Get the largest buffer size served from the pools
+     * @return Size of the largest size class, larger requests are not pooled
+     */
+    static unsigned int maxSize();
+
+    /**
+     * Get the number of free buffers kept in the lists shared between threads
+     * @return Number of buffers cached in shared lists
+     */
+    static unsigned int cached();
+
+    /**
+     * Append the statistics of all pool accounts to a status string
+     * @param str String to append "name=allocs|reused|oversized|inuse" items to
+     * @return Number of pool accounts
+     */
+    static unsigned int status(String& str);
+
+private:
+    DataPool(const String& name);
+    void* alloc(unsigned int& len);
+    void release(void* data, unsigned int len);
+    void detach();
+    u_int64_t m_allocs;
+    u_int64_t m_released;
+    u_int64_t m_missed;
+    u_int64_t m_oversized;
+};
+
 /**
  * The DataBlock holds a data buffer with no specific formatting.
  * @short A class that holds just a block of raw data
@@ -4335,6 +4415,22 @@ public:
     inline void overAlloc(unsigned int bytes)
 	{ m_overAlloc = bytes; }
 
+    /**
+     * Get the buffer pool used for allocating memory
+     * @return Pointer to the pool account, NULL if memory is not pooled
+     */
+    inline DataPool* pool() const
+	{ return m_pool; }
+
+    /**
+     * Request pooled storage for the memory allocated from now on.
+     * This is useful for blocks that are repeatedly filled with fixed size
+     *  frames, the data already held is kept in its current storage.
+     * @param pool Pointer to the pool account, NULL to use the system allocator
+     */
+    inline void pool(DataPool* pool)
+	{ m_pool = pool; }
+
     /**
      * Clear the data and optionally free the memory
      * @param deleteData True to free the deta block, false to just forget it
@@ -4485,10 +4581,14 @@ public:
 
 private:
     unsigned int allocLen(unsigned int len) const;
+    void* allocData(unsigned int& len) const;
+    static void freeData(void* data, unsigned int len, DataPool* pool);
     void* m_data;
     unsigned int m_length;
     unsigned int m_allocated;
     unsigned int m_overAlloc;
+    DataPool* m_pool;
+    DataPool* m_dataPool;
 };
 
 /**
@@ -5036,6 +5136,11 @@ public:
      */
     NamedList(const char* name, const NamedList& original, const String& prefix);
 
+    /**
+     * Destructor, releases the parameter index
+     */
+    virtual ~NamedList();
+
     /**
      * Assignment operator
      * @param value New name and parameters to assign
@@ -5067,8 +5172,35 @@ public:
     /**
      * Clear all parameters
      */
-    inline void clearParams()
-	{ m_params.clear(); }
+    void clearParams();
+
+    /**
+     * Enable or disable the hash index of parameter names for this list.
+     * The index keeps the insertion order but finds parameters by name without
+     *  walking the list. Lists are indexed automatically when they grow above
+     *  the indexThreshold() unless indexing was disabled for them.
+     * @param enable True to build the index now, false to remove it and
+     *  disable automatic indexing of this list
+     */
+    void indexParams(bool enable);
+
+    /**
+     * Check if parameter lookups by name currently use the hash index
+     * @return True if the list has a valid parameter index
+     */
+    bool indexed() const;
+
+    /**
+     * Set the number of parameters above which lists are indexed automatically
+     * @param count Parameters count threshold, zero to disable automatic indexing
+     */
+    static void indexThreshold(unsigned int count);
+
+    /**
+     * Get the number of parameters above which lists are indexed automatically
+     * @return Parameters count threshold, zero if automatic indexing is disabled
+     */
+    static unsigned int indexThreshold();
 
     /**
      * Add a named string to the parameter list.
@@ -5091,12 +5223,7 @@ public:
      * @param param Parameter to set or add
      * @return Reference to this NamedList
      */
-    inline NamedList& setParam(NamedString* param)
-    {
-	if (param)
-	    m_params.setUnique(param);
-	return *this;
-    }
+    NamedList& setParam(NamedString* param);
 
     /**
      * Set a named string in the parameter list.
@@ -5294,11 +5421,22 @@ public:
     static const NamedList& empty();
 
     /**
-     * Get the parameters list
+     * Get the parameters list.
+     * Modifying the list directly invalidates the parameter index until
+     *  the next change made through the NamedList methods.
      * @return Pointer to the parameters list
      */
-    inline ObjList* paramList()
-	{ return &m_params; }
+    ObjList* paramList();
+
+    /**
+     * Retrieve a number identifying the current layout of the parameters.
+     * It changes whenever a parameter is added, removed or replaced but not
+     *  when only a value changes. A number is never handed out twice, not
+     *  even by different lists, so it can validate cached parameter pointers.
+     * The 64 bit counter would need centuries to wrap around.
+     * @return Non zero layout version of the list
+     */
+    u_int64_t version() const;
 
     /**
      * Get the parameters list
@@ -5309,7 +5447,16 @@ public:
 
 private:
     NamedList(); // no default constructor please
+    ObjList* appendParam(NamedString* param, ObjList* from = 0);
+    void removeParam(ObjList* node, bool delParam);
+    void indexAdd();
+    void indexBuild();
+    void indexCheck();
     ObjList m_params;
+    NamedListIndex* m_index;
+    unsigned int m_added;
+    mutable u_int64_t m_version;
+    bool m_noIndex;
 };
 
 /**
@@ -7796,6 +7943,34 @@ public:
      */
     int recvFrom(void* buffer, int length, SocketAddr& addr, int flags = 0);
 
+    /**
+     * Receive several datagrams from an unconnected socket in a single
+     *  operation if the system supports it, a single datagram otherwise.
+     * Datagrams claimed by installed filters are not returned
+     * @param buffer Buffer holding count slots of size bytes each
+     * @param size Size of each slot in buffer
+     * @param count Number of slots in buffer
+     * @param lengths Array of count entries to fill with the length of each datagram
+     * @param addrs Array of count entries to fill with the source of each datagram
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of datagrams stored in the first slots, @ref socketError() if an error occurred
+     */
+    int recvFromMulti(void* buffer, int size, int count, int* lengths, SocketAddr* addrs, int flags = 0);
+
+    /**
+     * Send several datagrams over an unconnected socket in a single
+     *  operation if the system supports it, one by one otherwise
+     * @param buffers Array of count pointers to the data of each datagram
+     * @param lengths Array of count datagram lengths
+     * @param addrs Array of count pointers to the destination of each datagram
+     * @param count Number of datagrams to send
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of datagrams sent from the start of the arrays,
+     *  @ref socketError() if the first one could not be sent
+     */
+    int sendToMulti(const void* const* buffers, const int* lengths, const SocketAddr* const* addrs,
+	int count, int flags = 0);
+
     /**
      * Receive a message from a connected socket
      * @param buffer Buffer for data transfer
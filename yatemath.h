@@ -827,6 +827,22 @@ public:
 	    return result;
 	}
 
+    /**
+     * Multiply element by element with another vector and take the sum of the results
+     * @param other Vector to multiply with
+     * @return The result, zero if vectors don't have the same length
+     */
+    inline Obj sumMul(const SliceVector& other) const {
+	    Obj result(0);
+	    if (length() != other.length())
+		return result;
+	    const Obj* od = other.m_data;
+	    const Obj* d = data();
+	    for (const Obj* last = end(d,length()); d != last; ++d, ++od)
+		result += *d * *od;
+	    return result;
+	}
+
     /**
      * Sum this vector with another one
      * @param other Vector to sum with this one
@@ -1555,9 +1571,102 @@ public:
      */
     static String& dumpFloat(String& buf, const float& val, const char* sep = 0,
 	const char* fmt = 0);
+
+    /**
+     * Sum an array of float values.
+     * This and the other vector methods use SIMD instructions if the CPU
+     *  supports them, results may differ from sequential summing by rounding
+     * @param src Values to sum
+     * @param len Number of values
+     * @return The sum of the values
+     */
+    static float sum(const float* src, unsigned int len);
+
+    /**
+     * Sum an array of Complex numbers
+     * @param src Numbers to sum
+     * @param len Number of elements
+     * @return The sum of the numbers
+     */
+    static Complex sum(const Complex* src, unsigned int len);
+
+    /**
+     * Multiply two float arrays element by element and sum the results
+     * @param a First array
+     * @param b Second array
+     * @param len Number of elements in each array
+     * @return The sum of a[i] * b[i]
+     */
+    static float sumMul(const float* a, const float* b, unsigned int len);
+
+    /**
+     * Multiply two Complex arrays element by element and sum the results
+     * @param a First array
+     * @param b Second array
+     * @param len Number of elements in each array
+     * @return The sum of a[i] * b[i]
+     */
+    static Complex sumMul(const Complex* a, const Complex* b, unsigned int len);
+
+    /**
+     * Sum the norm2 (power) of Complex numbers
+     * @param src Numbers to process
+     * @param len Number of elements
+     * @return The sum of src[i].norm2()
+     */
+    static float sumNorm2(const Complex* src, unsigned int len);
+
+    /**
+     * Scale interleaved I/Q float values and convert them to 16 bit integers.
+     * Results are rounded and saturated to the 16 bit range, then shifted
+     * @param dest Destination buffer
+     * @param src Source values, I and Q alternating starting with I
+     * @param len Number of values (twice the number of I/Q pairs)
+     * @param scaleI Scale to apply to I values
+     * @param scaleQ Scale to apply to Q values
+     * @param shift Arithmetic right shift to apply after saturation
+     */
+    static void floatToInt16(int16_t* dest, const float* src, unsigned int len,
+	float scaleI, float scaleQ, unsigned int shift = 0);
+
+    /**
+     * Convert 16 bit integers to scaled float values
+     * @param dest Destination buffer
+     * @param src Source values
+     * @param len Number of values
+     * @param scale Scale to apply to converted values
+     */
+    static void int16ToFloat(float* dest, const int16_t* src, unsigned int len, float scale);
+
+    /**
+     * Select the implementation of the vector methods
+     * @param enable True to use the best SIMD instruction set supported by the CPU,
+     *  false to use plain C++ code
+     * @return Name of the selected implementation
+     */
+    static const char* simd(bool enable);
+
+    /**
+     * Retrieve the implementation used by the vector methods
+     * @return Name of the implementation: "scalar", "sse2" or "avx2"
+     */
+    static const char* simd();
 };
 
 
+// Float and Complex vectors use the Math vector methods
+template <> inline float SliceVector<float>::sum() const
+    { return Math::sum(data(),length()); }
+
+template <> inline Complex SliceVector<Complex>::sum() const
+    { return Math::sum(data(),length()); }
+
+template <> inline float SliceVector<float>::sumMul(const SliceVector<float>& other) const
+    { return (length() == other.length()) ? Math::sumMul(data(),other.data(),length()) : 0; }
+
+template <> inline Complex SliceVector<Complex>::sumMul(const SliceVector<Complex>& other) const
+    { return (length() == other.length()) ? Math::sumMul(data(),other.data(),length()) : Complex(); }
+
 /**
  * Addition operator
  * @param c1 First number
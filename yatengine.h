@@ -302,6 +302,8 @@ private:
 };
 
 class MessageDispatcher;
+class MessageHandlerSnapshot;
+class MessageDispatchQueue;
 class MessageRelay;
 class Engine;
 
@@ -475,6 +477,7 @@ private:
     RefObject* m_data;
     bool m_notify;
     bool m_broadcast;
+    int m_queued;
     void commonEncode(String& str) const;
     int commonDecode(const char* str, int offs);
 };
@@ -740,6 +743,7 @@ public:
      * The handlers are installed in ascending order of their priorities.
      * There is NO GUARANTEE on the order of handlers with equal priorities
      *  although for avoiding uncertainity such handlers are sorted by address.
+     * Handlers are indexed by name so it must not change while installed.
      * @param handler A pointer to the handler to install
      * @return True on success, false on failure
      */
@@ -758,6 +762,8 @@ public:
      *  their installed order (based on priority) until one returns true.
      * If the message has the broadcast flag set all matching handlers are
      *  called and the return value is true if any handler returned true.
+     * The handler lists are read from an immutable snapshot without taking
+     *  the dispatcher lock, changes are picked up before the next handler.
      * Note that in some cases when a handler is removed from the list
      *  other handlers with equal priority may be called twice.
      * @param msg The message to dispatch
@@ -766,22 +772,68 @@ public:
     bool dispatch(Message& msg);
 
     /**
-     * Put a message in the waiting queue for asynchronous dispatching
+     * Put a message in one of the waiting queues for asynchronous dispatching
      * @param msg The message to enqueue, will be destroyed after dispatching
      * @return True if successfully queued, false otherwise
      */
     bool enqueue(Message* msg);
 
     /**
-     * Dispatch all messages from the waiting queue
+     * Dispatch all messages from the waiting queues
      */
-    void dequeue();
+    inline void dequeue()
+	{ dequeue(0); }
 
     /**
-     * Dispatch one message from the waiting queue
-     * @return True if success, false if the queue is empty
+     * Dispatch all messages from the waiting queues, preferring one of them.
+     * Messages are dispatched in order within each queue but not across queues.
+     * @param queue Index of the queue to check first
      */
-    bool dequeueOne();
+    void dequeue(unsigned int queue);
+
+    /**
+     * Dispatch one message from the waiting queues
+     * @return True if success, false if all queues are empty
+     */
+    inline bool dequeueOne()
+	{ return dequeueOne(0); }
+
+    /**
+     * Dispatch one message from the waiting queues, preferring one of them.
+     * If the preferred queue is empty or much shorter than another one the
+     *  message is taken from the longest queue. Order is FIFO per queue only.
+     * @param queue Index of the queue to check first
+     * @return True if success, false if all queues are empty
+     */
+    bool dequeueOne(unsigned int queue);
+
+    /**
+     * Set the number of queues new messages are distributed to
+     * @param count Number of queues to use, between 1 and maxQueues()
+     */
+    void queues(unsigned int count);
+
+    /**
+     * Get the number of queues new messages are distributed to
+     * @return Number of queues in use
+     */
+    inline unsigned int queues() const
+	{ return m_queueCount; }
+
+    /**
+     * Get the maximum number of waiting queues
+     * @return Maximum number of queues that can be used
+     */
+    static unsigned int maxQueues();
+
+    /**
+     * Retrieve the statistics of one of the waiting queues
+     * @param queue Index of the queue
+     * @param depth Returns count of messages waiting in the queue
+     * @param age Returns average age of messages dequeued from it in microseconds
+     * @return True if the queue index is valid
+     */
+    bool getQueueStats(unsigned int queue, unsigned int& depth, u_int64_t& age);
 
     /**
      * Set a limit to generate warning when a message took too long to dispatch
@@ -793,15 +845,14 @@ public:
     /**
      * Clear all the message handlers and post-dispatch hooks
      */
-    inline void clear()
-	{ m_handlers.clear(); m_hookAppend = &m_hooks; m_hooks.clear(); }
+    void clear();
 
     /**
      * Check if there is at least one message in the queue
      * @return True if the queue holds at least one message
      */
     inline bool hasMessages() const
-	{ return m_messages.get() || m_messages.next(); }
+	{ return m_queued > 0; }
 
     /**
      * Check if there is at least one handler installed
@@ -896,14 +947,25 @@ protected:
 	{ m_trackParam = paramName; }
 
 private:
+    int readEnter();
+    void readLeave(int slot);
+    void readSync();
+    MessageHandlerSnapshot* getSnapshot();
+    void publish();
     ObjList m_handlers;
-    ObjList m_messages;
+    HashList m_index;
+    ObjList m_broadcast;
+    MessageDispatchQueue* m_queues;
+    unsigned int m_queueCount;
+    int m_queueNext;
+    int m_queued;
     ObjList m_hooks;
     Mutex m_hookMutex;
-    ObjList* m_msgAppend;
     ObjList* m_hookAppend;
     String m_trackParam;
-    unsigned int m_changes;
+    MessageHandlerSnapshot* m_snapshot;
+    int m_readers[2];
+    int m_epoch;
     u_int64_t m_warnTime;
     u_int64_t m_enqueueCount;
     u_int64_t m_dequeueCount;
@@ -1599,6 +1661,23 @@ public:
     inline void getStats(u_int64_t& enqueued, u_int64_t& dequeued, u_int64_t& dispatched, u_int64_t& queueMax)
 	{ m_dispatcher.getStats(enqueued,dequeued,dispatched,queueMax); }
 
+    /**
+     * Get the number of queues new messages are distributed to
+     * @return Number of message queues in use
+     */
+    inline unsigned int messageQueues() const
+	{ return m_dispatcher.queues(); }
+
+    /**
+     * Retrieve the statistics of one of the dispatcher's waiting queues
+     * @param queue Index of the queue
+     * @param depth Returns count of messages waiting in the queue
+     * @param age Returns average age of messages dequeued from it in microseconds
+     * @return True if the queue index is valid
+     */
+    inline bool getQueueStats(unsigned int queue, unsigned int& depth, u_int64_t& age)
+	{ return m_dispatcher.getQueueStats(queue,depth,age); }
+
     /**
      * Check if a plugin is currently loaded
      * @param name Name of the plugin to check
@@ -1665,6 +1665,8 @@ private:
     u_int64_t m_timeout;
     u_int64_t m_maxcall;
     u_int64_t m_maxPDD;          // Timeout while waiting for some progress on outgoing calls
+    u_int64_t m_timerWhen;       // Time the driver will check the timers
+    int m_timerSlot;             // Driver timer wheel slot, negative if not scheduled
     u_int64_t m_dtmfTime;
     unsigned int m_toutAns;
     unsigned int m_dtmfSeq;
@@ -1818,7 +1820,9 @@ public:
     virtual bool msgControl(Message& msg);
 
     /**
-     * Timer check method, by default handles channel timeouts
+     * Timer check method, by default handles channel timeouts.
+     * The driver calls it only when a timeout, maxcall or maxPDD time is due
+     *  or at a time requested by timerCheck()
      * @param msg Timer message
      * @param tmr Current time against which timers are compared
      */
@@ -1951,7 +1955,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void timeout(u_int64_t tout)
-	{ m_timeout = tout; }
+	{ m_timeout = tout; timerCheck(tout); }
 
     /**
      * Get the time this channel will time out on outgoing calls
@@ -1965,7 +1969,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxcall(u_int64_t tout)
-	{ m_maxcall = tout; }
+	{ m_maxcall = tout; timerCheck(tout); }
 
     /**
      * Set the time this channel will time out on outgoing calls
@@ -1996,7 +2000,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxPDD(u_int64_t tout)
-	{ m_maxPDD = tout; }
+	{ m_maxPDD = tout; timerCheck(tout); }
 
     /**
      * Set the time this channel will time out while waiting for some progress
@@ -2219,8 +2223,18 @@ protected:
     inline NamedList& parameters()
 	{ return m_parameters; }
 
+    /**
+     * Request the driver to call checkTimers() at or shortly after a given time.
+     * Derived classes handling other timers in checkTimers() must call it when
+     *  setting them and from checkTimers() while they are still pending.
+     * Only the earliest of the pending requests is kept
+     * @param when Time to check the timers, zero to not request anything
+     */
+    void timerCheck(u_int64_t when);
+
 private:
     void init();
+    void timerReset();
     Channel(); // no default constructor please
     static Mutex s_chanDataMutex;
     // Just in case we are going to (re)move the channel data mutex!
@@ -2242,6 +2256,9 @@ private:
     bool m_varchan;
     String m_prefix;
     ObjList m_chans;
+    HashList* m_chanIndex;
+    ObjList* m_timerSlots;
+    u_int64_t m_timerSec;
     int m_routing;
     int m_routed;
     int m_total;
@@ -2377,6 +2394,11 @@ protected:
      */
     Driver(const char* name, const char* type = 0);
 
+    /**
+     * Destructor
+     */
+    virtual ~Driver();
+
     /**
      * This method is called to initialize the loaded module
      */
@@ -2510,6 +2532,8 @@ protected:
 
 private:
     Driver(); // no default constructor please
+    void indexChan(Channel* chan);
+    void expireTimers(Message& msg);
 };
 
 /**
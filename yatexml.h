@@ -340,6 +340,41 @@ protected:
      */
     void skipBlanks();
 
+    /**
+     * Get a character from the unconsumed part of the buffer
+     * @param index Index of the character relative to the current position
+     * @return The character, 0 if the index is past the end of the buffer
+     */
+    inline char bufAt(unsigned int index) const
+	{ return m_buf.at(m_bufPos + index); }
+
+    /**
+     * Get a pointer to the unconsumed part of the buffer
+     * @return Pointer to buffer data at current position, NULL if the buffer is empty
+     */
+    inline const char* bufPtr() const
+	{ return m_buf.c_str() ? (m_buf.c_str() + m_bufPos) : 0; }
+
+    /**
+     * Get the length of the unconsumed part of the buffer
+     * @return Count of bytes not yet parsed
+     */
+    inline unsigned int bufLength() const
+	{ return m_buf.length() - m_bufPos; }
+
+    /**
+     * Advance the buffer position past parsed data without copying the rest
+     * @param len Count of bytes to consume
+     */
+    inline void consume(unsigned int len)
+	{ m_bufPos = (len < bufLength()) ? (m_bufPos + len) : m_buf.length(); }
+
+    /**
+     * Replace the unconsumed part of the buffer
+     * @param buf New data to be parsed
+     */
+    void setBuffer(const String& buf);
+
     /**
      * Check if a character is an angle bracket
      * @param c The character to verify
@@ -485,6 +520,16 @@ protected:
      */
     String m_buf;
 
+    /**
+     * Position of the first unconsumed byte in the main buffer while parsing
+     */
+    unsigned int m_bufPos;
+
+    /**
+     * Length of the buffer data already checked to be valid UTF-8
+     */
+    unsigned int m_checked;
+
     /**
      * The parser data holder.
      * Keeps the parsed data when an incomplete xml object is found
@@ -495,6 +540,10 @@ protected:
      * The last parsed xml object code
      */
     Type m_unparsed;
+
+private:
+    bool parseBuffer();
+    bool checkUtf8();
 };
 
 /**